@@ -0,0 +1,67 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "ShmemAccessor.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Leave a few thousand holes of mixed sizes in the bins, like a heap that has been in use for a while
+static void fragment(ShmemHeap &heap)
+{
+    std::mt19937 rng(42);
+    std::vector<size_t> blocks;
+    for (int i = 0; i < 20000; i++)
+        blocks.push_back(heap.shmalloc(8 + rng() % 256));
+    for (size_t i = 0; i < blocks.size(); i += 2)
+        heap.shfree(blocks[i]);
+}
+
+int main(int argc, char **argv)
+{
+    size_t numLists = argc > 1 ? strtoull(argv[1], nullptr, 10) : 200000;
+    std::vector<std::vector<int>> snapshot(numLists, std::vector<int>(8));
+    for (size_t i = 0; i < numLists; i++)
+        for (int j = 0; j < 8; j++)
+            snapshot[i][j] = static_cast<int>(i) * 8 + j;
+
+    printf("%-8s %14s %14s\n", "Mode", "construct ms", "free ms");
+    for (bool arena : {false, true})
+    {
+        ShmemHeap heap("ShmemArena_benchmark", 4096, 1UL << 30);
+        heap.create();
+        fragment(heap);
+
+        // Size the region from the snapshot: one list header per list plus its 8 ints, rounded generously
+        size_t region = 0;
+        auto start = Clock::now();
+        if (arena)
+            region = heap.beginArena(numLists * 160 + 4096);
+        size_t offset = ShmemObj::construct(snapshot, &heap);
+        size_t used = arena ? heap.endArena() : 0;
+        double constructMs = elapsedMs(start);
+
+        start = Clock::now();
+        if (arena)
+            heap.shfreeRegion(region, used);
+        else
+            ShmemObj::deconstruct(offset, &heap);
+        double freeMs = elapsedMs(start);
+
+        if (!heap.verifyHeap())
+        {
+            fprintf(stderr, "Heap is inconsistent\n");
+            return 1;
+        }
+        printf("%-8s %14.1f %14.1f\n", arena ? "arena" : "bins", constructMs, freeMs);
+        heap.unlink();
+    }
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "ShmemAccessor.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsedNs(Clock::time_point start, size_t ops)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(ops);
+}
+
+int main(int argc, char **argv)
+{
+    size_t numObjects = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    std::vector<size_t> sizes(numObjects), offsets(numObjects);
+    for (size_t i = 0; i < numObjects; i++)
+        sizes[i] = 16 + (i % 8) * 8;
+
+    // One call per block against one call for all of them, on a heap large enough to never grow
+    printf("%-14s %12s\n", "Allocator", "ns/block");
+    for (bool batched : {false, true})
+    {
+        ShmemHeap heap("ShmemBatch_benchmark", 4096, 1UL << 28);
+        heap.create();
+        auto start = Clock::now();
+        if (batched)
+            heap.shmallocBatch(sizes.data(), numObjects, offsets.data());
+        else
+            for (size_t i = 0; i < numObjects; i++)
+                offsets[i] = heap.shmalloc(sizes[i]);
+        printf("%-14s %12.1f\n", batched ? "shmallocBatch" : "shmalloc", elapsedNs(start, numObjects));
+        heap.unlink();
+    }
+
+    // A list of strings takes its object, list space and elements in one batch
+    std::vector<std::string> strings(numObjects / 10);
+    for (size_t i = 0; i < strings.size(); i++)
+        strings[i] = "benchmark_string_" + std::to_string(i);
+    ShmemHeap heap("ShmemBatch_benchmark", 4096, 1UL << 28);
+    heap.create();
+    auto start = Clock::now();
+    size_t listOffset = ShmemList::construct(strings, &heap);
+    printf("list of %zu strings: %.1f ns/element\n", strings.size(), elapsedNs(start, strings.size()));
+    ShmemObj::deconstruct(listOffset, &heap);
+    heap.unlink();
+    return 0;
+}
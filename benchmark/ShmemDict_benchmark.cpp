@@ -0,0 +1,104 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ShmemAccessor.h"
+
+// Expose the tree walk of ShmemDict to the benchmark
+class ShmemDictProbe : public ShmemDict
+{
+public:
+    /**
+     * @brief Lookup as it was done before the hash was cached in ShmemDictNode:
+     * rebuild the key from its primitive and rehash it at every level of the tree
+     */
+    const ShmemDictNode *legacySearch(const KeyType &key) const
+    {
+        size_t hashKey = hashIntOrString(key);
+        const ShmemDictNode *node = this->root();
+        const ShmemDictNode *nil = this->NIL();
+        while (node != nil)
+        {
+            size_t nodeHash = hashIntOrString(node->keyVal());
+            if (hashKey == nodeHash)
+                return node;
+            node = hashKey < nodeHash ? node->left() : node->right();
+        }
+        return nullptr;
+    }
+
+    const ShmemDictNode *cachedSearch(const KeyType &key) const
+    {
+        return this->search(key);
+    }
+};
+
+template <typename Func>
+static double timeLookups(const std::vector<KeyType> &keys, Func &&lookup)
+{
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const KeyType &key : keys)
+        found += lookup(key) != nullptr;
+    auto end = std::chrono::steady_clock::now();
+    if (found != keys.size())
+    {
+        fprintf(stderr, "Only %zu / %zu keys found\n", found, keys.size());
+        exit(1);
+    }
+    return std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(keys.size());
+}
+
+template <typename keyType>
+static void runBenchmark(const char *label, const std::map<keyType, int> &content, std::vector<KeyType> lookupKeys)
+{
+    ShmemHeap heap("ShmemDict_benchmark", 4096, 256 * 1024 * 1024);
+    heap.create();
+    ShmemAccessor acc(&heap);
+    acc = content;
+
+    const ShmemDictProbe *dict = reinterpret_cast<const ShmemDictProbe *>(heap.entrance());
+
+    std::shuffle(lookupKeys.begin(), lookupKeys.end(), std::mt19937(42));
+
+    double legacy = timeLookups(lookupKeys, [dict](const KeyType &key)
+                                { return dict->legacySearch(key); });
+    double cached = timeLookups(lookupKeys, [dict](const KeyType &key)
+                                { return dict->cachedSearch(key); });
+
+    printf("%-12s %10zu %16.1f %16.1f %9.2fx\n", label, content.size(), legacy, cached, legacy / cached);
+
+    heap.unlink();
+}
+
+int main(int argc, char **argv)
+{
+    int numKeys = argc > 1 ? atoi(argv[1]) : 200000;
+
+    printf("%-12s %10s %16s %16s %10s\n", "Key type", "Entries", "Rehash ns/op", "Cached ns/op", "Speedup");
+
+    std::map<int, int> intContent;
+    std::vector<KeyType> intKeys;
+    for (int i = 0; i < numKeys; i++)
+    {
+        intContent[i] = i;
+        intKeys.push_back(i);
+    }
+    runBenchmark("int", intContent, intKeys);
+
+    std::map<std::string, int> stringContent;
+    std::vector<KeyType> stringKeys;
+    for (int i = 0; i < numKeys; i++)
+    {
+        std::string key = "benchmark_key_" + std::to_string(i);
+        stringContent[key] = i;
+        stringKeys.push_back(key);
+    }
+    runBenchmark("string", stringContent, stringKeys);
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ShmemAccessor.h"
+
+template <typename Func>
+static double timeLookups(const std::vector<KeyType> &keys, Func &&lookup)
+{
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const KeyType &key : keys)
+        found += lookup(key) != nullptr;
+    auto end = std::chrono::steady_clock::now();
+    if (found != keys.size())
+    {
+        fprintf(stderr, "Only %zu / %zu keys found\n", found, keys.size());
+        exit(1);
+    }
+    return std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(keys.size());
+}
+
+template <typename keyType>
+static void runBenchmark(const char *label, const std::map<keyType, int> &content, std::vector<KeyType> lookupKeys)
+{
+    ShmemHeap heap("ShmemHashMap_benchmark", 4096, 512 * 1024 * 1024);
+    heap.create();
+
+    // Build both containers up front, the heap does not move while we hold the pointers
+    size_t dictOffset = ShmemDict::construct(content, &heap);
+    size_t mapOffset = ShmemHashMap::construct(content, &heap);
+    const ShmemDict *dict = reinterpret_cast<const ShmemDict *>(heap.heapHead() + dictOffset);
+    const ShmemHashMap *hashMap = reinterpret_cast<const ShmemHashMap *>(heap.heapHead() + mapOffset);
+
+    std::shuffle(lookupKeys.begin(), lookupKeys.end(), std::mt19937(42));
+
+    double tree = timeLookups(lookupKeys, [dict](const KeyType &key)
+                              { return dict->get(key); });
+    double table = timeLookups(lookupKeys, [hashMap](const KeyType &key)
+                               { return hashMap->get(key); });
+
+    printf("%-12s %10zu %16.1f %16.1f %9.2fx\n", label, content.size(), tree, table, tree / table);
+
+    heap.unlink();
+}
+
+int main(int argc, char **argv)
+{
+    int numKeys = argc > 1 ? atoi(argv[1]) : 200000;
+
+    printf("%-12s %10s %16s %16s %10s\n", "Key type", "Entries", "Dict ns/op", "HashMap ns/op", "Speedup");
+
+    std::map<int, int> intContent;
+    std::vector<KeyType> intKeys;
+    for (int i = 0; i < numKeys; i++)
+    {
+        intContent[i] = i;
+        intKeys.push_back(i);
+    }
+    runBenchmark("int", intContent, intKeys);
+
+    std::map<std::string, int> stringContent;
+    std::vector<KeyType> stringKeys;
+    for (int i = 0; i < numKeys; i++)
+    {
+        std::string key = "benchmark_key_" + std::to_string(i);
+        stringContent[key] = i;
+        stringKeys.push_back(key);
+    }
+    runBenchmark("string", stringContent, stringKeys);
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "ShmemHeap.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    size_t maxSize = argc > 1 ? strtoull(argv[1], nullptr, 10) << 20 : 1UL << 30;
+
+    printf("%-12s %14s %18s\n", "Heap MiB", "resize ms", "one heap copy ms");
+    for (size_t heapSize = 1UL << 20; heapSize <= maxSize; heapSize <<= 2)
+    {
+        ShmemHeap heap("ShmemHeapResize_benchmark", 4096, heapSize);
+        heap.create();
+
+        // Fill the heap with one live block so every page is resident
+        size_t offset = heap.shmalloc(heapSize - 64);
+        std::memset(heap.heapHead() + offset, 0xAB, heapSize - 64);
+
+        auto start = Clock::now();
+        heap.resize(2 * heapSize);
+        double resizeMs = elapsedMs(start);
+
+        // Reference: a single memcpy of the heap, the old resize did two of these plus a temporary buffer
+        std::vector<Byte> buffer(heapSize);
+        start = Clock::now();
+        std::memcpy(buffer.data(), heap.heapHead(), heapSize);
+        double copyMs = elapsedMs(start);
+
+        if (heap.heapHead()[offset + heapSize - 65] != 0xAB)
+        {
+            fprintf(stderr, "Heap content lost during resize\n");
+            return 1;
+        }
+        printf("%-12zu %14.3f %18.3f\n", heapSize >> 20, resizeMs, copyMs);
+        heap.unlink();
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "ShmemHeap.h"
+
+using Clock = std::chrono::steady_clock;
+
+// The busy-wait loop BlockHeader::wait used before it parked on a futex
+static void sleepPollWait(const ShmemHeap::BlockHeader *header)
+{
+    while (header->B())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+static void futexWait(const ShmemHeap::BlockHeader *header)
+{
+    header->wait();
+}
+
+// Measures the time between the holder clearing the busy bit and the waiter noticing it
+template <typename WaitFunc>
+static std::vector<double> measureHandoffs(ShmemHeap::BlockHeader *header, int rounds, WaitFunc &&waitFunc)
+{
+    std::vector<double> latencies;
+    std::atomic<int> round{-1};
+    std::atomic<long long> unlockedAt{0};
+
+    std::thread waiter([&]()
+                       {
+        for (int i = 0; i < rounds; i++)
+        {
+            while (round.load(std::memory_order_acquire) != i)
+                std::this_thread::yield();
+            waitFunc(header);
+            auto now = Clock::now().time_since_epoch().count();
+            latencies.push_back(std::chrono::duration<double, std::micro>(Clock::duration(now - unlockedAt.load())).count());
+            round.store(-1, std::memory_order_release);
+        } });
+
+    for (int i = 0; i < rounds; i++)
+    {
+        header->lock();
+        round.store(i, std::memory_order_release);
+        // Hold the block long enough for the waiter to give up spinning
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        unlockedAt.store(Clock::now().time_since_epoch().count());
+        header->unlock();
+        while (round.load(std::memory_order_acquire) != -1)
+            std::this_thread::yield();
+    }
+    waiter.join();
+    return latencies;
+}
+
+static void printHistogram(const char *label, const std::vector<double> &latencies)
+{
+    const double bounds[] = {1, 10, 100, 1000, 10000};
+    size_t counts[6] = {0};
+    double total = 0;
+    for (double latency : latencies)
+    {
+        size_t bucket = 0;
+        while (bucket < 5 && latency >= bounds[bucket])
+            bucket++;
+        counts[bucket]++;
+        total += latency;
+    }
+    printf("%-12s %10.1f %8zu %8zu %8zu %8zu %8zu %8zu\n", label, total / latencies.size(),
+           counts[0], counts[1], counts[2], counts[3], counts[4], counts[5]);
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 500;
+
+    ShmemHeap heap("ShmemHeapWait_benchmark", 4096, 4096);
+    heap.create();
+    size_t offset = heap.shmalloc(24);
+    ShmemHeap::BlockHeader *header = reinterpret_cast<ShmemHeap::BlockHeader *>(heap.heapHead() + offset) - 1;
+
+    printf("Wake-up latency after unlock, %d handoffs\n", rounds);
+    printf("%-12s %10s %8s %8s %8s %8s %8s %8s\n", "Wait", "Mean us", "<1us", "<10us", "<100us", "<1ms", "<10ms", ">=10ms");
+    printHistogram("sleep poll", measureHandoffs(header, rounds, sleepPollWait));
+    printHistogram("futex", measureHandoffs(header, rounds, futexWait));
+
+    heap.unlink();
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "ShmemAccessor.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Random lookups in a large red-black tree spread over the whole heap, TLB reach and first-touch faults both show here
+int main(int argc, char **argv)
+{
+    int numKeys = argc > 1 ? atoi(argv[1]) : 2000000;
+    size_t numLookups = 2000000;
+    std::map<int, int> content;
+    for (int i = 0; i < numKeys; i++)
+        content[i] = i;
+    std::vector<int> keys(numLookups);
+    std::mt19937 rng(42);
+    for (int &key : keys)
+        key = static_cast<int>(rng() % numKeys);
+
+    struct Mode
+    {
+        const char *label;
+        int options;
+    };
+    const Mode modes[] = {
+        {"default", ShmemUtils::MapDefault},
+        {"populate", ShmemUtils::MapPopulate},
+        {"hugepages", ShmemUtils::MapHugePages | ShmemUtils::MapPopulate},
+    };
+
+    printf("%-10s %12s %14s %16s\n", "Mode", "create ms", "construct ms", "lookup ns/op");
+    for (const Mode &mode : modes)
+    {
+        ShmemHeap heap("ShmemMapOptions_benchmark", 4096, 1UL << 30);
+        heap.setMapOptions(mode.options);
+
+        auto start = Clock::now();
+        heap.create();
+        double createMs = elapsedMs(start);
+
+        start = Clock::now();
+        size_t offset = ShmemDict::construct(content, &heap);
+        double constructMs = elapsedMs(start);
+
+        const ShmemDict *dict = reinterpret_cast<const ShmemDict *>(heap.heapHead() + offset);
+        size_t found = 0;
+        start = Clock::now();
+        for (int key : keys)
+            found += dict->get(key) != nullptr;
+        double lookupNs = elapsedMs(start) * 1e6 / static_cast<double>(numLookups);
+        if (found != numLookups)
+        {
+            fprintf(stderr, "Only %zu / %zu keys found\n", found, numLookups);
+            return 1;
+        }
+
+        printf("%-10s %12.1f %14.1f %16.1f\n", mode.label, createMs, constructMs, lookupNs);
+        heap.unlink();
+    }
+    return 0;
+}
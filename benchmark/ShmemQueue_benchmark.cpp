@@ -0,0 +1,80 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ShmemQueue.h"
+
+// Messages per second from this process to a forked consumer, until the consumer has popped the last one
+static double measureThroughput(bool multi, size_t batch, uint64_t numMessages)
+{
+    ShmemHeap heap("ShmemQueue_benchmark", 4096, 64 * 1024 * 1024);
+    heap.create();
+    size_t queueOffset = ShmemQueue::construct(&heap, 4096, ShmemQueue::DefaultSlotSize, multi);
+    ShmemQueue *queue = reinterpret_cast<ShmemQueue *>(heap.heapHead() + queueOffset);
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        ShmemHeap other("ShmemQueue_benchmark", 1, 1);
+        other.connect();
+        ShmemQueue *otherQueue = reinterpret_cast<ShmemQueue *>(other.heapHead() + queueOffset);
+        std::vector<uint64_t> values;
+        uint64_t expected = 0;
+        while (expected != numMessages)
+        {
+            values.clear();
+            otherQueue->popBatch(values, batch);
+            for (uint64_t value : values)
+            {
+                if (value != expected++)
+                    _exit(1);
+            }
+        }
+        _exit(0);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint64_t> values(batch);
+    for (uint64_t i = 0; i < numMessages; i += batch)
+    {
+        if (batch == 1)
+        {
+            queue->push(i);
+            continue;
+        }
+        values.resize(std::min<uint64_t>(batch, numMessages - i));
+        for (size_t j = 0; j < values.size(); j++)
+            values[j] = i + j;
+        queue->pushBatch(values);
+    }
+    int status = -1;
+    waitpid(pid, &status, 0);
+    auto end = std::chrono::steady_clock::now();
+    heap.unlink();
+
+    if (WEXITSTATUS(status) != 0)
+    {
+        fprintf(stderr, "Consumer saw the messages out of order\n");
+        exit(1);
+    }
+    return static_cast<double>(numMessages) / std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t numMessages = argc > 1 ? strtoull(argv[1], nullptr, 10) : 10000000;
+
+    printf("%-6s %8s %14s\n", "Mode", "Batch", "Mmsg/s");
+    for (bool multi : {false, true})
+    {
+        for (size_t batch : {1, 16, 256})
+        {
+            double rate = measureThroughput(multi, batch, numMessages);
+            printf("%-6s %8zu %14.2f\n", multi ? "MPMC" : "SPSC", batch, rate / 1e6);
+        }
+    }
+    return 0;
+}
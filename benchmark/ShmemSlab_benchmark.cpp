@@ -0,0 +1,73 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ShmemAccessor.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsedNs(Clock::time_point start, size_t ops)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(ops);
+}
+
+// Allocate and free small payloads in random order, the shape of dict inserts and deletes
+template <typename Alloc>
+static void churn(const char *label, size_t numObjects, size_t payloadSize, Alloc &&alloc)
+{
+    ShmemHeap heap("ShmemSlab_benchmark", 4096, 1UL << 28);
+    heap.create();
+
+    std::vector<size_t> offsets(numObjects);
+    auto start = Clock::now();
+    for (size_t i = 0; i < numObjects; i++)
+        offsets[i] = alloc(heap, payloadSize);
+    double allocNs = elapsedNs(start, numObjects);
+    size_t allocated = heap.stats().allocatedBytes;
+
+    std::shuffle(offsets.begin(), offsets.end(), std::mt19937(42));
+    start = Clock::now();
+    for (size_t offset : offsets)
+        heap.shfree(offset);
+    double freeNs = elapsedNs(start, numObjects);
+
+    if (!heap.verifyHeap())
+    {
+        fprintf(stderr, "Heap is inconsistent\n");
+        exit(1);
+    }
+    printf("%-10s %8zu %14.1f %14.1f %14.1f\n", label, payloadSize, allocNs, freeNs, static_cast<double>(allocated) / numObjects);
+    heap.unlink();
+}
+
+int main(int argc, char **argv)
+{
+    size_t numObjects = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+
+    printf("%-10s %8s %14s %14s %14s\n", "Allocator", "Payload", "alloc ns/op", "free ns/op", "bytes/object");
+    for (size_t payloadSize : {12, 64})
+    {
+        churn("shmalloc", numObjects, payloadSize, [](ShmemHeap &heap, size_t size)
+              { return heap.shmalloc(size); });
+        churn("slab", numObjects, payloadSize, [](ShmemHeap &heap, size_t size)
+              { return heap.shmallocSlab(size); });
+    }
+
+    // Whole dicts, where nodes and scalar values come from the slabs
+    std::map<int, int> content;
+    for (size_t i = 0; i < numObjects / 4; i++)
+        content[static_cast<int>(i)] = static_cast<int>(i);
+    ShmemHeap heap("ShmemSlab_benchmark", 4096, 1UL << 28);
+    heap.create();
+    auto start = Clock::now();
+    size_t dictOffset = ShmemDict::construct(content, &heap);
+    double constructNs = elapsedNs(start, content.size());
+    printf("dict of %zu int entries: %.1f ns/insert, %.1f heap bytes/entry\n", content.size(), constructNs, static_cast<double>(heap.stats().allocatedBytes) / content.size());
+    ShmemObj::deconstruct(dictOffset, &heap);
+    heap.unlink();
+    return 0;
+}
@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ShmemAccessor.h"
+
+// Replays an allocation trace recorded by ShmemHeap::startTrace() against a fresh heap.
+// Usage: ShmemTraceReplay_benchmark [trace file] [number of samples]
+// Without a trace file a synthetic workload is recorded first and replayed.
+
+using Clock = std::chrono::steady_clock;
+using TraceRecord = ShmemHeap::TraceRecord;
+
+static std::vector<TraceRecord> readTrace(const std::string &path)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Cannot open trace file %s\n", path.c_str());
+        exit(1);
+    }
+    std::vector<TraceRecord> records;
+    TraceRecord record;
+    while (fread(&record, sizeof(TraceRecord), 1, file) == 1)
+        records.push_back(record);
+    fclose(file);
+    return records;
+}
+
+// Mixed small and large payloads, reallocs of growing buffers and whole dicts built and torn down
+static void recordSyntheticTrace(const std::string &path)
+{
+    ShmemHeap heap("ShmemTraceReplay_benchmark", 4096, 4096);
+    heap.create();
+    remove(path.c_str());
+    heap.startTrace(path);
+
+    std::mt19937 rng(42);
+    std::lognormal_distribution<double> sizeDist(4.0, 1.5);
+    std::vector<size_t> live;
+    for (int round = 0; round < 200000; round++)
+    {
+        int action = static_cast<int>(rng() % 10);
+        if (live.empty() || action < 5)
+        {
+            size_t size = std::min<size_t>(static_cast<size_t>(sizeDist(rng)) + 1, 1 << 16);
+            live.push_back(size <= 64 && action < 3 ? heap.shmallocSlab(size) : heap.shmalloc(size));
+        }
+        else if (action < 7)
+        {
+            size_t &offset = live[rng() % live.size()];
+            offset = heap.shrealloc(offset, static_cast<size_t>(sizeDist(rng)) + 1);
+        }
+        else
+        {
+            size_t index = rng() % live.size();
+            heap.shfree(live[index]);
+            live[index] = live.back();
+            live.pop_back();
+        }
+
+        if (round % 20000 == 0)
+        {
+            std::map<int, int> content;
+            for (int i = 0; i < 2000; i++)
+                content[i] = i;
+            ShmemObj::deconstruct(ShmemDict::construct(content, &heap), &heap);
+        }
+        else if (round % 20000 == 10000)
+        {
+            // Short-lived blocks carved from an arena and given back as one region
+            size_t region = heap.beginArena(64 * 1024);
+            for (int i = 0; i < 200; i++)
+                heap.shmalloc(static_cast<size_t>(sizeDist(rng)) % 256 + 1);
+            heap.shfreeRegion(region, heap.endArena());
+        }
+    }
+    for (size_t offset : live)
+        heap.shfree(offset);
+    heap.trim();
+
+    heap.stopTrace();
+    heap.unlink();
+}
+
+struct Sample
+{
+    size_t op;
+    ShmemHeap::Stats stats;
+    size_t liveBytes;
+};
+
+// External fragmentation: share of the free bytes outside the largest free block
+static double fragmentation(const ShmemHeap::Stats &stats)
+{
+    return stats.freeBytes == 0 ? 0.0 : 1.0 - static_cast<double>(stats.largestFreeBlock) / static_cast<double>(stats.freeBytes);
+}
+
+int main(int argc, char **argv)
+{
+    std::string tracePath = argc > 1 ? argv[1] : "/tmp/ShmemTraceReplay_benchmark.trace";
+    size_t numSamples = argc > 2 ? strtoull(argv[2], nullptr, 10) : 20;
+    if (argc <= 1)
+        recordSyntheticTrace(tracePath);
+
+    std::vector<TraceRecord> records = readTrace(tracePath);
+    if (records.empty())
+    {
+        fprintf(stderr, "Trace %s holds no records\n", tracePath.c_str());
+        return 1;
+    }
+    double recordedMs = static_cast<double>(records.back().timestamp - records.front().timestamp) / 1e6;
+    printf("Trace %s: %zu records over %.1f ms\n", tracePath.c_str(), records.size(), recordedMs);
+
+    ShmemHeap heap("ShmemTraceReplay_benchmark", 4096, 4096);
+    heap.create();
+
+    // Offsets of the recorded run -> offset and requested size in the replay
+    std::unordered_map<uint64_t, std::pair<size_t, size_t>> live;
+    // Arena regions of the recorded run -> region in the replay
+    std::unordered_map<uint64_t, size_t> regions;
+    size_t liveBytes = 0, skipped = 0, peakCapacity = 0;
+    size_t sampleEvery = std::max<size_t>(records.size() / std::max<size_t>(numSamples, 1), 1);
+    std::vector<Sample> samples;
+
+    auto track = [&](uint64_t recorded, size_t offset, size_t size)
+    {
+        if (recorded == 0 || offset == 0)
+            return;
+        live[recorded] = {offset, size};
+        liveBytes += size;
+    };
+    auto untrack = [&](uint64_t recorded, size_t &offset)
+    {
+        auto it = live.find(recorded);
+        if (it == live.end())
+            return false;
+        offset = it->second.first;
+        liveBytes -= it->second.second;
+        live.erase(it);
+        return true;
+    };
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const TraceRecord &record = records[i];
+        size_t offset;
+        switch (record.op)
+        {
+        case ShmemHeap::TraceMalloc:
+            track(record.result, heap.shmalloc(record.size), record.size);
+            break;
+        case ShmemHeap::TraceMallocSlab:
+            track(record.result, heap.shmallocSlab(record.size), record.size);
+            break;
+        case ShmemHeap::TraceMemalign:
+            track(record.result, heap.shmemalign(record.size, record.offset, record.aux), record.size);
+            break;
+        case ShmemHeap::TraceRealloc:
+            if (record.offset == 0)
+                offset = 0;
+            else if (!untrack(record.offset, offset))
+            {
+                skipped++;
+                break;
+            }
+            track(record.result, heap.shrealloc(offset, record.size, record.aux), record.size);
+            break;
+        case ShmemHeap::TraceFree:
+            if (untrack(record.offset, offset))
+                heap.shfree(offset);
+            else
+                skipped++;
+            break;
+        case ShmemHeap::TraceBeginArena:
+            regions[record.result] = heap.beginArena(record.size);
+            break;
+        case ShmemHeap::TraceEndArena:
+            heap.endArena();
+            break;
+        case ShmemHeap::TraceFreeRegion:
+        {
+            auto region = regions.find(record.offset);
+            if (region == regions.end())
+            {
+                skipped++;
+                break;
+            }
+            // The blocks carved from the region go with it
+            for (auto it = live.begin(); it != live.end();)
+            {
+                if (it->first >= record.offset && it->first < record.offset + record.size)
+                {
+                    liveBytes -= it->second.second;
+                    it = live.erase(it);
+                }
+                else
+                    it++;
+            }
+            if (heap.shfreeRegion(region->second, record.size) != 0)
+                skipped++;
+            regions.erase(region);
+            break;
+        }
+        case ShmemHeap::TraceResize:
+            // The replayed heap has its own shape, only growth is replayed
+            if (static_cast<long>(record.size) > static_cast<long>(heap.heapCapacity()))
+                heap.resize(-1, static_cast<long>(record.size));
+            else
+                skipped++;
+            break;
+        case ShmemHeap::TraceTrim:
+            peakCapacity = std::max(peakCapacity, heap.heapCapacity());
+            heap.trim();
+            break;
+        default:
+            fprintf(stderr, "Unknown trace op %u at record %zu\n", record.op, i);
+            return 1;
+        }
+
+        if ((i + 1) % sampleEvery == 0 || i + 1 == records.size())
+            samples.push_back({i + 1, heap.stats(), liveBytes});
+    }
+    double replayNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+    if (!heap.verifyHeap())
+    {
+        fprintf(stderr, "Heap is inconsistent\n");
+        exit(1);
+    }
+
+    printf("%10s %12s %12s %12s %12s %8s\n", "Op", "Heap KiB", "Alloc KiB", "Live KiB", "Free blocks", "Frag %");
+    for (const Sample &sample : samples)
+    {
+        peakCapacity = std::max(peakCapacity, sample.stats.heapCapacity);
+        printf("%10zu %12.1f %12.1f %12.1f %12zu %8.1f\n", sample.op, sample.stats.heapCapacity / 1024.0, sample.stats.allocatedBytes / 1024.0,
+               sample.liveBytes / 1024.0, sample.stats.freeBlocks, 100.0 * fragmentation(sample.stats));
+    }
+
+    printf("Replayed %zu ops in %.1f ms: %.2f Mops/s, %.1f ns/op\n", records.size(), replayNs / 1e6, records.size() * 1e3 / replayNs, replayNs / records.size());
+    printf("Peak heap capacity: %.1f KiB, %zu resizes, %zu records skipped\n", peakCapacity / 1024.0, heap.stats().resizeCount, skipped);
+
+    heap.unlink();
+    return 0;
+}
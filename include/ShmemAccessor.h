@@ -8,6 +8,17 @@ ShmemObjInitializer SList(const pybind11::object &iniList = pybind11::none());
 
 ShmemObjInitializer SDict(const pybind11::object &iniDict = pybind11::none());
 
+ShmemObjInitializer SHashMap(const pybind11::object &iniDict = pybind11::none());
+
+/**
+ * @brief Initializer of an empty ShmemQueue
+ *
+ * @param capacity number of slots, rounded up to a power of 2
+ * @param slotSize largest message in bytes
+ * @param multi false for one producer and one consumer (SPSC), true for any number of each (MPMC)
+ */
+ShmemObjInitializer SQueue(size_t capacity = ShmemQueue::DefaultCapacity, size_t slotSize = ShmemQueue::DefaultSlotSize, bool multi = false);
+
 class ShmemAccessor
 {
 protected:
@@ -51,7 +62,104 @@ protected:
 
     // Utility functions
 
-    void resolvePath(ShmemObj *&prevObj, ShmemObj *&obj, int &resolvedDepth) const;
+    /**
+     * @brief Follow the path from the entrance as far as it resolves
+     *
+     * @param chain if given, receives the offsets (from the heap head) of the objects passed, the entrance first
+     */
+    void resolvePath(ShmemObj *&prevObj, ShmemObj *&obj, int &resolvedDepth, std::vector<size_t> *chain = nullptr) const;
+
+    /**
+     * @brief Publish a write: bumps the version of every object in the chain, then wakes the watchers of the heap
+     *
+     * @param chain offsets collected by resolvePath(), from the entrance down to the object written
+     */
+    void notifyChange(const std::vector<size_t> &chain) const;
+
+    /**
+     * @brief Run a read again until no transaction commit overlapped it, see ShmemHeap::commit()
+     *
+     * @param read the read, may run several times
+     * @return what the last run returned
+     */
+    template <typename Func>
+    auto readCommitted(Func &&read) const -> decltype(read())
+    {
+        ShmemDict::SnapshotScope scope(this->snapshotEpoch());
+        while (true)
+        {
+            size_t seq = this->heapPtr->readBegin();
+            try
+            {
+                auto result = read();
+                if (!this->heapPtr->readRetry(seq))
+                    return result;
+            }
+            catch (...)
+            {
+                // A read over a half applied commit may fail by itself, only a clean run reports its error
+                if (!this->heapPtr->readRetry(seq))
+                    throw;
+            }
+        }
+    }
+
+    /**
+     * @brief Stage a write instead of applying it while the heap has an open transaction
+     *
+     * @param write the write, applied by ShmemHeap::commit()
+     * @param undo takes the undo image of the write, see undoImage()
+     * @return true if the write was staged
+     */
+    template <typename Func>
+    bool stageWrite(Func &&write, ShmemHeap::UndoImage undo) const
+    {
+        if (!this->heapPtr->inTransaction())
+            return false;
+        this->heapPtr->stageWrite(std::forward<Func>(write), std::move(undo));
+        return true;
+    }
+
+    /**
+     * @brief Take what a write to this path is about to change, for ShmemHeap::commit() to roll the write back
+     *
+     * A replaced or removed object is linked again, its free is held back until the commit ends. A key the write adds
+     * is removed, an element of a primitive array gets the bytes of the array back
+     * @param removes true for del(), a list element removed goes back to its index
+     * @return the write putting the path back, empty if the write is going to fail before it changes anything
+     */
+    ShmemHeap::StagedWrite undoImage(bool removes) const;
+
+    /**
+     * @brief Like undoImage(), for add() appending to the list at this path
+     */
+    ShmemHeap::StagedWrite undoAppend() const;
+
+    // Link an object at this path again, unless it is already there (see undoImage())
+    void relink(size_t offset);
+
+    // Keeps a snapshot pinned while an accessor reading it exists, see snapshot()
+    struct SnapshotPin
+    {
+        ShmemHeap *heapPtr;
+        size_t epoch;
+        size_t entranceOffset; // entrance as of the snapshot, NPtr if there was none
+
+        explicit SnapshotPin(ShmemHeap *heapPtr);
+        ~SnapshotPin();
+        SnapshotPin(const SnapshotPin &) = delete;
+        SnapshotPin &operator=(const SnapshotPin &) = delete;
+    };
+    std::shared_ptr<const SnapshotPin> snapshotPin; // nullptr for the live data, shared by the accessors derived from a snapshot
+
+    // Pin a new snapshot for this accessor, see snapshot()
+    void pinSnapshot();
+
+    // Throw if this accessor reads a snapshot, writes go through live accessors only
+    void checkWritable() const;
+
+    // The queue at the path, throws if the path does not lead to one
+    ShmemQueue *resolveQueue() const;
 
 public:
     ShmemHeap *heapPtr;
@@ -69,9 +177,34 @@ public:
         static_assert(((std::is_same_v<KeyTypes, int> || std::is_same_v<KeyTypes, std::variant<int, std::string>> || isString<KeyTypes>()) && ...), "All arguments must be of type KeyType");
         std::vector<KeyType> newPath(this->path);
         newPath.insert(newPath.end(), {accessPath...});
-        return ShmemAccessor(this->heapPtr, newPath);
+        ShmemAccessor result(this->heapPtr, newPath);
+        result.snapshotPin = this->snapshotPin;
+        return result;
     }
 
+    // Snapshots
+
+    /**
+     * @brief Accessor to the same path that keeps reading the dicts as they are now, while writers go on
+     *
+     * Taken between two transaction commits. Writers copy the dict nodes a snapshot may read instead of changing them,
+     * so neither side waits for the other. Writes through a snapshot throw
+     * @return accessor reading the snapshot, it stays pinned until the last accessor derived from it is released or gone
+     * @note Only dicts keep older versions. Lists, hash maps and primitive payloads, and what is reached through them, are read live
+     */
+    ShmemAccessor snapshot() const;
+
+    // Whether this accessor reads a snapshot
+    bool isSnapshot() const;
+
+    // Epoch of the snapshot this accessor reads, 0 for the live data
+    size_t snapshotEpoch() const;
+
+    /**
+     * @brief Read the live data again. The snapshot is unpinned and its old versions freed once no accessor holds it
+     */
+    void release();
+
     // Type (Special interface)
     int typeId() const;
     std::string typeStr() const;
@@ -80,9 +213,17 @@ public:
     // __len__
     size_t len() const;
 
-    // __getitem__
+    // __getitem__, never sees a transaction half committed
     template <typename T>
     T get() const
+    {
+        return this->readCommitted([this]()
+                                   { return this->getOnce<T>(); });
+    }
+
+    // One attempt of get(), a commit in between may tear it
+    template <typename T>
+    T getOnce() const
     {
         ShmemObj *obj, *prev;
         int resolvedDepth;
@@ -149,6 +290,14 @@ public:
         {
             return reinterpret_cast<ShmemDict *>(obj)->operator T();
         }
+        else if (obj->type == HashMap)
+        {
+            return reinterpret_cast<ShmemHashMap *>(obj)->operator T();
+        }
+        else if (obj->type == Queue)
+        {
+            throw ConversionError("Cannot convert queue to " + typeName<T>() + ", pop() its messages instead");
+        }
         else
         {
             throw std::runtime_error("ShmemAccessor.get(): Unknown type: "+std::to_string(obj->type));
@@ -159,9 +308,17 @@ public:
     template <typename T>
     void set(const T &val)
     {
+        this->checkWritable();
+        if (this->stageWrite([target = *this, val]() mutable
+                             { target.set(val); },
+                             [target = *this]()
+                             { return target.undoImage(false); }))
+            return;
+
         ShmemObj *obj, *prev;
         int resolvedDepth;
-        resolvePath(prev, obj, resolvedDepth);
+        std::vector<size_t> chain;
+        resolvePath(prev, obj, resolvedDepth, &chain);
 
         bool partiallyResolved = static_cast<size_t>(resolvedDepth) != path.size();
 
@@ -198,7 +355,7 @@ public:
                         throw std::runtime_error("Cannot use string as index on primitive array");
                     }
                 }
-                else if (obj->type == Dict)
+                else if (obj->type == Dict || obj->type == HashMap)
                 {
                     insertNewKey = true;
                 }
@@ -217,24 +374,37 @@ public:
         if (partiallyResolved)
         { // The obj ptr is the work target
             if (usePrimitiveIndex)
+            {
                 static_cast<ShmemPrimitive_ *>(obj)->set(val, primitiveIndex);
+                chain.pop_back(); // The array counted the write itself
+            }
             else if (insertNewKey)
             {
-                static_cast<ShmemDict *>(obj)->set(val, path[resolvedDepth], this->heapPtr);
+                if (obj->type == HashMap)
+                    static_cast<ShmemHashMap *>(obj)->set(val, path[resolvedDepth], this->heapPtr);
+                else
+                    static_cast<ShmemDict *>(obj)->set(val, path[resolvedDepth], this->heapPtr);
             }
             else
                 throw std::runtime_error("Code should not reach here");
         }
         else
         { // The prev ptr is the work target, as the obj ptr is the one get replaced
+            // Its watchers see the bump even if the replacement lands at the same offset
+            if (obj != nullptr)
+                (reinterpret_cast<ShmemHeap::BlockHeader *>(obj) - 1)->bumpSeq();
+
             if (prev == nullptr)
             {
-                if (obj != nullptr)
-                {
-                    ShmemObj::deconstruct(reinterpret_cast<Byte *>(obj) - this->heapPtr->heapHead(), this->heapPtr);
-                }
-                // The obj is the root object in the heap, update the entrance point
-                this->setEntrance(ShmemObj::construct(val, this->heapPtr));
+                // Under the commit sequence, a snapshot takes the entrance between two of them
+                this->heapPtr->commitWrite([this, obj, &val]()
+                                           {
+                    if (obj != nullptr)
+                    {
+                        ShmemObj::retire(reinterpret_cast<Byte *>(obj) - this->heapPtr->heapHead(), this->heapPtr);
+                    }
+                    // The obj is the root object in the heap, update the entrance point
+                    this->setEntrance(ShmemObj::construct(val, this->heapPtr)); });
             }
             else
             {
@@ -252,12 +422,21 @@ public:
                 {
                     static_cast<ShmemDict *>(prev)->set(val, path.back(), this->heapPtr);
                 }
+                else if (prevType == HashMap)
+                {
+                    static_cast<ShmemHashMap *>(prev)->set(val, path.back(), this->heapPtr);
+                }
                 else
                 {
                     throw std::runtime_error("Does not support this type yet");
                 }
             }
+
+            // The path now leads to the replacement
+            chain.clear();
+            resolvePath(prev, obj, resolvedDepth, &chain);
         }
+        this->notifyChange(chain);
     }
 
     // __delitem__
@@ -267,6 +446,7 @@ public:
     template <typename T>
     bool contains(const T &value) const
     {
+        ShmemDict::SnapshotScope scope(this->snapshotEpoch());
         ShmemObj *obj, *prev;
         int resolvedDepth;
         resolvePath(prev, obj, resolvedDepth);
@@ -305,6 +485,23 @@ public:
             }
             return false;
         }
+        else if (obj->type == HashMap)
+        {
+            if constexpr (std::is_same_v<T, int> || std::is_same_v<T, std::variant<int, std::string>> || isString<T>())
+            {
+                return static_cast<ShmemHashMap *>(obj)->contains(value);
+            }
+            else if constexpr (std::is_base_of_v<pybind11::object, T>)
+            {
+                if (pybind11::isinstance<pybind11::str>(value))
+                    return static_cast<ShmemHashMap *>(obj)->contains(pybind11::cast<std::string>(value));
+                else if (pybind11::isinstance<pybind11::int_>(value))
+                    return static_cast<ShmemHashMap *>(obj)->contains(pybind11::cast<int>(value));
+                else
+                    return false;
+            }
+            return false;
+        }
         else
         {
             throw std::runtime_error("Unknown obj type");
@@ -315,6 +512,7 @@ public:
     template <typename T>
     int index(const T &value) const
     {
+        ShmemDict::SnapshotScope scope(this->snapshotEpoch());
         ShmemObj *obj, *prev;
         int resolvedDepth;
         resolvePath(prev, obj, resolvedDepth);
@@ -332,9 +530,9 @@ public:
         {
             return static_cast<ShmemList *>(obj)->index(value);
         }
-        else if (obj->type == Dict)
+        else if (obj->type == Dict || obj->type == HashMap)
         {
-            throw std::runtime_error("index() is not supported on Dict, please use key() instead");
+            throw std::runtime_error("index() is not supported on " + typeNames.at(obj->type) + ", please use key() instead");
         }
         else
         {
@@ -346,6 +544,7 @@ public:
     template <typename T>
     KeyType key(const T &value) const
     {
+        ShmemDict::SnapshotScope scope(this->snapshotEpoch());
         ShmemObj *obj, *prev;
         int resolvedDepth;
         resolvePath(prev, obj, resolvedDepth);
@@ -368,6 +567,10 @@ public:
         {
             return static_cast<ShmemDict *>(obj)->key(value);
         }
+        else if (obj->type == HashMap)
+        {
+            return static_cast<ShmemHashMap *>(obj)->key(value);
+        }
         else
         {
             throw std::runtime_error("ShmemAccessor.key(): Unknown type: "+std::to_string(obj->type));
@@ -377,14 +580,52 @@ public:
     // __str__
     std::string toString(int maxElements = -1) const;
 
+    // Change notification
+
+    /**
+     * @brief Version of the object at the path, it moves with every write through an accessor to the object or below it
+     *
+     * @return 0 if the path does not lead to an object
+     * @note Replacing the object changes the version as well
+     */
+    size_t version() const;
+
+    /**
+     * @brief Block until version() moves away from the given one, without polling
+     *
+     * Sleeps on the change counter of the heap (a futex shared by all processes) and checks the version on every wake-up
+     *
+     * @param since a value returned by version() or by a previous watch()
+     * @param timeout in milliseconds, -1 to wait without a timeout
+     * @return the current version(), equal to since on timeout
+     */
+    size_t watch(size_t since, int timeout = -1) const;
+
+    /**
+     * @brief Block until the object at the path, or anything below it, is written
+     *
+     * @param timeout in milliseconds, -1 to wait without a timeout
+     * @return false on timeout
+     * @note Writes between an earlier read and this call are missed, loop on watch() to see every change
+     */
+    bool waitForChange(int timeout = -1) const;
+
     // Type specific methods
     // Dict
     template <typename T>
     void add(const T &value, const KeyType &key)
     {
+        this->checkWritable();
+        if (this->stageWrite([target = *this, value, key]() mutable
+                             { target.add(value, key); },
+                             [target = (*this)[key]]()
+                             { return target.undoImage(false); }))
+            return;
+
         ShmemObj *obj, *prev;
         int resolvedDepth;
-        resolvePath(prev, obj, resolvedDepth);
+        std::vector<size_t> chain;
+        resolvePath(prev, obj, resolvedDepth, &chain);
 
         if (static_cast<size_t>(resolvedDepth) != path.size())
         {
@@ -401,16 +642,27 @@ public:
         }
         if (obj->type == Dict)
             static_cast<ShmemDict *>(obj)->set(value, key, this->heapPtr);
+        else if (obj->type == HashMap)
+            static_cast<ShmemHashMap *>(obj)->set(value, key, this->heapPtr);
         else
             throw std::runtime_error("Cannot add a key-value pair to a non-dict object");
+        this->notifyChange(chain);
     }
 
     template <typename T>
     void add(const T &value) const
     {
+        this->checkWritable();
+        if (this->stageWrite([target = *this, value]()
+                             { target.add(value); },
+                             [target = *this]()
+                             { return target.undoAppend(); }))
+            return;
+
         ShmemObj *obj, *prev;
         int resolvedDepth;
-        resolvePath(prev, obj, resolvedDepth);
+        std::vector<size_t> chain;
+        resolvePath(prev, obj, resolvedDepth, &chain);
 
         if (static_cast<size_t>(resolvedDepth) != path.size())
         {
@@ -428,6 +680,7 @@ public:
             static_cast<ShmemList *>(obj)->append(value, this->heapPtr);
         else
             throw std::runtime_error("Cannot add a single value to a " + typeNames.at(obj->type) + " object");
+        this->notifyChange(chain);
     }
 
     // Quick add
@@ -477,6 +730,60 @@ public:
         this->add(stringMap);
     }
 
+    // Queue
+    // Messages go around transactions and change notification, the queue wakes its own waiters. T is std::string
+    // or trivially copyable. The queue must stay in place while a push or pop waits on it
+
+    /**
+     * @brief Push a message to the queue at the path, waiting for room while it is full
+     *
+     * @param timeout in milliseconds, 0 to return at once, -1 to wait without a timeout
+     * @return false on timeout
+     */
+    template <typename T>
+    bool push(const T &message, int timeout = -1) const
+    {
+        this->checkWritable();
+        return this->resolveQueue()->push(message, timeout);
+    }
+
+    /**
+     * @brief Pop a message from the queue at the path, waiting while it is empty
+     *
+     * @param timeout in milliseconds, 0 to return at once, -1 to wait without a timeout
+     * @return false on timeout, message is left alone
+     */
+    template <typename T>
+    bool pop(T &message, int timeout = -1) const
+    {
+        this->checkWritable();
+        return this->resolveQueue()->pop(message, timeout);
+    }
+
+    /**
+     * @brief Push messages in order, an SPSC queue publishes them at once
+     *
+     * @return number of messages pushed, less than messages.size() on timeout
+     */
+    template <typename T>
+    size_t pushBatch(const std::vector<T> &messages, int timeout = -1) const
+    {
+        this->checkWritable();
+        return this->resolveQueue()->pushBatch(messages, timeout);
+    }
+
+    /**
+     * @brief Append up to maxCount messages, waiting for the first one only
+     *
+     * @return number of messages appended, 0 on timeout
+     */
+    template <typename T>
+    size_t popBatch(std::vector<T> &messages, size_t maxCount, int timeout = -1) const
+    {
+        this->checkWritable();
+        return this->resolveQueue()->popBatch(messages, maxCount, timeout);
+    }
+
     // Iterator related
     // template <typename T>
     // T operator*() const
@@ -491,6 +798,7 @@ public:
     // __iter__
     ShmemAccessor begin() const
     {
+        ShmemDict::SnapshotScope scope(this->snapshotEpoch());
         ShmemObj *obj, *prev;
         int resolvedDepth;
         resolvePath(prev, obj, resolvedDepth);
@@ -505,6 +813,7 @@ public:
 
     ShmemAccessor end() const
     {
+        ShmemDict::SnapshotScope scope(this->snapshotEpoch());
         ShmemObj *obj, *prev;
         int resolvedDepth;
         resolvePath(prev, obj, resolvedDepth);
@@ -520,6 +829,7 @@ public:
     // __next__
     ShmemAccessor &operator++()
     {
+        ShmemDict::SnapshotScope scope(this->snapshotEpoch());
         KeyType lastPath = this->path.back();
         path.pop_back();
 
@@ -647,6 +957,7 @@ public:
     template <typename T>
     bool operator==(const T &val) const
     {
+        ShmemDict::SnapshotScope scope(this->snapshotEpoch());
         ShmemObj *obj, *prev;
         int resolvedDepth;
         resolvePath(prev, obj, resolvedDepth);
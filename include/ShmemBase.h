@@ -63,11 +63,17 @@ public:
 
     // Setters
     void setCapacity(size_t capacity);
+    /**
+     * @brief Set the backing options (ShmemUtils::MapOption flags) used whenever this process maps the segment
+     * @note Takes effect on the next create(), connect() or resize(), the options are per process
+     */
+    void setMapOptions(int options);
 
     // Accessors
     const std::string &getName() const;
     size_t getCapacity() const;
     size_t getUsedSize() const;
+    int getMapOptions() const;
     int getVersion() const;
     bool isConnected() const;
     bool ownsSharedMemory() const;
@@ -114,6 +120,8 @@ private:
     // Member Variables
     std::string name;
     size_t capacity;
+    size_t mappedSize; // Length of the current mapping, capacity may already hold a pending resize target
+    int mapOptions;    // ShmemUtils::MapOption flags for this process' mapping
     bool connected;
     bool ownShm;
     size_t usedSize;
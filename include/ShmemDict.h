@@ -8,10 +8,9 @@
 #include <map>
 #include <stdexcept>
 
-int hashIntOrString(KeyType key);
+size_t hashIntOrString(const KeyType &key);
 
 const static KeyType NILKey = "NILKey:js82nfd-";
-const static int hashedNILKey = hashIntOrString(NILKey);
 
 class ShmemDictNode : public ShmemObj
 {
@@ -20,8 +19,10 @@ public:
     ptrdiff_t keyOffset;
     ptrdiff_t dataOffset;
     int color;
+    uint32_t birth; // snapshot epoch the node was written in, snapshots of that epoch or later may read it
+    size_t keyHash; // hashIntOrString(key), cached at construction
 
-    static size_t construct(KeyType key, ShmemHeap *heapPtr);
+    static size_t construct(const KeyType &key, ShmemHeap *heapPtr);
 
     static void deconstruct(size_t offset, ShmemHeap *heapPtr);
 
@@ -46,10 +47,31 @@ public:
 
     int keyType() const;
     int dataType() const;
-    int hashedKey() const;
+    size_t hashedKey() const;
+
+    /**
+     * @brief Order a (hash, key) pair against this node: by hash first, then by the full key
+     * (int keys before string keys) so keys with colliding hashes still have a strict order
+     *
+     * @param hash hashIntOrString(key)
+     * @param key key to compare
+     * @return negative / 0 / positive if the key orders before / equal to / after this node's key
+     * @note Does not allocate
+     */
+    int compare(size_t hash, const KeyType &key) const;
+
     std::string keyToString() const;
 };
 
+// An older root of a ShmemDict, kept while a pinned snapshot may read it
+struct ShmemDictVersion
+{
+    size_t epoch;         // snapshot epoch the root was written in
+    ptrdiff_t rootOffset; // from the dict
+    ptrdiff_t nextOffset; // older version from the dict, 0 at the end
+    int size;
+};
+
 class ShmemDict : public ShmemObj
 {
     friend class ShmemAccessor;
@@ -57,6 +79,11 @@ class ShmemDict : public ShmemObj
 protected:
     ptrdiff_t rootOffset;
     ptrdiff_t NILOffset;
+    size_t versionEpoch;      // snapshot epoch the current root was written in
+    ptrdiff_t versionsOffset; // newest ShmemDictVersion from the dict, 0 if no snapshot needs an older root
+
+    // Snapshot epoch the reads of this thread see, 0 for the live data. Set through SnapshotScope
+    static thread_local size_t readEpoch;
 
     ShmemDictNode *root() const;
     void setRoot(ShmemDictNode *node);
@@ -69,18 +96,40 @@ protected:
     void transplant(ShmemDictNode *nodeU, ShmemDictNode *nodeV);
     ShmemDictNode *minimum(ShmemDictNode *node) const;
     ShmemDictNode *maximum(ShmemDictNode *node) const;
-    ShmemDictNode *findSuccessor(const ShmemDictNode *node) const;
-    void fixDelete(ShmemDictNode *nodeX);
+    void fixDelete(ShmemDictNode *nodeX, size_t newest, ShmemHeap *heapPtr);
 
-    void insert(KeyType key, ShmemObj *data, ShmemHeap *heapPtr);
+    // Copy on write while snapshots are pinned. Readers of a snapshot only follow left, right, key and data,
+    // so color and parent links (which describe the live tree) are still changed in place
 
-    ShmemDictNode *search(KeyType key);
-    const ShmemDictNode *search(KeyType key) const;
+    /**
+     * @brief Start a write, with the busy bit of the dict held: keep the current root for the snapshots that read it
+     *
+     * @return newest pinned snapshot epoch, nodes written up to it are copied by own()
+     */
+    size_t beginVersion(ShmemHeap *heapPtr);
+
+    /**
+     * @brief Get a node whose links and data can be changed in place, a copy if a snapshot may read the node
+     *
+     * @param newest value returned by beginVersion()
+     * @return the node, or its copy which already replaced it in its parent (owned too) and its children
+     */
+    ShmemDictNode *own(ShmemDictNode *node, size_t newest, ShmemHeap *heapPtr);
+
+    /**
+     * @brief Root and size the reads of this thread see, see readEpoch
+     */
+    ShmemDictNode *readRoot(int *size = nullptr) const;
+
+    void insert(const KeyType &key, ShmemObj *data, ShmemHeap *heapPtr);
+
+    ShmemDictNode *search(const KeyType &key);
+    const ShmemDictNode *search(const KeyType &key) const;
 
     // Traversal helpers
     void toStringHelper(const ShmemDictNode *node, int indent, std::ostringstream &resultStream, int currentElement, int maxElements) const;
-    static void deconstructHelper(ShmemDictNode *node, ShmemHeap *heapPtr);
-    ShmemDictNode *searchHelper(ShmemDictNode *node, int key);
+    static void deconstructHelper(ShmemDictNode *node, const ShmemDictNode *nil, ShmemHeap *heapPtr);
+    ShmemDictNode *searchHelper(ShmemDictNode *node, size_t hash, const KeyType &key);
     template <typename T>
     ShmemDictNode *searchKeyHelper(ShmemDictNode *node, const T &value);
     void keysHelper(const ShmemDictNode *node, std::vector<KeyType> &result, bool &allInt, bool &allString) const;
@@ -89,6 +138,19 @@ protected:
     void toPyObjectHelper(ShmemDictNode *node, pybind11::dict &result) const;
 
 public:
+    // Makes the reads of this thread see every dict as of a snapshot epoch (0 for the live data) while it lives
+    class SnapshotScope
+    {
+    public:
+        explicit SnapshotScope(size_t epoch) : previous(readEpoch) { readEpoch = epoch; }
+        ~SnapshotScope() { readEpoch = previous; }
+        SnapshotScope(const SnapshotScope &) = delete;
+        SnapshotScope &operator=(const SnapshotScope &) = delete;
+
+    private:
+        size_t previous;
+    };
+
     static size_t construct(ShmemHeap *heapPtr);
 
     template <typename keyType, typename T>
@@ -103,17 +165,17 @@ public:
     size_t len() const;
 
     // __getitem__
-    ShmemObj *get(KeyType key) const;
+    ShmemObj *get(const KeyType &key) const;
 
     // __setitem__ (only for assign)
     template <typename T>
     void set(const T &value, KeyType key, ShmemHeap *heapPtr);
 
     // __delitem__
-    void del(KeyType key, ShmemHeap *heapPtr);
+    void del(const KeyType &key, ShmemHeap *heapPtr);
 
     // __contains__
-    bool contains(KeyType key) const;
+    bool contains(const KeyType &key) const;
 
     // __key__ (similar to __index__)
     template <typename T>
@@ -4,7 +4,7 @@
 #include "ShmemObj.h"
 #include "ShmemDict.h"
 
-inline const ShmemDictNode *ShmemDict::search(KeyType key) const
+inline const ShmemDictNode *ShmemDict::search(const KeyType &key) const
 {
     return const_cast<ShmemDict *>(this)->search(key);
 }
@@ -27,25 +27,45 @@ inline const ShmemDictNode *ShmemDict::search(KeyType key) const
 template <typename keyType, typename T>
 size_t ShmemDict::construct(std::map<keyType, T> map, ShmemHeap *heapPtr)
 {
-    if constexpr (std::is_same_v<keyType, int> || std::is_same_v<keyType, std::variant<int, std::string>>)
+    if constexpr (std::is_same_v<keyType, int> || std::is_same_v<keyType, std::variant<int, std::string>> || isString<keyType>())
     {
         size_t dictOffset = ShmemDict::construct(heapPtr);
-        ShmemDict *dict = reinterpret_cast<ShmemDict *>(ShmemObj::resolveOffset(dictOffset, heapPtr));
-        for (auto &[key, val] : map)
+
+        // Values of a known size are allocated in one pass over the free bins, nodes and keys come from the slab pages.
+        // Aligned arrays need shmemalign(), they are constructed one by one below
+        std::vector<size_t> valueOffsets;
+        if constexpr (ShmemPrimitive_::hasKnownSize<T>())
         {
-            ShmemObj *newObj = reinterpret_cast<ShmemObj *>(heapPtr->heapHead() + ShmemObj::construct(val, heapPtr));
-            dict->insert(key, newObj, heapPtr);
+            if (heapPtr->getArrayAlignment() <= unitSize)
+            {
+                std::vector<size_t> sizes;
+                sizes.reserve(map.size());
+                for (auto &[key, val] : map)
+                    sizes.push_back(ShmemPrimitive_::payloadSize(val));
+                valueOffsets.resize(map.size());
+                heapPtr->shmallocBatch(sizes.data(), sizes.size(), valueOffsets.data());
+            }
         }
-        return dictOffset;
-    }
-    else if (isString<keyType>())
-    {
-        size_t dictOffset = ShmemDict::construct(heapPtr);
+
         ShmemDict *dict = reinterpret_cast<ShmemDict *>(ShmemObj::resolveOffset(dictOffset, heapPtr));
+        size_t index = 0;
         for (auto &[key, val] : map)
         {
-            ShmemObj *newObj = reinterpret_cast<ShmemObj *>(heapPtr->heapHead() + ShmemObj::construct(val, heapPtr));
-            dict->insert(std::string(key), newObj, heapPtr);
+            size_t valueOffset;
+            if (valueOffsets.empty())
+                valueOffset = ShmemObj::construct(val, heapPtr);
+            else
+            {
+                valueOffset = valueOffsets[index++];
+                if constexpr (ShmemPrimitive_::hasKnownSize<T>())
+                    ShmemPrimitive_::constructAt(valueOffset, val, heapPtr);
+            }
+
+            ShmemObj *newObj = reinterpret_cast<ShmemObj *>(heapPtr->heapHead() + valueOffset);
+            if constexpr (isString<keyType>())
+                dict->insert(std::string(key), newObj, heapPtr);
+            else
+                dict->insert(key, newObj, heapPtr);
         }
         return dictOffset;
     }
@@ -87,7 +107,7 @@ ShmemDictNode *ShmemDict::searchKeyHelper(ShmemDictNode *node, const T &value)
 template <typename T>
 KeyType ShmemDict::key(const T &value) const
 {
-    ShmemDictNode *target = const_cast<ShmemDict *>(this)->searchKeyHelper(const_cast<ShmemDict *>(this)->root(), value);
+    ShmemDictNode *target = const_cast<ShmemDict *>(this)->searchKeyHelper(readRoot(), value);
     return target->keyVal();
 }
 
@@ -104,7 +124,7 @@ ShmemDict::operator T() const
         bool allString = true;
         std::map<KeyType, mapDataType> tmpResult;
         T result;
-        convertHelper(this->root(), tmpResult, allInt, allString);
+        convertHelper(readRoot(), tmpResult, allInt, allString);
         if constexpr (std::is_convertible_v<keyDataType, int>)
         {
             if (!allInt)
@@ -135,7 +155,7 @@ ShmemDict::operator T() const
     else if constexpr (std::is_same_v<T, pybind11::dict> || std::is_same_v<T, pybind11::object>)
     {
         pybind11::dict result;
-        toPyObjectHelper(this->root(), result);
+        toPyObjectHelper(readRoot(), result);
         return result;
     }
     else
@@ -179,7 +199,7 @@ bool ShmemDict::operator==(const T &val) const
             return false;
         // Ensure T = const ShmemDict*
 
-        if (this->size != val->size)
+        if (this->len() != reinterpret_cast<const ShmemDict *>(val)->len())
             return false;
 
         return this->toString() == reinterpret_cast<const ShmemDict *>(val)->toString();
@@ -0,0 +1,157 @@
+#include "ShmemObj.h"
+// Please keep this inclusion before header guard, which make the order of include correct
+
+#ifndef SHMEM_HASH_MAP_H
+#define SHMEM_HASH_MAP_H
+
+#include "ShmemDict.h"
+#include <cstdint>
+#include <string>
+#include <map>
+#include <stdexcept>
+
+/**
+ * @brief Open addressing hash table (SwissTable layout)
+ *
+ * The table is a single allocation: slotCount control bytes followed by slotCount inline entries.
+ * A control byte is CtrlEmpty, CtrlDeleted or the low 7 bits (H2) of the entry's hash, so a probe
+ * compares a whole group of GroupWidth slots against H2 at once and only touches entries that match.
+ * Int keys are stored inline in the entry, string keys are a Char primitive like ShmemDict's keys.
+ */
+class ShmemHashMap : public ShmemObj
+{
+    friend class ShmemAccessor;
+
+protected:
+    struct Entry
+    {
+        size_t hash;          // mixHash(key)
+        int keyType;          // Int or String
+        int intKey;           // Key value when keyType == Int
+        ptrdiff_t keyOffset;  // Char primitive when keyType == String, relative to the map
+        ptrdiff_t dataOffset; // Relative to the map
+    };
+
+    size_t slotCount;      // Power of 2, multiple of GroupWidth
+    size_t growthLeft;     // Number of empty slots that can be filled before a rehash
+    ptrdiff_t tableOffset; // Control bytes then entries, relative to the map
+
+    int8_t *ctrl();
+    const int8_t *ctrl() const;
+    Entry *entries();
+    const Entry *entries() const;
+
+    /**
+     * @brief hashIntOrString() passed through a 64-bit finalizer, std::hash<int> is the identity
+     * and would put H2 and the probe start in the same low bits
+     */
+    static size_t mixHash(const KeyType &key);
+
+    /**
+     * @brief Smallest table that holds n entries under the 7/8 load factor
+     */
+    static size_t slotCountFor(size_t n);
+
+    static size_t makeTable(size_t slotCount, ShmemHeap *heapPtr);
+
+    /**
+     * @brief Find the slot holding key
+     *
+     * @return slot index, or slotCount if the key is absent
+     * @note Does not allocate
+     */
+    size_t findSlot(size_t hash, const KeyType &key) const;
+
+    /**
+     * @brief First empty or deleted slot on hash's probe sequence
+     */
+    size_t findInsertSlot(size_t hash) const;
+
+    /**
+     * @brief First full slot at or after slot
+     *
+     * @return slot index, or slotCount if there is none
+     */
+    size_t nextFullSlot(size_t slot) const;
+
+    void rehash(size_t newSlotCount, ShmemHeap *heapPtr);
+
+    bool entryMatches(const Entry &entry, const KeyType &key) const;
+    KeyType entryKey(const Entry &entry) const;
+    std::string entryKeyToString(const Entry &entry) const;
+    pybind11::object entryKeyToPyObject(const Entry &entry) const;
+    ShmemObj *entryData(const Entry &entry) const;
+    void setEntryData(Entry &entry, ShmemObj *obj);
+
+    void insert(const KeyType &key, ShmemObj *data, ShmemHeap *heapPtr);
+
+public:
+    static constexpr size_t GroupWidth = 16;
+    static constexpr int8_t CtrlEmpty = -128;
+    static constexpr int8_t CtrlDeleted = -2;
+
+    /**
+     * @brief Empty constructor for ShmemHashMap
+     *
+     * @param heapPtr The heap pointer
+     * @param capacity Number of entries to make room for without rehashing
+     * @return Offset of the map from heap head
+     */
+    static size_t construct(ShmemHeap *heapPtr, size_t capacity = 0);
+
+    template <typename keyType, typename T>
+    static size_t construct(std::map<keyType, T> map, ShmemHeap *heapPtr);
+
+    static size_t construct(pybind11::dict pythonDict, ShmemHeap *heapPtr);
+    static size_t construct(pybind11::object pythonObj, ShmemHeap *heapPtr);
+
+    static void deconstruct(size_t offset, ShmemHeap *heapPtr);
+
+    // __len__
+    size_t len() const;
+
+    // __getitem__
+    ShmemObj *get(const KeyType &key) const;
+
+    // __setitem__ (only for assign)
+    template <typename T>
+    void set(const T &value, KeyType key, ShmemHeap *heapPtr);
+
+    // __delitem__
+    void del(const KeyType &key, ShmemHeap *heapPtr);
+
+    // __contains__
+    bool contains(const KeyType &key) const;
+
+    // __key__ (similar to __index__)
+    template <typename T>
+    KeyType key(const T &value) const;
+
+    // __str__
+    std::string toString(int indent = 0, int maxElements = -1) const;
+
+    // Dict interface
+
+    std::vector<KeyType> keys(bool *allInt = nullptr, bool *allStr = nullptr) const;
+
+    // Iterator Interface (slot order)
+    KeyType beginIdx() const;
+    KeyType endIdx() const;
+    KeyType nextIdx(KeyType index) const;
+
+    // Converters
+    template <typename T>
+    operator T() const;
+
+    operator pybind11::dict() const;
+    operator pybind11::object() const;
+
+    // Arithmetic Interface
+    template <typename T>
+    bool operator==(const T &val) const;
+};
+
+// Include the template implementation file
+#include "ShmemHashMap.tcc"
+
+#endif // SHMEM_HASH_MAP_H
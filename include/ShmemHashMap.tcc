@@ -0,0 +1,148 @@
+#ifndef SHMEM_HASH_MAP_TCC
+#define SHMEM_HASH_MAP_TCC
+
+#include "ShmemObj.h"
+#include "ShmemHashMap.h"
+
+template <typename keyType, typename T>
+size_t ShmemHashMap::construct(std::map<keyType, T> map, ShmemHeap *heapPtr)
+{
+    if constexpr (std::is_same_v<keyType, int> || std::is_same_v<keyType, std::variant<int, std::string>> || isString<keyType>())
+    {
+        size_t mapOffset = ShmemHashMap::construct(heapPtr, map.size());
+        ShmemHashMap *hashMap = reinterpret_cast<ShmemHashMap *>(ShmemObj::resolveOffset(mapOffset, heapPtr));
+        for (auto &[key, val] : map)
+        {
+            size_t newObjOffset = ShmemObj::construct(val, heapPtr);
+            ShmemObj *newObj = newObjOffset == NPtr ? nullptr : ShmemObj::resolveOffset(newObjOffset, heapPtr);
+            if constexpr (isString<keyType>())
+                hashMap->insert(std::string(key), newObj, heapPtr);
+            else
+                hashMap->insert(key, newObj, heapPtr);
+        }
+        return mapOffset;
+    }
+    else
+    {
+        throw std::runtime_error("Unsupported key type");
+    }
+}
+
+// __setitem__
+template <typename T>
+inline void ShmemHashMap::set(const T &value, KeyType key, ShmemHeap *heapPtr)
+{
+    size_t newObjOffset = ShmemObj::construct(value, heapPtr);
+    insert(key, newObjOffset == NPtr ? nullptr : ShmemObj::resolveOffset(newObjOffset, heapPtr), heapPtr);
+}
+
+// __key__
+template <typename T>
+KeyType ShmemHashMap::key(const T &value) const
+{
+    const int8_t *ctrlPtr = ctrl();
+    const Entry *entryPtr = entries();
+    for (size_t slot = 0; slot < slotCount; slot++)
+    {
+        if (ctrlPtr[slot] < 0)
+            continue;
+        const ShmemObj *data = entryData(entryPtr[slot]);
+        if (data != nullptr && data->operator==(value))
+            return entryKey(entryPtr[slot]);
+    }
+    throw IndexError("Value not found in hash map");
+}
+
+// Convertors
+template <typename T>
+ShmemHashMap::operator T() const
+{
+    if constexpr (isMap<T>::value)
+    {
+        using mapDataType = typename unwrapMapType<T>::type;
+        using keyDataType = typename unwrapMapType<T>::keyType;
+
+        T result;
+        const int8_t *ctrlPtr = ctrl();
+        const Entry *entryPtr = entries();
+        for (size_t slot = 0; slot < slotCount; slot++)
+        {
+            if (ctrlPtr[slot] < 0)
+                continue;
+            const Entry &entry = entryPtr[slot];
+            mapDataType data = entryData(entry)->operator mapDataType();
+            if constexpr (std::is_same_v<keyDataType, KeyType>)
+                result[entryKey(entry)] = data;
+            else if constexpr (std::is_convertible_v<keyDataType, int>)
+            {
+                if (entry.keyType != Int)
+                    throw std::runtime_error("ShmemHashMap: All keys must be int");
+                result[static_cast<keyDataType>(entry.intKey)] = data;
+            }
+            else if constexpr (std::is_same_v<keyDataType, std::string>)
+            {
+                if (entry.keyType != String)
+                    throw std::runtime_error("ShmemHashMap: All keys must be string");
+                result[std::get<std::string>(entryKey(entry))] = data;
+            }
+            else
+                throw std::runtime_error("ShmemHashMap: Unsupported key type");
+        }
+        return result;
+    }
+    else if constexpr (std::is_same_v<T, pybind11::dict> || std::is_same_v<T, pybind11::object>)
+    {
+        return this->operator pybind11::dict();
+    }
+    else
+    {
+        throw std::runtime_error("ShmemHashMap: Unsupported type conversion");
+    }
+}
+
+template <typename T>
+bool ShmemHashMap::operator==(const T &val) const
+{
+    if constexpr (isObjPtr<T>::value)
+    {
+        if (val->type != this->type)
+            return false;
+        const ShmemHashMap *another = reinterpret_cast<const ShmemHashMap *>(val);
+        if (this->size != another->size)
+            return false;
+
+        // Slot order depends on insertion history, so compare by lookup
+        const int8_t *ctrlPtr = ctrl();
+        const Entry *entryPtr = entries();
+        for (size_t slot = 0; slot < slotCount; slot++)
+        {
+            if (ctrlPtr[slot] < 0)
+                continue;
+            const Entry &entry = entryPtr[slot];
+            KeyType key = entryKey(entry);
+            size_t anotherSlot = another->findSlot(entry.hash, key);
+            if (anotherSlot == another->slotCount)
+                return false;
+            const ShmemObj *data = entryData(entry);
+            const ShmemObj *anotherData = another->entryData(another->entries()[anotherSlot]);
+            if (data == nullptr || anotherData == nullptr)
+            {
+                if (data != anotherData)
+                    return false;
+            }
+            else if (!data->operator==(anotherData))
+                return false;
+        }
+        return true;
+    }
+    else if constexpr (isMap<T>::value)
+    {
+        return this->operator T() == val;
+    }
+    else
+    {
+        throw std::runtime_error("Comparison of " + typeNames.at(this->type) + " with " + typeName<T>() + " is not allowed");
+    }
+}
+
+#endif // SHMEM_HASH_MAP_TCC
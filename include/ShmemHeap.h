@@ -6,6 +6,10 @@
 #include <atomic>
 #include <spdlog/spdlog.h>
 #include <limits>
+#include <cstdio>
+#include <utility>
+#include <vector>
+#include <functional>
 #include <unistd.h>
 
 #include "ShmemUtils.h"
@@ -21,17 +25,53 @@ static const size_t unitSize = sizeof(void *);
 class ShmemHeap : public ShmemBase
 {
 public:
-    // Minimum static size
-    const int minStaticSize = 4;
+    // Free blocks are kept in segregated bins. Bins [0, numExactBins) hold exactly one block size each
+    // (32, 40, ..., 280 bytes), the remaining bins are log-spaced ([2^k, 2^(k+1)) bytes)
+    static constexpr size_t numExactBins = 32;
+    static constexpr size_t numBins = 64;
+
+    // Running counters behind stats(), stored after the free bin heads
+    static constexpr size_t numStatCounters = 9;
+
+    // Small payloads of up to 16, 32 and 64 bytes can be carved from slab pages of their size class, see shmallocSlab()
+    // A class starts with pages of slabFirstPageSlots slots, every page it holds doubles the next one up to slabSlotsPerPage
+    static constexpr size_t numSlabClasses = 3;
+    static constexpr size_t slabSlotsPerPage = 16;
+    static constexpr size_t slabFirstPageSlots = 4;
+
+    // A segmented heap grows by appending shared memory segments behind the first one, see setSegmented()
+    static constexpr size_t maxSegments = 32;
+
+    // Snapshots that can be pinned at the same time, one slot each in the static space, see pinSnapshot()
+    static constexpr size_t maxSnapshots = 6;
+
+    // Minimum static size: 6 header slots + one head offset per free bin + the stat counters + one page list per slab class
+    // + the segment table (segment count, next serial, one entry per segment) + the change counter and its number of waiters
+    // + the commit sequence of transactions + the snapshot epoch, the retired objects and one slot per pinned snapshot
+    const int minStaticSize = 6 + static_cast<int>(numBins + numStatCounters + numSlabClasses + 2 + maxSegments + 2 + 1 + 2 + maxSnapshots);
 
     // Inner BlockHeader structure
     struct BlockHeader
     {
         /**
          * size of the block / Busy bit / Previous Allocated bit / Allocated bit
+         * The top bit is set while some process is parked on the busy bit (see parkedBit)
          */
         size_t size_BPA;
 
+        // Set by wait() before it parks on the header, tells the unlocker to issue a futex wake
+        // No block is ever 2^63 bytes, so the bit is free in the size field
+        static constexpr size_t parkedBit = 1UL << 63;
+
+        // Set on the header of a slab slot, its size field then holds the distance back to the slab page
+        static constexpr size_t slabBit = 1UL << 62;
+
+        // Bits [40, 62) count the payload writes published by unlockWrite(), readers pair them with the busy bit as a seqlock
+        // The count stays at the address when the block is freed and goes on in the next block allocated there
+        // The heap capacity stays below 2^40 bytes (see setHCap()), so the bits are free in the size field
+        static constexpr size_t seqShift = 40;
+        static constexpr size_t seqMask = ((1UL << (62 - seqShift)) - 1) << seqShift;
+
         /**
          * @brief Provide {size | B bit | P bit | A bit} as a size_t reference.
          * @return reference to the 8 bytes {size | B bit | P bit | A bit} at *(this)
@@ -97,6 +137,13 @@ public:
          */
         bool A() const;
 
+        /**
+         * @brief Is this the header of a slab slot rather than of a heap block
+         *
+         * @return true if the slab bit is set
+         */
+        bool S() const;
+
         /**
          * @brief Set the busy bit (default true)
          *
@@ -189,16 +236,136 @@ public:
         /**
          * @brief Wait until the busy bit is cleared
          *
+         * Spins briefly, then parks on a shared futex on the header word until the holder unlocks
+         *
          * @param timeout Maximum wait time in milliseconds (-1 means no timeout)
          * @return 0 if the busy bit is cleared, ETIMEDOUT if the timeout is reached
          */
         int wait(int timeout = -1) const;
+
+        /**
+         * @brief Atomically set the busy bit if it is clear
+         *
+         * @return true if this call set the busy bit, false if the block was already busy
+         */
+        bool tryLock();
+
+        /**
+         * @brief Set the busy bit, waiting until it is clear
+         *
+         * @param timeout Maximum wait time in milliseconds (-1 means no timeout)
+         * @return 0 once the busy bit is owned by the caller, ETIMEDOUT if the timeout is reached
+         */
+        int lock(int timeout = -1);
+
+        /**
+         * @brief Clear the busy bit set by tryLock() / lock() and wake parked waiters if there are any
+         */
+        void unlock();
+
+        /**
+         * @brief Like unlock(), after a write to the payload: bumps the write sequence in the same atomic step
+         */
+        void unlockWrite();
+
+        /**
+         * @brief Start an optimistic read of the payload, waiting while a writer holds the busy bit
+         *
+         * @return write sequence to hand to readRetry() once the payload is copied
+         * @note Readers never set anything, not even the parked bit: they spin, then yield, while the busy bit is set.
+         * A writer is never held up by them and its unlockWrite() never has a futex wake to issue for them
+         */
+        size_t readBegin() const;
+
+        /**
+         * @brief Check whether a write started or completed since readBegin()
+         *
+         * @param seq value returned by readBegin()
+         * @return true if the payload copied in between may be torn and the read must be repeated
+         */
+        bool readRetry(size_t seq) const;
+
+        /**
+         * @brief Write sequence of the payload, without waiting for the busy bit
+         *
+         * @return number of counted writes, wrapping at 2^22
+         */
+        size_t seq() const;
+
+        /**
+         * @brief Count a change without taking the busy bit, e.g. a write to a child of the container in the payload
+         */
+        void bumpSeq();
+
+        /**
+         * @brief Write a new header for a free block at this address, keeping the write sequence found there
+         *
+         * @param bits size and flag bits of the block
+         * @note The sequence outlives the block, so an object allocated here later continues it (see resetAllocated())
+         */
+        void reset(size_t bits);
+
+        /**
+         * @brief Write the header of a block being handed out, its write sequence moves on from the one found there
+         *
+         * @param bits size and flag bits of the block
+         * @note A version taken of the object freed at this address never matches the object allocated in its place,
+         * unless the payload of a block in between overwrote the header or the sequence wrapped
+         */
+        void resetAllocated(size_t bits);
+    };
+
+    /**
+     * @brief Snapshot of the heap counters, see stats()
+     */
+    struct Stats
+    {
+        size_t heapCapacity;     // bytes in the heap, block headers included
+        size_t allocatedBytes;   // bytes in allocated blocks, block headers and whole slab pages included
+        size_t freeBytes;        // bytes in free blocks
+        size_t freeBlocks;       // number of free blocks
+        size_t largestFreeBlock; // size of the largest free block, 0 if there is none
+        size_t allocCount;       // blocks handed out by shmalloc(), arena carves, slab slots and slab pages included
+        size_t freeCount;        // allocated blocks and slab slots given back by shfree() and shfreeRegion()
+        size_t reallocCount;     // shrealloc() calls on an existing block
+        size_t resizeCount;      // resize() and trim() calls that changed the segment
+        size_t busyContention;   // shfree() / shrealloc() calls that found the block busy and had to wait
+        size_t binsContention;   // bins lock acquisitions that found the lock held by someone else
+    };
+
+    // Operations recorded by the allocation trace, see startTrace()
+    enum TraceOp : uint32_t
+    {
+        TraceMalloc,
+        TraceRealloc,
+        TraceFree,
+        TraceResize,
+        TraceTrim,
+        TraceMallocSlab,
+        TraceMemalign,
+        TraceBeginArena,
+        TraceEndArena,
+        TraceFreeRegion
+    };
+
+    /**
+     * @brief One fixed-size record of the allocation trace, written in the native byte order
+     */
+    struct TraceRecord
+    {
+        uint64_t timestamp; // steady clock in ns when the call started, comparable between processes of one host
+        uint64_t size;      // requested payload size; heap size passed to resize(), -1 if unchanged; region size passed to beginArena() / shfreeRegion()
+        uint64_t offset;    // payload offset passed to shrealloc() / shfree(); alignment of TraceMemalign; static space size passed to resize(); region offset passed to shfreeRegion()
+        uint64_t result;    // payload offset returned; return code of shfree() / shfreeRegion(); bytes cut by trim(); region offset of beginArena(); bytes carved by endArena()
+        uint32_t op;        // TraceOp
+        uint32_t aux;       // alignedOffset of TraceMemalign; alignment of TraceRealloc
     };
 
     // Constructor
     ShmemHeap() : ShmemHeap("", DSCap, DHCap) {}
     ShmemHeap(const ShmemHeap &other) : ShmemHeap(other.getName(), (const_cast<ShmemHeap &>(other)).staticCapacity(), (const_cast<ShmemHeap &>(other)).heapCapacity()) {}
     ShmemHeap(const std::string &name, size_t staticSpaceSize = DSCap, size_t heapSize = DHCap);
+    ~ShmemHeap();
 
     /**
      * @brief Create a basic shared memory and setup the heap on it
@@ -207,6 +374,18 @@ public:
      */
     void create();
 
+    /**
+     * @brief Connect to an existing shared memory heap
+     * @note The resize epoch is not trusted until the first check, which remaps the segment once
+     */
+    void connect();
+
+    /**
+     * @brief Unlink the shared memory, the extra segments of a segmented heap included
+     * @note Only the owner unlinks, like ShmemBase::unlink()
+     */
+    void unlink();
+
     /**
      * @brief Resize the heap space
      *
@@ -219,9 +398,20 @@ public:
      *
      * @param staticSpaceSize required size of static space, padded to unitSize. -1 means not changed
      * @param heapSize required size of heap space, padded to page size. -1 means not changed
+     * @note The segment grows in place and keeps its name, only a larger static space moves the heap content.
+     * A segmented heap appends a segment instead and its static space cannot be resized
      */
     void resize(long staticSpaceSize, long heapSize);
 
+    /**
+     * @brief Give the trailing free space of the heap back to the OS by shrinking the segment
+     *
+     * @return number of bytes the heap capacity shrank by, 0 if the last block is allocated
+     * @note The heap keeps at least one page. Other processes follow the shrink through the resize epoch.
+     * A segmented heap with extra segments drops the trailing segments the last free block covers instead
+     */
+    size_t trim();
+
     /**
      * @brief Allocate a block in the heap
      * @param size size of the payload, will be padded to a multiple of unitSize
@@ -229,13 +419,52 @@ public:
      */
     size_t shmalloc(size_t size);
 
+    /**
+     * @brief Allocate several blocks with one pass over the free bins
+     * @param sizes payload sizes, each padded like shmalloc(). A size of 0 gets offset 0 and no block
+     * @param n number of requests
+     * @param outOffsets receives the payload offset of every request, in order
+     * @note The blocks are carved back to back from one free block, under one bins lock acquisition, and are
+     * freed one by one with shfree(). In arena mode the requests are carved from the arena one at a time
+     */
+    void shmallocBatch(const size_t *sizes, size_t n, size_t *outOffsets);
+
     /**
      * @brief Reallocate a block in the heap, keep content
      * @param offset offset of original block from the heap head
      * @param size new size of the payload, will be padded to a multiple of unitSize
+     * @param alignment alignment the block was allocated with by shmemalign(), 0 (or unitSize and less) for none.
+     * A moved payload keeps its address modulo alignment, so whatever alignedOffset was aligned stays aligned
      * @return offset of the reallocated block from the heap head
      */
-    size_t shrealloc(size_t offset, size_t size);
+    size_t shrealloc(size_t offset, size_t size, size_t alignment = 0);
+
+    /**
+     * @brief Allocate a small payload from a slab page of its size class
+     * @param size size of the payload
+     * @return offset of the allocated payload from the heap head
+     * @note Falls back to shmalloc() above the largest class, in arena mode, and for sizes whose slot would take more
+     * bytes than the block shmalloc() carves (e.g. 40 bytes in the 64-byte class). The slot is given back by shfree(),
+     * shrealloc() moves the payload to a regular block once it outgrows the slot
+     */
+    size_t shmallocSlab(size_t size);
+
+    /**
+     * @brief Payload bytes of a slot of the slab class
+     */
+    static constexpr size_t slabClassSize(size_t slabClass) { return 16UL << slabClass; }
+
+    /**
+     * @brief Allocate a block whose payload lands on an alignment boundary
+     * @param size size of the payload, will be padded to a multiple of unitSize
+     * @param alignment power of two up to the page size. Mappings are page aligned, so every process sees the same alignment
+     * @param alignedOffset bytes into the payload that must be aligned, a multiple of unitSize. E.g. the data behind an object header
+     * @return offset of the allocated payload from the heap head
+     * @note The block is freed like any other. shrealloc() only keeps the alignment when it is passed the same one,
+     * a plain shrealloc() may move the payload to any unitSize boundary. Growing the static space moves the heap by
+     * its growth and may break the alignment. Arena mode is bypassed
+     */
+    size_t shmemalign(size_t size, size_t alignment, size_t alignedOffset = 0);
 
     /**
      * @brief Free a block in the heap
@@ -255,6 +484,170 @@ public:
         return this->shfreeHelper(reinterpret_cast<Byte *>(ptr));
     }
 
+    // Arena mode
+
+    /**
+     * @brief Reserve one block of at least size bytes, every shmalloc() of this instance bump-allocates from it until endArena()
+     *
+     * @param size size of the region in bytes, must be positive
+     * @return offset of the region (its first block header) from the heap head
+     * @note Carved blocks are regular heap blocks, shfree() and shrealloc() work on them as usual.
+     * Once the region is exhausted shmalloc() falls back to the free bins, those blocks are not part of the region
+     */
+    size_t beginArena(size_t size);
+
+    /**
+     * @brief Leave arena mode and return the unused tail of the region to the heap
+     *
+     * @return size in bytes of the region actually carved, [beginArena(), beginArena() + endArena()) can be passed to shfreeRegion()
+     */
+    size_t endArena();
+
+    /**
+     * @brief Check if this instance is in arena mode
+     */
+    bool inArena() const;
+
+    // Transactions
+
+    // A write staged by a transaction, applied by commit()
+    using StagedWrite = std::function<void()>;
+
+    // Takes what a staged write is about to change, right before commit() applies it, and returns the write putting it back
+    using UndoImage = std::function<StagedWrite()>;
+
+    /**
+     * @brief Stage every accessor write through this instance until commit() or abort()
+     *
+     * @note Reads inside the transaction see the committed data, not the staged writes
+     */
+    void beginTransaction();
+
+    /**
+     * @brief Apply the staged writes as one unit: accessor reads never see some of them without the others
+     *
+     * All writes go in under a single acquisition of the commit sequence, watchers are woken once for the batch
+     * @note A write that fails rolls the commit back before the sequence is released: the undo images of the writes
+     * applied so far put back what they changed, in reverse order, and the error is rethrown. Readers see none of the writes
+     */
+    void commit();
+
+    /**
+     * @brief Drop the staged writes, nothing reaches the shared memory
+     */
+    void abort();
+
+    /**
+     * @brief Check if this instance stages its writes
+     */
+    bool inTransaction() const;
+
+    /**
+     * @brief Add a write to the open transaction, used by ShmemAccessor
+     *
+     * @param write the write
+     * @param undo takes the undo image of the write, a write without one cannot be rolled back
+     */
+    void stageWrite(StagedWrite write, UndoImage undo = nullptr);
+
+    /**
+     * @brief Start a read that must not overlap a commit, waiting while one is applied
+     *
+     * Spins briefly, then sleeps on the sequence until the commit ends. A committer that died while applying its commit
+     * does not hold readers forever: the sequence is released and the error is logged
+     * @return commit sequence to hand to readRetry() once the read is done
+     */
+    size_t readBegin();
+
+    /**
+     * @brief Check whether a commit started or completed since readBegin()
+     *
+     * @param seq value returned by readBegin()
+     * @return true if the read may have seen a half applied commit and must be repeated
+     */
+    bool readRetry(size_t seq);
+
+    /**
+     * @brief Apply a single write under the commit sequence, like a commit() of its own
+     *
+     * @param write the write, run at once if this instance is already committing
+     * @note Watchers are not woken, that is left to the caller
+     */
+    void commitWrite(const StagedWrite &write);
+
+    /**
+     * @brief Hold back the free of an object unlinked while this instance applies a commit(), until the commit ends
+     *
+     * A rollback may link the object again, see keepRetired()
+     * @param offset offset of the object from the heap head
+     * @param retire frees the object, run once the commit ends unless it was linked again
+     * @return false if this instance is not applying a commit, the caller frees the object itself
+     */
+    bool deferRetire(size_t offset, StagedWrite retire);
+
+    /**
+     * @brief Drop the held back free of an object that a rollback linked again
+     */
+    void keepRetired(size_t offset);
+
+    // Snapshots
+
+    /**
+     * @brief Pin a snapshot: copy on write objects (ShmemDict) keep the version of now readable until unpinSnapshot()
+     *
+     * Taken between two commits, a snapshot never holds part of a transaction
+     * @param entrance receives the entrance offset as of the snapshot
+     * @return epoch of the snapshot, every pinned snapshot has its own
+     * @note A process that exits without unpinning keeps the old versions alive, there are maxSnapshots slots
+     */
+    size_t pinSnapshot(size_t &entrance);
+
+    /**
+     * @brief Release a snapshot, ShmemObj::reclaim() frees what only it could still read
+     *
+     * @param epoch value returned by pinSnapshot()
+     */
+    void unpinSnapshot(size_t epoch);
+
+    /**
+     * @brief Epoch the next snapshot gets, writers stamp what they create with it
+     */
+    size_t snapshotEpoch();
+
+    /**
+     * @brief Newest pinned epoch, 0 if no snapshot is pinned
+     * @note Objects written in an epoch up to it may be read by a snapshot and must be copied on write
+     */
+    size_t newestSnapshot();
+
+    /**
+     * @brief Oldest pinned epoch, SIZE_MAX if no snapshot is pinned
+     */
+    size_t oldestSnapshot();
+
+    /**
+     * @brief Epochs of all pinned snapshots, in slot order
+     */
+    std::vector<size_t> pinnedSnapshots();
+
+    /**
+     * @brief Head of the objects retired while snapshots were pinned, see ShmemObj::retire()
+     *
+     * @return reference to the offset of the newest record, NPtr if there is none
+     */
+    std::atomic<size_t> &retiredObjects();
+
+    /**
+     * @brief Free every block in [offset, offset + size) at once and coalesce the range into a single free block
+     *
+     * @param offset offset of the first block header of the region from the heap head, as returned by beginArena()
+     * @param size size of the region in bytes, must end on a block boundary or inside a free last block
+     * @return 0 on success, -1 if the range does not tile whole blocks
+     * @warning Nothing in the region may be in use, the blocks are freed without taking their busy bits.
+     * Blocks of the region may have been freed one by one, except the first one
+     */
+    int shfreeRegion(size_t offset, size_t size);
+
     // Getters
 
     /**
@@ -271,6 +664,13 @@ public:
      */
     size_t getSCap() const;
 
+    /**
+     * @brief Check whether create() makes a segmented heap
+     *
+     * @return the value set by setSegmented()
+     */
+    bool getSegmented() const;
+
     // Safe Getters (check shm connection)
 
     /**
@@ -288,12 +688,77 @@ public:
     size_t &heapCapacity();
 
     /**
-     * @brief Get the offset(from the heap head) of the free block list, recorded in the third size_t(8 bytes) of the heap
+     * @brief Get the bitmap of non-empty free bins, recorded in the third size_t(8 bytes) of the heap
      *
-     * @return size_t reference to the offset of the free block list
-     * @note the offset can be calculated into a reference to a free block in the heap, thus can be used as the head of the free block list (double linked list)
+     * @return size_t reference to the bitmap, bit i is set if bin i holds at least one free block
      */
-    size_t &freeBlockListOffset();
+    size_t &freeBinBitmap();
+
+    /**
+     * @brief Get the resize epoch recorded in the sixth size_t(8 bytes) of the heap, bumped by every resize()
+     *
+     * @return current resize epoch
+     * @note Each instance caches the epoch it has mapped, a mismatch on entry to a public operation remaps the segment
+     */
+    size_t resizeEpoch();
+
+    /**
+     * @brief Read the running counters of the heap in O(1), without taking any lock
+     *
+     * @return snapshot of the counters
+     * @note The counters are read one by one while other processes keep working, so they may be
+     * mutually off by the operations in flight. They are exact once the heap is quiescent
+     */
+    Stats stats();
+
+    /**
+     * @brief Check whether the connected heap grows by appending segments, see setSegmented()
+     */
+    bool isSegmented();
+
+    /**
+     * @brief Number of shared memory segments the heap is made of, 1 for a heap that is not segmented
+     */
+    size_t numSegments();
+
+    /**
+     * @brief Locate a heap offset in the segments of the heap
+     *
+     * @param offset offset from the heap head
+     * @return (segment, offset from the start of the segment's part of the heap), segment 0 starts at the heap head
+     * @note Offsets stay linear for the containers, every process maps the segments back to back
+     */
+    std::pair<size_t, size_t> segmentOf(size_t offset);
+
+    /**
+     * @brief Number of changes announced by notifyChange() since the heap was created
+     */
+    size_t changeCount();
+
+    /**
+     * @brief Announce a change of the data on the heap, wakes every waitChange()
+     *
+     * @note Only issues a futex wake while some process is waiting
+     */
+    void notifyChange();
+
+    /**
+     * @brief Block on the shared change counter until changeCount() moves away from since
+     *
+     * @param since a value returned by changeCount()
+     * @param timeout in milliseconds, -1 to wait without a timeout
+     * @return the current changeCount(), equal to since on timeout
+     */
+    size_t waitChange(size_t since, int timeout = -1);
+
+    /**
+     * @brief Get the offset(from the heap head) of the first block in a free bin, recorded in the (7 + bin)th size_t of the heap
+     *
+     * @param bin index of the bin, see binIndex()
+     * @return size_t reference to the offset of the bin head, NPtr if the bin is empty
+     * @note the offset can be calculated into a reference to a free block in the heap, thus can be used as the head of the bin (double linked list)
+     */
+    size_t &freeBinOffset(size_t bin);
 
     /**
      * @brief Get the offset(from the heap head) of the entrance, recorded in the fourth size_t(8 bytes) of the heap
@@ -332,18 +797,19 @@ public:
     Byte *heapTail();
 
     /**
-     * @brief Get the head ptr of the free block list. Check connection before using
+     * @brief Get the head ptr of a free bin. Check connection before using
      *
-     * @return this->heapHead + freeBlockListOffset
+     * @param bin index of the bin, see binIndex()
+     * @return this->heapHead + freeBinOffset(bin), nullptr if the bin is empty
      */
-    BlockHeader *freeBlockList();
+    BlockHeader *freeBin(size_t bin);
 
     // Setters
 
     /**
      * @brief Repurpose the heap capacity
      *
-     * @param size purposed heap capacity
+     * @param size purposed heap capacity, below 2^40 bytes
      */
     void setHCap(size_t size);
 
@@ -354,7 +820,94 @@ public:
      */
     void setSCap(size_t size);
 
+    /**
+     * @brief Let the heap grow by appending shared memory segments (<name>_seg<serial>) instead of resizing its first one
+     *
+     * @param segmented true for a segmented heap, only used by create()
+     * @note Existing pages are never remapped: every process maps a new segment right behind the heap tail, in the
+     * address range reserved behind the first segment, and trim() unlinks whole trailing segments.
+     * The static space cannot be resized and the heap holds at most maxSegments segments
+     */
+    void setSegmented(bool segmented);
+
+    // Growth policy, applied when shmalloc() finds no free block large enough
+
+    /**
+     * @brief Set the factor the heap capacity is multiplied by on an allocation miss
+     *
+     * @param factor growth factor, must be >= 1.0. 1.0 disables geometric growth
+     */
+    void setGrowthFactor(double factor);
+
+    /**
+     * @brief Set the minimum number of bytes added to the heap on an allocation miss
+     *
+     * @param size minimum grow size, padded to page size. The heap always grows by at least the missed block
+     */
+    void setMinGrowSize(size_t size);
+
+    /**
+     * @brief Set the maximum heap capacity growth may reach
+     *
+     * @param size maximum heap capacity, padded to page size. shmalloc() throws once a miss cannot be served below it
+     */
+    void setMaxHCap(size_t size);
+
+    double getGrowthFactor() const;
+    size_t getMinGrowSize() const;
+    size_t getMaxHCap() const;
+
+    /**
+     * @brief Set the size from which a free block gives the pages inside it back to the OS
+     *
+     * @param size threshold in bytes of the coalesced free block, SIZE_MAX disables the release
+     * @note The pages holding the header, the free list links and the footer stay resident
+     */
+    void setReleaseThreshold(size_t size);
+    size_t getReleaseThreshold() const;
+
+    /**
+     * @brief Set the boundary the data of primitive arrays is aligned to, e.g. 64 for cache lines or 32 for AVX2 loads
+     *
+     * @param alignment power of two up to the page size, unitSize or less keeps the default 8-byte alignment
+     * @note Per process. Only arrays with at least alignment bytes of data are aligned, scalars always use the slab pages
+     */
+    void setArrayAlignment(size_t alignment);
+    size_t getArrayAlignment() const;
+
+    /**
+     * @brief Append a TraceRecord to a file for every allocator call made by this process from now on
+     *
+     * @param path file the records are appended to, created if it does not exist
+     * @note Per process. Calls made inside another call (e.g. the shmalloc() behind a moving shrealloc(), or a resize()
+     * done by the growth policy) are not recorded, replaying the outer call reproduces them. Calls that throw are not recorded
+     */
+    void startTrace(const std::string &path);
+    /**
+     * @brief Flush and close the trace file, no-op if no trace is being recorded
+     * @note Must not race with allocator calls of other threads on this object
+     */
+    void stopTrace();
+    bool isTracing() const;
+
     // Utility Functions
+
+    /**
+     * @brief Map a block size to the index of the free bin it belongs to
+     *
+     * @param blockSize size of the whole block (including header)
+     * @return index of the bin in [0, numBins)
+     */
+    static size_t binIndex(size_t blockSize);
+
+    /**
+     * @brief Usable payload bytes behind the header of a block or of a slab slot
+     *
+     * @param header header in front of the payload
+     * @return payload capacity in bytes
+     */
+    static size_t payloadCapacity(const BlockHeader *header);
+
     std::shared_ptr<spdlog::logger> &getLogger();
     const std::shared_ptr<spdlog::logger> &getLogger() const;
 
@@ -376,26 +929,284 @@ public:
      * @note e.g. "256A, 128E, 64A, 32E, 16A, 8E, 4A, 2E, 1A" E-empty, A-allocated
      */
     std::string briefLayoutStr();
+    /**
+     * @brief Check the heap invariants: block sizes tile the heap, P bits match the previous block,
+     * free blocks have footers and are never adjacent, the free bins hold exactly the free blocks
+     * and the free space counters of stats() match them
+     *
+     * @return true if the heap is consistent, otherwise logs the first violation and returns false
+     * @note Holds the bins lock while walking the heap
+     */
+    bool verifyHeap();
 
     // TODO: Untested functions
     void borrow(const ShmemHeap &heap);
     void steal(ShmemHeap &&heap);
 
 protected:
+    /**
+     * @brief Check the connection and follow resizes made by other processes
+     *
+     * @note Hides ShmemBase::checkConnection(). The hot path is one relaxed load of the resize epoch,
+     * the segment is only remapped when it differs from the epoch this instance has mapped
+     */
+    void checkConnection();
+
     // Helpers
     int shfreeHelper(Byte *ptr);
 
+    // Commit sequence word: the sequence below commitParkedBit (odd while a commit is applied), the parked bit, and the pid
+    // of the committer from commitOwnerShift up while the sequence is odd
+    static constexpr size_t commitOwnerShift = 40;
+    static constexpr size_t commitParkedBit = 1UL << 39;
+    static constexpr size_t commitSeqMask = commitParkedBit - 1;
+
+    // Take the commit sequence (odd while held) and return its even value, unlockCommitSeq() hands that value back
+    size_t lockCommitSeq();
+    void unlockCommitSeq(size_t seq);
+
+    // Release the commit sequence taken for commit() or commitWrite(), then run the frees held back meanwhile
+    void endCommit(size_t seq);
+
+    /**
+     * @brief Release the commit sequence held by a committer that died
+     *
+     * @param current the odd sequence word as last loaded
+     * @return true if the owner in current is dead and the sequence moved on (by this process or another one)
+     */
+    bool recoverCommitSeq(size_t current);
+
+    // The page list word of a slab class counts the pages it holds above this bit, offsets stay below 2^40 (see setHCap())
+    static constexpr size_t slabGrowthShift = 40;
+
+    // Slab page metadata, at the start of the payload of the heap block holding the page
+    struct SlabPage
+    {
+        size_t slotSize;   // bytes per slot, its header included
+        size_t slotCount;  // slots in the page, at most slabSlotsPerPage
+        size_t freeMap;    // bit i is set while slot i is free
+        size_t prevOffset; // neighbours in the list of the class's pages with a free slot, NPtr at the ends
+        size_t nextOffset;
+    };
+
+    /**
+     * @brief Map a payload size to the smallest slab class that holds it
+     *
+     * @return index of the class, numSlabClasses if the payload is too large for any
+     */
+    static size_t slabClass(size_t size);
+
+    /**
+     * @brief Give a slab slot back to its page, the page goes back to the heap once all its slots are free
+     *
+     * @param header header of the slot
+     * @return 0 on success, -1 if the slot is not allocated
+     */
+    int slabFree(BlockHeader *header);
+
+    /**
+     * @brief Check that a header with the slab bit points back to a slot of a live slab page
+     *
+     * @param header header of the slot
+     * @return true if the page is an allocated block of a slab class and the header starts one of its slots
+     */
+    bool verifySlabSlot(BlockHeader *header);
+
+    // Slab page list manipulators, the caller must hold the bins lock
+    void linkSlabPage(size_t slabClass, SlabPage *page);
+    void unlinkSlabPage(size_t slabClass, SlabPage *page);
+
+    // First page with a free slot of the class, NPtr if there is none. The caller must hold the bins lock
+    size_t slabListHead(size_t slabClass);
+    void setSlabListHead(size_t slabClass, size_t pageOffset);
+
+    // Slots of the next page the class opens. countSlabPage() counts a page in when it is opened and out when it goes back to the heap
+    size_t nextSlabPageSlots(size_t slabClass);
+    void countSlabPage(size_t slabClass, bool opened);
+
+    /**
+     * @brief Carve a block from the front of the arena tail
+     *
+     * @param blockSize size of the whole block (including header)
+     * @return offset of the payload from the heap head, NPtr if the tail cannot hold the block
+     */
+    size_t arenaAllocate(size_t blockSize);
+
+    /**
+     * @brief Allocate the block a moving shrealloc() copies the payload at offset into
+     *
+     * @param offset payload offset of the block being moved
+     * @param size new size of the payload
+     * @param alignment alignment passed to shrealloc(), the new payload keeps the old address modulo alignment
+     * @return offset of the new payload from the heap head
+     */
+    size_t moveAllocate(size_t offset, size_t size, size_t alignment);
+
+    /**
+     * @brief Grow the heap after an allocation miss, following the growth policy
+     *
+     * @param blockSize size of the block (including header) that did not fit
+     * @param seenCapacity heap capacity observed at the miss, the heap is not grown again if another process already did
+     */
+    void grow(size_t blockSize, size_t seenCapacity);
+
+    /**
+     * @brief Release the pages of a free block that a free made reclaimable, if the block reaches the release threshold
+     *
+     * @param block the free block after coalescing, must be held under the bins lock
+     * @param freedBegin start of the range whose pages may still be resident
+     * @param freedEnd end of the range whose pages may still be resident
+     * @note Only pages in or next to the range are released, a neighbour above the threshold was released when it was freed
+     */
+    void releaseFreePages(BlockHeader *block, Byte *freedBegin, Byte *freedEnd);
+
+    // Segment table helpers. An entry holds the serial naming the segment in its top bits and the heap offset it ends at
+    static constexpr size_t segmentSerialShift = 48;
+    static size_t segmentEnd(size_t entry) { return entry & ((1UL << segmentSerialShift) - 1); }
+    static size_t segmentSerial(size_t entry) { return entry >> segmentSerialShift; }
+    std::string segmentName(size_t serial) const;
+
+    /**
+     * @brief Create a segment of size bytes and map it behind the heap tail, the heap capacity is left to the caller
+     * @note The caller must hold the bins lock
+     */
+    void appendSegment(size_t size);
+
+    /**
+     * @brief Drop the trailing segments covered by the last free block
+     * @return number of bytes the heap capacity shrank by
+     * @note The caller must hold the bins lock
+     */
+    size_t trimSegments(BlockHeader *lastBlock);
+
+    /**
+     * @brief Bring the segments mapped by this process in line with the segment table
+     */
+    void mapSegments();
+
+    /**
+     * @brief Unlink the extra segments, without touching the mapping
+     */
+    void unlinkSegments();
+
+    /**
+     * @brief Find the block that ends at the heap tail. The caller must hold the bins lock
+     */
+    BlockHeader *lastBlock_unsafe();
+
     // Utility functions
     bool verifyPayloadPtr(Byte *ptr);
 
-    // Free list pointer manipulators
-    void insertFreeBlock(BlockHeader *block, BlockHeader *prevBlock = nullptr);
+    /**
+     * @brief Find a free block that can hold blockSize bytes. Best fit within the bin blockSize maps to,
+     * otherwise the head of the next non-empty bin
+     *
+     * @param blockSize size of the whole block (including header)
+     * @return pointer to a free block, nullptr if no block is large enough
+     */
+    BlockHeader *findFreeBlock(size_t blockSize);
+
+    // Free bin pointer manipulators, the block size must not change while the block is in a bin
+    // The caller must hold the bins lock
+    // They also keep the free bytes, free block count and largest free block counters
+    void insertFreeBlock(BlockHeader *block);
     void removeFreeBlock(BlockHeader *block);
 
+    // Counters behind stats(), stored in this order after the free bin heads
+    enum StatCounter
+    {
+        StatFreeBytes,
+        StatFreeBlocks,
+        StatLargestFree,
+        StatAllocCount,
+        StatFreeCount,
+        StatReallocCount,
+        StatResizeCount,
+        StatBusyContention,
+        StatBinsContention
+    };
+
+    /**
+     * @brief Take the heap-wide bins lock (spins on a CAS of the owner pid into the lock word)
+     * @note Serializes every change to the free bins and to block boundaries between processes. The bins are not
+     * lock-free: a waiter takes the lock over from an owner that has died (see ShmemUtils::processDead()), but the
+     * bins it was changing are left as they were
+     */
+    void lockBins();
+    void unlockBins();
+
+    /**
+     * @brief Holds the bins lock for the lifetime of the object
+     */
+    class BinsLockGuard
+    {
+    public:
+        explicit BinsLockGuard(ShmemHeap *heap) : heap(heap) { heap->lockBins(); }
+        ~BinsLockGuard() { heap->unlockBins(); }
+        BinsLockGuard(const BinsLockGuard &) = delete;
+        BinsLockGuard &operator=(const BinsLockGuard &) = delete;
+
+    private:
+        ShmemHeap *heap;
+    };
+
+    /**
+     * @brief Records one allocator call in the trace, unless it runs inside another recorded call of this thread
+     * @note Only touches the nesting depth while a trace is being recorded. done() passes the result through
+     */
+    class TraceScope
+    {
+    public:
+        TraceScope(ShmemHeap *heap, TraceOp op, size_t size, size_t offset = 0, size_t aux = 0);
+        ~TraceScope()
+        {
+            if (this->active)
+                traceDepth--;
+        }
+        TraceScope(const TraceScope &) = delete;
+        TraceScope &operator=(const TraceScope &) = delete;
+
+        template <typename T>
+        T done(T result)
+        {
+            if (this->outermost)
+            {
+                this->record.result = static_cast<uint64_t>(result);
+                this->heap->writeTrace(this->record);
+            }
+            return result;
+        }
+        // One record per non-empty request of a batch, sharing the timestamp of the call
+        void doneBatch(const size_t *sizes, const size_t *offsets, size_t n);
+
+    private:
+        ShmemHeap *heap;
+        TraceRecord record;
+        bool active;
+        bool outermost;
+    };
+    static thread_local int traceDepth;
+
+    void writeTrace(const TraceRecord &record);
+
     // Fast arithmetic, without connection check
     size_t &staticCapacity_unsafe();
     size_t &heapCapacity_unsafe();
-    size_t &freeBlockListOffset_unsafe();
+    size_t &freeBinBitmap_unsafe();
+    std::atomic<size_t> &binsLock_unsafe(); // 0 if free, otherwise pid of the owner
+    std::atomic<size_t> &resizeEpoch_unsafe();
+    size_t &freeBinOffset_unsafe(size_t bin);
+    std::atomic<size_t> &statCounter_unsafe(StatCounter counter);
+    size_t &slabPages_unsafe(size_t slabClass); // slabListHead() in the low bits, pages held by the class from slabGrowthShift up
+    size_t &segmentCount_unsafe();               // 0 if the heap is not segmented, otherwise the number of segments
+    size_t &segmentNextSerial_unsafe();          // serial of the next segment created
+    size_t &segmentEntry_unsafe(size_t segment); // see segmentEnd() and segmentSerial()
+    std::atomic<size_t> &changeCounter_unsafe();  // bumped by notifyChange(), its low half is the futex word of waitChange()
+    std::atomic<size_t> &changeWaiters_unsafe();  // processes in waitChange(), notifyChange() skips the wake while it is 0
+    std::atomic<size_t> &commitSeq_unsafe();      // odd while a commit() is applied, doubles as the lock between committers (see commitOwnerShift)
+    std::atomic<size_t> &snapshotEpoch_unsafe();  // next epoch handed out by pinSnapshot(), starts at 1
+    std::atomic<size_t> &retiredObjects_unsafe(); // see retiredObjects()
+    std::atomic<size_t> &snapshotPin_unsafe(size_t slot); // pinned epoch, 0 if the slot is free
     size_t &entranceOffset_unsafe();
 
     /**
@@ -427,11 +1238,11 @@ protected:
     Byte *heapTail_unsafe();
 
     /**
-     * @brief Get the head ptr of the free block list
+     * @brief Get the head ptr of a free bin
      *
-     * @return this->heapHead + freeBlockListOffset
+     * @return this->heapHead + freeBinOffset(bin), nullptr if the bin is empty
      */
-    BlockHeader *freeBlockList_unsafe();
+    BlockHeader *freeBin_unsafe(size_t bin);
 
 private:
     // preset capacity
@@ -456,6 +1267,45 @@ private:
      */
     size_t HCap = 0;
 
+    // Purposed segmentation, only used to initially create a shared memory heap
+    bool segmented = false;
+
+    // Growth policy, per process and not stored in the shared memory
+    double growthFactor = 2.0;
+    size_t minGrowSize = DHCap;
+    size_t maxHCap = SIZE_MAX;
+
+    // Coalesced free blocks from this size on give their pages back to the OS
+    size_t releaseThreshold = 1UL << 20;
+
+    // Alignment of primitive array data, per process and not stored in the shared memory
+    size_t arrayAlignment = unitSize;
+
+    // Allocation trace of this process, shared by the copies of this object. nullptr while not tracing
+    std::shared_ptr<FILE> traceFile;
+
+    // Arena mode, offsets of the first block header and of the unused tail block, NPtr outside arena mode
+    size_t arenaBegin = NPtr;
+    size_t arenaTail = NPtr;
+
+    // Open transaction of this instance, true from beginTransaction() to commit() or abort()
+    bool stagingWrites = false;
+    std::vector<std::pair<StagedWrite, UndoImage>> stagedWrites;
+
+    // Set while commit() applies the staged writes, notifyChange() then leaves the wake to the end of the commit
+    bool committing = false;
+
+    // Set while commit() applies or rolls back the staged writes, deferRetire() then holds the frees in commitRetired
+    // with the offsets they free, until the commit ends
+    bool deferringRetires = false;
+    std::vector<std::pair<size_t, StagedWrite>> commitRetired;
+
+    // Resize epoch the current mapping corresponds to, SIZE_MAX forces a remap on the next check
+    size_t epoch = SIZE_MAX;
+
+    // Segment table entries as this process mapped them, the first segment included. Empty if the heap is not segmented
+    std::vector<size_t> mappedSegments;
+
     // Logger
     std::shared_ptr<spdlog::logger> logger;
 };
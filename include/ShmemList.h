@@ -30,6 +30,16 @@ protected:
     static size_t makeSpace(size_t listCapacity, ShmemHeap *heapPtr);
     static size_t makeListSpace(size_t listCapacity, ShmemHeap *heapPtr);
 
+    /**
+     * @brief Set up a list object and its list space allocated by the caller
+     *
+     * @param offset payload offset of the list object
+     * @param listSpaceOffset payload offset of the list space, at least max(listCapacity, 1) pointers
+     * @return offset of the list object
+     */
+    static size_t initSpace(size_t offset, size_t listSpaceOffset, size_t listCapacity, ShmemHeap *heapPtr);
+    static void initListSpace(size_t listSpaceOffset, ShmemHeap *heapPtr);
+
     /**
      * @brief Capacity of the list
      *
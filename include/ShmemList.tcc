@@ -46,6 +46,32 @@ size_t ShmemList::construct(std::vector<T> vec, ShmemHeap *heapPtr)
         throw std::runtime_error("Not a good idea to construct a list for an array of primitives");
     }
 
+    if constexpr (ShmemPrimitive_::hasKnownSize<T>())
+    {
+        // Aligned arrays need shmemalign(), they are appended one by one below
+        if (heapPtr->getArrayAlignment() <= unitSize)
+        {
+            // The list object, its list space and every element in one pass over the free bins
+            std::vector<size_t> sizes(vec.size() + 2), offsets(vec.size() + 2);
+            sizes[0] = sizeof(ShmemList);
+            sizes[1] = std::max(vec.capacity(), static_cast<size_t>(1)) * sizeof(ptrdiff_t);
+            for (size_t i = 0; i < vec.size(); i++)
+                sizes[i + 2] = ShmemPrimitive_::payloadSize(vec[i]);
+            heapPtr->shmallocBatch(sizes.data(), sizes.size(), offsets.data());
+
+            size_t listOffset = ShmemList::initSpace(offsets[0], offsets[1], vec.capacity(), heapPtr);
+            ShmemList *list = reinterpret_cast<ShmemList *>(ShmemObj::resolveOffset(listOffset, heapPtr));
+            ptrdiff_t *basePtr = list->relativeOffsetPtr();
+            for (size_t i = 0; i < vec.size(); i++)
+            {
+                ShmemPrimitive_::constructAt(offsets[i + 2], vec[i], heapPtr);
+                basePtr[i] = offsets[i + 2] - listOffset;
+            }
+            list->listSize = static_cast<uint>(vec.size());
+            return listOffset;
+        }
+    }
+
     size_t listOffset = ShmemList::makeSpace(vec.capacity(), heapPtr);
     ShmemList *list = reinterpret_cast<ShmemList *>(ShmemObj::resolveOffset(listOffset, heapPtr));
     for (int i = 0; i < static_cast<int>(vec.size()); i++)
@@ -72,14 +98,14 @@ void ShmemList::set(const T &val, int index, ShmemHeap *heapPtr)
     if (offset != NPtr)
     {
         ShmemObj *victim = const_cast<ShmemObj *>(reinterpret_cast<const ShmemObj *>(reinterpret_cast<const Byte *>(this) + offset));
-        ShmemObj::deconstruct(reinterpret_cast<Byte *>(victim) - heapPtr->heapHead(), heapPtr);
+        ShmemObj::retire(reinterpret_cast<Byte *>(victim) - heapPtr->heapHead(), heapPtr);
     }
 
     size_t newObjOffset = ShmemObj::construct(val, heapPtr);
     if (newObjOffset == NPtr)
         basePtr[resolvedIndex] = NPtr;
     else
-        basePtr[resolvedIndex] = (heapPtr->heapHead() + ShmemObj::construct(val, heapPtr)) - reinterpret_cast<Byte *>(this);
+        basePtr[resolvedIndex] = (heapPtr->heapHead() + newObjOffset) - reinterpret_cast<Byte *>(this);
 }
 
 // del() implemented in ShmemList.cpp
@@ -16,6 +16,8 @@ template <typename T>
 class ShmemPrimitive;
 class ShmemList;
 class ShmemDict;
+class ShmemHashMap;
+class ShmemQueue;
 class ShmemAccessor;
 
 class IndexError : public std::runtime_error
@@ -60,8 +62,39 @@ protected:
     void release();
     ShmemHeap::BlockHeader *getHeader() const;
 
+    // Seqlock on the block header: writers hold the busy bit and bump the write sequence on release,
+    // readers copy the payload without locking and repeat the copy if a write overlapped
+    void beginWrite();
+    void endWrite();
+    size_t beginRead() const;
+    bool retryRead(size_t seq) const;
+
+    // Holds the busy bit for a write to the payload, see beginWrite()
+    class WriteGuard
+    {
+    public:
+        explicit WriteGuard(ShmemObj *obj) : obj(obj) { obj->beginWrite(); }
+        ~WriteGuard() { obj->endWrite(); }
+        WriteGuard(const WriteGuard &) = delete;
+        WriteGuard &operator=(const WriteGuard &) = delete;
+
+    private:
+        ShmemObj *obj;
+    };
+
     static ShmemObj *resolveOffset(size_t offset, ShmemHeap *heapPtr);
 
+    // Frees an object no longer reachable from the live data. While snapshots are pinned the free is deferred
+    // to reclaim(), as a snapshot may still read it. deep: deconstruct the object, otherwise only free its block.
+    // Inside a commit the free waits for its end, a rollback may link the object again (see ShmemHeap::deferRetire())
+    static void retire(size_t offset, ShmemHeap *heapPtr, bool deep = true);
+
+    // An object already in the heap, construct() links it as it is instead of building a new one
+    struct Linked
+    {
+        size_t offset;
+    };
+
 public:
     int type;
     int size;
@@ -77,6 +110,11 @@ public:
 
     static void deconstruct(size_t offset, ShmemHeap *heapPtr);
 
+    /**
+     * @brief Free the retired objects that no pinned snapshot can read anymore, see ShmemHeap::unpinSnapshot()
+     */
+    static void reclaim(ShmemHeap *heapPtr);
+
     // __str__
     std::string toString(int indent = 0, int maxElements = -1) const;
 
@@ -108,11 +146,15 @@ struct isObjPtr
 // #include "ShmemPrimitive.h"
 // #include "ShmemDict.h"
 // #include "ShmemList.h"
+// #include "ShmemHashMap.h"
+// #include "ShmemQueue.h"
 
 // Include the template implementation file
 #include "ShmemObj.tcc"
 #include "ShmemPrimitive.tcc"
 #include "ShmemList.tcc"
 #include "ShmemDict.tcc"
+#include "ShmemHashMap.tcc"
+#include "ShmemQueue.tcc"
 
 #endif // SHMEM_OBJ_H
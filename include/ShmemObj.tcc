@@ -5,6 +5,8 @@
 #include "ShmemPrimitive.h"
 #include "ShmemDict.h"
 #include "ShmemList.h"
+#include "ShmemHashMap.h"
+#include "ShmemQueue.h"
 
 // template part
 template <typename T>
@@ -18,7 +20,11 @@ size_t ShmemObj::construct(const T &value, ShmemHeap *heapPtr)
         }
     }
 
-    if constexpr (isPrimitive<T>())
+    if constexpr (std::is_same_v<T, Linked>)
+    {
+        return value.offset;
+    }
+    else if constexpr (isPrimitive<T>())
     {
         return ShmemPrimitive_::construct(value, heapPtr);
     }
@@ -159,6 +165,32 @@ size_t ShmemObj::construct(const T &value, ShmemHeap *heapPtr)
                 return ShmemDict::construct(pybind11::cast<pybind11::dict>(initialVal), heapPtr);
             }
         }
+        else if (value.typeId == HashMap)
+        {
+            if (pybind11::isinstance<pybind11::none>(initialVal))
+                return ShmemHashMap::construct(heapPtr);
+            else
+            {
+                if (!pybind11::isinstance<pybind11::dict>(initialVal))
+                {
+                    throw std::runtime_error("Initializer's value and type mismatch");
+                }
+                return ShmemHashMap::construct(pybind11::cast<pybind11::dict>(initialVal), heapPtr);
+            }
+        }
+        else if (value.typeId == Queue)
+        {
+            if (pybind11::isinstance<pybind11::none>(initialVal))
+                return ShmemQueue::construct(heapPtr);
+            else
+            {
+                if (!pybind11::isinstance<pybind11::dict>(initialVal))
+                {
+                    throw std::runtime_error("Initializer's value and type mismatch");
+                }
+                return ShmemQueue::construct(pybind11::cast<pybind11::dict>(initialVal), heapPtr);
+            }
+        }
 
         throw std::runtime_error("Unrecognized ShmemObjInitializer typeId " + std::to_string(value.typeId));
     }
@@ -184,6 +216,10 @@ ShmemObj::operator T() const
     {
         return reinterpret_cast<const ShmemDict *>(this)->operator T();
     }
+    else if (this->type == HashMap)
+    {
+        return reinterpret_cast<const ShmemHashMap *>(this)->operator T();
+    }
     else
     {
         throw ConversionError("Cannot convert " + typeNames.at(this->type) + "[" + std::to_string(this->size) + "]" + " to " + typeName<T>());
@@ -207,6 +243,8 @@ bool ShmemObj::operator==(const T &val) const
             return reinterpret_cast<const ShmemList *>(this)->operator==(val);
         else if (this->type == Dict && val->type == Dict)
             return reinterpret_cast<const ShmemDict *>(this)->operator==(val);
+        else if (this->type == HashMap && val->type == HashMap)
+            return reinterpret_cast<const ShmemHashMap *>(this)->operator==(val);
         else
             throw std::runtime_error("Unsupported type comparison: this->type = " + std::to_string(this->type) + "; val->type = " + std::to_string(val->type));
     }
@@ -224,6 +262,8 @@ bool ShmemObj::operator==(const T &val) const
     }
     else if constexpr (isMap<T>::value)
     {
+        if (this->type == HashMap)
+            return reinterpret_cast<const ShmemHashMap *>(this)->operator==(val);
         return reinterpret_cast<const ShmemDict *>(this)->operator==(val);
     }
     else
@@ -236,7 +276,7 @@ bool ShmemObj::operator==(const T &val) const
 
 inline size_t ShmemObj::capacity() const
 {
-    return this->getHeader()->size() - sizeof(ShmemHeap::BlockHeader);
+    return ShmemHeap::payloadCapacity(this->getHeader());
 }
 
 inline bool ShmemObj::isBusy() const
@@ -256,13 +296,34 @@ inline int ShmemObj::wait(int timeout) const
 
 inline void ShmemObj::acquire(int timeout)
 {
-    this->wait(timeout);
-    this->setBusy(true);
+    this->getHeader()->lock(timeout);
 }
 
 inline void ShmemObj::release()
 {
-    this->setBusy(false);
+    this->getHeader()->unlock();
+}
+
+inline void ShmemObj::beginWrite()
+{
+    this->getHeader()->lock();
+    // The busy bit must be visible before any payload store, a reader that sees a store then sees the bit
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+inline void ShmemObj::endWrite()
+{
+    this->getHeader()->unlockWrite();
+}
+
+inline size_t ShmemObj::beginRead() const
+{
+    return this->getHeader()->readBegin();
+}
+
+inline bool ShmemObj::retryRead(size_t seq) const
+{
+    return this->getHeader()->readRetry(seq);
 }
 
 inline ShmemHeap::BlockHeader *ShmemObj::getHeader() const
@@ -13,11 +13,29 @@
 class ShmemPrimitive_ : public ShmemObj
 {
     friend class ShmemAccessor;
+    friend class ShmemDictNode;
+    friend class ShmemHashMap;
+    friend class ShmemList;
+    friend class ShmemDict;
 
 protected:
     template <typename T>
     static size_t makeSpace(size_t size, ShmemHeap *heapPtr);
 
+    // Strings and arrays of primitives have a payload size known before construction,
+    // containers allocate them together with ShmemHeap::shmallocBatch() and build them with constructAt()
+    template <typename T>
+    static constexpr bool hasKnownSize()
+    {
+        return std::is_same_v<T, std::string> || (isPrimitive<T>() && isVector<T>::value);
+    }
+    template <typename T>
+    static size_t payloadSize(const T &val);
+    template <typename T>
+    static void constructAt(size_t offset, const T &val, ShmemHeap *heapPtr);
+    template <typename T>
+    void fill(const T &val);
+
     inline Byte *getBytePtr()
     {
         return reinterpret_cast<Byte *>(reinterpret_cast<Byte *>(this) + sizeof(ShmemPrimitive_));
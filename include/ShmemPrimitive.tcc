@@ -7,14 +7,74 @@
 template <typename T>
 inline size_t ShmemPrimitive_::makeSpace(size_t size, ShmemHeap *heapPtr)
 {
-    // Alignment will be automatically done
-    size_t offset = heapPtr->shmalloc(sizeof(ShmemPrimitive_) + size * sizeof(T));
+    // Alignment will be automatically done. Scalars are packed into slab pages, arrays get a regular block
+    // whose data (behind the object header) starts on the array alignment of the heap
+    size_t payloadSize = sizeof(ShmemPrimitive_) + size * sizeof(T);
+    size_t alignment = heapPtr->getArrayAlignment();
+    size_t offset;
+    if (size == 1)
+        offset = heapPtr->shmallocSlab(payloadSize);
+    else if (alignment > unitSize && size * sizeof(T) >= alignment)
+        offset = heapPtr->shmemalign(payloadSize, alignment, sizeof(ShmemPrimitive_));
+    else
+        offset = heapPtr->shmalloc(payloadSize);
     ShmemObj *ptr = reinterpret_cast<ShmemObj *>(heapPtr->heapHead() + offset);
     ptr->type = TypeEncoding<T>::value;
     ptr->size = static_cast<int>(size);
     return offset;
 }
 
+template <typename T>
+inline size_t ShmemPrimitive_::payloadSize(const T &val)
+{
+    static_assert(hasKnownSize<T>(), "Only strings and arrays of primitives have a known payload size");
+    if constexpr (std::is_same_v<T, std::string>)
+        return sizeof(ShmemPrimitive_) + val.size() + 1; // +1 for the \0
+    else
+        return sizeof(ShmemPrimitive_) + val.size() * sizeof(typename unwrapVectorType<T>::type);
+}
+
+template <typename T>
+inline void ShmemPrimitive_::constructAt(size_t offset, const T &val, ShmemHeap *heapPtr)
+{
+    ShmemPrimitive_ *ptr = reinterpret_cast<ShmemPrimitive_ *>(heapPtr->heapHead() + offset);
+    if constexpr (std::is_same_v<T, std::string>)
+    {
+        ptr->type = TypeEncoding<char>::value;
+        ptr->size = static_cast<int>(val.size() + 1);
+    }
+    else
+    {
+        ptr->type = TypeEncoding<typename unwrapVectorType<T>::type>::value;
+        ptr->size = static_cast<int>(val.size());
+    }
+    ptr->fill(val);
+}
+
+template <typename T>
+inline void ShmemPrimitive_::fill(const T &val)
+{
+    if constexpr (std::is_same_v<T, std::string>)
+    {
+        memcpy(reinterpret_cast<char *>(this->getBytePtr()), val.data(), (val.size() + 1) * sizeof(char));
+    }
+    else
+    {
+        using vecDataType = typename unwrapVectorType<T>::type;
+        if constexpr (std::is_same_v<vecDataType, bool>)
+        { // Handle bool vector separately as it doesn't have .data()
+            for (size_t i = 0; i < val.size(); i++)
+            {
+                reinterpret_cast<vecDataType *>(this->getBytePtr())[i] = val[i];
+            }
+        }
+        else
+        {
+            memcpy(this->getBytePtr(), val.data(), val.size() * sizeof(vecDataType));
+        }
+    }
+}
+
 template <typename T>
 inline size_t ShmemPrimitive_::construct(const T &val, ShmemHeap *heapPtr)
 {
@@ -31,20 +91,8 @@ inline size_t ShmemPrimitive_::construct(const T &val, ShmemHeap *heapPtr)
         { // a vector of primitive, such as vector<int>, vector<float>
             using vecDataType = typename unwrapVectorType<T>::type;
 
-            size_t size = val.size();
-            size_t offset = makeSpace<vecDataType>(size, heapPtr);
-            ShmemPrimitive_ *ptr = reinterpret_cast<ShmemPrimitive_ *>(heapPtr->heapHead() + offset);
-            if constexpr (std::is_same_v<vecDataType, bool>)
-            { // Handle bool vector separately as it doesn't have .data()
-                for (size_t i = 0; i < size; i++)
-                {
-                    reinterpret_cast<vecDataType *>(ptr->getBytePtr())[i] = val[i];
-                }
-            }
-            else
-            {
-                memcpy(ptr->getBytePtr(), val.data(), size * sizeof(vecDataType));
-            }
+            size_t offset = makeSpace<vecDataType>(val.size(), heapPtr);
+            reinterpret_cast<ShmemPrimitive_ *>(heapPtr->heapHead() + offset)->fill(val);
             return offset;
         }
         else
@@ -94,22 +142,39 @@ inline T ShmemPrimitive_::get(int index) const
                 printf("It's nonsense to provide an index when converting to a vector\n");
             }
             using vecDataType = typename unwrapVectorType<T>::type;
-            std::vector<vecDataType> result(this->size);
-
-#define SHMEM_PRIMITIVE_CONVERT_VEC(TYPE)                                                                                                               \
-    std::transform(reinterpret_cast<const TYPE *>(this->getBytePtr()), reinterpret_cast<const TYPE *>(this->getBytePtr()) + this->size, result.begin(), \
-                   [](TYPE value) { return static_cast<vecDataType>(value); });                                                                         \
-    return result;
-            SWITCH_PRIMITIVE_TYPES(static_cast<int>(this->type), SHMEM_PRIMITIVE_CONVERT_VEC)
+            std::vector<vecDataType> result;
+
+            // Copy until no write overlapped the copy, an array of the requested type is a plain memcpy
+#define SHMEM_PRIMITIVE_CONVERT_VEC(TYPE)                                                                                                                   \
+    if constexpr (std::is_same_v<TYPE, vecDataType> && !std::is_same_v<TYPE, bool>)                                                                        \
+        memcpy(result.data(), this->getBytePtr(), result.size() * sizeof(TYPE));                                                                            \
+    else                                                                                                                                                    \
+        std::transform(reinterpret_cast<const TYPE *>(this->getBytePtr()), reinterpret_cast<const TYPE *>(this->getBytePtr()) + result.size(), result.begin(), \
+                       [](TYPE value) { return static_cast<vecDataType>(value); });
+            size_t seq;
+            do
+            {
+                seq = this->beginRead();
+                result.resize(this->size);
+                SWITCH_PRIMITIVE_TYPES(static_cast<int>(this->type), SHMEM_PRIMITIVE_CONVERT_VEC)
+            } while (this->retryRead(seq));
+            return result;
 
 #undef SHMEM_PRIMITIVE_CONVERT_VEC
         }
         else
         { // Single element
+            T result{};
 #define SHMEM_PRIMITIVE_CONVERT(TYPE) \
-    return static_cast<T>(reinterpret_cast<const TYPE *>(this->getBytePtr())[this->resolveIndex(index)]);
+    result = static_cast<T>(reinterpret_cast<const TYPE *>(this->getBytePtr())[this->resolveIndex(index)]);
 
-            SWITCH_PRIMITIVE_TYPES(static_cast<int>(this->type), SHMEM_PRIMITIVE_CONVERT)
+            size_t seq;
+            do
+            {
+                seq = this->beginRead();
+                SWITCH_PRIMITIVE_TYPES(static_cast<int>(this->type), SHMEM_PRIMITIVE_CONVERT)
+            } while (this->retryRead(seq));
+            return result;
 
 #undef SHMEM_PRIMITIVE_CONVERT
         }
@@ -126,11 +191,15 @@ inline T ShmemPrimitive_::get(int index) const
 
         if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, const std::string>)
         {
-            int endPoint = this->index('\0');
-            if (endPoint == -1)
-                return std::string(reinterpret_cast<const char *>(this->getBytePtr()), this->size);
-            else
-                return std::string(reinterpret_cast<const char *>(this->getBytePtr()), endPoint);
+            std::string result;
+            size_t seq;
+            do
+            {
+                seq = this->beginRead();
+                int endPoint = this->index('\0');
+                result.assign(reinterpret_cast<const char *>(this->getBytePtr()), endPoint == -1 ? this->size : endPoint);
+            } while (this->retryRead(seq));
+            return result;
         }
         else if constexpr (std::is_same_v<T, char *> || std::is_same_v<T, const char *>)
         { // TODO: Should I just allocate some mem and return it?
@@ -160,7 +229,7 @@ inline T ShmemPrimitive_::get(int index) const
     else if constexpr (std::is_same_v<T, pybind11::list>)
     {
         const Byte *ptr = this->getBytePtr();
-        size_t i = 0;
+        size_t i;
         pybind11::list result;
 #define PRIMITIVE_TO_PYTHON_LIST(TYPE, PY_TYPE)                                                        \
     for (; i < static_cast<size_t>(this->size); i++)                                                                        \
@@ -177,7 +246,14 @@ inline T ShmemPrimitive_::get(int index) const
             result.append(reinterpret_cast<const TYPE *>(ptr)[i]);                                     \
     }
 
-        SWITCH_PRIMITIVE_TYPES_TO_PY(this->type, PRIMITIVE_TO_PYTHON_LIST);
+        size_t seq;
+        do
+        {
+            seq = this->beginRead();
+            i = 0;
+            result = pybind11::list();
+            SWITCH_PRIMITIVE_TYPES_TO_PY(this->type, PRIMITIVE_TO_PYTHON_LIST);
+        } while (this->retryRead(seq));
 
         return result;
 
@@ -213,7 +289,7 @@ inline T ShmemPrimitive_::get(int index) const
         else
         {
             const Byte *ptr = this->getBytePtr();
-            size_t i = 0;
+            size_t i;
 
             pybind11::list result;
 #define PRIMITIVE_TO_PYTHON_LIST(TYPE, PY_TYPE)                                             \
@@ -231,7 +307,14 @@ inline T ShmemPrimitive_::get(int index) const
             result.append(PY_TYPE(reinterpret_cast<const TYPE *>(ptr)[i]));                 \
     }
 
-            SWITCH_PRIMITIVE_TYPES_TO_PY(this->type, PRIMITIVE_TO_PYTHON_LIST);
+            size_t seq;
+            do
+            {
+                seq = this->beginRead();
+                i = 0;
+                result = pybind11::list();
+                SWITCH_PRIMITIVE_TYPES_TO_PY(this->type, PRIMITIVE_TO_PYTHON_LIST);
+            } while (this->retryRead(seq));
             return result;
 #undef PRIMITIVE_TO_PYTHON_LIST
         }
@@ -251,6 +334,7 @@ inline void ShmemPrimitive_::set(const T &value, int index)
 {
     if constexpr (isPrimitiveBaseCase<T>())
     {
+        WriteGuard guard(this);
 #define SHMEM_CONVERT_PRIMITIVE(TYPE) \
     reinterpret_cast<TYPE *>(this->getBytePtr())[this->resolveIndex(index)] = static_cast<TYPE>(value);
 
@@ -276,6 +360,7 @@ inline void ShmemPrimitive_::set(const T &value, int index)
 // __delitem__
 inline void ShmemPrimitive_::del(int index)
 {
+    WriteGuard guard(this);
     index = this->resolveIndex(index);
     Byte *ptr = this->getBytePtr();
 #define SHMEM_DEL_PRIMITIVE(TYPE)                                                \
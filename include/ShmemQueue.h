@@ -0,0 +1,187 @@
+#include "ShmemObj.h"
+// Please keep this inclusion before header guard, which make the order of include correct
+
+#ifndef SHMEM_QUEUE_H
+#define SHMEM_QUEUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+/**
+ * @brief Bounded ring of fixed-size message slots, for passing messages between processes
+ *
+ * The queue is a single cache line aligned allocation: a read-only header line, the producer line (tail), the consumer
+ * line (head), then capacity slots of slotSize payload bytes each. Producers and consumers only write their own line,
+ * so neither side invalidates the other's cache line on every message.
+ *
+ * - SPSC: one producer and one consumer process at a time. Each side keeps a cached copy of the other side's index
+ *   and only reads the shared one when the cache says the ring is full (empty). Batches publish once
+ * - MPMC: any number of producers and consumers. Every slot has a sequence number (Vyukov's bounded queue),
+ *   producers and consumers claim slots with a CAS on tail and head
+ *
+ * When the ring is full (empty), push() (pop()) spins briefly, then sleeps on a futex in the other side's line until
+ * the other side publishes. The other side only pays for the wake-up when someone sleeps.
+ * Messages are raw bytes. Typed helpers copy std::string or trivially copyable values
+ */
+class ShmemQueue : public ShmemObj
+{
+    friend class ShmemAccessor;
+
+protected:
+    static constexpr size_t CacheLine = 64;
+
+    struct Slot
+    {
+        std::atomic<size_t> seq; // MPMC only: pos when free for the push of pos, pos + 1 when holding its message
+        uint32_t length;         // Bytes of the message
+        uint32_t padding;
+
+        Byte *data() { return reinterpret_cast<Byte *>(this + 1); }
+        const Byte *data() const { return reinterpret_cast<const Byte *>(this + 1); }
+    };
+
+    // Written by producers, read by consumers on a cache miss
+    struct ProducerLine
+    {
+        std::atomic<size_t> tail;        // Next position to push
+        size_t cachedHead;               // SPSC only: head as last seen by the producer
+        std::atomic<size_t> dataWaiters; // Set by consumers going to sleep in pop(), cleared by the push that wakes them
+        std::atomic<size_t> dataSignal;  // Futex word, bumped by a push that clears dataWaiters
+        Byte padding[CacheLine - 4 * sizeof(size_t)];
+    };
+
+    // Written by consumers, read by producers on a cache miss
+    struct ConsumerLine
+    {
+        std::atomic<size_t> head;         // Next position to pop
+        size_t cachedTail;                // SPSC only: tail as last seen by the consumer
+        std::atomic<size_t> spaceWaiters; // Set by producers going to sleep in push(), cleared by the pop that wakes them
+        std::atomic<size_t> spaceSignal;  // Futex word, bumped by a pop that clears spaceWaiters
+        Byte padding[CacheLine - 4 * sizeof(size_t)];
+    };
+
+    // Header line, read-only after construct(). ShmemObj::size is unused, len() reads the indices
+    size_t capacity; // Power of 2
+    size_t slotSize; // Payload bytes of a slot
+    size_t stride;   // Bytes from one slot to the next, header included
+    size_t multi;    // 1 for MPMC
+    Byte headerPadding[CacheLine - sizeof(ShmemObj) - 4 * sizeof(size_t)];
+
+    ProducerLine producer;
+    ConsumerLine consumer;
+
+    Slot *slot(size_t pos);
+
+    /**
+     * @brief Push as many messages as there is room for, without waiting
+     *
+     * @return number of messages pushed, from the front
+     */
+    size_t tryPushRaw(const void *const *messages, const size_t *lengths, size_t count);
+
+    /**
+     * @brief Pop up to maxCount messages, without waiting
+     *
+     * @return number of messages popped
+     */
+    size_t tryPopRaw(void *buffer, size_t bufferStride, size_t *lengths, size_t maxCount);
+
+    /**
+     * @brief Wake every process sleeping on signal, if waiters is set. Only the first publish after they went to sleep
+     * pays for the system call
+     */
+    static void wake(std::atomic<size_t> &waiters, std::atomic<size_t> &signal);
+
+public:
+    static constexpr size_t DefaultCapacity = 1024;
+    static constexpr size_t DefaultSlotSize = CacheLine - sizeof(Slot); // One cache line per slot
+
+    /**
+     * @brief Constructor for ShmemQueue
+     *
+     * @param heapPtr The heap pointer
+     * @param capacity Number of slots, rounded up to a power of 2 (at least 2)
+     * @param slotSize Largest message in bytes
+     * @param multi false for a single producer and a single consumer (SPSC), true for any number of each (MPMC)
+     * @return Offset of the queue from heap head
+     */
+    static size_t construct(ShmemHeap *heapPtr, size_t capacity = DefaultCapacity, size_t slotSize = DefaultSlotSize, bool multi = false);
+
+    /**
+     * @brief Construct from a python dict with the optional keys "capacity", "slotSize" and "multi"
+     */
+    static size_t construct(pybind11::dict spec, ShmemHeap *heapPtr);
+
+    static void deconstruct(size_t offset, ShmemHeap *heapPtr);
+
+    // __len__, number of messages waiting. Only a hint while producers or consumers run
+    size_t len() const;
+
+    // __str__
+    std::string toString(int indent = 0, int maxElements = -1) const;
+
+    size_t getCapacity() const;
+    size_t getSlotSize() const;
+    bool isMulti() const;
+
+    /**
+     * @brief Push messages in order, waiting for room while the ring is full
+     *
+     * @param messages pointers to the messages
+     * @param lengths bytes of each message, at most slotSize
+     * @param count number of messages
+     * @param timeout in milliseconds, 0 to return at once, -1 to wait without a timeout
+     * @return number of messages pushed, less than count on timeout
+     */
+    size_t pushRaw(const void *const *messages, const size_t *lengths, size_t count, int timeout = -1);
+
+    /**
+     * @brief Pop up to maxCount messages, waiting while the ring is empty
+     *
+     * Only waits for the first message, then takes what is there
+     * @param buffer receives message i at buffer + i * bufferStride, cut to bufferStride bytes
+     * @param bufferStride bytes for each message in buffer
+     * @param lengths receives the full length of each message
+     * @param maxCount most messages to pop
+     * @param timeout in milliseconds, 0 to return at once, -1 to wait without a timeout
+     * @return number of messages popped, 0 on timeout
+     */
+    size_t popRaw(void *buffer, size_t bufferStride, size_t *lengths, size_t maxCount, int timeout = -1);
+
+    // Typed interface, T is std::string or trivially copyable
+
+    /**
+     * @return false on timeout
+     */
+    template <typename T>
+    bool push(const T &message, int timeout = -1);
+
+    /**
+     * @return false on timeout
+     * @note A trivially copyable T must match the length of the message, or ConversionError is thrown (the message is gone)
+     */
+    template <typename T>
+    bool pop(T &message, int timeout = -1);
+
+    /**
+     * @return number of messages pushed, less than messages.size() on timeout
+     */
+    template <typename T>
+    size_t pushBatch(const std::vector<T> &messages, int timeout = -1);
+
+    /**
+     * @brief Append up to maxCount messages to messages, waiting for the first one only
+     *
+     * @return number of messages appended
+     */
+    template <typename T>
+    size_t popBatch(std::vector<T> &messages, size_t maxCount, int timeout = -1);
+};
+
+// Include the template implementation file
+#include "ShmemQueue.tcc"
+
+#endif // SHMEM_QUEUE_H
@@ -0,0 +1,115 @@
+#ifndef SHMEM_QUEUE_TCC
+#define SHMEM_QUEUE_TCC
+
+#include "ShmemObj.h"
+#include "ShmemQueue.h"
+#include <string_view>
+
+template <typename T>
+bool ShmemQueue::push(const T &message, int timeout)
+{
+    if constexpr (isString<T>())
+    {
+        std::string_view view(message);
+        const void *data = view.data();
+        size_t length = view.size();
+        return pushRaw(&data, &length, 1, timeout) == 1;
+    }
+    else if constexpr (std::is_trivially_copyable_v<T>)
+    {
+        const void *data = &message;
+        size_t length = sizeof(T);
+        return pushRaw(&data, &length, 1, timeout) == 1;
+    }
+    else
+    {
+        throw std::runtime_error("Cannot push message of type " + typeName<T>());
+    }
+}
+
+template <typename T>
+bool ShmemQueue::pop(T &message, int timeout)
+{
+    size_t length;
+    if constexpr (std::is_same_v<T, std::string>)
+    {
+        std::string buffer(slotSize, '\0');
+        if (popRaw(buffer.data(), slotSize, &length, 1, timeout) == 0)
+            return false;
+        buffer.resize(length);
+        message = std::move(buffer);
+        return true;
+    }
+    else if constexpr (std::is_trivially_copyable_v<T>)
+    {
+        if (popRaw(&message, sizeof(T), &length, 1, timeout) == 0)
+            return false;
+        if (length != sizeof(T))
+            throw ConversionError("Cannot convert message of " + std::to_string(length) + " bytes to " + typeName<T>());
+        return true;
+    }
+    else
+    {
+        throw std::runtime_error("Cannot pop message of type " + typeName<T>());
+    }
+}
+
+template <typename T>
+size_t ShmemQueue::pushBatch(const std::vector<T> &messages, int timeout)
+{
+    std::vector<const void *> data(messages.size());
+    std::vector<size_t> lengths(messages.size());
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+        if constexpr (isString<T>())
+        {
+            std::string_view view(messages[i]);
+            data[i] = view.data();
+            lengths[i] = view.size();
+        }
+        else if constexpr (std::is_trivially_copyable_v<T>)
+        {
+            data[i] = &messages[i];
+            lengths[i] = sizeof(T);
+        }
+        else
+        {
+            throw std::runtime_error("Cannot push message of type " + typeName<T>());
+        }
+    }
+    return pushRaw(data.data(), lengths.data(), messages.size(), timeout);
+}
+
+template <typename T>
+size_t ShmemQueue::popBatch(std::vector<T> &messages, size_t maxCount, int timeout)
+{
+    maxCount = std::min(maxCount, capacity);
+    std::vector<size_t> lengths(maxCount);
+    if constexpr (std::is_same_v<T, std::string>)
+    {
+        std::vector<Byte> buffer(maxCount * slotSize);
+        size_t count = popRaw(buffer.data(), slotSize, lengths.data(), maxCount, timeout);
+        for (size_t i = 0; i < count; i++)
+            messages.emplace_back(reinterpret_cast<const char *>(buffer.data() + i * slotSize), lengths[i]);
+        return count;
+    }
+    else if constexpr (std::is_trivially_copyable_v<T>)
+    {
+        size_t start = messages.size();
+        messages.resize(start + maxCount);
+        size_t count = popRaw(messages.data() + start, sizeof(T), lengths.data(), maxCount, timeout);
+        messages.resize(start + count);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (lengths[i] != sizeof(T))
+                throw ConversionError("Cannot convert message of " + std::to_string(lengths[i]) + " bytes to " + typeName<T>());
+        }
+        return count;
+    }
+    else
+    {
+        throw std::runtime_error("Cannot pop message of type " + typeName<T>());
+    }
+}
+
+#endif // SHMEM_QUEUE_TCC
@@ -24,6 +24,23 @@ typedef std::chrono::milliseconds milliseconds;
 
 namespace ShmemUtils
 {
+    // Address space reserved behind every mapping so it can grow in place (PROT_NONE, costs no memory)
+    static const size_t shmReserveSize = 1UL << 36;
+
+    // Mappings that may use transparent huge pages start on this boundary
+    static const size_t hugePageSize = 1UL << 21;
+
+    /**
+     * @brief Backing options of a mapping, or-ed together. They only affect the mapping of the calling process
+     */
+    enum MapOption : int
+    {
+        MapDefault = 0,
+        MapHugePages = 1 << 0, // madvise(MADV_HUGEPAGE), effective when /sys/kernel/mm/transparent_hugepage/shmem_enabled is advise or within_size
+        MapPopulate = 1 << 1,  // Pre-fault every page when it gets mapped, after create(), connect() and each resize
+        MapLock = 1 << 2,      // mlock the mapping, limited by RLIMIT_MEMLOCK
+    };
+
     // Sublogger specific to ShmemUtils
     // Function to get or create the logger instance
     std::shared_ptr<spdlog::logger> getLogger();
@@ -40,7 +57,8 @@ namespace ShmemUtils
      * @brief Connects to an existing semaphore or waits for it to be created.
      *
      * @param semName The name of the semaphore.
-     * @param waitTime Time to wait in seconds before checking again.
+     * @param waitTime Longest sleep before checking again. Creation of the semaphore wakes the wait early (inotify).
+     * @param timeout Timeout in milliseconds.
      * @return A pointer to the connected semaphore.
      */
     sem_t *connectSem(const std::string &semName, const milliseconds &waitTime = milliseconds(10), const milliseconds &timeout = milliseconds(100 * 1000));
@@ -66,11 +84,12 @@ namespace ShmemUtils
      *
      * @param shmPtr Reference to a pointer to the shared memory.
      * @param shmName The name of the shared memory.
-     * @param waitTime Time to wait in seconds before checking again.
+     * @param waitTime Longest sleep before checking again. Creation of the shared memory wakes the wait early (inotify).
      * @param timeout Timeout in milliseconds.
+     * @param options Backing options of the mapping, see MapOption.
      * @return The file descriptor of the connected shared memory.
      */
-    FileDescriptor connectShm(Byte *&shmPtr, const std::string &shmName, const milliseconds &waitTime = milliseconds(10), const milliseconds &timeout = milliseconds(100 * 1000));
+    FileDescriptor connectShm(Byte *&shmPtr, const std::string &shmName, const milliseconds &waitTime = milliseconds(10), const milliseconds &timeout = milliseconds(100 * 1000), int options = MapDefault);
 
     /**
      * @brief Creates new shared memory with the given name and size.
@@ -78,9 +97,118 @@ namespace ShmemUtils
      * @param shmPtr Reference to a pointer to the shared memory.
      * @param shmName The name of the shared memory.
      * @param size The size of the shared memory in bytes.
+     * @param options Backing options of the mapping, see MapOption.
      * @return The file descriptor of the created shared memory.
      */
-    FileDescriptor createShm(Byte *&shmPtr, const std::string &shmName, const size_t &size);
+    FileDescriptor createShm(Byte *&shmPtr, const std::string &shmName, const size_t &size, int options = MapDefault);
+
+    /**
+     * @brief Address space taken by a mapping of the given size, including the reservation behind it.
+     *
+     * @param size The size of the mapping in bytes.
+     * @return The size of the reserved range in bytes.
+     */
+    size_t reservationSize(size_t size);
+
+    /**
+     * @brief Maps shared memory at the start of a reserved address range of reservationSize(size) bytes.
+     *
+     * @param shmFd The file descriptor of the shared memory.
+     * @param size The size of the shared memory in bytes.
+     * @param options Backing options of the mapping, see MapOption.
+     * @return A pointer to the mapping.
+     */
+    Byte *mapShm(FileDescriptor shmFd, size_t size, int options = MapDefault);
+
+    /**
+     * @brief Changes the size of a mapping made by mapShm() without changing the shared memory itself.
+     *
+     * Stays at the same address while the new size fits the reservation, otherwise moves with mremap (no copy).
+     *
+     * @param shmFd The file descriptor of the shared memory.
+     * @param shmPtr The current mapping of the shared memory.
+     * @param oldSize The size of the current mapping in bytes.
+     * @param newSize The new size of the mapping in bytes.
+     * @param options Backing options applied to the newly mapped range, see MapOption.
+     * @return The new mapping.
+     */
+    Byte *remapShm(FileDescriptor shmFd, Byte *shmPtr, size_t oldSize, size_t newSize, int options = MapDefault);
+
+    /**
+     * @brief Grows or shrinks shared memory in place (ftruncate + remapShm), keeping its content and name.
+     *
+     * @param shmFd The file descriptor of the shared memory.
+     * @param shmPtr The current mapping of the shared memory.
+     * @param oldSize The size of the current mapping in bytes.
+     * @param newSize The new size of the shared memory in bytes.
+     * @param options Backing options applied to the newly mapped range, see MapOption.
+     * @return The new mapping.
+     */
+    Byte *resizeShm(FileDescriptor shmFd, Byte *shmPtr, size_t oldSize, size_t newSize, int options = MapDefault);
+
+    /**
+     * @brief Creates new shared memory and maps it at a fixed address inside a range reserved by mapShm().
+     *
+     * The descriptor is closed again, the mapping keeps the shared memory alive until it is unmapped.
+     *
+     * @param shmPtr Page aligned address in the reservation, whatever was mapped there is replaced.
+     * @param shmName The name of the shared memory.
+     * @param size The size of the shared memory in bytes.
+     * @param options Backing options of the mapping, see MapOption.
+     */
+    void createShmAt(Byte *shmPtr, const std::string &shmName, size_t size, int options = MapDefault);
+
+    /**
+     * @brief Maps existing shared memory at a fixed address inside a range reserved by mapShm(), without waiting for it.
+     *
+     * The descriptor is closed again, the mapping keeps the shared memory alive until it is unmapped.
+     *
+     * @param shmPtr Page aligned address in the reservation, whatever was mapped there is replaced.
+     * @param shmName The name of the shared memory.
+     * @param size The number of bytes to map, the shared memory must be at least as large.
+     * @param options Backing options of the mapping, see MapOption.
+     */
+    void connectShmAt(Byte *shmPtr, const std::string &shmName, size_t size, int options = MapDefault);
+
+    /**
+     * @brief Hands a range mapped by createShmAt() or connectShmAt() back to the reservation (PROT_NONE).
+     *
+     * @param shmPtr Page aligned start of the range.
+     * @param size The size of the range in bytes.
+     */
+    void unmapShmAt(Byte *shmPtr, size_t size);
+
+    /**
+     * @brief Applies backing options to a mapped range: huge page advice first, then pre-faulting and locking.
+     *
+     * Failures are logged as warnings, the mapping stays usable with ordinary pages.
+     *
+     * @param shmPtr Start of the range, page aligned.
+     * @param size The size of the range in bytes.
+     * @param options Backing options, see MapOption.
+     */
+    void adviseShm(Byte *shmPtr, size_t size, int options);
+
+    /**
+     * @brief Gives the pages of a range back to the OS, the range reads as zeros afterwards in every process.
+     *
+     * Punches a hole in the shared memory (fallocate), falling back to madvise(MADV_REMOVE) on the mapping.
+     *
+     * @param shmFd The file descriptor of the shared memory.
+     * @param shmPtr The mapping of the shared memory.
+     * @param offset Offset of the range in the shared memory, page aligned.
+     * @param size The size of the range in bytes, page aligned.
+     * @return true if the pages were released.
+     */
+    bool releaseShm(FileDescriptor shmFd, Byte *shmPtr, size_t offset, size_t size);
+
+    /**
+     * @brief Checks if the shared memory behind a descriptor has been unlinked (e.g. recreated by another process).
+     *
+     * @param shmFd The file descriptor of the shared memory.
+     * @return true if the name no longer refers to this shared memory.
+     */
+    bool shmUnlinked(FileDescriptor shmFd);
 
     /**
      * @brief Clears the semaphore by waiting until its value reaches zero.
@@ -154,14 +282,25 @@ namespace ShmemUtils
     /**
      * @brief Waits for the semaphore to become > 0.
      *
+     * Blocks in the kernel until the semaphore is posted, so the wake-up does not depend on waitTime.
+     *
      * @param sem A pointer to the semaphore.
-     * @param waitTime Milliseconds to wait before checking again. Default to 10 seconds.
+     * @param waitTime Interval at which the callback is polled while blocked. Unused without a callback.
      * @param timeout Timeout in milliseconds.
-     * @param callback A function to be called when the semaphore becomes > 0.
-     * @return 0 on success, error code on failure.
+     * @param callback Polled every waitTime, the wait is interrupted when it returns true.
+     * @return 0 on success, EINTR if interrupted by the callback, ETIMEDOUT on timeout.
      */
     int waitSem(sem_t *sem, const milliseconds &waitTime = milliseconds(10), const milliseconds &timeout = milliseconds(100 * 1000), std::function<bool()> callback = nullptr);
 
+    /**
+     * @brief Blocks on the semaphore until it is posted or the deadline passes, retrying on signals.
+     *
+     * @param sem A pointer to the semaphore.
+     * @param deadline Absolute deadline on the steady clock.
+     * @return 0 on success, ETIMEDOUT if the deadline passed, other errno on failure.
+     */
+    int timedWaitSem(sem_t *sem, const std::chrono::steady_clock::time_point &deadline);
+
     /**
      * @brief Posts on the semaphore.
      *
@@ -170,6 +309,32 @@ namespace ShmemUtils
      */
     int postSem(sem_t *sem);
 
+    /**
+     * @brief Blocks while the low 32 bits of a shared word hold the expected value (shared futex).
+     *
+     * Also returns on a wake-up, a signal or a timeout, callers check their condition again.
+     *
+     * @param word The word, its low half is the futex on little endian machines.
+     * @param expected The value of the low half the wait starts from.
+     * @param timeout Relative timeout, nullptr to wait until woken.
+     */
+    void futexWait(const size_t *word, uint32_t expected, const timespec *timeout);
+
+    /**
+     * @brief Wakes every process blocked in futexWait() on the word.
+     *
+     * @param word The word passed to futexWait().
+     */
+    void futexWakeAll(const size_t *word);
+
+    /**
+     * @brief Checks if a process that stored its pid in shared memory (e.g. as a lock owner) has exited.
+     *
+     * @param pid The process id, 0 is never dead.
+     * @return true if no process with this pid exists. A reused pid reads as alive.
+     */
+    bool processDead(size_t pid);
+
 } // namespace ShmemUtils
 
 #endif // SHMEM_UTILS_H
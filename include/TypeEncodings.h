@@ -236,6 +236,8 @@ static const int String = 101;
 static const int List = 102;
 static const int DictNode = 103;
 static const int Dict = 104;
+static const int HashMap = 105;
+static const int Queue = 106;
 
 extern const std::unordered_map<int, std::string> typeNames;
 
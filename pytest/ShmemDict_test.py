@@ -1,3 +1,6 @@
+import threading
+import time
+
 import pytest
 from TypedShmem import ShmemHeap, ShmemAccessor, SDict
 
@@ -28,18 +31,19 @@ def testBasicAssignmentAndMemoryUsage(shmemDictTest):
     acc.set(m1)
 
     # Expected layout after assignment
-    assert shmHeap.briefLayout() == [24, 56, 24, 24, 56, 24, 3832]
+    # DictObj, node page(NIL, DictNode), NIL_key, scalar page(data(2)), key("9"), free_block
+    assert shmHeap.briefLayout() == [40, 328, 24, 136, 24, 3496]
 
     m2 = {str(100 * "A"): 2}
     acc.set(m2)
-    assert shmHeap.briefLayout() == [24, 56, 24, 24, 56, 112, 3744]
+    assert shmHeap.briefLayout() == [40, 328, 24, 136, 112, 3408]
 
     acc.set(m1)
     acc["new"].set(5)
-    assert shmHeap.briefLayout() == [24, 56, 24, 24, 56, 24, 24, 56, 24, 3704]
+    assert shmHeap.briefLayout() == [40, 328, 24, 136, 24, 24, 3464]
 
     acc["new"].set([1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16])
-    assert shmHeap.briefLayout() == [24, 56, 24, 24, 56, 24, 24, 56, 24, 72, 3624]
+    assert shmHeap.briefLayout() == [40, 328, 24, 136, 24, 24, 72, 3384]
 
     with pytest.raises(Exception):
         del acc[9]
@@ -82,6 +86,140 @@ def testQuickAssign(shmemDictTest):
     assert acc == m6
 
 
+def testWatchWakesOnWritesBelow(shmemDictTest):
+    shmHeap, acc = shmemDictTest
+    acc.set(SDict({"a": SDict({"x": 1}), "b": 2}))
+    a = acc["a"].version()
+    b = acc["b"].version()
+    assert a != 0
+    assert acc["missing"].version() == 0
+
+    acc["a"]["x"] = 3
+    assert acc["a"].version() != a
+    assert acc["b"].version() == b
+    assert not acc["b"].waitForChange(20)
+
+    # The wait releases the GIL, the writer thread gets to run
+    since = acc["a"].version()
+    changes = shmHeap.changeCount()
+
+    def writer():
+        time.sleep(0.05)
+        ShmemAccessor(shmHeap)["a"]["y"] = 5
+
+    thread = threading.Thread(target=writer)
+    thread.start()
+    assert acc["a"].watch(since, 5000) != since
+    thread.join()
+    assert acc["a"]["y"] == 5
+    assert shmHeap.changeCount() > changes
+
+
+def testVersionSurvivesReplacement(shmemDictTest):
+    _, acc = shmemDictTest
+    acc.set(SDict({"x": 1}))
+    acc["x"] = 2
+    x = acc["x"]
+    since = x.version()
+    # Each value lands in the block the previous one was freed from
+    acc["x"] = 3
+    acc["x"] = 4
+    assert x.watch(since, 0) != since
+
+    since = x.version()
+    del acc["x"]
+    acc["x"] = 5
+    assert x.watch(since, 0) != since
+
+
+def testTransactionsPublishAtOnce(shmemDictTest):
+    shmHeap, acc = shmemDictTest
+    acc.set({"v": 0, "w": 0})
+
+    with pytest.raises(Exception):
+        with shmHeap.transaction():
+            acc["v"] = 1
+            acc["w"] = 1
+            assert acc["v"] == 0
+            raise ValueError("aborted")
+    assert not shmHeap.inTransaction()
+    assert acc.fetch() == {"v": 0, "w": 0}
+
+    changes = shmHeap.changeCount()
+    with shmHeap.transaction():
+        acc["v"] = 2
+        acc["w"] = 2
+        acc.insert("u", 3)
+    assert shmHeap.changeCount() == changes + 1
+    assert acc.fetch() == {"u": 3, "v": 2, "w": 2}
+
+    # A write failing in commit() rolls back the writes before it
+    with pytest.raises(Exception):
+        with shmHeap.transaction():
+            acc["v"] = -1
+            acc["x"] = [1, 2, 3]
+            del acc["w"]
+            acc["v"][3] = 1
+    assert acc.fetch() == {"u": 3, "v": 2, "w": 2}
+    assert shmHeap.verifyHeap()
+
+    # fetch() of the whole dict never mixes two commits
+    numCommits = 200
+    mixed = []
+
+    def reader():
+        v = 0
+        while v != numCommits:
+            content = ShmemAccessor(shmHeap).fetch()
+            v = content["v"]
+            if content["v"] != content["w"]:
+                mixed.append(content)
+
+    thread = threading.Thread(target=reader)
+    thread.start()
+    for i in range(1, numCommits + 1):
+        with shmHeap.transaction():
+            acc["v"] = i
+            acc["w"] = i
+    thread.join()
+    assert mixed == []
+
+
+def testSnapshotsKeepTheirVersion(shmemDictTest):
+    shmHeap, acc = shmemDictTest
+    acc.set({i: i for i in range(64)})
+    acc.insert(100, SDict({"x": 1}))
+
+    with acc.snapshot() as snap:
+        assert snap.isSnapshot()
+        assert shmHeap.newestSnapshot() == snap.snapshotEpoch()
+
+        # Writes after the snapshot only show through the live accessor
+        for i in range(0, 64, 2):
+            del acc[i]
+        acc[1] = -1
+        acc[100]["y"] = 3
+        assert acc[1] == -1
+        assert 0 not in acc
+
+        assert snap.len() == 65
+        assert snap[0] == 0
+        assert snap[1] == 1
+        assert "y" not in snap[100]
+        assert snap.fetch() == {**{i: i for i in range(64)}, 100: {"x": 1}}
+        with pytest.raises(Exception):
+            snap[1] = 5
+
+        # Replacing the root object keeps the old one for the snapshot
+        acc.set({"a": 1})
+        assert snap[3] == 3
+
+    assert not snap.isSnapshot()
+    assert snap.fetch() == {"a": 1}
+    assert shmHeap.newestSnapshot() == 0
+    assert shmHeap.verifyHeap()
+
+
 def testConvertToPythonObject(shmemDictTest):
     _, acc = shmemDictTest
     acc.set({"A": 1, "BB": 11, "CCC": 111, "DDDD": 1111, "EEEEE": 11111})
@@ -0,0 +1,66 @@
+import pytest
+from TypedShmem import ShmemHeap, ShmemAccessor, SHashMap
+
+
+@pytest.fixture
+def shmemHashMapTest():
+    """Fixture to initialize and cleanup ShmemHeap and ShmemAccessor for each test."""
+    shmHeap = ShmemHeap("test_shm_hash_map", 80, 1 << 20)
+    acc = ShmemAccessor(shmHeap)
+    shmHeap.setLogLevel(0)
+    shmHeap.create()
+    yield shmHeap, acc
+    shmHeap.close()
+
+
+def testCreateEmptyHashMap(shmemHashMapTest):
+    _, acc = shmemHashMapTest
+    acc.set(SHashMap())
+    assert acc.len() == 0
+    assert acc.typeStr() == "hash map"
+    assert acc.toString() == "(H:0){\n}"
+
+
+def testInsertLookupDelete(shmemHashMapTest):
+    _, acc = shmemHashMapTest
+    acc.set(SHashMap())
+    n = 1000
+
+    for i in range(n):
+        acc[i] = i * 2
+        acc["key" + str(i)] = i * 3
+    assert acc.len() == 2 * n
+    for i in range(n):
+        assert acc[i] == i * 2
+        assert acc["key" + str(i)] == i * 3
+    assert n not in acc
+    assert "0" not in acc
+
+    for i in range(0, n, 2):
+        del acc[i]
+        del acc["key" + str(i)]
+    assert acc.len() == n
+    for i in range(1, n, 2):
+        assert i in acc
+        assert acc["key" + str(i)] == i * 3
+
+    with pytest.raises(Exception):
+        del acc[0]
+
+
+def testAccessorPathsAndConversion(shmemHashMapTest):
+    _, acc = shmemHashMapTest
+    m1 = {"A": 1, "B": [1, 2, 3], "C": {"x": 10, "y": 20}, 5: None}
+    acc.set(SHashMap(m1))
+
+    assert acc["B"][1] == 2
+    assert acc["C"]["y"] == 20
+    assert acc.fetch() == m1
+
+    acc[5] = SHashMap({"inner": 3.5})
+    assert acc[5].typeStr() == "hash map"
+    assert acc[5]["inner"] == 3.5
+
+
+if __name__ == "__main__":
+    pytest.main(["-v", "pytest/ShmemHashMap_test.py"])
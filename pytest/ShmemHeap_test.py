@@ -1,16 +1,18 @@
 import sys
 import os
+import random
 import tempfile
 import subprocess
 import shutil
+import struct
 
 import pytest
-from TypedShmem import ShmemHeap
+from TypedShmem import MapHugePages, MapLock, MapPopulate, ShmemHeap
 
 
 @pytest.fixture
 def setup():
-    shmHeap = ShmemHeap("test_shm_heap", 80, 1024)
+    shmHeap = ShmemHeap("test_shm_heap", 1024, 1024)
     yield shmHeap
     shmHeap.unlink()
 
@@ -18,14 +20,17 @@ def testConstructor(setup):
     shmHeap = setup
 
     assert shmHeap.getName() == "test_shm_heap"
-    assert shmHeap.getCapacity() == 4096 + 80
+    assert shmHeap.getCapacity() == 4096 + 1024
     assert not shmHeap.isConnected()
     assert not shmHeap.ownsSharedMemory()
     assert shmHeap.getVersion() == -1
 
     another = ShmemHeap("another_shm_heap", 1, 4097)
     assert another.getName() == "another_shm_heap"
-    assert another.getCapacity() == 2 * 4096 + 4 * 8
+    # Static space is padded up to the header (6 slots + 64 free bin heads + 9 stat counters + 3 slab lists
+    # + 34 slots of segment table + change counter and its waiters + commit sequence + snapshot epoch
+    # + retired list + 6 snapshot pins)
+    assert another.getCapacity() == 2 * 4096 + 127 * 8
 
 
 def testCreate(setup):
@@ -34,7 +39,7 @@ def testCreate(setup):
     shmHeap.create()
     assert shmHeap.isConnected()
     assert shmHeap.ownsSharedMemory()
-    assert shmHeap.staticCapacity() == 80
+    assert shmHeap.staticCapacity() == 1024
     assert shmHeap.heapCapacity() == 4096
 
 
@@ -42,12 +47,12 @@ def testConnect(setup):
     shmHeap = setup
 
     shmHeap.setHCap(4097)
-    shmHeap.setSCap(90)
+    shmHeap.setSCap(1030)
     shmHeap.create()
 
     another = ShmemHeap("test_shm_heap", 1, 1000000)
     another.connect()
-    assert another.staticCapacity() == 96
+    assert another.staticCapacity() == 1032
     assert another.heapCapacity() == 4096 * 2
 
 
@@ -59,11 +64,11 @@ def testResizeCapacityCorrectness(setup):
 
     another = ShmemHeap("test_shm_heap", 1, 1000000)
     another.connect()
-    assert another.staticCapacity() == 80
+    assert another.staticCapacity() == 1024
     assert another.heapCapacity() == 4096 * 2
 
-    shmHeap.resize(90, 4096 * 2 + 1)
-    assert another.staticCapacity() == 96
+    shmHeap.resize(1030, 4096 * 2 + 1)
+    assert another.staticCapacity() == 1032
     assert another.heapCapacity() == 4096 * 3
 
 
@@ -82,7 +87,7 @@ def testResizeContentCorrectness(setup):
     shmHeap.shfree(ptr2)
     assert another.briefLayoutStr() == "256A, 7712E, 200A"
 
-    shmHeap.resize(90, 4096 * 2 + 1)
+    shmHeap.resize(1030, 4096 * 2 + 1)
     assert another.briefLayoutStr() == "256A, 7712E, 200A, 4088E"
 
     shmHeap.shfree(ptr3)
@@ -91,10 +96,82 @@ def testResizeContentCorrectness(setup):
 
     another.resize(4096 * 3 + 1)
     assert shmHeap.briefLayoutStr() == "256A, 11984A, 4120E"
-    assert another.staticCapacity() == 96
+    assert another.staticCapacity() == 1032
     assert another.heapCapacity() == 4096 * 4
 
 
+def testSegmentedHeap(setup):
+    shmHeap = setup
+
+    shmHeap.setSegmented(True)
+    assert shmHeap.getSegmented()
+    shmHeap.create()
+    assert shmHeap.isSegmented()
+    assert shmHeap.numSegments() == 1
+    firstEnd = 2 * 4096 - 1024
+    assert shmHeap.heapCapacity() == firstEnd
+
+    another = ShmemHeap("test_shm_heap", 1, 1)
+    another.connect()
+
+    ptr = shmHeap.shmalloc(100)
+    big = shmHeap.shmalloc(64 << 10)
+    assert shmHeap.numSegments() == 2
+    assert os.path.exists("/dev/shm/test_shm_heap_seg1")
+    assert shmHeap.segmentOf(ptr) == (0, ptr)
+    assert shmHeap.segmentOf(firstEnd + 8) == (1, 8)
+    assert another.numSegments() == 2
+    assert another.verifyHeap()
+
+    with pytest.raises(Exception):
+        shmHeap.resize(4096, -1)
+
+    shmHeap.shfree(big)
+    capacity = shmHeap.heapCapacity()
+    assert shmHeap.trim() == capacity - firstEnd
+    assert shmHeap.numSegments() == 1
+    assert not os.path.exists("/dev/shm/test_shm_heap_seg1")
+    assert another.numSegments() == 1
+    assert another.verifyHeap()
+
+
+def testMapOptions(setup):
+    shmHeap = setup
+
+    options = MapHugePages | MapPopulate | MapLock
+    shmHeap.setMapOptions(options)
+    assert shmHeap.getMapOptions() == options
+    shmHeap.setHCap(1 << 20)
+    shmHeap.create()
+    ptr = shmHeap.shmalloc(1000)
+    shmHeap.resize(-1, 2 << 20)
+    assert shmHeap.heapCapacity() == 2 << 20
+    assert shmHeap.shfree(ptr) == 0
+    assert shmHeap.briefLayoutStr() == str((2 << 20) - 8) + "E"
+
+
+def testReleaseAndTrim(setup):
+    shmHeap = setup
+
+    shmHeap.setHCap(4 << 20)
+    shmHeap.setReleaseThreshold(1 << 20)
+    assert shmHeap.getReleaseThreshold() == 1 << 20
+    shmHeap.create()
+
+    large = shmHeap.shmalloc(2 << 20)
+    guard = shmHeap.shmalloc(64)
+    assert shmHeap.shfree(large) == 0
+    assert shmHeap.verifyHeap()
+
+    capacity = shmHeap.heapCapacity()
+    cut = shmHeap.trim()
+    assert cut > 0
+    assert shmHeap.heapCapacity() == capacity - cut
+    assert shmHeap.heapCapacity() - (guard + 64) < 4096 + 32
+    assert shmHeap.verifyHeap()
+    assert shmHeap.trim() == 0
+
+
 def testFullMallocAndFree(setup):
     shmHeap = setup
 
@@ -152,5 +229,328 @@ def testBasicRealloc(setup):
     ptr2 = shmHeap.shrealloc(ptr1, 0x1FA)
     assert shmHeap.briefLayoutStr() == "512A, 3568E"
 
+
+def testInPlaceRealloc(setup):
+    shmHeap = setup
+
+    shmHeap.create()
+    ptr1 = shmHeap.shmalloc(64)
+    ptr2 = shmHeap.shmalloc(64)
+    ptr3 = shmHeap.shmalloc(64)
+    shmHeap.shfree(ptr2)
+    assert shmHeap.briefLayoutStr() == "64A, 64E, 64A, 3872E"
+
+    assert shmHeap.shrealloc(ptr1, 100) == ptr1
+    assert shmHeap.briefLayoutStr() == "104A, 24E, 64A, 3872E"
+    assert shmHeap.shrealloc(ptr1, 128) == ptr1
+    assert shmHeap.briefLayoutStr() == "136A, 64A, 3872E"
+
+    assert shmHeap.shrealloc(ptr3, 40) == ptr3
+    assert shmHeap.briefLayoutStr() == "136A, 40A, 3896E"
+    assert shmHeap.shrealloc(ptr1, 64) == ptr1
+    assert shmHeap.briefLayoutStr() == "64A, 64E, 40A, 3896E"
+
+    assert shmHeap.shrealloc(ptr1, 200) != ptr1
+    assert shmHeap.briefLayoutStr() == "136E, 40A, 200A, 3688E"
+    assert shmHeap.verifyHeap()
+
+
+def testHeapStats(setup):
+    shmHeap = setup
+
+    shmHeap.create()
+    stats = shmHeap.stats()
+    assert stats["heapCapacity"] == 4096
+    assert stats["allocatedBytes"] == 0
+    assert stats["freeBlocks"] == 1
+    assert stats["largestFreeBlock"] == 4096
+
+    ptr1 = shmHeap.shmalloc(64)
+    ptr2 = shmHeap.shmalloc(64)
+    shmHeap.shmalloc(64)
+    shmHeap.shfree(ptr2)
+    stats = shmHeap.stats()
+    assert stats["allocatedBytes"] == 2 * 72
+    assert stats["freeBytes"] == 72 + 3880
+    assert stats["freeBlocks"] == 2
+    assert stats["largestFreeBlock"] == 3880
+    assert stats["allocCount"] == 3
+    assert stats["freeCount"] == 1
+
+    shmHeap.shrealloc(ptr1, 100)
+    shmHeap.resize(8192)
+    stats = shmHeap.stats()
+    assert stats["reallocCount"] == 1
+    assert stats["resizeCount"] == 1
+    assert stats["largestFreeBlock"] == 8192 - 112 - 32 - 72
+    assert shmHeap.verifyHeap()
+
+    reader = ShmemHeap("test_shm_heap")
+    reader.connect()
+    assert reader.stats() == shmHeap.stats()
+    reader.close()
+
+
+def testBinnedAllocation(setup):
+    shmHeap = setup
+
+    shmHeap.create()
+    ptr1 = shmHeap.shmalloc(24)
+    ptr2 = shmHeap.shmalloc(64)
+    ptr3 = shmHeap.shmalloc(24)
+    ptr4 = shmHeap.shmalloc(600)
+    ptr5 = shmHeap.shmalloc(24)
+
+    shmHeap.shfree(ptr2)
+    shmHeap.shfree(ptr4)
+    assert shmHeap.briefLayoutStr() == "24A, 64E, 24A, 600E, 24A, 3312E"
+    assert shmHeap.freeBinBitmap() & (1 << ShmemHeap.binIndex(72))
+    assert shmHeap.freeBinOffset(ShmemHeap.binIndex(72)) == ptr2 - 8
+
+    # An exact bin hit reuses the hole instead of splitting the tail block
+    assert shmHeap.shmalloc(64) == ptr2
+    # Best fit inside a log-spaced bin
+    assert shmHeap.shmalloc(500) == ptr4
+    assert shmHeap.briefLayoutStr() == "24A, 64A, 24A, 504A, 88E, 24A, 3312E"
+
+    for ptr in [ptr1, ptr2, ptr3, ptr4, ptr5]:
+        shmHeap.shfree(ptr)
+    assert shmHeap.briefLayoutStr() == "4088E"
+    assert shmHeap.verifyHeap()
+
+
+def testGrowthPolicy(setup):
+    shmHeap = setup
+
+    shmHeap.create()
+    assert shmHeap.getGrowthFactor() == 2.0
+    with pytest.raises(Exception):
+        shmHeap.setGrowthFactor(0.5)
+
+    shmHeap.shmalloc(5000)
+    assert shmHeap.heapCapacity() == 4096 + 8192
+
+    resizes = 0
+    lastCapacity = shmHeap.heapCapacity()
+    for _ in range(1000):
+        shmHeap.shmalloc(1000)
+        if shmHeap.heapCapacity() != lastCapacity:
+            assert shmHeap.heapCapacity() >= 2 * lastCapacity
+            lastCapacity = shmHeap.heapCapacity()
+            resizes += 1
+    assert resizes <= 7
+
+    shmHeap.setMaxHCap(shmHeap.heapCapacity())
+    with pytest.raises(Exception):
+        shmHeap.shmalloc(1 << 20)
+    assert shmHeap.heapCapacity() == lastCapacity
+    assert shmHeap.verifyHeap()
+
+
+def testArenaAllocation(setup):
+    shmHeap = setup
+
+    shmHeap.create()
+    with shmHeap.arena(2048) as region:
+        assert shmHeap.inArena()
+        ptr1 = shmHeap.shmalloc(24)
+        ptr2 = shmHeap.shmalloc(24)
+        ptr3 = shmHeap.shmalloc(24)
+        assert ptr1 == region[0] + 8
+        assert ptr2 == ptr1 + 32 and ptr3 == ptr2 + 32
+        assert shmHeap.briefLayoutStr() == "24A, 24A, 24A, 1952A, 2032E"
+        assert shmHeap.shfree(ptr2) == 0
+    assert not shmHeap.inArena()
+    assert region[1] == 96
+    assert shmHeap.briefLayoutStr() == "24A, 24E, 24A, 3992E"
+
+    assert shmHeap.shfreeRegion(region[0], region[1]) == 0
+    assert shmHeap.briefLayoutStr() == "4088E"
+    assert shmHeap.verifyHeap()
+
+
+def testSlabAllocation(setup):
+    shmHeap = setup
+
+    shmHeap.create()
+    pageSize = 5 * 8 + ShmemHeap.slabFirstPageSlots * 24
+    slots = [shmHeap.shmallocSlab(12) for _ in range(ShmemHeap.slabFirstPageSlots)]
+    assert all(b - a == 24 for a, b in zip(slots, slots[1:]))
+    assert shmHeap.briefLayout() == [pageSize, 4096 - pageSize - 2 * 8]
+    assert shmHeap.verifyHeap()
+
+    assert shmHeap.shfree(slots[3]) == 0
+    assert shmHeap.shfree(slots[3]) == -1
+    assert shmHeap.shmallocSlab(8) == slots[3]
+
+    # A full class opens a page twice as large
+    extra = shmHeap.shmallocSlab(16)
+    assert shmHeap.briefLayout()[1] == 5 * 8 + 2 * ShmemHeap.slabFirstPageSlots * 24
+    assert shmHeap.shfree(extra) == 0
+
+    assert shmHeap.shrealloc(slots[0], 16) == slots[0]
+    moved = shmHeap.shrealloc(slots[0], 40)
+    assert moved != slots[0]
+
+    for slot in slots[1:]:
+        assert shmHeap.shfree(slot) == 0
+    assert shmHeap.shfree(moved) == 0
+    assert shmHeap.briefLayoutStr() == "4088E"
+    assert shmHeap.verifyHeap()
+
+
+def testBatchAllocation(setup):
+    shmHeap = setup
+
+    shmHeap.create()
+    offsets = shmHeap.shmallocBatch([100, 0, 8, 200, 24])
+    assert offsets[1] == 0
+    assert offsets[2] == offsets[0] + 112
+    assert offsets[3] == offsets[2] + 32
+    assert offsets[4] == offsets[3] + 208
+    assert shmHeap.briefLayout() == [104, 24, 200, 24, 4096 - 384 - 8]
+    assert shmHeap.verifyHeap()
+
+    for offset in [offsets[3], offsets[0], offsets[4], offsets[2]]:
+        assert shmHeap.shfree(offset) == 0
+    assert shmHeap.briefLayout() == [4096 - 8]
+    assert shmHeap.verifyHeap()
+
+
+def testAlignedAllocation(setup):
+    shmHeap = setup
+
+    shmHeap.create()
+    # The mapping is page aligned, so the heap head sits staticCapacity bytes past a page boundary
+    offsets = []
+    for alignment in [16, 32, 64, 256, 4096]:
+        offset = shmHeap.shmemalign(100, alignment)
+        assert (shmHeap.staticCapacity() + offset) % alignment == 0
+        offsets.append(offset)
+        assert shmHeap.verifyHeap()
+
+    shifted = shmHeap.shmemalign(200, 64, 8)
+    assert (shmHeap.staticCapacity() + shifted + 8) % 64 == 0
+    offsets.append(shifted)
+
+    # A moved block keeps the alignment passed to shrealloc()
+    offsets[2] = shmHeap.shrealloc(offsets[2], 6000, alignment=64)
+    assert (shmHeap.staticCapacity() + offsets[2]) % 64 == 0
+    offsets[5] = shmHeap.shrealloc(shifted, 5000, alignment=64)
+    assert (shmHeap.staticCapacity() + offsets[5] + 8) % 64 == 0
+
+    with pytest.raises(Exception):
+        shmHeap.shmemalign(64, 48)
+    with pytest.raises(Exception):
+        shmHeap.shmemalign(64, 64, 4)
+
+    for offset in offsets:
+        assert shmHeap.shfree(offset) == 0
+    assert len(shmHeap.briefLayout()) == 1
+    assert shmHeap.verifyHeap()
+
+
+def testTraceRecording(setup):
+    shmHeap = setup
+
+    shmHeap.create()
+    tracePath = os.path.join(tempfile.mkdtemp(), "heap.trace")
+    shmHeap.startTrace(tracePath)
+    assert shmHeap.isTracing()
+    block = shmHeap.shmalloc(100)
+    moved = shmHeap.shrealloc(block, 5000)
+    assert shmHeap.shfree(moved) == 0
+    shmHeap.stopTrace()
+    assert not shmHeap.isTracing()
+
+    # timestamp, size, offset, result, op, aux
+    with open(tracePath, "rb") as f:
+        data = f.read()
+    shutil.rmtree(os.path.dirname(tracePath))
+    records = [struct.unpack_from("=QQQQII", data, i) for i in range(0, len(data), 40)]
+    assert len(data) == 3 * 40
+    assert [record[4] for record in records] == [0, 1, 2]  # malloc, realloc, free
+    assert records[0][1] == 100 and records[0][3] == block
+    assert records[1][2] == block and records[1][3] == moved
+    assert records[2][2] == moved
+
+
+def testConcurrentAllocation(setup):
+    shmHeap = setup
+
+    # Large enough that no process ever needs to resize
+    shmHeap.setHCap(1 << 20)
+    shmHeap.create()
+
+    # Children block on the pipe until all of them are forked
+    startRead, startWrite = os.pipe()
+    children = []
+    for p in range(4):
+        pid = os.fork()
+        if pid == 0:
+            os.close(startWrite)
+            os.read(startRead, 1)
+            rng = random.Random(p)
+            live = []
+            try:
+                for _ in range(2000):
+                    if len(live) < 64 and (not live or rng.random() < 0.5):
+                        live.append(shmHeap.shmalloc(rng.randint(8, 519)))
+                    else:
+                        ptr = live.pop(rng.randrange(len(live)))
+                        if shmHeap.shfree(ptr) != 0:
+                            os._exit(2)
+                for ptr in live:
+                    shmHeap.shfree(ptr)
+            except Exception:
+                os._exit(1)
+            os._exit(0)
+        children.append(pid)
+    os.close(startRead)
+    os.close(startWrite)
+
+    for pid in children:
+        _, status = os.waitpid(pid, 0)
+        assert os.WIFEXITED(status) and os.WEXITSTATUS(status) == 0
+
+    assert shmHeap.verifyHeap()
+    assert shmHeap.briefLayoutStr() == str((1 << 20) - 8) + "E"
+
+
+def testReadersFollowResize(setup):
+    shmHeap = setup
+
+    shmHeap.create()
+    numResizes = 64
+    startRead, startWrite = os.pipe()
+    children = []
+    for _ in range(3):
+        pid = os.fork()
+        if pid == 0:
+            os.close(startWrite)
+            os.read(startRead, 1)
+            try:
+                # verifyHeap walks every block up to the tail, so it faults if the grown tail is not mapped
+                while shmHeap.resizeEpoch() < numResizes:
+                    if not shmHeap.verifyHeap():
+                        os._exit(1)
+                if shmHeap.heapCapacity() != 4096 * (numResizes + 1):
+                    os._exit(2)
+            except Exception:
+                os._exit(3)
+            os._exit(0)
+        children.append(pid)
+    os.close(startRead)
+    os.close(startWrite)
+
+    for _ in range(numResizes):
+        shmHeap.resize(-1, shmHeap.heapCapacity() + 4096)
+
+    for pid in children:
+        _, status = os.waitpid(pid, 0)
+        assert os.WIFEXITED(status) and os.WEXITSTATUS(status) == 0
+    assert shmHeap.resizeEpoch() == numResizes
+
+
 if __name__ == "__main__":
     pytest.main(["-v", "pytest/ShmemHeap_test.py"])
\ No newline at end of file
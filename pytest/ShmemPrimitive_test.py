@@ -18,7 +18,7 @@ def testBasicAssignmentAndMemoryUsage(shmemPrimitiveTest):
     unitSize = 8  # Assuming unitSize is 8 bytes; adjust based on actual value
 
     acc.set(1)
-    expectedMemSize = 24  # min payload is 24
+    expectedMemSize = 5 * 8 + ShmemHeap.slabFirstPageSlots * 24  # Scalars share a slab page: 5 words of page info + 24-byte slots
     assert shmHeap.briefLayout() == [
         expectedMemSize,
         4096 - expectedMemSize - unitSize * 2,
@@ -51,6 +51,23 @@ def testBasicAssignmentAndMemoryUsage(shmemPrimitiveTest):
     # assert acc.toString(4) == "(P:unsigned long:10)[1, 1, 1, 1, ...]"
 
 
+def testAlignedArrays(shmemPrimitiveTest):
+    shmHeap, acc = shmemPrimitiveTest
+
+    shmHeap.setArrayAlignment(64)
+    assert shmHeap.getArrayAlignment() == 64
+    with pytest.raises(Exception):
+        shmHeap.setArrayAlignment(48)
+
+    acc.set([1.5] * 100)
+    assert (shmHeap.staticCapacity() + shmHeap.entranceOffset() + 8) % 64 == 0
+    assert acc[99] == 1.5
+    assert shmHeap.verifyHeap()
+
+    acc.set(None)
+    assert shmHeap.briefLayout() == [4096 - 8]
+
+
 def testTypeIdAndLen(shmemPrimitiveTest):
     _, acc = shmemPrimitiveTest
 
@@ -104,6 +121,22 @@ def testSetAndGetElement(shmemPrimitiveTest):
     assert acc.typeStr() == "char"
 
 
+def testWritesKeepLayout(shmemPrimitiveTest):
+    shmHeap, acc = shmemPrimitiveTest
+
+    # Writes bump a sequence kept in the block header, the block itself is untouched
+    acc.set([0.0] * 100)
+    layout = shmHeap.briefLayout()
+    for i in range(1000):
+        acc[i % 100] = float(i)
+        assert acc[i % 100] == float(i)
+    del acc[0]
+    assert shmHeap.briefLayout() == layout
+    assert acc.len() == 99
+    assert acc.fetch()[0] == 901.0
+    assert shmHeap.verifyHeap()
+
+
 # def testContains(shmemPrimitiveTest):
 #     _, acc = shmemPrimitiveTest
 
@@ -0,0 +1,79 @@
+import threading
+import time
+
+import pytest
+from TypedShmem import ShmemHeap, ShmemAccessor, SDict, SQueue
+
+
+@pytest.fixture
+def shmemQueueTest():
+    """Fixture to initialize and cleanup ShmemHeap and ShmemAccessor for each test."""
+    shmHeap = ShmemHeap("test_shm_queue", 80, 1 << 20)
+    acc = ShmemAccessor(shmHeap)
+    shmHeap.setLogLevel(0)
+    shmHeap.create()
+    yield shmHeap, acc
+    shmHeap.close()
+
+
+def testCreateEmptyQueue(shmemQueueTest):
+    _, acc = shmemQueueTest
+    acc.set(SQueue(100))
+    assert acc.len() == 0
+    assert acc.typeStr() == "queue"
+    assert acc.toString() == "(Q:0/128)SPSC[48 bytes]"
+    with pytest.raises(Exception):
+        acc.fetch()
+
+    acc.set(SQueue(3, slotSize=100, multi=True))
+    assert acc.toString() == "(Q:0/4)MPMC[100 bytes]"
+
+
+@pytest.mark.parametrize("multi", [False, True])
+def testPushPopInOrder(shmemQueueTest, multi):
+    _, acc = shmemQueueTest
+    acc.set(SDict({"q": SQueue(8, slotSize=16, multi=multi)}))
+    q = acc["q"]
+
+    assert q.pop(0) is None
+    for i in range(8):
+        assert q.push(str(i), 0)
+    assert not q.push("8", 0)
+    assert q.len() == 8
+    assert q.pop() == b"0"
+    assert q.popBatch(100, 0) == [str(i).encode() for i in range(1, 8)]
+
+    # bytes and str up to the slot size, the batch stops when the ring is full
+    assert q.pushBatch([b"\x00\x01", "", "0123456789abcdef"] + ["x"] * 10, 0) == 8
+    with pytest.raises(Exception):
+        q.push(b"0123456789abcdefg")
+    assert q.popBatch(3) == [b"\x00\x01", b"", b"0123456789abcdef"]
+    assert q.popBatch(100) == [b"x"] * 5
+
+    start = time.monotonic()
+    assert q.pop(20) is None
+    assert time.monotonic() - start >= 0.02
+
+
+def testBlockedPopReleasesGil(shmemQueueTest):
+    shmHeap, acc = shmemQueueTest
+    acc.set(SQueue(16, multi=True))
+    numMessages = 10000
+    received = []
+
+    def consumer():
+        other = ShmemAccessor(shmHeap)
+        while len(received) < numMessages:
+            received.extend(other.popBatch(64, 5000))
+
+    thread = threading.Thread(target=consumer)
+    thread.start()
+    for i in range(numMessages):
+        assert acc.push(i.to_bytes(4, "little"), 5000)
+    thread.join()
+    assert [int.from_bytes(m, "little") for m in received] == list(range(numMessages))
+    assert acc.len() == 0
+
+
+if __name__ == "__main__":
+    pytest.main(["-v", "pytest/ShmemQueue_test.py"])
@@ -48,7 +48,9 @@ ShmemAccessorWrapper ShmemAccessorWrapper::__getitem__(const py::args &keys) con
             throw py::type_error("Invalid type in access path");
         }
     }
-    return ShmemAccessorWrapper(this->heapPtr, accessPath);
+    ShmemAccessorWrapper result(this->heapPtr, accessPath);
+    result.snapshotPin = this->snapshotPin;
+    return result;
 }
 
 ShmemAccessorWrapper ShmemAccessorWrapper::operator[](const py::args &keys) const
@@ -58,6 +60,7 @@ ShmemAccessorWrapper ShmemAccessorWrapper::operator[](const py::args &keys) cons
 
 void ShmemAccessorWrapper::__setitem__(const py::object &indexOrKey, const py::object &value) const
 {
+    this->checkWritable();
     if (py::isinstance<py::str>(indexOrKey))
     {
         ShmemAccessorWrapper target = this->ShmemAccessor::operator[](py::cast<std::string>(indexOrKey));
@@ -158,7 +161,67 @@ void ShmemAccessorWrapper::add(const py::object &value)
     this->ShmemAccessor::add(value);
 }
 
+ShmemAccessorWrapper ShmemAccessorWrapper::snapshot() const
+{
+    ShmemAccessorWrapper result(this->heapPtr, this->path);
+    result.pinSnapshot();
+    return result;
+}
+
+bool ShmemAccessorWrapper::push(const py::object &message, int timeout) const
+{
+    std::string data = py::cast<std::string>(message);
+    py::gil_scoped_release release;
+    return this->ShmemAccessor::push(data, timeout);
+}
+
+py::object ShmemAccessorWrapper::pop(int timeout) const
+{
+    std::string data;
+    bool popped;
+    {
+        py::gil_scoped_release release;
+        popped = this->ShmemAccessor::pop(data, timeout);
+    }
+    if (!popped)
+        return py::none();
+    return py::bytes(data);
+}
+
+size_t ShmemAccessorWrapper::pushBatch(const py::list &messages, int timeout) const
+{
+    std::vector<std::string> data;
+    data.reserve(messages.size());
+    for (auto message : messages)
+    {
+        data.push_back(py::cast<std::string>(message));
+    }
+    py::gil_scoped_release release;
+    return this->ShmemAccessor::pushBatch(data, timeout);
+}
+
+py::list ShmemAccessorWrapper::popBatch(size_t maxCount, int timeout) const
+{
+    std::vector<std::string> data;
+    {
+        py::gil_scoped_release release;
+        this->ShmemAccessor::popBatch(data, maxCount, timeout);
+    }
+    py::list result;
+    for (const std::string &message : data)
+    {
+        result.append(py::bytes(message));
+    }
+    return result;
+}
+
 py::object ShmemAccessorWrapper::fetch() const
+{
+    return this->readCommitted([this]()
+                               { return this->fetchOnce(); });
+}
+
+py::object ShmemAccessorWrapper::fetchOnce() const
 {
     ShmemObj *obj, *prev;
     int resolvedDepth;
@@ -217,7 +280,7 @@ py::object ShmemAccessorWrapper::fetch() const
             return reinterpret_cast<ShmemPrimitive_ *>(obj)->operator pybind11::object();
         }
     }
-    else if (obj->type == List || obj->type == Dict)
+    else if (obj->type == List || obj->type == Dict || obj->type == HashMap || obj->type == Queue)
     {
         return obj->operator pybind11::object();
     }
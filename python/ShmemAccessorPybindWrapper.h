@@ -31,6 +31,17 @@ public:
     void insert(const py::object &key, const py::object &value);
     void add(const py::object &value);
     py::object fetch() const;
+
+    ShmemAccessorWrapper snapshot() const;
+
+    // Queue, messages are bytes (str is encoded as UTF-8). The waits release the GIL
+    bool push(const py::object &message, int timeout = -1) const;
+    py::object pop(int timeout = -1) const;
+    size_t pushBatch(const py::list &messages, int timeout = -1) const;
+    py::list popBatch(size_t maxCount, int timeout = -1) const;
+
+private:
+    py::object fetchOnce() const;
 };
 
 #endif
\ No newline at end of file
@@ -131,6 +131,107 @@ class ShmemAccessor(ShmemAccessor_pybind11):
         :return: The object pointed by the current accessor.
         """
         return super().fetch()
+
+    def version(self) -> int:
+        """
+        Get the version of the object pointed by the current accessor, it moves with every write to the object or below it.
+
+        :return: The version, 0 if the path does not lead to an object.
+        """
+        return super().version()
+
+    def watch(self, since: int, timeout: int = -1) -> int:
+        """
+        Block until version() moves away from since, without polling. The GIL is released while waiting.
+
+        :param since: A value returned by version() or by a previous watch().
+        :param timeout: Timeout in milliseconds, -1 to wait without a timeout.
+        :return: The current version, equal to since on timeout.
+        """
+        return super().watch(since, timeout)
+
+    def waitForChange(self, timeout: int = -1) -> bool:
+        """
+        Block until the object pointed by the current accessor, or anything below it, is written.
+        The GIL is released while waiting.
+
+        :param timeout: Timeout in milliseconds, -1 to wait without a timeout.
+        :return: False on timeout.
+        """
+        return super().waitForChange(timeout)
+
+    def snapshot(self) -> "ShmemAccessor":
+        """
+        Get an accessor to the same path that keeps reading the dicts as they are now, while writers go on.
+        Taken between two transaction commits, writes through it raise. Use it in a with block to release it at the end.
+        Only dicts keep older versions: lists, hash maps and primitive payloads, and what is reached through them, are read live.
+
+        :return: An accessor reading the snapshot.
+        """
+        return super().snapshot()
+
+    def isSnapshot(self) -> bool:
+        """
+        Check whether the current accessor reads a snapshot.
+
+        :return: True if it reads a snapshot.
+        """
+        return super().isSnapshot()
+
+    def snapshotEpoch(self) -> int:
+        """
+        Get the epoch of the snapshot the current accessor reads.
+
+        :return: The epoch, 0 for the live data.
+        """
+        return super().snapshotEpoch()
+
+    def release(self):
+        """
+        Read the live data again. The snapshot is unpinned, and its old versions freed, once no accessor holds it.
+        """
+        super().release()
+
+    def push(self, message: Union[bytes, str], timeout: int = -1) -> bool:
+        """
+        Push a message to the queue pointed by the current accessor, waiting for room while it is full.
+        The GIL is released while waiting.
+
+        :param message: The message, str is encoded as UTF-8. At most the slot size of the queue.
+        :param timeout: Timeout in milliseconds, 0 to return at once, -1 to wait without a timeout.
+        :return: False on timeout.
+        """
+        return super().push(message, timeout)
+
+    def pop(self, timeout: int = -1) -> Optional[bytes]:
+        """
+        Pop a message from the queue pointed by the current accessor, waiting while it is empty.
+        The GIL is released while waiting.
+
+        :param timeout: Timeout in milliseconds, 0 to return at once, -1 to wait without a timeout.
+        :return: The message, None on timeout.
+        """
+        return super().pop(timeout)
+
+    def pushBatch(self, messages: List[Union[bytes, str]], timeout: int = -1) -> int:
+        """
+        Push messages in order, an SPSC queue publishes them at once.
+
+        :param messages: The messages, str is encoded as UTF-8.
+        :param timeout: Timeout in milliseconds, 0 to return at once, -1 to wait without a timeout.
+        :return: Number of messages pushed, less than len(messages) on timeout.
+        """
+        return super().pushBatch(messages, timeout)
+
+    def popBatch(self, maxCount: int, timeout: int = -1) -> List[bytes]:
+        """
+        Pop up to maxCount messages, waiting for the first one only.
+
+        :param maxCount: Most messages to pop.
+        :param timeout: Timeout in milliseconds, 0 to return at once, -1 to wait without a timeout.
+        :return: The messages, empty on timeout.
+        """
+        return super().popBatch(maxCount, timeout)
     
     def get(self, key) -> ValueType:
         """
@@ -1,6 +1,8 @@
+from contextlib import contextmanager
 from typing import List, Optional, Union
 
 from .TypedShmem import ShmemHeap as ShmemHeap_pybind11
+from .TypedShmem import MapDefault, MapHugePages, MapLock, MapPopulate
 
 DHCap = 0x1000
 DSCap = 0x8
@@ -66,6 +68,15 @@ class ShmemHeap(ShmemHeap_pybind11):
             staticSpaceSize = arg1
         super().resize(staticSpaceSize, heapSize)
 
+    def trim(self) -> int:
+        """
+        Give the trailing free space of the heap back to the OS by shrinking the segment.
+        The heap keeps at least one page.
+
+        :return: Number of bytes the heap capacity shrank by.
+        """
+        return super().trim()
+
     def shmalloc(self, size: int) -> int:
         """
         Allocate a block in the heap.
@@ -75,15 +86,48 @@ class ShmemHeap(ShmemHeap_pybind11):
         """
         return super().shmalloc(size)
 
-    def shrealloc(self, offset: int, size: int) -> int:
+    def shrealloc(self, offset: int, size: int, alignment: int = 0) -> int:
         """
         Reallocate a block in the heap, keeping the content.
 
         :param offset: Offset of the original block from the heap head.
         :param size: New size of the payload, padded to a multiple of unitSize.
+        :param alignment: Alignment the block was allocated with by shmemalign(), 0 (or unitSize and less) for none.
+            A moved payload keeps its address modulo alignment, so an aligned offset stays aligned.
         :return: Offset of the reallocated block from the heap head.
         """
-        return super().shrealloc(offset, size)
+        return super().shrealloc(offset, size, alignment)
+
+    def shmallocSlab(self, size: int) -> int:
+        """
+        Allocate a small payload from a slab page of its size class (16, 32 or 64 bytes).
+        Larger payloads, and every payload in arena mode, fall back to shmalloc.
+
+        :param size: Size of the payload.
+        :return: Offset of the allocated payload from the heap head, freed by shfree.
+        """
+        return super().shmallocSlab(size)
+
+    def shmallocBatch(self, sizes: list) -> list:
+        """
+        Allocate several payloads with one pass over the free bins, carved back to back from one free block.
+
+        :param sizes: Payload sizes, a size of 0 gets offset 0.
+        :return: Offsets of the allocated payloads from the heap head, each freed by shfree.
+        """
+        return super().shmallocBatch(sizes)
+
+    def shmemalign(self, size: int, alignment: int, alignedOffset: int = 0) -> int:
+        """
+        Allocate a payload whose byte at alignedOffset lands on an alignment boundary.
+        Growing the static space moves the heap and may break the alignment.
+
+        :param size: Size of the payload.
+        :param alignment: Power of two up to the page size.
+        :param alignedOffset: Bytes into the payload that must be aligned, a multiple of 8.
+        :return: Offset of the allocated payload from the heap head, freed by shfree.
+        """
+        return super().shmemalign(size, alignment, alignedOffset)
 
     def shfree(self, offset: int) -> int:
         """
@@ -94,6 +138,115 @@ class ShmemHeap(ShmemHeap_pybind11):
         """
         return super().shfree(offset)
 
+    def beginArena(self, size: int) -> int:
+        """
+        Reserve one block of at least size bytes. Every shmalloc of this heap
+        bump-allocates from it until endArena(). Carved blocks are regular blocks
+        and can still be freed one by one.
+
+        :param size: Size of the region in bytes.
+        :return: Offset of the region from the heap head.
+        """
+        return super().beginArena(size)
+
+    def endArena(self) -> int:
+        """
+        Leave arena mode and return the unused tail of the region to the heap.
+
+        :return: Size in bytes of the region actually carved.
+        """
+        return super().endArena()
+
+    def inArena(self) -> bool:
+        """
+        Check if the heap is in arena mode.
+
+        :return: True between beginArena() and endArena().
+        """
+        return super().inArena()
+
+    def shfreeRegion(self, offset: int, size: int) -> int:
+        """
+        Free every block of a region at once, e.g. a whole snapshot built in arena mode.
+
+        :param offset: Offset of the region from the heap head, as returned by beginArena().
+        :param size: Size of the region in bytes, as returned by endArena().
+        :return: 0 on success, -1 if the range does not cover whole blocks.
+        """
+        return super().shfreeRegion(offset, size)
+
+    @contextmanager
+    def arena(self, size: int):
+        """
+        Context manager for arena mode, objects constructed inside the block are carved from one region.
+
+        :param size: Size of the region in bytes.
+        :return: A list that holds [offset, size] of the carved region once the block exits.
+        """
+        region = [self.beginArena(size), 0]
+        try:
+            yield region
+        finally:
+            region[1] = self.endArena()
+
+    def beginTransaction(self) -> None:
+        """
+        Start staging the writes of every accessor on this heap instead of applying them.
+        Reads keep seeing the committed data, including reads of this instance.
+        """
+        super().beginTransaction()
+
+    def commit(self) -> None:
+        """
+        Apply the staged writes in order and publish them to readers at once.
+        A write that fails rolls the commit back: the writes before it are undone, none of them is
+        published, and the error is raised.
+        """
+        super().commit()
+
+    def abort(self) -> None:
+        """
+        Drop the staged writes and end the transaction.
+        """
+        super().abort()
+
+    def inTransaction(self) -> bool:
+        """
+        Check if writes of this heap are staged.
+
+        :return: True between beginTransaction() and commit() or abort().
+        """
+        return super().inTransaction()
+
+    @contextmanager
+    def transaction(self):
+        """
+        Context manager for transactions, commits when the block exits normally and aborts on an exception.
+        """
+        self.beginTransaction()
+        try:
+            yield self
+        except BaseException:
+            self.abort()
+            raise
+        self.commit()
+
+    def newestSnapshot(self) -> int:
+        """
+        Get the epoch of the newest pinned snapshot, see ShmemAccessor.snapshot().
+
+        :return: The epoch, 0 if no snapshot is pinned.
+        """
+        return super().newestSnapshot()
+
+    def oldestSnapshot(self) -> int:
+        """
+        Get the epoch of the oldest pinned snapshot, see ShmemAccessor.snapshot().
+
+        :return: The epoch, 2**64 - 1 if no snapshot is pinned.
+        """
+        return super().oldestSnapshot()
+
     def getHCap(self) -> int:
         """
         Check the current purposed heap capacity.
@@ -110,6 +263,62 @@ class ShmemHeap(ShmemHeap_pybind11):
         """
         return super().getSCap()
 
+    def getSegmented(self) -> bool:
+        """
+        Check whether create() makes a segmented heap.
+
+        :return: The value set by setSegmented().
+        """
+        return super().getSegmented()
+
+    def getMapOptions(self) -> int:
+        """
+        Get the backing options used when this process maps the heap.
+
+        :return: Or-ed MapHugePages, MapPopulate and MapLock flags.
+        """
+        return super().getMapOptions()
+
+    def getReleaseThreshold(self) -> int:
+        """
+        Get the size from which a coalesced free block gives its pages back to the OS.
+
+        :return: Release threshold in bytes.
+        """
+        return super().getReleaseThreshold()
+
+    def getArrayAlignment(self) -> int:
+        """
+        Get the boundary the data of new primitive arrays is aligned to in this process.
+
+        :return: Alignment in bytes, 8 when arrays are not aligned.
+        """
+        return super().getArrayAlignment()
+
+    def getGrowthFactor(self) -> float:
+        """
+        Get the factor the heap capacity is multiplied by when shmalloc runs out of space.
+
+        :return: Growth factor.
+        """
+        return super().getGrowthFactor()
+
+    def getMinGrowSize(self) -> int:
+        """
+        Get the minimum number of bytes the heap grows by when shmalloc runs out of space.
+
+        :return: Minimum grow size.
+        """
+        return super().getMinGrowSize()
+
+    def getMaxHCap(self) -> int:
+        """
+        Get the maximum heap capacity growth may reach.
+
+        :return: Maximum heap capacity.
+        """
+        return super().getMaxHCap()
+
     def staticCapacity(self) -> int:
         """
         Get the size of the static space recorded in the first size_t(8 bytes) of the heap.
@@ -126,13 +335,90 @@ class ShmemHeap(ShmemHeap_pybind11):
         """
         return super().heapCapacity()
 
-    def freeBlockListOffset(self) -> int:
+    def freeBinBitmap(self) -> int:
+        """
+        Get the bitmap of non-empty free bins, recorded in the third size_t(8 bytes) of the heap.
+
+        :return: Bitmap where bit i is set if bin i holds at least one free block.
+        """
+        return super().freeBinBitmap()
+
+    def resizeEpoch(self) -> int:
+        """
+        Get the resize epoch, recorded in the sixth size_t(8 bytes) of the heap and bumped by every resize.
+        A heap that sees a new epoch remaps the segment before the operation continues.
+
+        :return: Current resize epoch.
+        """
+        return super().resizeEpoch()
+
+    def isSegmented(self) -> bool:
+        """
+        Check whether the connected heap grows by appending shared memory segments.
+
+        :return: True for a segmented heap.
+        """
+        return super().isSegmented()
+
+    def numSegments(self) -> int:
+        """
+        Get the number of shared memory segments the heap is made of, 1 for a heap that is not segmented.
+
+        :return: Number of segments.
+        """
+        return super().numSegments()
+
+    def segmentOf(self, offset: int) -> tuple:
+        """
+        Locate a heap offset in the segments of the heap.
+
+        :param offset: Offset from the heap head.
+        :return: (segment, offset from the start of the segment's part of the heap).
+        """
+        return super().segmentOf(offset)
+
+    def changeCount(self) -> int:
         """
-        Get the offset of the free block list, recorded in the third size_t(8 bytes) of the heap.
+        Get the number of changes announced by notifyChange() since the heap was created.
 
-        :return: Reference to the offset of the free block list.
+        :return: Change count.
         """
-        return super().freeBlockListOffset()
+        return super().changeCount()
+
+    def notifyChange(self):
+        """
+        Announce a change of the data on the heap, wakes every waitChange().
+        """
+        super().notifyChange()
+
+    def waitChange(self, since: int, timeout: int = -1) -> int:
+        """
+        Block until changeCount() moves away from since. The GIL is released while waiting.
+
+        :param since: A value returned by changeCount().
+        :param timeout: Timeout in milliseconds, -1 to wait without a timeout.
+        :return: The current change count, equal to since on timeout.
+        """
+        return super().waitChange(since, timeout)
+
+    def stats(self) -> dict:
+        """
+        Read the running counters of the heap in O(1), without walking the blocks or taking a lock.
+        Counters may be mutually off by the operations other processes have in flight.
+
+        :return: Dict with heapCapacity, allocatedBytes, freeBytes, freeBlocks, largestFreeBlock,
+                 allocCount, freeCount, reallocCount, resizeCount, busyContention and binsContention.
+        """
+        return super().stats()
+
+    def freeBinOffset(self, bin: int) -> int:
+        """
+        Get the offset of the first block in a free bin, recorded in the static space after the first four size_t.
+
+        :param bin: Index of the bin, see binIndex().
+        :return: Offset of the bin head from the heap head, NPtr if the bin is empty.
+        """
+        return super().freeBinOffset(bin)
 
     def entranceOffset(self) -> int:
         """
@@ -174,13 +460,24 @@ class ShmemHeap(ShmemHeap_pybind11):
         """
         return super().heapTail()
 
-    def freeBlockList(self) -> int:
+    def freeBin(self, bin: int) -> int:
+        """
+        Get the head pointer of a free bin. Check connection before using.
+
+        :param bin: Index of the bin, see binIndex().
+        :return: Pointer to the head of the free bin.
+        """
+        return super().freeBin(bin)
+
+    @staticmethod
+    def binIndex(blockSize: int) -> int:
         """
-        Get the head pointer of the free block list. Check connection before using.
+        Map a block size (including header) to the index of the free bin it belongs to.
 
-        :return: Pointer to the head of the free block list.
+        :param blockSize: Size of the whole block.
+        :return: Index of the bin.
         """
-        return super().freeBlockList()
+        return ShmemHeap_pybind11.binIndex(blockSize)
 
     def setHCap(self, size: int):
         """
@@ -198,6 +495,95 @@ class ShmemHeap(ShmemHeap_pybind11):
         """
         super().setSCap(size)
 
+    def setSegmented(self, segmented: bool):
+        """
+        Let the heap grow by appending shared memory segments (<name>_seg<serial>) instead of resizing
+        its first one, so existing pages are never remapped. Only used by create(). The static space of
+        a segmented heap cannot be resized and trim() drops whole trailing segments.
+
+        :param segmented: True for a segmented heap.
+        """
+        super().setSegmented(segmented)
+
+    def setMapOptions(self, options: int):
+        """
+        Set the backing options used when this process maps the heap. Takes effect on the
+        next create(), connect() or resize().
+
+        MapHugePages advises transparent huge pages (needs shmem_enabled set to advise),
+        MapPopulate pre-faults every page and MapLock locks the pages in memory.
+
+        :param options: Or-ed MapHugePages, MapPopulate and MapLock flags.
+        """
+        super().setMapOptions(options)
+
+    def setReleaseThreshold(self, size: int):
+        """
+        Set the size from which a coalesced free block gives its pages back to the OS.
+        The pages holding the block header and footer stay resident.
+
+        :param size: Release threshold in bytes, a value larger than the heap disables the release.
+        """
+        super().setReleaseThreshold(size)
+
+    def setArrayAlignment(self, alignment: int):
+        """
+        Set the boundary the data of new primitive arrays is aligned to in this process, e.g. 64 for cache lines.
+        Only arrays with at least alignment bytes of data are aligned.
+
+        :param alignment: Power of two up to the page size.
+        """
+        super().setArrayAlignment(alignment)
+
+    def startTrace(self, path: str):
+        """
+        Append a 40-byte record (timestamp, size, offset, result, op, aux) to a file for every allocator call
+        made by this process from now on. Calls made inside another call are not recorded.
+        Replay the file with the ShmemTraceReplay_benchmark executable.
+
+        :param path: File the records are appended to.
+        """
+        super().startTrace(path)
+
+    def stopTrace(self):
+        """
+        Flush and close the trace file.
+        """
+        super().stopTrace()
+
+    def isTracing(self) -> bool:
+        """
+        Check whether allocator calls are being recorded.
+
+        :return: True between startTrace and stopTrace.
+        """
+        return super().isTracing()
+
+    def setGrowthFactor(self, factor: float):
+        """
+        Set the factor the heap capacity is multiplied by when shmalloc runs out of space.
+
+        :param factor: Growth factor, must be >= 1.0. 1.0 disables geometric growth.
+        """
+        super().setGrowthFactor(factor)
+
+    def setMinGrowSize(self, size: int):
+        """
+        Set the minimum number of bytes the heap grows by when shmalloc runs out of space.
+        The heap always grows by at least the block that did not fit.
+
+        :param size: Minimum grow size, padded to page size.
+        """
+        super().setMinGrowSize(size)
+
+    def setMaxHCap(self, size: int):
+        """
+        Set the maximum heap capacity growth may reach. shmalloc raises once a request cannot fit below it.
+
+        :param size: Maximum heap capacity, rounded down to page size.
+        """
+        super().setMaxHCap(size)
+
     def setLogLevel(self, level: int):
         """
         Set the logger level.
@@ -237,6 +623,14 @@ class ShmemHeap(ShmemHeap_pybind11):
         """
         return super().briefLayoutStr()
 
+    def verifyHeap(self) -> bool:
+        """
+        Check the block and free bin invariants of the heap. The first violation is logged as an error.
+
+        :return: True if the heap is consistent.
+        """
+        return super().verifyHeap()
+
     # Temporary Utils
     def getCounterSemValue(self) -> int:
         """
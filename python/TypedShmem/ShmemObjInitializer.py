@@ -5,17 +5,34 @@ from .TypedShmem import ShmemObjInitializer as ShmemObjInitializer_pybind11
 # from .TypedShmem import SDict as SDict_pybind11
 # from .TypedShmem import SList as SList_pybind11
 from .TypeEncodings import Dict as Dict_val
+from .TypeEncodings import HashMap as HashMap_val
 from .TypeEncodings import List as List_val
+from .TypeEncodings import Queue as Queue_val
 
 
 def SDict(initVal=None) -> Union[Any, "ShmemObjInitializer"]:
     return ShmemObjInitializer(Dict_val, initVal)
 
 
+def SHashMap(initVal=None) -> Union[Any, "ShmemObjInitializer"]:
+    return ShmemObjInitializer(HashMap_val, initVal)
+
+
 def SList(initVal=None) -> Union[Any, "ShmemObjInitializer"]:
     return ShmemObjInitializer(List_val, initVal)
 
 
+def SQueue(capacity: int = 1024, slotSize: int = 48, multi: bool = False) -> Union[Any, "ShmemObjInitializer"]:
+    """
+    An empty queue of bytes messages, see ShmemAccessor.push() and ShmemAccessor.pop().
+
+    :param capacity: Number of slots, rounded up to a power of 2.
+    :param slotSize: Largest message in bytes.
+    :param multi: False for one producer and one consumer (SPSC), True for any number of each (MPMC).
+    """
+    return ShmemObjInitializer(Queue_val, {"capacity": capacity, "slotSize": slotSize, "multi": multi})
+
+
 class ShmemObjInitializer(ShmemObjInitializer_pybind11):
     """
     Can explicitly initialize a shared memory object to specific type.
@@ -17,4 +17,6 @@ String=101
 
 List=102
 DictNode=103
-Dict=104
\ No newline at end of file
+Dict=104
+HashMap=105
+Queue=106
@@ -1,17 +1,23 @@
 from __future__ import annotations
 
 from .ShmemAccessor import KeyType, ShmemAccessor, ValueType
-from .ShmemHeap import ShmemHeap
-from .ShmemObjInitializer import SDict, ShmemObjInitializer, SList
+from .ShmemHeap import MapDefault, MapHugePages, MapLock, MapPopulate, ShmemHeap
+from .ShmemObjInitializer import SDict, SHashMap, ShmemObjInitializer, SList, SQueue
 from .Utils import setShmemUtilLogLevel
 
 __all__ = [
     "ShmemHeap",
+    "MapDefault",
+    "MapHugePages",
+    "MapPopulate",
+    "MapLock",
     "ShmemAccessor",
     "KeyType",
     "ValueType",
     "SDict",
+    "SHashMap",
     "SList",
+    "SQueue",
     "ShmemObjInitializer",
     "setShmemUtilLogLevel",
 ]
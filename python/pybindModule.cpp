@@ -18,33 +18,93 @@ PYBIND11_MODULE(TypedShmem, m)
          .def("close", &ShmemHeap::close)
          .def("unlink", &ShmemHeap::unlink)
          .def("resize", py::overload_cast<long, long>(&ShmemHeap::resize))
+         .def("trim", &ShmemHeap::trim)
          .def("shmalloc", &ShmemHeap::shmalloc)
-         .def("shrealloc", &ShmemHeap::shrealloc)
+         .def("shrealloc", &ShmemHeap::shrealloc, py::arg("offset"), py::arg("size"), py::arg("alignment") = 0)
+         .def("shmallocSlab", &ShmemHeap::shmallocSlab, py::arg("size"))
+         .def("shmallocBatch", [](ShmemHeap *heap, const std::vector<size_t> &sizes)
+              {
+                   std::vector<size_t> offsets(sizes.size());
+                   heap->shmallocBatch(sizes.data(), sizes.size(), offsets.data());
+                   return offsets; }, py::arg("sizes"))
+         .def("shmemalign", &ShmemHeap::shmemalign, py::arg("size"), py::arg("alignment"), py::arg("alignedOffset") = 0)
          .def("shfree", static_cast<int (ShmemHeap::*)(size_t)>(&ShmemHeap::shfree), py::arg("offset"))
+         .def("beginArena", &ShmemHeap::beginArena, py::arg("size"))
+         .def("endArena", &ShmemHeap::endArena)
+         .def("inArena", &ShmemHeap::inArena)
+         .def("beginTransaction", &ShmemHeap::beginTransaction)
+         .def("commit", &ShmemHeap::commit)
+         .def("abort", &ShmemHeap::abort)
+         .def("inTransaction", &ShmemHeap::inTransaction)
+         .def("newestSnapshot", &ShmemHeap::newestSnapshot)
+         .def("oldestSnapshot", &ShmemHeap::oldestSnapshot)
+         .def("shfreeRegion", &ShmemHeap::shfreeRegion, py::arg("offset"), py::arg("size"))
          .def("getName", &ShmemHeap::getName)
          .def("getCapacity", &ShmemHeap::getCapacity)
          .def("getVersion", &ShmemHeap::getVersion)
          .def("getHCap", &ShmemHeap::getHCap)
          .def("getSCap", &ShmemHeap::getSCap)
+         .def("getSegmented", &ShmemHeap::getSegmented)
+         .def("getGrowthFactor", &ShmemHeap::getGrowthFactor)
+         .def("getMinGrowSize", &ShmemHeap::getMinGrowSize)
+         .def("getMaxHCap", &ShmemHeap::getMaxHCap)
+         .def("getMapOptions", &ShmemHeap::getMapOptions)
+         .def("getReleaseThreshold", &ShmemHeap::getReleaseThreshold)
+         .def("getArrayAlignment", &ShmemHeap::getArrayAlignment)
          .def("isConnected", &ShmemHeap::isConnected)
          .def("ownsSharedMemory", &ShmemHeap::ownsSharedMemory)
          // Not a good idea to provide reference to internal data
          //     .def("staticCapacity", &ShmemHeap::staticCapacity, py::return_value_policy::reference)
          //     .def("heapCapacity", &ShmemHeap::heapCapacity, py::return_value_policy::reference)
-         //     .def("freeBlockListOffset", &ShmemHeap::freeBlockListOffset, py::return_value_policy::reference)
          //     .def("entranceOffset", &ShmemHeap::entranceOffset, py::return_value_policy::reference)
          .def("staticCapacity", &ShmemHeap::staticCapacity)
          .def("heapCapacity", &ShmemHeap::heapCapacity)
-         .def("freeBlockListOffset", &ShmemHeap::freeBlockListOffset)
+         .def("freeBinBitmap", &ShmemHeap::freeBinBitmap)
+         .def("resizeEpoch", &ShmemHeap::resizeEpoch)
+         .def("isSegmented", &ShmemHeap::isSegmented)
+         .def("numSegments", &ShmemHeap::numSegments)
+         .def("segmentOf", &ShmemHeap::segmentOf, py::arg("offset"))
+         .def("changeCount", &ShmemHeap::changeCount)
+         .def("notifyChange", &ShmemHeap::notifyChange)
+         .def("waitChange", &ShmemHeap::waitChange, py::arg("since"), py::arg("timeout") = -1, py::call_guard<py::gil_scoped_release>())
+         .def("stats", [](ShmemHeap *heap)
+              {
+                   ShmemHeap::Stats stats = heap->stats();
+                   py::dict result;
+                   result["heapCapacity"] = stats.heapCapacity;
+                   result["allocatedBytes"] = stats.allocatedBytes;
+                   result["freeBytes"] = stats.freeBytes;
+                   result["freeBlocks"] = stats.freeBlocks;
+                   result["largestFreeBlock"] = stats.largestFreeBlock;
+                   result["allocCount"] = stats.allocCount;
+                   result["freeCount"] = stats.freeCount;
+                   result["reallocCount"] = stats.reallocCount;
+                   result["resizeCount"] = stats.resizeCount;
+                   result["busyContention"] = stats.busyContention;
+                   result["binsContention"] = stats.binsContention;
+                   return result; })
+         .def("freeBinOffset", &ShmemHeap::freeBinOffset, py::arg("bin"))
          .def("entranceOffset", &ShmemHeap::entranceOffset)
          .def("staticSpaceHead", &ShmemHeap::staticSpaceHead)
          .def("entrance", &ShmemHeap::entrance)
          .def("heapHead", &ShmemHeap::heapHead)
          .def("heapTail", &ShmemHeap::heapTail)
-         //     .def("freeBlockList", &ShmemHeap::freeBlockList, py::return_value_policy::reference)
-         .def("freeBlockList", &ShmemHeap::freeBlockList)
+         .def("freeBin", &ShmemHeap::freeBin, py::arg("bin"))
+         .def_static("binIndex", &ShmemHeap::binIndex, py::arg("blockSize"))
+         .def_readonly_static("slabSlotsPerPage", &ShmemHeap::slabSlotsPerPage)
+         .def_readonly_static("slabFirstPageSlots", &ShmemHeap::slabFirstPageSlots)
          .def("setHCap", &ShmemHeap::setHCap)
          .def("setSCap", &ShmemHeap::setSCap)
+         .def("setSegmented", &ShmemHeap::setSegmented, py::arg("segmented"))
+         .def("setGrowthFactor", &ShmemHeap::setGrowthFactor)
+         .def("setMinGrowSize", &ShmemHeap::setMinGrowSize)
+         .def("setMaxHCap", &ShmemHeap::setMaxHCap)
+         .def("setMapOptions", &ShmemHeap::setMapOptions, py::arg("options"))
+         .def("setReleaseThreshold", &ShmemHeap::setReleaseThreshold, py::arg("size"))
+         .def("setArrayAlignment", &ShmemHeap::setArrayAlignment, py::arg("alignment"))
+         .def("startTrace", &ShmemHeap::startTrace, py::arg("path"))
+         .def("stopTrace", &ShmemHeap::stopTrace)
+         .def("isTracing", &ShmemHeap::isTracing)
          // spdlog is not usable in python, so we don't expose the instance, instead, we set some common attribute functions
          // .def("getLogger", &ShmemHeap::getLogger)
          .def("setLogLevel", [](ShmemHeap *heap, int level)
@@ -55,11 +115,18 @@ PYBIND11_MODULE(TypedShmem, m)
          .def("printShmHeap", &ShmemHeap::printShmHeap)
          .def("briefLayout", &ShmemHeap::briefLayout)
          .def("briefLayoutStr", &ShmemHeap::briefLayoutStr)
+         .def("verifyHeap", &ShmemHeap::verifyHeap)
           // Temporary Utils
           .def("getCounterSemValue", &ShmemHeap::getCounterSemValue)
           .def("postCounterSem", &ShmemHeap::postCounterSem)
           .def("waitCounterSem", &ShmemHeap::waitCounterSem);
           
+     // Backing options for setMapOptions, or them together
+     m.attr("MapDefault") = static_cast<int>(ShmemUtils::MapDefault);
+     m.attr("MapHugePages") = static_cast<int>(ShmemUtils::MapHugePages);
+     m.attr("MapPopulate") = static_cast<int>(ShmemUtils::MapPopulate);
+     m.attr("MapLock") = static_cast<int>(ShmemUtils::MapLock);
+
      // Initializers
      py::class_<ShmemObjInitializer>(m, "ShmemObjInitializer")
          .def(py::init<int, pybind11::object>(), py::arg("typeId"), py::arg("initialVal"))
@@ -72,6 +139,8 @@ PYBIND11_MODULE(TypedShmem, m)
                                 { return self.getInitialVal(); }); // Access initial value
                                 
      m.def("SDict", &SDict);
+     m.def("SHashMap", &SHashMap);
+     m.def("SQueue", &SQueue, py::arg("capacity") = ShmemQueue::DefaultCapacity, py::arg("slotSize") = ShmemQueue::DefaultSlotSize, py::arg("multi") = false);
      m.def("SList", &SList);
 
      m.def("setShmemUtilLogLevel", [](int level)
@@ -93,6 +162,24 @@ PYBIND11_MODULE(TypedShmem, m)
          .def("typeId", &ShmemAccessorWrapper::typeId)
          .def("typeStr", &ShmemAccessorWrapper::typeStr)
          .def("fetch", &ShmemAccessorWrapper::fetch)
+         // Change notification, the waits let other Python threads run
+         .def("version", &ShmemAccessorWrapper::version)
+         .def("watch", &ShmemAccessorWrapper::watch, py::arg("since"), py::arg("timeout") = -1, py::call_guard<py::gil_scoped_release>())
+         .def("waitForChange", &ShmemAccessorWrapper::waitForChange, py::arg("timeout") = -1, py::call_guard<py::gil_scoped_release>())
+         // Snapshots, a with block releases the snapshot at its end
+         .def("snapshot", &ShmemAccessorWrapper::snapshot)
+         .def("isSnapshot", &ShmemAccessorWrapper::isSnapshot)
+         .def("snapshotEpoch", &ShmemAccessorWrapper::snapshotEpoch)
+         .def("release", &ShmemAccessorWrapper::release)
+         .def("__enter__", [](py::object self)
+              { return self; })
+         .def("__exit__", [](ShmemAccessorWrapper &a, const py::args &)
+              { a.release(); })
+         // Queue, the waits let other Python threads run
+         .def("push", &ShmemAccessorWrapper::push, py::arg("message"), py::arg("timeout") = -1)
+         .def("pop", &ShmemAccessorWrapper::pop, py::arg("timeout") = -1)
+         .def("pushBatch", &ShmemAccessorWrapper::pushBatch, py::arg("messages"), py::arg("timeout") = -1)
+         .def("popBatch", &ShmemAccessorWrapper::popBatch, py::arg("maxCount"), py::arg("timeout") = -1)
          .def("get", &ShmemAccessorWrapper::get<py::object>)
          .def("set", &ShmemAccessorWrapper::set<py::object>)
          .def("add", &ShmemAccessorWrapper::add)
@@ -13,6 +13,20 @@ ShmemObjInitializer SDict(const pybind11::object &iniDict)
     return ShmemObjInitializer(Dict, iniDict);
 }
 
+ShmemObjInitializer SHashMap(const pybind11::object &iniDict)
+{
+    return ShmemObjInitializer(HashMap, iniDict);
+}
+
+ShmemObjInitializer SQueue(size_t capacity, size_t slotSize, bool multi)
+{
+    pybind11::dict spec;
+    spec["capacity"] = capacity;
+    spec["slotSize"] = slotSize;
+    spec["multi"] = multi;
+    return ShmemObjInitializer(Queue, spec);
+}
+
 // ShmemAccessor constructors
 ShmemAccessor::ShmemAccessor(ShmemHeap *heapPtr) : heapPtr(heapPtr), path({}) {}
 
@@ -20,6 +34,11 @@ ShmemAccessor::ShmemAccessor(ShmemHeap *heapPtr, std::vector<KeyType> path) : he
 
 inline ShmemObj *ShmemAccessor::entrance() const
 {
+    if (this->snapshotPin)
+    {
+        size_t offset = this->snapshotPin->entranceOffset;
+        return offset == NPtr ? nullptr : reinterpret_cast<ShmemObj *>(this->heapPtr->heapHead() + offset);
+    }
     return reinterpret_cast<ShmemObj *>(this->heapPtr->entrance());
 }
 
@@ -33,7 +52,75 @@ void ShmemAccessor::setEntrance(ShmemObj *obj)
     this->heapPtr->entranceOffset() = reinterpret_cast<Byte *>(obj) - this->heapPtr->heapHead();
 }
 
-void ShmemAccessor::resolvePath(ShmemObj *&prevObj, ShmemObj *&obj, int &resolvedDepth) const
+// Snapshots
+ShmemAccessor::SnapshotPin::SnapshotPin(ShmemHeap *heapPtr) : heapPtr(heapPtr)
+{
+    this->epoch = heapPtr->pinSnapshot(this->entranceOffset);
+}
+
+ShmemAccessor::SnapshotPin::~SnapshotPin()
+{
+    try
+    {
+        this->heapPtr->unpinSnapshot(this->epoch);
+        ShmemObj::reclaim(this->heapPtr);
+    }
+    catch (...)
+    {
+        // The heap is gone already, nothing is left to free
+    }
+}
+
+void ShmemAccessor::pinSnapshot()
+{
+    this->snapshotPin = std::make_shared<const SnapshotPin>(this->heapPtr);
+}
+
+void ShmemAccessor::checkWritable() const
+{
+    if (this->snapshotPin)
+    {
+        throw std::runtime_error("Cannot write through a snapshot of " + this->pathToString());
+    }
+}
+
+ShmemQueue *ShmemAccessor::resolveQueue() const
+{
+    return this->readCommitted([this]()
+                               {
+        ShmemObj *obj, *prev;
+        int resolvedDepth;
+        resolvePath(prev, obj, resolvedDepth);
+        if (static_cast<size_t>(resolvedDepth) != path.size() || obj == nullptr)
+            throw std::runtime_error("No queue at " + this->pathToString());
+        if (obj->type != Queue)
+            throw std::runtime_error("Cannot push or pop on a " + typeNames.at(obj->type) + " object");
+        return static_cast<ShmemQueue *>(obj); });
+}
+
+ShmemAccessor ShmemAccessor::snapshot() const
+{
+    ShmemAccessor result(this->heapPtr, this->path);
+    result.pinSnapshot();
+    return result;
+}
+
+bool ShmemAccessor::isSnapshot() const
+{
+    return this->snapshotPin != nullptr;
+}
+
+size_t ShmemAccessor::snapshotEpoch() const
+{
+    return this->snapshotPin ? this->snapshotPin->epoch : 0;
+}
+
+void ShmemAccessor::release()
+{
+    this->snapshotPin.reset();
+}
+
+void ShmemAccessor::resolvePath(ShmemObj *&prevObj, ShmemObj *&obj, int &resolvedDepth, std::vector<size_t> *chain) const
 {
     ShmemObj *current = this->entrance();
     ShmemObj *prev = nullptr;
@@ -47,10 +134,18 @@ void ShmemAccessor::resolvePath(ShmemObj *&prevObj, ShmemObj *&obj, int &resolve
             {
                 break;
             }
-            else if (isPrimitive(current->type))
+            if (chain != nullptr)
+            {
+                chain->push_back(reinterpret_cast<Byte *>(current) - this->heapPtr->heapHead());
+            }
+            if (isPrimitive(current->type))
             { // This mean there's an additional index on a primitive
                 break;
             }
+            else if (current->type == Queue)
+            { // Messages in a queue are not indexable
+                break;
+            }
             else if (current->type == Dict)
             {
                 ShmemDict *currentDict = static_cast<ShmemDict *>(current);
@@ -58,6 +153,13 @@ void ShmemAccessor::resolvePath(ShmemObj *&prevObj, ShmemObj *&obj, int &resolve
                 prev = current;
                 current = currentDict->get(pathElement);
             }
+            else if (current->type == HashMap)
+            {
+                ShmemHashMap *currentMap = static_cast<ShmemHashMap *>(current);
+
+                prev = current;
+                current = currentMap->get(pathElement);
+            }
             else if (current->type == List)
             {
                 ShmemList *currentList = static_cast<ShmemList *>(current);
@@ -75,15 +177,128 @@ void ShmemAccessor::resolvePath(ShmemObj *&prevObj, ShmemObj *&obj, int &resolve
             break;
         }
     }
+    // Fully resolved, the last object has not been recorded by the loop
+    if (chain != nullptr && current != nullptr && static_cast<size_t>(resolveDepth) == path.size())
+    {
+        chain->push_back(reinterpret_cast<Byte *>(current) - this->heapPtr->heapHead());
+    }
     prevObj = prev;
     obj = current;
     resolvedDepth = resolveDepth;
     return;
 }
 
+void ShmemAccessor::notifyChange(const std::vector<size_t> &chain) const
+{
+    Byte *heapHead = this->heapPtr->heapHead();
+    for (size_t offset : chain)
+    {
+        (reinterpret_cast<ShmemHeap::BlockHeader *>(heapHead + offset) - 1)->bumpSeq();
+    }
+    this->heapPtr->notifyChange();
+}
+
+// Transactions
+ShmemHeap::StagedWrite ShmemAccessor::undoImage(bool removes) const
+{
+    ShmemObj *obj, *prev;
+    int resolvedDepth;
+    resolvePath(prev, obj, resolvedDepth);
+    Byte *heapHead = this->heapPtr->heapHead();
+
+    if (static_cast<size_t>(resolvedDepth) == path.size())
+    {
+        // The write unlinks the object and retires it, the commit holds the free back until it ends
+        size_t offset = obj == nullptr ? NPtr : static_cast<size_t>(reinterpret_cast<Byte *>(obj) - heapHead);
+        if (removes && prev != nullptr && prev->type == List)
+        {
+            const ShmemList *list = static_cast<const ShmemList *>(prev);
+            int index = std::get<int>(path.back());
+            index = index < 0 ? index + static_cast<int>(list->len()) : index;
+            ShmemAccessor parent(this->heapPtr, std::vector<KeyType>(path.begin(), path.end() - 1));
+            return [parent, index, offset]() mutable
+            {
+                ShmemObj *listObj, *listPrev;
+                int listDepth;
+                parent.resolvePath(listPrev, listObj, listDepth);
+                ShmemList *list = static_cast<ShmemList *>(listObj);
+                if (list->len() == static_cast<size_t>(index))
+                    list->append(ShmemObj::Linked{offset}, parent.heapPtr);
+                else
+                    list->insert(index, ShmemObj::Linked{offset}, parent.heapPtr);
+                if (offset != NPtr)
+                    parent.heapPtr->keepRetired(offset);
+            };
+        }
+        return [target = *this, offset]() mutable
+        { target.relink(offset); };
+    }
+
+    if (static_cast<size_t>(resolvedDepth) == path.size() - 1 && obj != nullptr)
+    {
+        // A key the write adds is removed again
+        if (!removes && (obj->type == Dict || obj->type == HashMap))
+        {
+            ShmemAccessor parent(this->heapPtr, std::vector<KeyType>(path.begin(), path.end() - 1));
+            return [parent, key = path.back()]() mutable
+            {
+                if (parent.contains(key))
+                    parent.del(key);
+            };
+        }
+        // Element writes change the array in place, it gets its bytes back
+        if (isPrimitive(obj->type) && std::holds_alternative<int>(path.back()))
+        {
+            size_t offset = reinterpret_cast<Byte *>(obj) - heapHead;
+            const Byte *begin = reinterpret_cast<const Byte *>(obj);
+            std::vector<Byte> image(begin, begin + obj->capacity());
+            return [heapPtr = this->heapPtr, offset, image]()
+            {
+                ShmemObj *array = reinterpret_cast<ShmemObj *>(heapPtr->heapHead() + offset);
+                ShmemObj::WriteGuard guard(array);
+                memcpy(array, image.data(), image.size());
+            };
+        }
+    }
+
+    // The write is going to fail before it changes anything
+    return nullptr;
+}
+
+ShmemHeap::StagedWrite ShmemAccessor::undoAppend() const
+{
+    ShmemObj *obj, *prev;
+    int resolvedDepth;
+    resolvePath(prev, obj, resolvedDepth);
+    if (static_cast<size_t>(resolvedDepth) != path.size() || obj == nullptr || obj->type != List)
+        return nullptr;
+
+    size_t length = static_cast<ShmemList *>(obj)->len();
+    return [target = *this, length]() mutable
+    {
+        if (target.len() > length)
+            target.del(static_cast<int>(length));
+    };
+}
+
+void ShmemAccessor::relink(size_t offset)
+{
+    ShmemObj *obj, *prev;
+    int resolvedDepth;
+    resolvePath(prev, obj, resolvedDepth);
+    if (static_cast<size_t>(resolvedDepth) == path.size() && (obj == nullptr ? NPtr : static_cast<size_t>(reinterpret_cast<Byte *>(obj) - this->heapPtr->heapHead())) == offset)
+        return;
+
+    // Replacing retires what the write linked, the commit frees it once it ends
+    this->set(ShmemObj::Linked{offset});
+    if (offset != NPtr)
+        this->heapPtr->keepRetired(offset);
+}
+
 // Type (Special interface)
 int ShmemAccessor::typeId() const
 {
+    ShmemDict::SnapshotScope scope(this->snapshotEpoch());
     ShmemObj *obj, *prev;
     int resolvedDepth;
     resolvePath(prev, obj, resolvedDepth);
@@ -120,6 +335,7 @@ std::string ShmemAccessor::pathString() const
 // __len__ implementation
 size_t ShmemAccessor::len() const
 {
+    ShmemDict::SnapshotScope scope(this->snapshotEpoch());
     ShmemObj *obj, *prev;
     int resolvedDepth;
     resolvePath(prev, obj, resolvedDepth);
@@ -155,6 +371,14 @@ size_t ShmemAccessor::len() const
     {
         return static_cast<ShmemDict *>(obj)->len();
     }
+    else if (obj->type == HashMap)
+    {
+        return static_cast<ShmemHashMap *>(obj)->len();
+    }
+    else if (obj->type == Queue)
+    {
+        return static_cast<ShmemQueue *>(obj)->len();
+    }
     else
     {
         throw std::runtime_error("Cannot get len of " + typeNames.at(obj->type));
@@ -164,9 +388,19 @@ size_t ShmemAccessor::len() const
 // __delitem__
 void ShmemAccessor::del(KeyType index)
 {
+    this->checkWritable();
+    if (this->stageWrite([target = *this, index]() mutable
+                         { target.del(index); },
+                         [target = (*this)[index]]()
+                         { return target.undoImage(true); }))
+    {
+        return;
+    }
+
     ShmemObj *obj, *prev;
     int resolvedDepth;
-    resolvePath(prev, obj, resolvedDepth);
+    std::vector<size_t> chain;
+    resolvePath(prev, obj, resolvedDepth, &chain);
 
     if (static_cast<size_t>(resolvedDepth) != path.size())
     {
@@ -191,6 +425,7 @@ void ShmemAccessor::del(KeyType index)
             throw std::runtime_error("Cannot use string as index on Primitive Object");
         }
         static_cast<ShmemPrimitive_ *>(obj)->del(std::get<int>(index));
+        chain.pop_back(); // The array counted the write itself
         // throw std::runtime_error("Cannot delete from " + typeNames.at(obj->type) + " Primitive Object, as it's immutable");
     }
     else if (obj->type == List)
@@ -205,15 +440,21 @@ void ShmemAccessor::del(KeyType index)
     {
         static_cast<ShmemDict *>(obj)->del(index, this->heapPtr);
     }
+    else if (obj->type == HashMap)
+    {
+        static_cast<ShmemHashMap *>(obj)->del(index, this->heapPtr);
+    }
     else
     {
         throw std::runtime_error("Cannot delete from " + typeNames.at(obj->type) + " Primitive Object, as it's immutable");
     }
+    this->notifyChange(chain);
 }
 
 // __str__ implementation
 std::string ShmemAccessor::toString(int maxElements) const
 {
+    ShmemDict::SnapshotScope scope(this->snapshotEpoch());
     ShmemObj *obj, *prev;
     int resolvedDepth;
     resolvePath(prev, obj, resolvedDepth);
@@ -253,6 +494,65 @@ std::string ShmemAccessor::toString(int maxElements) const
         return obj->toString(0, maxElements);
 }
 
+// Change notification
+size_t ShmemAccessor::version() const
+{
+    ShmemDict::SnapshotScope scope(this->snapshotEpoch());
+    ShmemObj *obj, *prev;
+    int resolvedDepth;
+    resolvePath(prev, obj, resolvedDepth);
+
+    if (obj == nullptr)
+    {
+        return 0;
+    }
+    if (static_cast<size_t>(resolvedDepth) != path.size())
+    {
+        // An element of a primitive array shares the version of the array
+        if (!(static_cast<size_t>(resolvedDepth) == path.size() - 1 && isPrimitive(obj->type) && std::holds_alternative<int>(path[resolvedDepth])))
+        {
+            return 0;
+        }
+    }
+
+    // The offset tells a replacement from the object it replaced, the write sequence counts the changes in place.
+    // The heap carries the sequence over to the next block at the same offset, a replacement landing there still moves it
+    size_t offset = reinterpret_cast<Byte *>(obj) - this->heapPtr->heapHead();
+    return (offset << (62 - ShmemHeap::BlockHeader::seqShift)) | (reinterpret_cast<ShmemHeap::BlockHeader *>(obj) - 1)->seq();
+}
+
+size_t ShmemAccessor::watch(size_t since, int timeout) const
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    while (true)
+    {
+        // Take the change count first, a write after it wakes the wait below
+        size_t changes = this->heapPtr->changeCount();
+        size_t current = this->version();
+        if (current != since)
+        {
+            return current;
+        }
+
+        int left = -1;
+        if (timeout >= 0)
+        {
+            left = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count());
+            if (left <= 0)
+            {
+                return current;
+            }
+        }
+        this->heapPtr->waitChange(changes, left);
+    }
+}
+
+bool ShmemAccessor::waitForChange(int timeout) const
+{
+    size_t since = this->version();
+    return this->watch(since, timeout) != since;
+}
+
 std::ostream &operator<<(std::ostream &os, const ShmemAccessor &acc)
 {
     os << acc.toString();
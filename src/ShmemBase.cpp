@@ -1,5 +1,6 @@
 #include "ShmemBase.h"
 #include "ShmemUtils.h"
+#include <algorithm>
 
 std::string sliceToHexString(const unsigned char *array, size_t start, size_t length)
 {
@@ -20,6 +21,8 @@ ShmemBase::ShmemBase(const std::string &name, size_t capacity)
     // init metrics
     this->name = name;
     this->capacity = capacity;
+    this->mappedSize = 0;
+    this->mapOptions = ShmemUtils::MapDefault;
     this->connected = false;
     this->ownShm = false;
     this->usedSize = 0;
@@ -71,7 +74,8 @@ void ShmemBase::create()
     }
 
     // create shared memory
-    this->shmFd = ShmemUtils::createShm(this->shmPtr, this->name, this->capacity);
+    this->shmFd = ShmemUtils::createShm(this->shmPtr, this->name, this->capacity, this->mapOptions);
+    this->mappedSize = this->capacity;
     this->ownShm = true;
     this->connected = true;
 
@@ -106,41 +110,26 @@ void ShmemBase::resize(size_t newCapacity, bool keepContent)
     // Acquire write lock to prevent concurrent writing/resizing
     assert(ShmemUtils::waitSem(this->writeLock) == 0);
 
-    size_t oldSize = 0;
-    Byte *tempShm = nullptr;
-    size_t oldCapacity = this->capacity;
+    size_t oldCapacity = this->mappedSize;
 
-    // Record old data
-    if (keepContent)
+    // Resize the segment in place, the content and the name are kept and nothing is copied
+    this->shmPtr = ShmemUtils::resizeShm(this->shmFd, this->shmPtr, oldCapacity, newCapacity, this->mapOptions);
+    if (!keepContent)
     {
-        oldSize = this->usedSize;
-        tempShm = new Byte[oldCapacity];
-        std::memcpy(tempShm, this->shmPtr, oldCapacity);
+        // Pages beyond the old capacity are already zero
+        ShmemUtils::clearShm(this->shmPtr, std::min(oldCapacity, newCapacity));
+        this->usedSize = 0;
     }
+    this->capacity = newCapacity;
+    this->mappedSize = newCapacity;
 
-    // Increase the version Semaphore to indicate this shm is resized
+    // Increase the version Semaphore to indicate this shm is resized, this process is already up to date
     ShmemUtils::postSem(this->versionSem);
-
-    // Close and recreate shared memory
-    ShmemUtils::closeShm(this->shmFd, this->shmPtr, this->capacity);
-    this->shmFd = ShmemUtils::createShm(this->shmPtr, this->name, newCapacity); // This will automatically unlink the old shm
-
-    // Restore old data
-    if (keepContent)
-    {
-        std::memcpy(this->shmPtr, tempShm, oldCapacity);
-        delete[] tempShm;
-    }
+    this->version = ShmemUtils::getSemValue(this->versionSem);
 
     // Release write lock
     ShmemUtils::postSem(this->writeLock);
 
-    if (keepContent)
-    {
-        this->usedSize = oldSize;
-    }
-    this->capacity = newCapacity;
-
     this->logger->info("Resized shared memory object {} from {} to {}", this->name, oldCapacity, newCapacity);
 }
 
@@ -152,11 +141,12 @@ void ShmemBase::connect()
         throw std::runtime_error("ShmemBase already connected, please close the previous connection first or use reconnect()");
     }
 
-    this->shmFd = ShmemUtils::connectShm(this->shmPtr, this->name, this->waitTime);
+    this->shmFd = ShmemUtils::connectShm(this->shmPtr, this->name, this->waitTime, milliseconds(100 * 1000), this->mapOptions);
     this->ownShm = false;
     this->connected = true;
 
     this->capacity = ShmemUtils::getShmSize(this->shmFd);
+    this->mappedSize = this->capacity;
     this->usedSize = 0; // used size only record the furthest index reached by this process
 
     // connect related semaphore
@@ -178,12 +168,25 @@ void ShmemBase::reconnect()
         throw std::runtime_error("ShmemBase not connected, please connect or create the ShmemBase first");
     }
 
-    this->shmFd = ShmemUtils::connectShm(this->shmPtr, this->name, this->waitTime);
+    if (ShmemUtils::shmUnlinked(this->shmFd))
+    {
+        // The shm was recreated under the same name, map the new one
+        ShmemUtils::closeShm(this->shmFd, this->shmPtr, this->mappedSize);
+        this->shmFd = ShmemUtils::connectShm(this->shmPtr, this->name, this->waitTime, milliseconds(100 * 1000), this->mapOptions);
+        this->mappedSize = ShmemUtils::getShmSize(this->shmFd);
+    }
+    else
+    {
+        // The shm was resized in place, follow it without leaving the reserved address range
+        size_t newSize = ShmemUtils::getShmSize(this->shmFd);
+        this->shmPtr = ShmemUtils::remapShm(this->shmFd, this->shmPtr, this->mappedSize, newSize, this->mapOptions);
+        this->mappedSize = newSize;
+    }
     // Reconnect won't change the ownership of the shm
     // As ownership is just the responsibility to clean up the shm
     this->connected = true;
 
-    this->capacity = ShmemUtils::getShmSize(this->shmFd);
+    this->capacity = this->mappedSize;
     // Reconnect won't change the usedSize either
 
     // The version sem should be already connected
@@ -208,7 +211,10 @@ void ShmemBase::clear()
 
 void ShmemBase::close()
 {
-    ShmemUtils::closeShm(this->shmFd, this->shmPtr, this->usedSize);
+    ShmemUtils::closeShm(this->shmFd, this->shmPtr, this->mappedSize);
+    this->shmFd = -1;
+    this->shmPtr = nullptr;
+    this->mappedSize = 0;
 
     // close related sem
     ShmemUtils::closeSem(this->counterSem);
@@ -309,6 +315,12 @@ void ShmemBase::setCapacity(size_t capacity)
     this->logger->info("Set capacity to {}", capacity);
 }
 
+void ShmemBase::setMapOptions(int options)
+{
+    this->mapOptions = options;
+    this->logger->info("Set map options to {:#x}", options);
+}
+
 // Accessors
 const std::string &ShmemBase::getName() const
 {
@@ -322,6 +334,10 @@ size_t ShmemBase::getUsedSize() const
 {
     return this->usedSize;
 }
+int ShmemBase::getMapOptions() const
+{
+    return this->mapOptions;
+}
 int ShmemBase::getVersion() const
 {
     return this->version;
@@ -455,6 +471,8 @@ void ShmemBase::borrow(const ShmemBase &other)
 
         this->name = other.name;
         this->capacity = other.capacity;
+        this->mappedSize = 0;
+        this->mapOptions = other.mapOptions;
         this->connected = false;
         this->ownShm = false;
         this->usedSize = 0;
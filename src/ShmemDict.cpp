@@ -1,19 +1,15 @@
 #include "ShmemDict.h"
 // Utlities
-int hashIntOrString(KeyType key)
+size_t hashIntOrString(const KeyType &key)
 {
-    size_t hashCode = 0;
     if (std::holds_alternative<std::string>(key))
-    {
-        hashCode = std::hash<std::string>{}(std::get<std::string>(key));
-    }
+        return std::hash<std::string>{}(std::get<std::string>(key));
     else
-    {
-        hashCode = std::hash<int>{}(std::get<int>(key));
-    }
-    return static_cast<int>(hashCode);
+        return std::hash<int>{}(std::get<int>(key));
 }
 
+thread_local size_t ShmemDict::readEpoch = 0;
+
 ShmemDictNode *ShmemDict::root() const
 {
     return reinterpret_cast<ShmemDictNode *>(reinterpret_cast<uintptr_t>(this) + rootOffset);
@@ -151,10 +147,8 @@ void ShmemDict::transplant(ShmemDictNode *nodeU, ShmemDictNode *nodeV)
     {
         nodeU->parent()->setRight(nodeV);
     }
-    if (nodeV != NIL())
-    {
-        nodeV->setParent(nodeU->parent());
-    }
+    // Also on NIL, fixDelete() climbs from it
+    nodeV->setParent(nodeU->parent());
 }
 
 ShmemDictNode *ShmemDict::minimum(ShmemDictNode *node) const
@@ -174,25 +168,7 @@ ShmemDictNode *ShmemDict::maximum(ShmemDictNode *node) const
     }
     return node;
 }
-ShmemDictNode *ShmemDict::findSuccessor(const ShmemDictNode *node) const
-{
-    // If the right subtree is not null, the successor is the minimum key in the right subtree
-    if (node->right() != NIL())
-    {
-        return minimum(node->right());
-    }
-
-    // If there is no right subtree, the successor is an ancestor
-    ShmemDictNode *p = node->parent();
-    while (p != nullptr && node == p->right())
-    {
-        node = p;
-        p = p->parent();
-    }
-    return p;
-}
-
-void ShmemDict::fixDelete(ShmemDictNode *nodeX)
+void ShmemDict::fixDelete(ShmemDictNode *nodeX, size_t newest, ShmemHeap *heapPtr)
 {
     while (nodeX != root() && !nodeX->isRed())
     {
@@ -202,6 +178,7 @@ void ShmemDict::fixDelete(ShmemDictNode *nodeX)
 
             if (nodeW->isRed())
             {
+                nodeW = own(nodeW, newest, heapPtr);
                 nodeW->colorBlack();
                 nodeX->parent()->colorRed();
                 leftRotate(nodeX->parent());
@@ -215,8 +192,11 @@ void ShmemDict::fixDelete(ShmemDictNode *nodeX)
             }
             else
             {
+                // The path up from nodeX is owned already, the sibling side is not
+                nodeW = own(nodeW, newest, heapPtr);
                 if (!nodeW->right()->isRed())
                 {
+                    own(nodeW->left(), newest, heapPtr);
                     nodeW->left()->colorBlack();
                     nodeW->colorRed();
                     rightRotate(nodeW);
@@ -236,6 +216,7 @@ void ShmemDict::fixDelete(ShmemDictNode *nodeX)
 
             if (nodeW->isRed())
             {
+                nodeW = own(nodeW, newest, heapPtr);
                 nodeW->colorBlack();
                 nodeX->parent()->colorRed();
                 rightRotate(nodeX->parent());
@@ -249,8 +230,10 @@ void ShmemDict::fixDelete(ShmemDictNode *nodeX)
             }
             else
             {
+                nodeW = own(nodeW, newest, heapPtr);
                 if (!nodeW->left()->isRed())
                 {
+                    own(nodeW->right(), newest, heapPtr);
                     nodeW->right()->colorBlack();
                     nodeW->colorRed();
                     leftRotate(nodeW);
@@ -268,24 +251,154 @@ void ShmemDict::fixDelete(ShmemDictNode *nodeX)
     nodeX->colorBlack();
 }
 
-void ShmemDict::insert(KeyType key, ShmemObj *data, ShmemHeap *heapPtr)
+size_t ShmemDict::beginVersion(ShmemHeap *heapPtr)
+{
+    // Pairs with the fence of ShmemHeap::pinSnapshot(): a snapshot missed below reads this dict after the write,
+    // and its epoch is at least the one read here
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    size_t epoch = heapPtr->snapshotEpoch();
+    if (heapPtr->newestSnapshot() == 0 && versionsOffset == 0)
+    {
+        versionEpoch = epoch;
+        return 0;
+    }
+
+    std::vector<size_t> pins = heapPtr->pinnedSnapshots();
+    size_t newest = pins.empty() ? 0 : *std::max_element(pins.begin(), pins.end());
+
+    // Keep the current root for the snapshots that read it
+    if (newest != 0 && versionEpoch <= newest)
+    {
+        size_t versionOffset = heapPtr->shmallocSlab(sizeof(ShmemDictVersion));
+        ShmemDictVersion *version = reinterpret_cast<ShmemDictVersion *>(heapPtr->heapHead() + versionOffset);
+        version->epoch = versionEpoch;
+        version->rootOffset = rootOffset;
+        version->nextOffset = versionsOffset;
+        version->size = this->size;
+        versionsOffset = reinterpret_cast<Byte *>(version) - reinterpret_cast<Byte *>(this);
+    }
+    // Later than every pin seen, what this write creates must not be read by them
+    versionEpoch = std::max(epoch, newest + 1);
+
+    // Drop the versions no pinned snapshot reads anymore. A version serves the epochs up to the next newer one
+    ptrdiff_t *link = &versionsOffset;
+    size_t newerEpoch = versionEpoch;
+    while (*link != 0)
+    {
+        ShmemDictVersion *version = reinterpret_cast<ShmemDictVersion *>(reinterpret_cast<Byte *>(this) + *link);
+        bool needed = std::any_of(pins.begin(), pins.end(), [&](size_t pin)
+                                  { return version->epoch <= pin && pin < newerEpoch; });
+        if (needed)
+        {
+            newerEpoch = version->epoch;
+            link = &version->nextOffset;
+            continue;
+        }
+        size_t versionOffset = reinterpret_cast<Byte *>(version) - heapPtr->heapHead();
+        *link = version->nextOffset;
+        // A snapshot may be walking the chain right now
+        ShmemObj::retire(versionOffset, heapPtr, false);
+    }
+    return newest;
+}
+
+ShmemDictNode *ShmemDict::own(ShmemDictNode *node, size_t newest, ShmemHeap *heapPtr)
+{
+    if (node == NIL() || node->birth > newest)
+        return node;
+
+    ShmemDictNode *parent = node->parent() == nullptr ? nullptr : own(node->parent(), newest, heapPtr);
+
+    size_t copyOffset = heapPtr->shmallocSlab(sizeof(ShmemDictNode));
+    ShmemDictNode *copy = static_cast<ShmemDictNode *>(resolveOffset(copyOffset, heapPtr));
+    copy->type = DictNode;
+    copy->size = -1;
+    copy->setColor(node->getColor());
+    copy->setLeft(node->left());
+    copy->setRight(node->right());
+    copy->setParent(parent);
+    copy->keyOffset = reinterpret_cast<const Byte *>(node->key()) - reinterpret_cast<Byte *>(copy);
+    copy->setData(node->data());
+    copy->keyHash = node->keyHash;
+    copy->birth = static_cast<uint32_t>(versionEpoch);
+
+    if (parent == nullptr)
+        setRoot(copy);
+    else if (parent->left() == node)
+        parent->setLeft(copy);
+    else
+        parent->setRight(copy);
+    if (copy->left() != NIL())
+        copy->left()->setParent(copy);
+    if (copy->right() != NIL())
+        copy->right()->setParent(copy);
+
+    // Key and data now belong to the copy
+    ShmemObj::retire(reinterpret_cast<Byte *>(node) - heapPtr->heapHead(), heapPtr, false);
+    return copy;
+}
+
+ShmemDictNode *ShmemDict::readRoot(int *size) const
 {
-    int hashKey = hashIntOrString(key);
+    if (readEpoch == 0)
+    {
+        if (size != nullptr)
+            *size = this->size;
+        return root();
+    }
+
+    while (true)
+    {
+        size_t seq = beginRead();
+        ptrdiff_t offset = rootOffset;
+        int count = this->size;
+        bool found = versionEpoch <= readEpoch;
+        // Versions go from the newest to the oldest, the first one not newer than the snapshot is its version.
+        // Without one the live root is read: only a dict reached through a list or a hash map (read live) can be newer
+        for (ptrdiff_t versionOffset = versionsOffset; !found && versionOffset != 0;)
+        {
+            const ShmemDictVersion *version = reinterpret_cast<const ShmemDictVersion *>(reinterpret_cast<const Byte *>(this) + versionOffset);
+            if (version->epoch <= readEpoch)
+            {
+                offset = version->rootOffset;
+                count = version->size;
+                found = true;
+            }
+            versionOffset = version->nextOffset;
+        }
+        if (retryRead(seq))
+            continue;
+        if (size != nullptr)
+            *size = count;
+        return reinterpret_cast<ShmemDictNode *>(reinterpret_cast<uintptr_t>(this) + offset);
+    }
+}
+
+void ShmemDict::insert(const KeyType &key, ShmemObj *data, ShmemHeap *heapPtr)
+{
+    WriteGuard guard(this);
+    size_t newest = beginVersion(heapPtr);
+    size_t hashKey = hashIntOrString(key);
 
     ShmemDictNode *parent = nullptr;
     ShmemDictNode *current = root();
+    int order = 0;
 
     while (current != NIL())
     {
         parent = current;
-        if (hashKey < current->hashedKey())
+        order = current->compare(hashKey, key);
+        if (order < 0)
             current = current->left();
-        else if (hashKey > current->hashedKey())
+        else if (order > 0)
             current = current->right();
         else
         { // repeated key, replace the old data, don't increase the size
-            ShmemObj::deconstruct(reinterpret_cast<Byte *>(current->data()) - heapPtr->heapHead(), heapPtr);
+            current = own(current, newest, heapPtr);
+            ShmemObj *oldData = current->data();
             current->setData(data);
+            if (oldData != nullptr)
+                ShmemObj::retire(reinterpret_cast<Byte *>(oldData) - heapPtr->heapHead(), heapPtr);
             return;
         }
     }
@@ -296,18 +409,18 @@ void ShmemDict::insert(KeyType key, ShmemObj *data, ShmemHeap *heapPtr)
     newNode->setData(data);
     newNode->setLeft(NIL());
     newNode->setRight(NIL());
+    newNode->birth = static_cast<uint32_t>(versionEpoch);
+    // fixInsert() only relinks nodes on the path to the new node, owning the parent owns all of them
+    if (parent != nullptr)
+        parent = own(parent, newest, heapPtr);
     newNode->setParent(parent);
 
     if (parent == nullptr)
         setRoot(newNode);
-    else if (hashKey < parent->hashedKey())
+    else if (order < 0)
         parent->setLeft(newNode);
-    else if (hashKey > parent->hashedKey())
-        parent->setRight(newNode);
     else
-    {
-        throw std::runtime_error("hashKey == parent->key, and code should not reach here");
-    }
+        parent->setRight(newNode);
 
     // Increase the size
     this->size++;
@@ -323,9 +436,9 @@ void ShmemDict::insert(KeyType key, ShmemObj *data, ShmemHeap *heapPtr)
     fixInsert(newNode);
 }
 
-ShmemDictNode *ShmemDict::search(KeyType key)
+ShmemDictNode *ShmemDict::search(const KeyType &key)
 {
-    ShmemDictNode *result = searchHelper(root(), hashIntOrString(key));
+    ShmemDictNode *result = searchHelper(readRoot(), hashIntOrString(key), key);
     if (result == NIL())
     {
         return nullptr;
@@ -360,24 +473,27 @@ void ShmemDict::toStringHelper(const ShmemDictNode *node, int indent, std::ostri
     }
 }
 
-void ShmemDict::deconstructHelper(ShmemDictNode *node, ShmemHeap *heapPtr)
+void ShmemDict::deconstructHelper(ShmemDictNode *node, const ShmemDictNode *nil, ShmemHeap *heapPtr)
 {
-    if (node->hashedKey() != hashedNILKey)
+    if (node != nil)
     {
-        deconstructHelper(node->left(), heapPtr);  // Destroy the left subtree
-        deconstructHelper(node->right(), heapPtr); // Destroy the right subtree
+        deconstructHelper(node->left(), nil, heapPtr);  // Destroy the left subtree
+        deconstructHelper(node->right(), nil, heapPtr); // Destroy the right subtree
         ShmemDictNode::deconstruct(reinterpret_cast<const Byte *>(node) - heapPtr->heapHead(), heapPtr);
     }
 }
 
-ShmemDictNode *ShmemDict::searchHelper(ShmemDictNode *node, int key)
+ShmemDictNode *ShmemDict::searchHelper(ShmemDictNode *node, size_t hash, const KeyType &key)
 {
-    if (node == this->NIL() || node->hashedKey() == key)
-        return node;
-    if (key < node->hashedKey())
-        return searchHelper(node->left(), key);
-    else
-        return searchHelper(node->right(), key);
+    ShmemDictNode *nil = this->NIL();
+    while (node != nil)
+    {
+        int order = node->compare(hash, key);
+        if (order == 0)
+            break;
+        node = order < 0 ? node->left() : node->right();
+    }
+    return node;
 }
 
 void ShmemDict::keysHelper(const ShmemDictNode *node, std::vector<KeyType> &result, bool &allInt, bool &allString) const
@@ -431,6 +547,8 @@ size_t ShmemDict::construct(ShmemHeap *heapPtr)
 
     dictPtr->setRoot(NILPtr);
     dictPtr->setNIL(NILPtr);
+    dictPtr->versionEpoch = heapPtr->snapshotEpoch();
+    dictPtr->versionsOffset = 0;
 
     return dictOffset;
 }
@@ -479,19 +597,28 @@ void ShmemDict::deconstruct(size_t offset, ShmemHeap *heapPtr)
 {
     // Do post-order traversal and remove all nodes
     ShmemDict *ptr = reinterpret_cast<ShmemDict *>(resolveOffset(offset, heapPtr));
-    deconstructHelper(ptr->root(), heapPtr);
+    deconstructHelper(ptr->root(), ptr->NIL(), heapPtr);
     ShmemDictNode::deconstruct(reinterpret_cast<Byte *>(ptr->NIL()) - heapPtr->heapHead(), heapPtr);
+    // Nodes only older versions had were retired when they were copied, the versions themselves are left
+    for (ptrdiff_t versionOffset = ptr->versionsOffset; versionOffset != 0;)
+    {
+        ShmemDictVersion *version = reinterpret_cast<ShmemDictVersion *>(reinterpret_cast<Byte *>(ptr) + versionOffset);
+        versionOffset = version->nextOffset;
+        heapPtr->shfree(reinterpret_cast<Byte *>(version));
+    }
     heapPtr->shfree(reinterpret_cast<Byte *>(ptr));
 }
 
 // __len__
 size_t ShmemDict::len() const
 {
-    return this->size;
+    int size;
+    readRoot(&size);
+    return size;
 }
 
 // __getitem__
-ShmemObj *ShmemDict::get(KeyType key) const
+ShmemObj *ShmemDict::get(const KeyType &key) const
 {
     const ShmemDictNode *result = search(key);
     if (result == nullptr)
@@ -502,13 +629,16 @@ ShmemObj *ShmemDict::get(KeyType key) const
 // __setitem__ implemented in .tcc, alias to insert()
 
 // __delitem__
-void ShmemDict::del(KeyType key, ShmemHeap *heapPtr)
+void ShmemDict::del(const KeyType &key, ShmemHeap *heapPtr)
 {
-    ShmemDictNode *nodeToDelete = search(key);
-    if (nodeToDelete == nullptr || nodeToDelete == NIL())
+    WriteGuard guard(this);
+    ShmemDictNode *nodeToDelete = searchHelper(root(), hashIntOrString(key), key);
+    if (nodeToDelete == NIL())
     {
         throw IndexError("Key not found");
     }
+    size_t newest = beginVersion(heapPtr);
+    nodeToDelete = own(nodeToDelete, newest, heapPtr);
 
     ShmemDictNode *nodeY = nodeToDelete; // Node to be deleted or moved
     ShmemDictNode *nodeX;                // Node that will replace nodeY
@@ -526,7 +656,7 @@ void ShmemDict::del(KeyType key, ShmemHeap *heapPtr)
     }
     else
     {
-        nodeY = minimum(nodeToDelete->right()); // Find the minimum node in the right subtree
+        nodeY = own(minimum(nodeToDelete->right()), newest, heapPtr); // Find the minimum node in the right subtree
         originalColor = nodeY->isRed();
         nodeX = nodeY->right();
 
@@ -547,20 +677,24 @@ void ShmemDict::del(KeyType key, ShmemHeap *heapPtr)
         nodeY->setColor(nodeToDelete->getColor());
     }
 
-    // Free memory used by the nodeToDelete
-    ShmemDictNode::deconstruct(reinterpret_cast<Byte *>(nodeToDelete) - heapPtr->heapHead(), heapPtr);
+    // Free memory used by the nodeToDelete. The data is retired on its own, a rolled back commit links it again
+    Byte *heapHead = heapPtr->heapHead();
+    if (nodeToDelete->data() != nullptr)
+        ShmemObj::retire(reinterpret_cast<Byte *>(nodeToDelete->data()) - heapHead, heapPtr);
+    ShmemObj::retire(reinterpret_cast<const Byte *>(nodeToDelete->key()) - heapHead, heapPtr);
+    ShmemObj::retire(reinterpret_cast<Byte *>(nodeToDelete) - heapHead, heapPtr, false);
 
     // Decrease the size
     this->size--;
 
     if (!originalColor)
     {
-        fixDelete(nodeX);
+        fixDelete(nodeX, newest, heapPtr);
     }
 }
 
 // __contains__
-bool ShmemDict::contains(KeyType key) const
+bool ShmemDict::contains(const KeyType &key) const
 {
     const ShmemDictNode *result = search(key);
     if (result == nullptr)
@@ -573,11 +707,13 @@ std::string ShmemDict::toString(int indent, int maxElements) const
 {
     std::ostringstream resultStream;
 
-    maxElements = maxElements > 0 ? maxElements : this->size;
+    int size;
+    const ShmemDictNode *root = readRoot(&size);
+    maxElements = maxElements > 0 ? maxElements : size;
 
-    resultStream << "(D:" << std::to_string(this->size) << ")" << "{\n";
+    resultStream << "(D:" << std::to_string(size) << ")" << "{\n";
 
-    toStringHelper(this->root(), indent + 1, resultStream, 0, maxElements);
+    toStringHelper(root, indent + 1, resultStream, 0, maxElements);
 
     resultStream << std::string(indent, ' ') << "}";
 
@@ -590,8 +726,10 @@ std::vector<KeyType> ShmemDict::keys(bool *allInt_, bool *allString_) const
     bool allInt = true;
     bool allString = true;
     std::vector<KeyType> result;
-    result.reserve(this->size);
-    keysHelper(this->root(), result, allInt, allString);
+    int size;
+    const ShmemDictNode *root = readRoot(&size);
+    result.reserve(size);
+    keysHelper(root, result, allInt, allString);
     if (allInt_)
         *allInt_ = allInt;
     if (allString_)
@@ -603,7 +741,7 @@ std::vector<KeyType> ShmemDict::keys(bool *allInt_, bool *allString_) const
 // Iterator related
 KeyType ShmemDict::beginIdx() const
 {
-    const ShmemDictNode *min = minimum(this->root());
+    const ShmemDictNode *min = minimum(readRoot());
     return min->keyVal(); // if NIL, it is the end() iterator, and the whole dict is empty
 }
 KeyType ShmemDict::endIdx() const
@@ -616,12 +754,28 @@ KeyType ShmemDict::nextIdx(KeyType index) const
     if (index == this->NIL()->keyVal())
         throw StopIteration("Dict index out of bounds");
 
-    const ShmemDictNode *node = search(index);
-    if (node == nullptr)
+    // Walk down from the root, parent links only hold for the live tree
+    size_t hash = hashIntOrString(index);
+    const ShmemDictNode *nil = this->NIL();
+    const ShmemDictNode *node = readRoot();
+    const ShmemDictNode *successor = nil;
+    bool found = false;
+    while (node != nil)
+    {
+        int order = node->compare(hash, index);
+        if (order < 0)
+        {
+            successor = node;
+            node = node->left();
+        }
+        else
+        {
+            found = found || order == 0;
+            node = node->right();
+        }
+    }
+    if (!found)
         throw IndexError("Cannot get next index of a non-existent key");
-    const ShmemDictNode *successor = findSuccessor(node);
-    if (successor == nullptr)
-        return this->NIL()->keyVal();
     return successor->keyVal();
 }
 
@@ -629,13 +783,13 @@ KeyType ShmemDict::nextIdx(KeyType index) const
 ShmemDict::operator pybind11::dict() const
 {
     pybind11::dict result;
-    toPyObjectHelper(this->root(), result);
+    toPyObjectHelper(readRoot(), result);
     return result;
 }
 
 ShmemDict::operator pybind11::object() const
 {
     pybind11::dict result;
-    toPyObjectHelper(this->root(), result);
+    toPyObjectHelper(readRoot(), result);
     return result;
 }
@@ -1,9 +1,12 @@
 #include "ShmemDict.h"
 
+static_assert(sizeof(ShmemDictNode) == ShmemHeap::slabClassSize(ShmemHeap::numSlabClasses - 1), "ShmemDictNode should fill a slot of the largest slab class");
+
 // ShmemDictNode methods
-size_t ShmemDictNode::construct(KeyType key, ShmemHeap *heapPtr)
+size_t ShmemDictNode::construct(const KeyType &key, ShmemHeap *heapPtr)
 {
-    size_t offset = heapPtr->shmalloc(sizeof(ShmemDictNode));
+    // Nodes all have the same size, they are packed into slab pages
+    size_t offset = heapPtr->shmallocSlab(sizeof(ShmemDictNode));
     ShmemDictNode *ptr = static_cast<ShmemDictNode *>(resolveOffset(offset, heapPtr));
     ptr->type = DictNode;
     ptr->size = -1; // DictNode doesn't need to record size
@@ -16,6 +19,9 @@ size_t ShmemDictNode::construct(KeyType key, ShmemHeap *heapPtr)
         ptr->keyOffset = ShmemPrimitive_::construct(std::get<std::string>(key), heapPtr) - offset;
     else
         ptr->keyOffset = ShmemPrimitive_::construct(std::get<int>(key), heapPtr) - offset;
+    // Keys are immutable, hash once so tree walks don't rebuild and rehash the key
+    ptr->keyHash = hashIntOrString(key);
+    ptr->birth = 0; // Stamped by the dict write that links the node
     return offset;
 }
 
@@ -150,15 +156,35 @@ int ShmemDictNode::dataType() const
     return data()->type;
 }
 
-int ShmemDictNode::hashedKey() const
+size_t ShmemDictNode::hashedKey() const
 {
-    int keyType = key()->type;
-    if (keyType == Char)
-        return static_cast<int>(std::hash<std::string>{}(reinterpret_cast<const ShmemPrimitive<char> *>(key())->operator std::string()));
-    else if (keyType == Int)
-        return static_cast<int>(std::hash<int>{}(reinterpret_cast<const ShmemPrimitive<int> *>(key())->operator int()));
-    else
-        throw std::runtime_error("Unknown key type");
+    return keyHash;
+}
+
+int ShmemDictNode::compare(size_t hash, const KeyType &key) const
+{
+    if (hash != keyHash)
+        return hash < keyHash ? -1 : 1;
+
+    // Same hash, order by the full key. Int keys go before string keys
+    const ShmemPrimitive_ *nodeKey = static_cast<const ShmemPrimitive_ *>(this->key());
+    if (std::holds_alternative<int>(key))
+    {
+        if (nodeKey->type != Int)
+            return -1;
+        int lhs = std::get<int>(key);
+        int rhs = *reinterpret_cast<const int *>(nodeKey->getBytePtr());
+        return (lhs > rhs) - (lhs < rhs);
+    }
+
+    if (nodeKey->type == Int)
+        return 1;
+    const std::string &lhs = std::get<std::string>(key);
+    size_t rhsSize = static_cast<size_t>(nodeKey->size) - 1; // Stored with a trailing \0
+    int result = std::memcmp(lhs.data(), nodeKey->getBytePtr(), std::min(lhs.size(), rhsSize));
+    if (result != 0)
+        return result;
+    return (lhs.size() > rhsSize) - (lhs.size() < rhsSize);
 }
 
 std::string ShmemDictNode::keyToString() const
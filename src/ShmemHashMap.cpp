@@ -0,0 +1,507 @@
+#include "ShmemHashMap.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Utilities
+namespace
+{
+    /**
+     * @brief Bit i is set if the i-th control byte of the group equals value
+     */
+    inline uint32_t matchCtrl(const int8_t *group, int8_t value)
+    {
+#ifdef __SSE2__
+        __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(value))));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < ShmemHashMap::GroupWidth; i++)
+            if (group[i] == value)
+                mask |= 1u << i;
+        return mask;
+#endif
+    }
+
+    /**
+     * @brief Bit i is set if the i-th control byte of the group is empty or deleted (sign bit set)
+     */
+    inline uint32_t matchEmptyOrDeleted(const int8_t *group)
+    {
+#ifdef __SSE2__
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(group))));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < ShmemHashMap::GroupWidth; i++)
+            if (group[i] < 0)
+                mask |= 1u << i;
+        return mask;
+#endif
+    }
+
+    inline int8_t h2(size_t hash)
+    {
+        return static_cast<int8_t>(hash & 0x7F);
+    }
+
+    inline size_t maxLoad(size_t slotCount)
+    {
+        return slotCount - slotCount / 8;
+    }
+}
+
+// Protected methods
+
+int8_t *ShmemHashMap::ctrl()
+{
+    return reinterpret_cast<int8_t *>(reinterpret_cast<Byte *>(this) + tableOffset);
+}
+
+const int8_t *ShmemHashMap::ctrl() const
+{
+    return const_cast<ShmemHashMap *>(this)->ctrl();
+}
+
+ShmemHashMap::Entry *ShmemHashMap::entries()
+{
+    return reinterpret_cast<Entry *>(ctrl() + slotCount);
+}
+
+const ShmemHashMap::Entry *ShmemHashMap::entries() const
+{
+    return const_cast<ShmemHashMap *>(this)->entries();
+}
+
+size_t ShmemHashMap::mixHash(const KeyType &key)
+{
+    uint64_t hash = hashIntOrString(key);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+size_t ShmemHashMap::slotCountFor(size_t n)
+{
+    size_t count = GroupWidth;
+    while (maxLoad(count) < n)
+        count *= 2;
+    return count;
+}
+
+size_t ShmemHashMap::makeTable(size_t slotCount, ShmemHeap *heapPtr)
+{
+    size_t tableOffset = heapPtr->shmalloc(slotCount * (sizeof(int8_t) + sizeof(Entry)));
+    int8_t *ctrlPtr = reinterpret_cast<int8_t *>(heapPtr->heapHead() + tableOffset);
+    std::fill(ctrlPtr, ctrlPtr + slotCount, CtrlEmpty);
+    return tableOffset;
+}
+
+size_t ShmemHashMap::findSlot(size_t hash, const KeyType &key) const
+{
+    const int8_t *ctrlPtr = ctrl();
+    const Entry *entryPtr = entries();
+    size_t groupMask = slotCount / GroupWidth - 1;
+    size_t group = (hash >> 7) & groupMask;
+
+    // Triangular probing visits every group once when the group count is a power of 2
+    for (size_t step = 1; step <= groupMask + 1; step++)
+    {
+        const int8_t *groupCtrl = ctrlPtr + group * GroupWidth;
+        for (uint32_t candidates = matchCtrl(groupCtrl, h2(hash)); candidates != 0; candidates &= candidates - 1)
+        {
+            size_t slot = group * GroupWidth + static_cast<size_t>(__builtin_ctz(candidates));
+            if (entryPtr[slot].hash == hash && entryMatches(entryPtr[slot], key))
+                return slot;
+        }
+        if (matchCtrl(groupCtrl, CtrlEmpty) != 0)
+            break;
+        group = (group + step) & groupMask;
+    }
+    return slotCount;
+}
+
+size_t ShmemHashMap::findInsertSlot(size_t hash) const
+{
+    const int8_t *ctrlPtr = ctrl();
+    size_t groupMask = slotCount / GroupWidth - 1;
+    size_t group = (hash >> 7) & groupMask;
+
+    for (size_t step = 1; step <= groupMask + 1; step++)
+    {
+        uint32_t available = matchEmptyOrDeleted(ctrlPtr + group * GroupWidth);
+        if (available != 0)
+            return group * GroupWidth + static_cast<size_t>(__builtin_ctz(available));
+        group = (group + step) & groupMask;
+    }
+    throw std::runtime_error("ShmemHashMap: no free slot, the load factor is broken");
+}
+
+size_t ShmemHashMap::nextFullSlot(size_t slot) const
+{
+    const int8_t *ctrlPtr = ctrl();
+    while (slot < slotCount && ctrlPtr[slot] < 0)
+        slot++;
+    return slot;
+}
+
+void ShmemHashMap::rehash(size_t newSlotCount, ShmemHeap *heapPtr)
+{
+    size_t mapOffset = reinterpret_cast<Byte *>(this) - heapPtr->heapHead();
+    size_t newTableOffset = makeTable(newSlotCount, heapPtr);
+
+    ptrdiff_t oldTableOffset = this->tableOffset;
+    size_t oldSlotCount = this->slotCount;
+    const int8_t *oldCtrl = reinterpret_cast<int8_t *>(reinterpret_cast<Byte *>(this) + oldTableOffset);
+    const Entry *oldEntries = reinterpret_cast<const Entry *>(oldCtrl + oldSlotCount);
+
+    this->tableOffset = static_cast<ptrdiff_t>(newTableOffset - mapOffset);
+    this->slotCount = newSlotCount;
+    this->growthLeft = maxLoad(newSlotCount) - static_cast<size_t>(this->size);
+
+    // Key and data offsets are relative to the map, so entries move without fix-ups
+    int8_t *ctrlPtr = ctrl();
+    Entry *entryPtr = entries();
+    for (size_t slot = 0; slot < oldSlotCount; slot++)
+    {
+        if (oldCtrl[slot] < 0)
+            continue;
+        size_t newSlot = findInsertSlot(oldEntries[slot].hash);
+        ctrlPtr[newSlot] = oldCtrl[slot];
+        entryPtr[newSlot] = oldEntries[slot];
+    }
+
+    heapPtr->shfree(reinterpret_cast<Byte *>(this) + oldTableOffset);
+}
+
+bool ShmemHashMap::entryMatches(const Entry &entry, const KeyType &key) const
+{
+    if (std::holds_alternative<int>(key))
+        return entry.keyType == Int && entry.intKey == std::get<int>(key);
+
+    if (entry.keyType != String)
+        return false;
+    const std::string &str = std::get<std::string>(key);
+    const ShmemPrimitive_ *entryKey = reinterpret_cast<const ShmemPrimitive_ *>(reinterpret_cast<const Byte *>(this) + entry.keyOffset);
+    // Stored with a trailing \0
+    return static_cast<size_t>(entryKey->size) == str.size() + 1 && std::memcmp(str.data(), entryKey->getBytePtr(), str.size()) == 0;
+}
+
+KeyType ShmemHashMap::entryKey(const Entry &entry) const
+{
+    if (entry.keyType == Int)
+        return entry.intKey;
+    return reinterpret_cast<const ShmemPrimitive<char> *>(reinterpret_cast<const Byte *>(this) + entry.keyOffset)->operator std::string();
+}
+
+std::string ShmemHashMap::entryKeyToString(const Entry &entry) const
+{
+    if (entry.keyType == Int)
+        return std::to_string(entry.intKey);
+    return "\"" + std::get<std::string>(entryKey(entry)) + "\"";
+}
+
+pybind11::object ShmemHashMap::entryKeyToPyObject(const Entry &entry) const
+{
+    if (entry.keyType == Int)
+        return pybind11::int_(entry.intKey);
+    return pybind11::str(std::get<std::string>(entryKey(entry)));
+}
+
+ShmemObj *ShmemHashMap::entryData(const Entry &entry) const
+{
+    if (entry.dataOffset == NPtr)
+        return nullptr;
+    return const_cast<ShmemObj *>(reinterpret_cast<const ShmemObj *>(reinterpret_cast<const Byte *>(this) + entry.dataOffset));
+}
+
+void ShmemHashMap::setEntryData(Entry &entry, ShmemObj *obj)
+{
+    if (obj == nullptr)
+        entry.dataOffset = NPtr;
+    else
+        entry.dataOffset = reinterpret_cast<Byte *>(obj) - reinterpret_cast<Byte *>(this);
+}
+
+void ShmemHashMap::insert(const KeyType &key, ShmemObj *data, ShmemHeap *heapPtr)
+{
+    size_t hash = mixHash(key);
+    size_t slot = findSlot(hash, key);
+
+    if (slot != slotCount)
+    { // repeated key, replace the old data, don't increase the size
+        Entry &entry = entries()[slot];
+        ShmemObj *oldData = entryData(entry);
+        if (oldData != nullptr)
+            ShmemObj::retire(reinterpret_cast<Byte *>(oldData) - heapPtr->heapHead(), heapPtr);
+        setEntryData(entry, data);
+        return;
+    }
+
+    slot = findInsertSlot(hash);
+    if (growthLeft == 0 && ctrl()[slot] == CtrlEmpty)
+    {
+        // Out of empty slots: grow if the live entries need it, otherwise only drop the tombstones
+        size_t newSlotCount = static_cast<size_t>(this->size) + 1 > maxLoad(slotCount) / 2 ? slotCount * 2 : slotCount;
+        rehash(newSlotCount, heapPtr);
+        slot = findInsertSlot(hash);
+    }
+
+    ptrdiff_t keyOffset = NPtr;
+    if (std::holds_alternative<std::string>(key))
+        keyOffset = static_cast<ptrdiff_t>(ShmemPrimitive_::construct(std::get<std::string>(key), heapPtr)) - (reinterpret_cast<Byte *>(this) - heapPtr->heapHead());
+
+    int8_t *ctrlPtr = ctrl();
+    if (ctrlPtr[slot] == CtrlEmpty)
+        growthLeft--;
+    ctrlPtr[slot] = h2(hash);
+
+    Entry &entry = entries()[slot];
+    entry.hash = hash;
+    entry.keyType = std::holds_alternative<int>(key) ? Int : String;
+    entry.intKey = std::holds_alternative<int>(key) ? std::get<int>(key) : 0;
+    entry.keyOffset = keyOffset;
+    setEntryData(entry, data);
+
+    this->size++;
+}
+
+// Public methods
+
+size_t ShmemHashMap::construct(ShmemHeap *heapPtr, size_t capacity)
+{
+    size_t slotCount = slotCountFor(capacity);
+    size_t mapOffset = heapPtr->shmalloc(sizeof(ShmemHashMap));
+    size_t tableOffset = makeTable(slotCount, heapPtr);
+
+    ShmemHashMap *mapPtr = reinterpret_cast<ShmemHashMap *>(resolveOffset(mapOffset, heapPtr));
+    mapPtr->type = HashMap;
+    mapPtr->size = 0;
+    mapPtr->slotCount = slotCount;
+    mapPtr->growthLeft = maxLoad(slotCount);
+    mapPtr->tableOffset = static_cast<ptrdiff_t>(tableOffset - mapOffset);
+
+    return mapOffset;
+}
+
+size_t ShmemHashMap::construct(pybind11::dict map, ShmemHeap *heapPtr)
+{
+    size_t mapOffset = ShmemHashMap::construct(heapPtr, map.size());
+    ShmemHashMap *hashMap = reinterpret_cast<ShmemHashMap *>(heapPtr->heapHead() + mapOffset);
+
+    for (auto &[key, val] : map)
+    {
+        size_t newObjOffset = ShmemObj::construct(val, heapPtr);
+        ShmemObj *newObj = nullptr;
+        if (newObjOffset != NPtr)
+            newObj = reinterpret_cast<ShmemObj *>(heapPtr->heapHead() + newObjOffset);
+
+        if (pybind11::isinstance<pybind11::str>(key) || pybind11::isinstance<pybind11::bytes>(key))
+        {
+            hashMap->insert(key.cast<std::string>(), newObj, heapPtr);
+        }
+        else if (pybind11::isinstance<pybind11::int_>(key))
+        {
+            hashMap->insert(key.cast<int>(), newObj, heapPtr);
+        }
+        else
+        {
+            throw std::runtime_error("Unsupported key type");
+        }
+    }
+    return mapOffset;
+}
+
+size_t ShmemHashMap::construct(pybind11::object pythonObj, ShmemHeap *heapPtr)
+{
+    if (pybind11::isinstance<pybind11::dict>(pythonObj))
+    {
+        return ShmemHashMap::construct(pybind11::cast<pybind11::dict>(pythonObj), heapPtr);
+    }
+    else
+    {
+        throw std::runtime_error("Cannot use normal python object to construct ShmemHashMap");
+    }
+}
+
+void ShmemHashMap::deconstruct(size_t offset, ShmemHeap *heapPtr)
+{
+    Byte *heapHead = heapPtr->heapHead();
+    ShmemHashMap *ptr = reinterpret_cast<ShmemHashMap *>(resolveOffset(offset, heapPtr));
+    const int8_t *ctrlPtr = ptr->ctrl();
+    const Entry *entryPtr = ptr->entries();
+    for (size_t slot = 0; slot < ptr->slotCount; slot++)
+    {
+        if (ctrlPtr[slot] < 0)
+            continue;
+        const Entry &entry = entryPtr[slot];
+        if (entry.keyType == String)
+            ShmemPrimitive_::deconstruct(reinterpret_cast<Byte *>(ptr) + entry.keyOffset - heapHead, heapPtr);
+        ShmemObj *data = ptr->entryData(entry);
+        if (data != nullptr)
+            ShmemObj::deconstruct(reinterpret_cast<Byte *>(data) - heapHead, heapPtr);
+    }
+    heapPtr->shfree(reinterpret_cast<Byte *>(ptr) + ptr->tableOffset);
+    heapPtr->shfree(reinterpret_cast<Byte *>(ptr));
+}
+
+// __len__
+size_t ShmemHashMap::len() const
+{
+    return this->size;
+}
+
+// __getitem__
+ShmemObj *ShmemHashMap::get(const KeyType &key) const
+{
+    size_t slot = findSlot(mixHash(key), key);
+    if (slot == slotCount)
+        throw IndexError("Key not found");
+    return entryData(entries()[slot]);
+}
+
+// __setitem__ implemented in .tcc, alias to insert()
+
+// __delitem__
+void ShmemHashMap::del(const KeyType &key, ShmemHeap *heapPtr)
+{
+    size_t slot = findSlot(mixHash(key), key);
+    if (slot == slotCount)
+        throw IndexError("Key not found");
+
+    Byte *heapHead = heapPtr->heapHead();
+    Entry &entry = entries()[slot];
+    if (entry.keyType == String)
+        ShmemPrimitive_::deconstruct(reinterpret_cast<Byte *>(this) + entry.keyOffset - heapHead, heapPtr);
+    ShmemObj *data = entryData(entry);
+    if (data != nullptr)
+        ShmemObj::retire(reinterpret_cast<Byte *>(data) - heapHead, heapPtr);
+
+    // A probe stops at the first group holding an empty slot. If this group already has one, no probe
+    // passes through it and the slot can become empty again, otherwise leave a tombstone
+    int8_t *ctrlPtr = ctrl();
+    if (matchCtrl(ctrlPtr + slot / GroupWidth * GroupWidth, CtrlEmpty) != 0)
+    {
+        ctrlPtr[slot] = CtrlEmpty;
+        growthLeft++;
+    }
+    else
+    {
+        ctrlPtr[slot] = CtrlDeleted;
+    }
+
+    this->size--;
+}
+
+// __contains__
+bool ShmemHashMap::contains(const KeyType &key) const
+{
+    return findSlot(mixHash(key), key) != slotCount;
+}
+
+// __str__
+std::string ShmemHashMap::toString(int indent, int maxElements) const
+{
+    std::ostringstream resultStream;
+
+    maxElements = maxElements > 0 ? maxElements : this->size;
+
+    resultStream << "(H:" << std::to_string(this->size) << ")" << "{\n";
+
+    int currentElement = 0;
+    const Entry *entryPtr = entries();
+    for (size_t slot = nextFullSlot(0); slot < slotCount; slot = nextFullSlot(slot + 1))
+    {
+        if (currentElement >= maxElements)
+        {
+            resultStream << std::string(indent + 1, ' ') << "..." << "\n";
+            break;
+        }
+        const ShmemObj *data = entryData(entryPtr[slot]);
+        resultStream << std::string(indent + 1, ' ')
+                     << entryKeyToString(entryPtr[slot]) << ": "
+                     << (data == nullptr ? "nullptr" : data->toString(indent + 1)) << "\n";
+        currentElement++;
+    }
+
+    resultStream << std::string(indent, ' ') << "}";
+
+    return resultStream.str();
+}
+
+// __keys__
+std::vector<KeyType> ShmemHashMap::keys(bool *allInt_, bool *allString_) const
+{
+    bool allInt = true;
+    bool allString = true;
+    std::vector<KeyType> result;
+    result.reserve(this->size);
+
+    const Entry *entryPtr = entries();
+    for (size_t slot = nextFullSlot(0); slot < slotCount; slot = nextFullSlot(slot + 1))
+    {
+        if (entryPtr[slot].keyType == Int)
+            allString = false;
+        else
+            allInt = false;
+        result.push_back(entryKey(entryPtr[slot]));
+    }
+
+    if (allInt_)
+        *allInt_ = allInt;
+    if (allString_)
+        *allString_ = allString;
+
+    return result;
+}
+
+// Iterator related
+KeyType ShmemHashMap::beginIdx() const
+{
+    size_t slot = nextFullSlot(0);
+    if (slot == slotCount)
+        return NILKey; // The whole map is empty
+    return entryKey(entries()[slot]);
+}
+
+KeyType ShmemHashMap::endIdx() const
+{
+    return NILKey;
+}
+
+KeyType ShmemHashMap::nextIdx(KeyType index) const
+{
+    if (index == NILKey)
+        throw StopIteration("Hash map index out of bounds");
+
+    size_t slot = findSlot(mixHash(index), index);
+    if (slot == slotCount)
+        throw IndexError("Cannot get next index of a non-existent key");
+    slot = nextFullSlot(slot + 1);
+    if (slot == slotCount)
+        return NILKey;
+    return entryKey(entries()[slot]);
+}
+
+// Converter
+ShmemHashMap::operator pybind11::dict() const
+{
+    pybind11::dict result;
+    const Entry *entryPtr = entries();
+    for (size_t slot = nextFullSlot(0); slot < slotCount; slot = nextFullSlot(slot + 1))
+    {
+        const ShmemObj *data = entryData(entryPtr[slot]);
+        if (data == nullptr)
+            result[entryKeyToPyObject(entryPtr[slot])] = pybind11::none();
+        else
+            result[entryKeyToPyObject(entryPtr[slot])] = data->operator pybind11::object();
+    }
+    return result;
+}
+
+ShmemHashMap::operator pybind11::object() const
+{
+    return this->operator pybind11::dict();
+}
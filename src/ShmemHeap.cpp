@@ -1,6 +1,9 @@
 #include "ShmemHeap.h"
 #include <cstring>
 #include <stdexcept>
+#include <thread>
+#include <cerrno>
+#include <vector>
 
 ShmemHeap::ShmemHeap(const std::string &name, size_t staticSpaceSize, size_t heapSize)
     : ShmemBase(name)
@@ -22,6 +25,20 @@ ShmemHeap::ShmemHeap(const std::string &name, size_t staticSpaceSize, size_t hea
     this->setCapacity(this->SCap + this->HCap);
 }
 
+ShmemHeap::~ShmemHeap()
+{
+    // ShmemBase only knows the first segment
+    try
+    {
+        if (this->ownsSharedMemory())
+            this->unlinkSegments();
+    }
+    catch (const std::exception &e)
+    {
+        this->logger->error("Exception during destructor: {}", e.what());
+    }
+}
+
 void ShmemHeap::create()
 {
     if (this->SCap < static_cast<size_t>(this->minStaticSize) || this->HCap == 0)
@@ -32,6 +49,13 @@ void ShmemHeap::create()
             this->logger->error("HCap is too small. HCap: {}", this->HCap);
         throw std::runtime_error("Capacity is too small to hold static space or heap space");
     }
+    if (this->segmented)
+    {
+        // Segments are mapped right behind the heap tail, which therefore has to end on a page boundary
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        this->HCap = pad(this->SCap + this->HCap, pageSize) - this->SCap;
+        this->setCapacity(this->SCap + this->HCap);
+    }
     ShmemBase::create();
 
     // Init the static information
@@ -40,25 +64,76 @@ void ShmemHeap::create()
 
     // Init the heap
     this->entranceOffset_unsafe() = NPtr;
+    this->binsLock_unsafe().store(0, std::memory_order_relaxed);
+    this->resizeEpoch_unsafe().store(0, std::memory_order_relaxed);
+    this->epoch = 0;
+
+    // All bins start empty
+    this->freeBinBitmap_unsafe() = 0;
+    for (size_t bin = 0; bin < numBins; bin++)
+        this->freeBinOffset_unsafe(bin) = NPtr;
+    for (size_t counter = 0; counter < numStatCounters; counter++)
+        this->statCounter_unsafe(static_cast<StatCounter>(counter)).store(0, std::memory_order_relaxed);
+    for (size_t slabClass = 0; slabClass < numSlabClasses; slabClass++)
+        this->slabPages_unsafe(slabClass) = NPtr;
+
+    // The first segment is the one ShmemBase maps, its serial 0 is never used for a name
+    this->segmentCount_unsafe() = this->segmented ? 1 : 0;
+    this->segmentNextSerial_unsafe() = 1;
+    this->segmentEntry_unsafe(0) = this->HCap;
+    this->mappedSegments.clear();
+    if (this->segmented)
+        this->mappedSegments.push_back(this->HCap);
+
+    this->changeCounter_unsafe().store(0, std::memory_order_relaxed);
+    this->changeWaiters_unsafe().store(0, std::memory_order_relaxed);
+    this->commitSeq_unsafe().store(0, std::memory_order_relaxed);
+    this->snapshotEpoch_unsafe().store(1, std::memory_order_relaxed);
+    this->retiredObjects_unsafe().store(NPtr, std::memory_order_relaxed);
+    for (size_t slot = 0; slot < maxSnapshots; slot++)
+        this->snapshotPin_unsafe(slot).store(0, std::memory_order_relaxed);
 
     BlockHeader *firstBlock = reinterpret_cast<BlockHeader *>(this->heapHead_unsafe());
 
     // Prev allocated bit set to 1
     firstBlock->val() = this->HCap | 0b010;
     firstBlock->getFooterPtr()->val() = this->HCap;
-    this->freeBlockListOffset_unsafe() = reinterpret_cast<Byte *>(firstBlock) - this->heapHead_unsafe();
+    this->insertFreeBlock(firstBlock);
 
     this->logger->info("Shared memory heap created. Static space capacity: {} heap capacity: {}", this->SCap, this->HCap);
 }
 
+void ShmemHeap::connect()
+{
+    // The epoch can only be read once connected, and reading it after the mapping could skip a resize in between
+    this->epoch = SIZE_MAX;
+    this->mappedSegments.clear();
+    ShmemBase::connect();
+}
+
+void ShmemHeap::unlink()
+{
+    if (this->ownsSharedMemory())
+        this->unlinkSegments();
+    ShmemBase::unlink();
+}
+
 void ShmemHeap::resize(long heapSize)
 {
+    TraceScope trace(this, TraceResize, static_cast<size_t>(heapSize), static_cast<size_t>(-1));
     this->checkConnection();
     this->resize(this->staticCapacity_unsafe(), heapSize);
+
+    trace.done(0);
 }
 
 void ShmemHeap::resize(long staticSpaceSize, long heapSize)
 {
+    TraceScope trace(this, TraceResize, static_cast<size_t>(heapSize), static_cast<size_t>(staticSpaceSize));
+    this->checkConnection();
+    // The lock word lives in the static space and survives the remap below
+    BinsLockGuard guard(this);
+    // Another process may have resized while this one waited for the lock
     this->checkConnection();
     if (staticSpaceSize == -1)
     { // Don't change static space capacity
@@ -77,39 +152,53 @@ void ShmemHeap::resize(long staticSpaceSize, long heapSize)
         this->setHCap(heapSize);
     }
 
+    if (this->segmentCount_unsafe() != 0)
+    {
+        if (this->SCap != this->staticCapacity_unsafe())
+        {
+            this->logger->error("Static space of segmented heap {} cannot be resized", this->getName());
+            this->SCap = this->staticCapacity_unsafe();
+            throw std::runtime_error("The static space of a segmented heap cannot be resized");
+        }
+        // Every segment ends on a page boundary, round the requested size up to the next one
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        size_t requested = heapSize == -1 ? this->heapCapacity_unsafe() : static_cast<size_t>(heapSize);
+        this->HCap = pad(this->SCap + requested, pageSize) - this->SCap;
+    }
+
     size_t newStaticSpaceCapacity = this->SCap;
     size_t newHeapCapacity = this->HCap;
 
     // find the last block
-    BlockHeader *lastBlock = this->freeBlockListOffset_unsafe() != NPtr ? this->freeBlockList_unsafe() : reinterpret_cast<BlockHeader *>(this->heapHead_unsafe()); // Start from a free block in the middle (hopefully close to the end)
-    while (reinterpret_cast<Byte *>(lastBlock->getNextPtr()) != this->heapTail_unsafe())
-    {
-        lastBlock = lastBlock->getNextPtr();
-    }
+    BlockHeader *lastBlock = this->lastBlock_unsafe();
     uintptr_t lastBlockOffset = reinterpret_cast<Byte *>(lastBlock) - this->heapHead_unsafe();
     bool lastBlockAllocated = lastBlock->A();
 
-    // Save everything
     size_t oldStaticSpaceCapacity = this->staticCapacity_unsafe();
     size_t oldHeapCapacity = this->heapCapacity_unsafe();
-    Byte *tempStaticSpace = new Byte[oldStaticSpaceCapacity];
-    std::memcpy(tempStaticSpace, this->shmPtr, oldStaticSpaceCapacity);
-    Byte *tempHeap = new Byte[oldHeapCapacity];
-    std::memcpy(tempHeap, this->heapHead_unsafe(), oldHeapCapacity);
 
-    // resize static space (without copy content)
-    ShmemBase::resize(newStaticSpaceCapacity + newHeapCapacity, false);
+    // Grow the segment in place, the static space and the heap keep their content
+    // A segmented heap leaves it alone and maps another segment behind the heap tail
+    if (this->segmentCount_unsafe() == 0)
+        ShmemBase::resize(newStaticSpaceCapacity + newHeapCapacity);
+    else if (newHeapCapacity > oldHeapCapacity)
+        this->appendSegment(newHeapCapacity - oldHeapCapacity);
 
-    // Restore the static space content
-    std::memcpy(this->shmPtr, tempStaticSpace, oldStaticSpaceCapacity);
+    // Publish the epoch before the new capacities, a process that reads the new capacity is bound to remap on its next check
+    this->epoch = this->resizeEpoch_unsafe().fetch_add(1, std::memory_order_release) + 1;
+    this->statCounter_unsafe(StatResizeCount).fetch_add(1, std::memory_order_relaxed);
+
+    if (newStaticSpaceCapacity != oldStaticSpaceCapacity)
+    {
+        // Only a larger static space moves the heap, shift it up and zero the new static bytes
+        std::memmove(this->shmPtr + newStaticSpaceCapacity, this->shmPtr + oldStaticSpaceCapacity, oldHeapCapacity);
+        std::memset(this->shmPtr + oldStaticSpaceCapacity, 0, newStaticSpaceCapacity - oldStaticSpaceCapacity);
+    }
 
     // Overwrite the old capacity
     this->staticCapacity_unsafe() = newStaticSpaceCapacity;
     this->heapCapacity_unsafe() = newHeapCapacity;
 
-    // Restore the heap content
-    std::memcpy(this->heapHead_unsafe(), tempHeap, oldHeapCapacity);
-
     // Get ptr to the new last block
     lastBlock = reinterpret_cast<BlockHeader *>(this->heapHead_unsafe() + lastBlockOffset);
 
@@ -118,10 +207,16 @@ void ShmemHeap::resize(long staticSpaceSize, long heapSize)
     {
         // There's not enough space to create a new free block, or the last block is not allocated,
         // just give all the space to last block
+        if (!lastBlockAllocated)
+        {
+            // The block moves to another bin as its size changes
+            this->removeFreeBlock(lastBlock);
+        }
         lastBlock->setSize(lastBlock->size() + newHeapCapacity - oldHeapCapacity);
         if (!lastBlockAllocated)
         {
-            lastBlock->getFooterPtr()->setSize(newHeapCapacity - oldHeapCapacity);
+            lastBlock->getFooterPtr()->val() = lastBlock->size();
+            this->insertFreeBlock(lastBlock);
         }
         this->logger->info("Resized to: Static space capacity: {}->{} heap capacity: {}->{}. Additional heap space({} Byte) is merged into last block", oldStaticSpaceCapacity, newStaticSpaceCapacity, oldHeapCapacity, newHeapCapacity, newHeapCapacity - oldHeapCapacity);
     }
@@ -139,8 +234,52 @@ void ShmemHeap::resize(long staticSpaceSize, long heapSize)
         this->logger->info("Resized to: Static space capacity: {}->{} heap capacity: {}->{}. Additional heap space({} Byte) is convert to a new free block", oldStaticSpaceCapacity, newStaticSpaceCapacity, oldHeapCapacity, newHeapCapacity, newHeapCapacity - oldHeapCapacity);
     }
 
-    delete[] tempStaticSpace;
-    delete[] tempHeap;
+    trace.done(0);
+}
+
+size_t ShmemHeap::trim()
+{
+    TraceScope trace(this, TraceTrim, 0);
+    this->checkConnection();
+    BinsLockGuard guard(this);
+    this->checkConnection();
+
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t oldHeapCapacity = this->heapCapacity_unsafe();
+    BlockHeader *lastBlock = this->lastBlock_unsafe();
+    if (lastBlock->A())
+        return trace.done(0);
+    if (this->segmentCount_unsafe() > 1)
+        return trace.done(this->trimSegments(lastBlock));
+
+    // Cut whole pages off the last free block, what is left of it must still be a valid block
+    size_t lastBlockSize = lastBlock->size();
+    size_t cut = std::min(lastBlockSize / pageSize * pageSize, oldHeapCapacity - pageSize);
+    if (lastBlockSize - cut != 0 && lastBlockSize - cut < 4 * unitSize)
+        cut -= pageSize;
+    if (cut == 0)
+        return trace.done(0);
+
+    this->removeFreeBlock(lastBlock);
+    if (lastBlockSize > cut)
+    {
+        lastBlock->setSize(lastBlockSize - cut);
+        lastBlock->getFooterPtr()->val() = lastBlockSize - cut;
+        this->insertFreeBlock(lastBlock);
+    }
+
+    // Nobody walks past the new capacity once it is written, then the segment shrinks in place
+    size_t newHeapCapacity = oldHeapCapacity - cut;
+    this->heapCapacity_unsafe() = newHeapCapacity;
+    this->HCap = newHeapCapacity;
+    ShmemBase::resize(this->staticCapacity_unsafe() + newHeapCapacity);
+    if (this->segmentCount_unsafe() != 0)
+        this->mappedSegments[0] = this->segmentEntry_unsafe(0) = newHeapCapacity;
+    this->epoch = this->resizeEpoch_unsafe().fetch_add(1, std::memory_order_release) + 1;
+    this->statCounter_unsafe(StatResizeCount).fetch_add(1, std::memory_order_relaxed);
+
+    this->logger->info("trim() heap capacity {} -> {}", oldHeapCapacity, newHeapCapacity);
+    return trace.done(cut);
 }
 
 size_t ShmemHeap::getHCap() const
@@ -151,6 +290,10 @@ size_t ShmemHeap::getSCap() const
 {
     return this->SCap;
 }
+bool ShmemHeap::getSegmented() const
+{
+    return this->segmented;
+}
 
 size_t &ShmemHeap::staticCapacity()
 {
@@ -164,10 +307,120 @@ size_t &ShmemHeap::heapCapacity()
     return reinterpret_cast<size_t *>(this->shmPtr)[1];
 }
 
-size_t &ShmemHeap::freeBlockListOffset()
+size_t &ShmemHeap::freeBinBitmap()
 {
     checkConnection();
-    return reinterpret_cast<size_t *>(this->shmPtr)[2];
+    return this->freeBinBitmap_unsafe();
+}
+
+size_t ShmemHeap::resizeEpoch()
+{
+    checkConnection();
+    return this->epoch;
+}
+
+ShmemHeap::Stats ShmemHeap::stats()
+{
+    checkConnection();
+    Stats stats;
+    stats.heapCapacity = this->heapCapacity_unsafe();
+    stats.freeBytes = this->statCounter_unsafe(StatFreeBytes).load(std::memory_order_relaxed);
+    // Every byte of the heap belongs to a block, the allocated bytes are what the free ones leave
+    stats.allocatedBytes = stats.heapCapacity > stats.freeBytes ? stats.heapCapacity - stats.freeBytes : 0;
+    stats.freeBlocks = this->statCounter_unsafe(StatFreeBlocks).load(std::memory_order_relaxed);
+    stats.largestFreeBlock = this->statCounter_unsafe(StatLargestFree).load(std::memory_order_relaxed);
+    stats.allocCount = this->statCounter_unsafe(StatAllocCount).load(std::memory_order_relaxed);
+    stats.freeCount = this->statCounter_unsafe(StatFreeCount).load(std::memory_order_relaxed);
+    stats.reallocCount = this->statCounter_unsafe(StatReallocCount).load(std::memory_order_relaxed);
+    stats.resizeCount = this->statCounter_unsafe(StatResizeCount).load(std::memory_order_relaxed);
+    stats.busyContention = this->statCounter_unsafe(StatBusyContention).load(std::memory_order_relaxed);
+    stats.binsContention = this->statCounter_unsafe(StatBinsContention).load(std::memory_order_relaxed);
+    return stats;
+}
+
+bool ShmemHeap::isSegmented()
+{
+    checkConnection();
+    return this->segmentCount_unsafe() != 0;
+}
+
+size_t ShmemHeap::numSegments()
+{
+    checkConnection();
+    return std::max<size_t>(this->segmentCount_unsafe(), 1);
+}
+
+std::pair<size_t, size_t> ShmemHeap::segmentOf(size_t offset)
+{
+    checkConnection();
+    if (offset >= this->heapCapacity_unsafe())
+    {
+        this->logger->error("Offset {} is out of the heap of {} bytes", offset, this->heapCapacity_unsafe());
+        throw std::out_of_range("Offset is out of the heap");
+    }
+    size_t begin = 0;
+    for (size_t segment = 0; segment < this->segmentCount_unsafe(); segment++)
+    {
+        size_t end = segmentEnd(this->segmentEntry_unsafe(segment));
+        if (offset < end)
+            return {segment, offset - begin};
+        begin = end;
+    }
+    return {0, offset};
+}
+
+size_t ShmemHeap::changeCount()
+{
+    checkConnection();
+    return this->changeCounter_unsafe().load(std::memory_order_acquire);
+}
+
+void ShmemHeap::notifyChange()
+{
+    checkConnection();
+    // commit() wakes the watchers once for the whole batch
+    if (this->committing)
+        return;
+    // Pairs with waitChange(): either the waiter sees the new count or we see the waiter
+    this->changeCounter_unsafe().fetch_add(1, std::memory_order_seq_cst);
+    if (this->changeWaiters_unsafe().load(std::memory_order_seq_cst) != 0)
+        ShmemUtils::futexWakeAll(reinterpret_cast<const size_t *>(&this->changeCounter_unsafe()));
+}
+
+size_t ShmemHeap::waitChange(size_t since, int timeout)
+{
+    checkConnection();
+    std::atomic<size_t> &counter = this->changeCounter_unsafe();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+    this->changeWaiters_unsafe().fetch_add(1, std::memory_order_seq_cst);
+    size_t current;
+    while ((current = counter.load(std::memory_order_seq_cst)) == since)
+    {
+        timespec remaining;
+        timespec *remainingPtr = nullptr;
+        if (timeout >= 0)
+        {
+            auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (left <= 0)
+                break;
+            remaining.tv_sec = left / 1000000000;
+            remaining.tv_nsec = left % 1000000000;
+            remainingPtr = &remaining;
+        }
+        // Returns at once if the low half of the counter moved since the load above
+        ShmemUtils::futexWait(reinterpret_cast<const size_t *>(&counter), static_cast<uint32_t>(since), remainingPtr);
+    }
+    this->changeWaiters_unsafe().fetch_sub(1, std::memory_order_relaxed);
+    return current;
+}
+
+size_t &ShmemHeap::freeBinOffset(size_t bin)
+{
+    checkConnection();
+    if (bin >= numBins)
+        throw std::out_of_range("Free bin index out of range: " + std::to_string(bin));
+    return this->freeBinOffset_unsafe(bin);
 }
 
 size_t &ShmemHeap::entranceOffset()
@@ -200,17 +453,20 @@ Byte *ShmemHeap::heapTail()
     return this->shmPtr + this->staticCapacity_unsafe() + this->heapCapacity_unsafe();
 }
 
-ShmemHeap::BlockHeader *ShmemHeap::freeBlockList()
+ShmemHeap::BlockHeader *ShmemHeap::freeBin(size_t bin)
 {
     checkConnection();
-    return reinterpret_cast<BlockHeader *>(this->heapHead_unsafe() + this->freeBlockListOffset_unsafe());
+    if (bin >= numBins)
+        throw std::out_of_range("Free bin index out of range: " + std::to_string(bin));
+    return this->freeBin_unsafe(bin);
 }
 
 size_t ShmemHeap::shmalloc(size_t size)
 {
+    TraceScope trace(this, TraceMalloc, size);
     this->checkConnection();
     if (size < 1)
-        return 0;
+        return trace.done(0);
 
     // Calculate the padding size
     size_t padSize = 0;
@@ -222,115 +478,224 @@ size_t ShmemHeap::shmalloc(size_t size)
     // Header + size + Padding
     size_t requiredSize = unitSize + size + padSize;
 
-    BlockHeader *listHead = this->freeBlockList_unsafe();
-    BlockHeader *current = listHead;
-
-    BlockHeader *best = nullptr;
-    size_t bestSize = std::numeric_limits<size_t>::max();
-
-    // Best fit logic
-    if (listHead != nullptr)
+    if (this->arenaTail != NPtr)
     {
-        do
+        size_t resultOffset = this->arenaAllocate(requiredSize);
+        if (resultOffset != NPtr)
         {
-            size_t blockSize = current->size();
-            if (!current->A() && blockSize >= requiredSize && blockSize < bestSize)
-            {
-                best = current;
-                bestSize = blockSize;
-
-                // Break if exact match
-                if (blockSize == requiredSize)
-                    break;
-            }
-            current = current->getBckPtr();
-        } while (current != listHead);
+            this->statCounter_unsafe(StatAllocCount).fetch_add(1, std::memory_order_relaxed);
+            return trace.done(resultOffset);
+        }
     }
 
-    if (best != nullptr)
+    while (true)
     {
-        // Lock the best fit block (Busy bit <- 1)
-        best->wait();
-        best->setB(true);
+        // Another process may have grown the heap since the last pass
+        this->checkConnection();
 
-        // Check if the best size < required size + 4
-        // In that case, we cannot split the block as a free block is minimum 4 bytes, we just increase the required size
-        if (bestSize < requiredSize + 4 * unitSize)
+        size_t seenCapacity;
         {
-            requiredSize = bestSize;
-        }
+            // Free blocks are only touched under the bins lock, so the best fit block needs no busy bit of its own
+            BinsLockGuard guard(this);
 
-        BlockHeader *fwdBlockHeader = best->getFwdPtr();
-        // BlockHeader* bckBlockHeader = best->getBckPtr();
+            BlockHeader *best = this->findFreeBlock(requiredSize);
+            seenCapacity = this->heapCapacity_unsafe();
 
-        // Set allocated bit to 0
-        best->setA(false);
-        // Remove the best block from free list
-        this->removeFreeBlock(best);
+            if (best != nullptr)
+            {
+                size_t bestSize = best->size();
 
-        // If the block we find is bigger than the required size, split it
-        if (bestSize > requiredSize)
-        {
-            BlockHeader *newBlockHeader = reinterpret_cast<BlockHeader *>(reinterpret_cast<uintptr_t>(best) + requiredSize);
+                // Check if the best size < required size + 4
+                // In that case, we cannot split the block as a free block is minimum 4 bytes, we just increase the required size
+                if (bestSize < requiredSize + 4 * unitSize)
+                {
+                    requiredSize = bestSize;
+                }
 
-            // update the new block
-            // Size: bestSize - requiredSize; Busy: 1; Previous Allocated: 1; Allocated: 0
-            newBlockHeader->val() = (bestSize - requiredSize) | 0b010;
-            newBlockHeader->getFooterPtr()->val() = bestSize - requiredSize;
+                // Remove the best block from its bin
+                this->removeFreeBlock(best);
 
-            this->insertFreeBlock(newBlockHeader, fwdBlockHeader);
+                // If the block we find is bigger than the required size, split it
+                if (bestSize > requiredSize)
+                {
+                    BlockHeader *newBlockHeader = reinterpret_cast<BlockHeader *>(reinterpret_cast<uintptr_t>(best) + requiredSize);
 
-            // Reset busy bit
-            newBlockHeader->setB(false);
+                    // update the new block
+                    // Size: bestSize - requiredSize; Busy: 0; Previous Allocated: 1; Allocated: 0
+                    newBlockHeader->reset((bestSize - requiredSize) | 0b010);
+                    newBlockHeader->getFooterPtr()->val() = bestSize - requiredSize;
 
-            this->logger->debug("shmalloc(size={}) split the best fit block at offset {}: {}E->{}A+{}E", size, reinterpret_cast<Byte *>(best) - this->heapHead_unsafe(), bestSize, requiredSize, bestSize - requiredSize);
-        }
+                    this->insertFreeBlock(newBlockHeader);
 
-        // update the best fit block
-        // Size: requiredSize; Busy: 0; Previous Allocated: not changed; Allocated: 1
-        best->val() = (requiredSize & ~0b100) | (best->size_BPA & 0b010) | 0b001;
+                    this->logger->debug("shmalloc(size={}) split the best fit block at offset {}: {}E->{}A+{}E", size, reinterpret_cast<Byte *>(best) - this->heapHead_unsafe(), bestSize, requiredSize, bestSize - requiredSize);
+                }
 
-        // update next block's p bit
-        if (reinterpret_cast<Byte *>(best->getNextPtr()) < this->heapTail_unsafe())
-        {
-            best->getNextPtr()->setP(true);
+                // update the best fit block
+                // Size: requiredSize; Busy: 0; Previous Allocated: not changed; Allocated: 1
+                best->resetAllocated((requiredSize & ~0b100) | (best->size_BPA & 0b010) | 0b001);
+
+                // update next block's p bit
+                if (reinterpret_cast<Byte *>(best->getNextPtr()) < this->heapTail_unsafe())
+                {
+                    best->getNextPtr()->setP(true);
+                }
+
+                // Return the offset from the heap head (+1 make the offset is on start of payload)
+                size_t resultOffset = reinterpret_cast<Byte *>(best + 1) - this->heapHead_unsafe();
+                this->statCounter_unsafe(StatAllocCount).fetch_add(1, std::memory_order_relaxed);
+
+                this->logger->info("shmalloc(size={}) succeeded. Payload Offset: {}, Block Size: {}", size, resultOffset, requiredSize);
+
+                return trace.done(resultOffset);
+            }
         }
 
-        // Return the offset from the heap head (+1 make the offset is on start of payload)
-        size_t resultOffset = reinterpret_cast<Byte *>(best + 1) - this->heapHead_unsafe();
+        // No fit, grow once and retry. grow() resizes under the bins lock, so the guard above must be released first
+        this->grow(requiredSize, seenCapacity);
+    }
+}
+
+void ShmemHeap::shmallocBatch(const size_t *sizes, size_t n, size_t *outOffsets)
+{
+    // Replaying the batch as single shmalloc() calls reproduces the requests, so it is recorded that way
+    TraceScope trace(this, TraceMalloc, 0);
+    this->checkConnection();
 
-        this->logger->info("shmalloc(size={}) succeeded. Payload Offset: {}, Block Size: {}", size, resultOffset, requiredSize);
+    // Block sizes as shmalloc() computes them: header + payload padded to a unit, at least 3 units of payload
+    std::vector<size_t> blockSizes(n);
+    size_t totalSize = 0, numBlocks = 0, lastBlock = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        outOffsets[i] = 0;
+        if (sizes[i] == 0)
+            continue;
+        blockSizes[i] = unitSize + std::max(pad(sizes[i], unitSize), 3 * unitSize);
+        totalSize += blockSizes[i];
+        numBlocks++;
+        lastBlock = i;
+    }
+    if (numBlocks == 0)
+        return;
 
-        return resultOffset;
+    if (this->arenaTail != NPtr)
+    {
+        for (size_t i = 0; i < n; i++)
+            if (sizes[i] != 0)
+                outOffsets[i] = this->shmalloc(sizes[i]);
+        trace.doneBatch(sizes, outOffsets, n);
+        return;
     }
-    else
+
+    while (true)
     {
-        // TODO: increase the size of the heap
-        this->resize(this->heapCapacity_unsafe(), this->heapCapacity_unsafe() + 1);
-        return this->shmalloc(size);
-        // this->logger->info("shmalloc(size={}) failed", size);
-        // return 0;
+        // Another process may have grown the heap since the last pass
+        this->checkConnection();
+
+        size_t seenCapacity;
+        {
+            BinsLockGuard guard(this);
+
+            BlockHeader *best = this->findFreeBlock(totalSize);
+            seenCapacity = this->heapCapacity_unsafe();
+
+            if (best != nullptr)
+            {
+                size_t bestSize = best->size();
+                size_t prevAllocated = best->size_BPA & 0b010;
+                this->removeFreeBlock(best);
+
+                // A remainder too small for a free block goes to the last block, like shmalloc() does
+                bool split = bestSize >= totalSize + 4 * unitSize;
+                if (split)
+                {
+                    BlockHeader *rest = reinterpret_cast<BlockHeader *>(reinterpret_cast<Byte *>(best) + totalSize);
+                    // Size: bestSize - totalSize; Busy: 0; Previous Allocated: 1; Allocated: 0
+                    rest->reset((bestSize - totalSize) | 0b010);
+                    rest->getFooterPtr()->val() = bestSize - totalSize;
+                    this->insertFreeBlock(rest);
+                }
+                else
+                {
+                    blockSizes[lastBlock] += bestSize - totalSize;
+                }
+
+                Byte *cursor = reinterpret_cast<Byte *>(best);
+                for (size_t i = 0; i < n; i++)
+                {
+                    if (blockSizes[i] == 0)
+                        continue;
+                    BlockHeader *header = reinterpret_cast<BlockHeader *>(cursor);
+                    // Size: blockSizes[i]; Busy: 0; Previous Allocated: the first block keeps the bit of the free block; Allocated: 1
+                    header->resetAllocated(blockSizes[i] | prevAllocated | 0b001);
+                    prevAllocated = 0b010;
+                    outOffsets[i] = reinterpret_cast<Byte *>(header + 1) - this->heapHead_unsafe();
+                    cursor += blockSizes[i];
+                }
+                if (!split && cursor < this->heapTail_unsafe())
+                    reinterpret_cast<BlockHeader *>(cursor)->setP(true);
+
+                this->statCounter_unsafe(StatAllocCount).fetch_add(numBlocks, std::memory_order_relaxed);
+                this->logger->info("shmallocBatch(n={}) succeeded. {} blocks, {} bytes from offset {}", n, numBlocks, split ? totalSize : bestSize, reinterpret_cast<Byte *>(best) - this->heapHead_unsafe());
+
+                trace.doneBatch(sizes, outOffsets, n);
+                return;
+            }
+        }
+
+        // No fit, grow once and retry. grow() resizes under the bins lock, so the guard above must be released first
+        this->grow(totalSize, seenCapacity);
     }
 }
 
-size_t ShmemHeap::shrealloc(size_t offset, size_t size)
+size_t ShmemHeap::shrealloc(size_t offset, size_t size, size_t alignment)
 {
+    TraceScope trace(this, TraceRealloc, size, offset, alignment);
     this->checkConnection();
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    if ((alignment & (alignment - 1)) != 0 || alignment > pageSize)
+    {
+        this->logger->error("shrealloc(offset={}, size={}, alignment={}) needs a power of two alignment up to {}", offset, size, alignment, pageSize);
+        throw std::runtime_error("Invalid alignment for shrealloc");
+    }
 
     // special cases
     if (size == 0)
     {
         this->shfree(offset);
-        return 0;
+        return trace.done(0);
     }
     if (offset == 0)
-        return this->shmalloc(size);
+        return trace.done(alignment > unitSize ? this->shmemalign(size, alignment) : this->shmalloc(size));
 
     BlockHeader *header = reinterpret_cast<BlockHeader *>(this->heapHead_unsafe() + offset) - 1;
+    this->statCounter_unsafe(StatReallocCount).fetch_add(1, std::memory_order_relaxed);
 
     // Set Busy bit
-    header->wait();
-    header->setB(true);
+    if (!header->tryLock())
+    {
+        this->statCounter_unsafe(StatBusyContention).fetch_add(1, std::memory_order_relaxed);
+        header->lock();
+    }
+
+    if (header->S())
+    {
+        // A slab slot never changes size, it is kept while the payload fits and left for a regular block otherwise
+        size_t capacity = payloadCapacity(header);
+        if (size <= capacity)
+        {
+            header->unlock();
+            return trace.done(offset);
+        }
+        size_t newPayloadOffset = this->moveAllocate(offset, size, alignment);
+        // shmalloc may have remapped the heap, only the offsets still hold
+        header = reinterpret_cast<BlockHeader *>(this->heapHead_unsafe() + offset) - 1;
+        std::memcpy(this->heapHead_unsafe() + newPayloadOffset, this->heapHead_unsafe() + offset, capacity);
+        header->unlock();
+        this->shfree(offset);
+
+        this->logger->debug("shrealloc(offset={}, size={}) move slab slot payload offset: {}->{}", offset, size, offset, newPayloadOffset);
+        return trace.done(newPayloadOffset);
+    }
 
     // TODO: check if it is a valid header
 
@@ -347,15 +712,36 @@ size_t ShmemHeap::shrealloc(size_t offset, size_t size)
     {
         this->logger->debug("shrealloc(offset={}, size={}) succeeded. Current block size: {} already satisfied the requirement", offset, size, oldSize);
 
-        header->setB(false);
-        return offset;
+        header->unlock();
+        return trace.done(offset);
     }
     else if (oldSize > requiredSize)
     {
-        if (oldSize - 4 * unitSize < requiredSize)
+        BinsLockGuard guard(this);
+
+        BlockHeader *next = header->getNextPtr();
+        bool nextFree = reinterpret_cast<Byte *>(next) < this->heapTail_unsafe() && !next->A();
+
+        if (nextFree)
+        {
+            // Hand the spare bytes to the following free block, its header moves down
+            size_t freeSize = oldSize - requiredSize + next->size();
+            this->removeFreeBlock(next);
+
+            BlockHeader *newBlockHeader = reinterpret_cast<BlockHeader *>(reinterpret_cast<uintptr_t>(header) + requiredSize);
+            // Size: freeSize; Busy: 0; Previous Allocated: 1; Allocated: 0
+            newBlockHeader->reset(freeSize | 0b010);
+            newBlockHeader->getFooterPtr()->val() = freeSize;
+            this->insertFreeBlock(newBlockHeader);
+
+            // update the header block, other bits are kept as waiters may be parked on it
+            header->setSize(requiredSize);
+
+            this->logger->debug("shrealloc(offset={}, size={}) shrink current block into the next free block: {}A+{}E->{}A+{}E", offset, size, oldSize, freeSize + requiredSize - oldSize, requiredSize, freeSize);
+        }
+        else if (oldSize - 4 * unitSize < requiredSize)
         {
             // a free block is at least 4 bytes, we cannot split the block
-            // TODO: the following block is a free block, we can merge the bytes into it
             this->logger->warn("A reallocation request is ignored as a free block is at least 4 bytes (Not enough space to split a free block). Request size: {}, old size: {}", requiredSize, oldSize);
         }
         else
@@ -363,142 +749,794 @@ size_t ShmemHeap::shrealloc(size_t offset, size_t size)
             // split a new free block
             BlockHeader *newBlockHeader = reinterpret_cast<BlockHeader *>(reinterpret_cast<uintptr_t>(header) + requiredSize);
             // update the new block
-            // Size: bestSize - requiredSize; Busy: 1; Previous Allocated: 1; Allocated: 0
-            newBlockHeader->val() = (header->size() - requiredSize) | 0b010;
-            newBlockHeader->getFooterPtr()->val() = header->size() - requiredSize;
+            // Size: bestSize - requiredSize; Busy: 0; Previous Allocated: 1; Allocated: 0
+            newBlockHeader->reset((oldSize - requiredSize) | 0b010);
+            newBlockHeader->getFooterPtr()->val() = oldSize - requiredSize;
 
             this->insertFreeBlock(newBlockHeader);
 
-            // Reset busy bit
-            newBlockHeader->setB(false);
+            // The following block is allocated and now follows a free one
+            if (reinterpret_cast<Byte *>(next) < this->heapTail_unsafe())
+                next->setP(false);
 
-            // update the header block
-            // Size: requiredSize; Busy: 0; Previous Allocated: not changed; Allocated: 1
-            header->val() = (requiredSize & ~0b100) | (header->size_BPA & 0b010) | 0b001;
+            // update the header block, other bits are kept as waiters may be parked on it
+            // Size: requiredSize; Busy: 1; Previous Allocated: not changed; Allocated: 1
+            header->setSize(requiredSize);
 
             this->logger->debug("shrealloc(offset={}, size={}) shrink current block from: {}A->{}A+{}E", offset, size, oldSize, requiredSize, oldSize - requiredSize);
         }
 
-        header->setB(false);
-        return offset;
+        header->unlock();
+        return trace.done(offset);
     }
     else
     { // The new size is larger than the old size
-        size_t oldPayloadSize = oldSize - sizeof(BlockHeader);
-
-        Byte *tempPayload = new Byte[oldPayloadSize];
-        // Copy the payload
-        std::memcpy(tempPayload, this->heapHead_unsafe() + offset, oldPayloadSize);
-
-        header->setB(false); // shrealloc is done with the current block
-        // Free the old payload
-        this->shfree(offset);
+        {
+            BinsLockGuard guard(this);
 
-        // Re-allocate the new payload
-        size_t newPayloadOffset = this->shmalloc(size);
+            BlockHeader *next = header->getNextPtr();
+            if (reinterpret_cast<Byte *>(next) < this->heapTail_unsafe() && !next->A() && oldSize + next->size() >= requiredSize)
+            {
+                // Absorb the following free block, the payload stays where it is
+                size_t totalSize = oldSize + next->size();
+                this->removeFreeBlock(next);
+
+                if (totalSize - requiredSize >= 4 * unitSize)
+                {
+                    // Split off the remainder, the block after it keeps P = 0 as it still follows a free block
+                    BlockHeader *newBlockHeader = reinterpret_cast<BlockHeader *>(reinterpret_cast<uintptr_t>(header) + requiredSize);
+                    // Size: totalSize - requiredSize; Busy: 0; Previous Allocated: 1; Allocated: 0
+                    newBlockHeader->reset((totalSize - requiredSize) | 0b010);
+                    newBlockHeader->getFooterPtr()->val() = totalSize - requiredSize;
+                    this->insertFreeBlock(newBlockHeader);
+                    header->setSize(requiredSize);
+                }
+                else
+                {
+                    header->setSize(totalSize);
+                    if (reinterpret_cast<Byte *>(header->getNextPtr()) < this->heapTail_unsafe())
+                        header->getNextPtr()->setP(true);
+                }
+
+                this->logger->debug("shrealloc(offset={}, size={}) expand current block in place: {}A->{}A", offset, size, oldSize, header->size());
+
+                header->unlock();
+                return trace.done(offset);
+            }
+        }
 
-        std::memcpy(this->heapHead_unsafe() + newPayloadOffset, tempPayload, oldPayloadSize);
+        // No room behind the block, copy the payload straight into a new block
+        size_t oldPayloadSize = oldSize - sizeof(BlockHeader);
+        size_t newPayloadOffset = this->moveAllocate(offset, size, alignment);
+        // shmalloc may have grown the heap and the mapping may have moved with it, only the offsets still hold
+        header = reinterpret_cast<BlockHeader *>(this->heapHead_unsafe() + offset) - 1;
+        std::memcpy(this->heapHead_unsafe() + newPayloadOffset, this->heapHead_unsafe() + offset, oldPayloadSize);
 
-        delete[] tempPayload;
+        header->unlock(); // shrealloc is done with the current block
+        this->shfree(offset);
 
         this->logger->debug("shrealloc(offset={}, size={}) move payload offset: {}->{}, block size: {}->{}", offset, size, offset, newPayloadOffset, oldSize, requiredSize);
 
-        return newPayloadOffset;
+        return trace.done(newPayloadOffset);
     }
 }
 
-int ShmemHeap::shfree(size_t offset)
+size_t ShmemHeap::moveAllocate(size_t offset, size_t size, size_t alignment)
 {
-    this->checkConnection();
-    return this->shfreeHelper(this->heapHead_unsafe() + offset);
+    if (alignment <= unitSize)
+        return this->shmalloc(size);
+    // The old payload sits alignedOffset short of a boundary, the new one must too. The payload only moves when it
+    // grows, so the distance is within the old payload and within size
+    size_t payloadAddress = reinterpret_cast<uintptr_t>(this->heapHead_unsafe() + offset);
+    return this->shmemalign(size, alignment, (alignment - payloadAddress % alignment) % alignment);
 }
 
-// Debug
-void ShmemHeap::printShmHeap()
+size_t ShmemHeap::shmallocSlab(size_t size)
 {
-    checkConnection();
-    size_t staticCapacity = this->staticCapacity_unsafe();
-    size_t heapCapacity = this->heapCapacity_unsafe();
-    size_t firstFreeBlockOffset = this->freeBlockListOffset_unsafe();
-    size_t entranceOffset = this->entranceOffset_unsafe();
-    Byte *heapHead = this->heapHead_unsafe();
-    Byte *heapTail = this->heapTail_unsafe();
-    std::vector<BlockHeader *> freeBlockList = {};
-    if (this->freeBlockListOffset_unsafe() != NPtr)
+    TraceScope trace(this, TraceMallocSlab, size);
+    this->checkConnection();
+    size_t slabClass = ShmemHeap::slabClass(size);
+    // Arena blocks are freed as a region, they must not share pages with the rest of the heap
+    if (size < 1 || slabClass == numSlabClasses || this->arenaTail != NPtr)
+        return trace.done(this->shmalloc(size));
+
+    // A slot must not take more than the block shmalloc() would carve, e.g. 40 bytes would waste 24 in the 64-byte class
+    size_t slotSize = unitSize + slabClassSize(slabClass);
+    if (slotSize > std::max(pad(size + sizeof(BlockHeader), unitSize), 4 * unitSize))
+        return trace.done(this->shmalloc(size));
+
+    size_t newPageOffset = NPtr;
+    size_t newPageSlots = 0;
+    size_t resultOffset = NPtr;
+    while (true)
     {
-        freeBlockList.push_back(this->freeBlockList_unsafe());
-        BlockHeader *current = this->freeBlockList_unsafe()->getBckPtr();
-        while (current != this->freeBlockList_unsafe())
+        this->checkConnection();
         {
-            freeBlockList.push_back(current);
-            current = current->getBckPtr();
+            BinsLockGuard guard(this);
+
+            // A page added while this process allocated its own is used first
+            if (this->slabListHead(slabClass) == NPtr && newPageOffset != NPtr)
+            {
+                SlabPage *page = reinterpret_cast<SlabPage *>(this->heapHead_unsafe() + newPageOffset);
+                page->slotSize = slotSize;
+                page->slotCount = newPageSlots;
+                page->freeMap = (1UL << newPageSlots) - 1;
+                this->linkSlabPage(slabClass, page);
+                this->countSlabPage(slabClass, true);
+                newPageOffset = NPtr;
+            }
+
+            size_t pageOffset = this->slabListHead(slabClass);
+            if (pageOffset != NPtr)
+            {
+                SlabPage *page = reinterpret_cast<SlabPage *>(this->heapHead_unsafe() + pageOffset);
+                size_t slot = static_cast<size_t>(__builtin_ctzl(page->freeMap));
+                page->freeMap &= ~(1UL << slot);
+                if (page->freeMap == 0)
+                    this->unlinkSlabPage(slabClass, page);
+
+                BlockHeader *header = reinterpret_cast<BlockHeader *>(reinterpret_cast<Byte *>(page + 1) + slot * slotSize);
+                // Size: distance back to the page; Slab: 1; Busy: 0; Allocated: 1
+                header->resetAllocated(static_cast<size_t>(reinterpret_cast<Byte *>(header) - reinterpret_cast<Byte *>(page)) | BlockHeader::slabBit | 0b001);
+                resultOffset = reinterpret_cast<Byte *>(header + 1) - this->heapHead_unsafe();
+                this->statCounter_unsafe(StatAllocCount).fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        if (resultOffset != NPtr)
+        {
+            // Another process refilled the class first, the page of this one is not needed
+            if (newPageOffset != NPtr)
+                this->shfree(newPageOffset);
+            this->logger->info("shmallocSlab(size={}) succeeded. Payload Offset: {}, Slot Size: {}", size, resultOffset, slotSize);
+            return trace.done(resultOffset);
         }
+
+        // Every page of the class is full. shmalloc() takes the bins lock and may grow the heap, so the guard above is released first
+        {
+            BinsLockGuard guard(this);
+            newPageSlots = this->nextSlabPageSlots(slabClass);
+        }
+        newPageOffset = this->shmalloc(sizeof(SlabPage) + newPageSlots * slotSize);
     }
-    this->logger->info("********************************* Static Space ****************************");
-    this->logger->info("Static Space Capacity: {}", staticCapacity);
-    this->logger->info("Heap Capacity: {}", heapCapacity);
-    this->logger->info("Free block list offset: {}", firstFreeBlockOffset == NPtr ? "NPtr" : std::to_string(firstFreeBlockOffset));
-    this->logger->info("Entrance offset: {}", entranceOffset == NPtr ? "null" : std::to_string(entranceOffset));
-    this->logger->info("********************************** Block List *****************************");
-    // this->logger->info("Offset\tStatus\tPrev\tBusy\tt_Begin\tt_End\tt_Size");
-    this->logger->info("{:<8} {:<6} {:<6} {:<6} {:<14} {:<14} {:<6}", "Offset", "Status", "Prev", "Busy", "Begin", "End", "Size");
+}
 
-    uintptr_t begin, end, size;
-    BlockHeader *current = reinterpret_cast<BlockHeader *>(heapHead);
-    while (reinterpret_cast<Byte *>(current) < heapTail)
+size_t ShmemHeap::shmemalign(size_t size, size_t alignment, size_t alignedOffset)
+{
+    TraceScope trace(this, TraceMemalign, size, alignment, alignedOffset);
+    this->checkConnection();
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment > pageSize || alignedOffset % unitSize != 0 || alignedOffset > size)
     {
-        size = current->size();
-        begin = reinterpret_cast<uintptr_t>(current);
-        end = begin + size;
-        this->logger->info("{:#08x} {:<6d} {:<6d} {:<6d} {:#014x} {:#014x} {:<6d}",
-                           reinterpret_cast<Byte *>(current) - heapHead,
-                           current->A() ? 1 : 0,
-                           current->P() ? 1 : 0,
-                           current->B() ? 1 : 0,
-                           begin,
-                           end,
-                           size);
-        current = current->getNextPtr();
+        this->logger->error("shmemalign(size={}, alignment={}, alignedOffset={}) needs a power of two alignment up to {} and an offset inside the payload aligned to {}", size, alignment, alignedOffset, pageSize, unitSize);
+        throw std::runtime_error("Invalid alignment for shmemalign");
     }
-    this->logger->info("********************************** Free List ******************************");
-    for (BlockHeader *block : freeBlockList)
+    if (size < 1)
+        return trace.done(0);
+    if (alignment <= unitSize)
+        return trace.done(this->shmalloc(size));
+
+    // Header + size + Padding, a block is at least 4 units
+    size_t requiredSize = std::max(pad(size + sizeof(BlockHeader), unitSize), 4 * unitSize);
+    // The aligned payload starts less than alignment + 4 units into the free block, whatever its address
+    size_t searchSize = requiredSize + alignment + 4 * unitSize;
+
+    while (true)
     {
-        this->logger->info("Block: {:#08x} Size: {}", reinterpret_cast<Byte *>(block) - heapHead, block->size());
+        // Another process may have grown the heap since the last pass
+        this->checkConnection();
+
+        size_t seenCapacity;
+        {
+            BinsLockGuard guard(this);
+
+            BlockHeader *best = this->findFreeBlock(searchSize);
+            seenCapacity = this->heapCapacity_unsafe();
+
+            if (best != nullptr)
+            {
+                size_t bestSize = best->size();
+                uintptr_t blockBegin = reinterpret_cast<uintptr_t>(best);
+
+                // The bytes in front of the aligned block must be empty or a valid free block
+                uintptr_t alignedPtr = pad(blockBegin + sizeof(BlockHeader) + alignedOffset, alignment);
+                size_t lead = alignedPtr - alignedOffset - sizeof(BlockHeader) - blockBegin;
+                while (lead != 0 && lead < 4 * unitSize)
+                    lead += alignment;
+
+                this->removeFreeBlock(best);
+                size_t prevAllocated = best->size_BPA & 0b010;
+                if (lead != 0)
+                {
+                    // Size: lead; Busy: 0; Previous Allocated: not changed; Allocated: 0
+                    best->reset(lead | prevAllocated);
+                    best->getFooterPtr()->val() = lead;
+                    this->insertFreeBlock(best);
+                    prevAllocated = 0;
+                }
+
+                BlockHeader *header = reinterpret_cast<BlockHeader *>(blockBegin + lead);
+                size_t blockSize = requiredSize;
+                size_t rest = bestSize - lead - requiredSize;
+                if (rest >= 4 * unitSize)
+                {
+                    // The block after the remainder keeps P = 0 as it still follows a free block
+                    BlockHeader *tail = reinterpret_cast<BlockHeader *>(reinterpret_cast<Byte *>(header) + requiredSize);
+                    // Size: rest; Busy: 0; Previous Allocated: 1; Allocated: 0
+                    tail->reset(rest | 0b010);
+                    tail->getFooterPtr()->val() = rest;
+                    this->insertFreeBlock(tail);
+                }
+                else
+                {
+                    blockSize += rest;
+                }
+
+                // Size: blockSize; Busy: 0; Previous Allocated: 0 after a lead block, otherwise not changed; Allocated: 1
+                header->resetAllocated(blockSize | prevAllocated | 0b001);
+                if (rest < 4 * unitSize && reinterpret_cast<Byte *>(header->getNextPtr()) < this->heapTail_unsafe())
+                    header->getNextPtr()->setP(true);
+
+                size_t resultOffset = reinterpret_cast<Byte *>(header + 1) - this->heapHead_unsafe();
+                this->statCounter_unsafe(StatAllocCount).fetch_add(1, std::memory_order_relaxed);
+
+                this->logger->info("shmemalign(size={}, alignment={}) succeeded. Payload Offset: {}, Block Size: {}, Lead: {}", size, alignment, resultOffset, blockSize, lead);
+                return trace.done(resultOffset);
+            }
+        }
+
+        // No fit, grow once and retry. grow() resizes under the bins lock, so the guard above must be released first
+        this->grow(searchSize, seenCapacity);
     }
-    this->logger->info("---------------------------------------------------------------------------");
 }
 
-std::vector<size_t> ShmemHeap::briefLayout()
+int ShmemHeap::shfree(size_t offset)
 {
-    checkConnection();
-    std::vector<size_t> layout = {};
+    this->checkConnection();
+    return this->shfreeHelper(this->heapHead_unsafe() + offset);
+}
 
-    Byte *heapHead = this->heapHead_unsafe();
-    Byte *heapTail = this->heapTail_unsafe();
+size_t ShmemHeap::beginArena(size_t size)
+{
+    // Replaying the call reserves the region again, the shmalloc() behind it is not recorded
+    TraceScope trace(this, TraceBeginArena, size);
+    if (this->arenaTail != NPtr)
+        throw std::runtime_error("ShmemHeap is already in arena mode");
+    if (size == 0)
+    {
+        this->logger->error("beginArena(size=0): the region must not be empty");
+        throw std::runtime_error("ShmemHeap arena size must be positive");
+    }
 
-    BlockHeader *current = reinterpret_cast<BlockHeader *>(heapHead);
-    while (reinterpret_cast<Byte *>(current) < heapTail)
+    // The region is one allocated block, nobody else can allocate from or coalesce into it
+    size_t payloadOffset = this->shmalloc(size);
+    // 0 is not a block, arenaBegin would wrap below the heap head
+    if (payloadOffset == 0 || payloadOffset == NPtr)
     {
-        layout.push_back(current->size() - sizeof(BlockHeader));
-        current = current->getNextPtr();
+        this->logger->error("beginArena(size={}): could not reserve the region", size);
+        throw std::runtime_error("ShmemHeap could not reserve the arena region");
     }
+    this->arenaBegin = payloadOffset - unitSize;
+    this->arenaTail = this->arenaBegin;
 
-    return layout;
+    this->logger->info("beginArena(size={}) reserved region at offset {}", size, this->arenaBegin);
+    return trace.done(this->arenaBegin);
 }
 
-std::string ShmemHeap::briefLayoutStr()
+size_t ShmemHeap::endArena()
 {
-    checkConnection();
-    // Get the raw layout
-    std::vector<size_t> layout = {};
+    TraceScope trace(this, TraceEndArena, 0);
+    if (this->arenaTail == NPtr)
+        throw std::runtime_error("ShmemHeap is not in arena mode");
 
-    Byte *heapHead = this->heapHead_unsafe();
+    size_t used = this->arenaTail - this->arenaBegin;
+    size_t tailOffset = this->arenaTail;
+    this->arenaBegin = NPtr;
+    this->arenaTail = NPtr;
+
+    // The tail is a regular allocated block, freeing it coalesces it with the next free block
+    this->shfree(tailOffset + unitSize);
+
+    this->logger->info("endArena() carved {} bytes", used);
+    return trace.done(used);
+}
+
+bool ShmemHeap::inArena() const
+{
+    return this->arenaTail != NPtr;
+}
+
+void ShmemHeap::beginTransaction()
+{
+    if (this->stagingWrites)
+        throw std::runtime_error("ShmemHeap already has an open transaction");
+    this->stagingWrites = true;
+}
+
+void ShmemHeap::commit()
+{
+    if (!this->stagingWrites)
+        throw std::runtime_error("ShmemHeap has no open transaction");
+    checkConnection();
+
+    // The writes below must reach the shared memory, not the log
+    std::vector<std::pair<StagedWrite, UndoImage>> writes = std::move(this->stagedWrites);
+    this->stagedWrites.clear();
+    this->stagingWrites = false;
+    if (writes.empty())
+        return;
+
+    // One acquisition for the whole batch, an odd sequence holds off readers and other committers
+    size_t seq = this->lockCommitSeq();
+
+    this->committing = true;
+    this->deferringRetires = true;
+    std::vector<StagedWrite> undos;
+    undos.reserve(writes.size());
+    try
+    {
+        for (auto &[write, undo] : writes)
+        {
+            // Taken right before the write, it sees what the writes before it left
+            undos.push_back(undo ? undo() : nullptr);
+            write();
+        }
+    }
+    catch (...)
+    {
+        // The failed write gets its undo too, in case it changed something before throwing
+        this->logger->error("commit() failed at write {} of {}, rolling back", undos.size(), writes.size());
+        try
+        {
+            for (auto it = undos.rbegin(); it != undos.rend(); it++)
+            {
+                if (*it)
+                    (*it)();
+            }
+        }
+        catch (std::exception &e)
+        {
+            this->logger->error("commit() could not roll back: {}. The writes are partly applied", e.what());
+        }
+        this->endCommit(seq);
+        this->notifyChange();
+        throw;
+    }
+    this->endCommit(seq);
+    this->notifyChange();
+    this->logger->debug("commit() applied {} writes", writes.size());
+}
+
+void ShmemHeap::abort()
+{
+    if (!this->stagingWrites)
+        throw std::runtime_error("ShmemHeap has no open transaction");
+    this->logger->debug("abort() dropped {} writes", this->stagedWrites.size());
+    this->stagedWrites.clear();
+    this->stagingWrites = false;
+}
+
+bool ShmemHeap::inTransaction() const
+{
+    return this->stagingWrites;
+}
+
+void ShmemHeap::stageWrite(StagedWrite write, UndoImage undo)
+{
+    if (!this->stagingWrites)
+        throw std::runtime_error("ShmemHeap has no open transaction");
+    this->stagedWrites.emplace_back(std::move(write), std::move(undo));
+}
+
+size_t ShmemHeap::readBegin()
+{
+    checkConnection();
+    std::atomic<size_t> &commitSeq = this->commitSeq_unsafe();
+    // The committer itself reads what it has applied so far
+    if (this->committing)
+        return commitSeq.load(std::memory_order_relaxed) & commitSeqMask;
+    for (int spin = 0;; spin++)
+    {
+        size_t current = commitSeq.load(std::memory_order_acquire);
+        if (!(current & 1))
+            return current & commitSeqMask;
+        if (spin < 64)
+            continue;
+        if (spin % 16 == 0 && this->recoverCommitSeq(current))
+            continue;
+        // Announce ourselves before sleeping, unlockCommitSeq() only issues a wake when the parked bit is set
+        if (!(current & commitParkedBit) && !commitSeq.compare_exchange_weak(current, current | commitParkedBit, std::memory_order_relaxed, std::memory_order_relaxed))
+            continue;
+        // Bounded, so that a committer dying without a wake is noticed
+        timespec timeout{0, 10000000};
+        ShmemUtils::futexWait(reinterpret_cast<const size_t *>(&commitSeq), static_cast<uint32_t>(current | commitParkedBit), &timeout);
+    }
+}
+
+bool ShmemHeap::readRetry(size_t seq)
+{
+    // Keeps the reads of the data before the second look at the sequence
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return (this->commitSeq_unsafe().load(std::memory_order_relaxed) & commitSeqMask) != seq;
+}
+
+void ShmemHeap::commitWrite(const StagedWrite &write)
+{
+    checkConnection();
+    if (this->committing)
+    {
+        write();
+        return;
+    }
+
+    size_t seq = this->lockCommitSeq();
+    this->committing = true;
+    try
+    {
+        write();
+    }
+    catch (...)
+    {
+        this->endCommit(seq);
+        throw;
+    }
+    this->endCommit(seq);
+}
+
+bool ShmemHeap::deferRetire(size_t offset, StagedWrite retire)
+{
+    if (!this->deferringRetires)
+        return false;
+    this->commitRetired.emplace_back(offset, std::move(retire));
+    return true;
+}
+
+void ShmemHeap::keepRetired(size_t offset)
+{
+    for (auto it = this->commitRetired.rbegin(); it != this->commitRetired.rend(); it++)
+    {
+        if (it->first == offset)
+        {
+            this->commitRetired.erase(std::next(it).base());
+            return;
+        }
+    }
+}
+
+void ShmemHeap::endCommit(size_t seq)
+{
+    this->committing = false;
+    this->deferringRetires = false;
+    this->unlockCommitSeq(seq);
+    // Nothing links these objects anymore, they are freed (or retired for the snapshots) as they would have been
+    std::vector<std::pair<size_t, StagedWrite>> retired = std::move(this->commitRetired);
+    this->commitRetired.clear();
+    for (auto &entry : retired)
+        entry.second();
+}
+
+size_t ShmemHeap::lockCommitSeq()
+{
+    std::atomic<size_t> &commitSeq = this->commitSeq_unsafe();
+    size_t owner = static_cast<size_t>(getpid()) << commitOwnerShift;
+    size_t current = commitSeq.load(std::memory_order_relaxed);
+    for (int spin = 0; (current & 1) || !commitSeq.compare_exchange_weak(current, ((current & commitSeqMask) + 1) | owner, std::memory_order_acquire, std::memory_order_relaxed); spin++)
+    {
+        if (spin >= 64)
+            std::this_thread::yield();
+        // Like the bins lock, now and then check that the committer holding the sequence is still alive
+        if (spin >= 64 && spin % 1024 == 0 && (current & 1))
+            this->recoverCommitSeq(current);
+        current = commitSeq.load(std::memory_order_relaxed);
+    }
+    // Payload stores must not become visible before the odd sequence, and the snapshot pins are read after it
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return current & commitSeqMask;
+}
+
+void ShmemHeap::unlockCommitSeq(size_t seq)
+{
+    // Clears the owner and the parked bit with the odd sequence
+    size_t previous = this->commitSeq_unsafe().exchange((seq + 2) & commitSeqMask, std::memory_order_release);
+    if (previous & commitParkedBit)
+        ShmemUtils::futexWakeAll(reinterpret_cast<const size_t *>(&this->commitSeq_unsafe()));
+}
+
+bool ShmemHeap::recoverCommitSeq(size_t current)
+{
+    size_t owner = current >> commitOwnerShift;
+    if (owner == 0 || !ShmemUtils::processDead(owner))
+        return false;
+    std::atomic<size_t> &commitSeq = this->commitSeq_unsafe();
+    size_t expected = current;
+    while (!commitSeq.compare_exchange_weak(expected, ((current & commitSeqMask) + 1) & commitSeqMask, std::memory_order_acq_rel, std::memory_order_relaxed))
+    {
+        // Readers parking still change the word, anything else means someone released it first
+        if ((expected & ~commitParkedBit) != (current & ~commitParkedBit))
+            return true;
+    }
+    this->logger->error("Committer {} died while applying a commit, commit sequence released. Its writes may be partly applied", owner);
+    if (expected & commitParkedBit)
+        ShmemUtils::futexWakeAll(reinterpret_cast<const size_t *>(&commitSeq));
+    return true;
+}
+
+size_t ShmemHeap::pinSnapshot(size_t &entrance)
+{
+    checkConnection();
+    while (true)
+    {
+        size_t seq = this->readBegin();
+        size_t epoch = this->snapshotEpoch_unsafe().load(std::memory_order_seq_cst);
+        // Dict nodes keep the epoch they were written in as 32 bits
+        if (epoch >= UINT32_MAX)
+        {
+            this->logger->error("pinSnapshot() ran out of epochs");
+            throw std::runtime_error("ShmemHeap ran out of snapshot epochs");
+        }
+
+        size_t slot = 0;
+        for (; slot < maxSnapshots; slot++)
+        {
+            size_t free = 0;
+            if (this->snapshotPin_unsafe(slot).compare_exchange_strong(free, epoch, std::memory_order_seq_cst))
+                break;
+        }
+        if (slot == maxSnapshots)
+        {
+            this->logger->error("pinSnapshot() found all {} snapshot slots taken", maxSnapshots);
+            throw std::runtime_error("Too many snapshots pinned");
+        }
+
+        // Pairs with the writers, who look at the pins after taking their lock: either they see this pin or we see them
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // The epoch moves on only once the pin is visible, so a writer that missed the pin stamped its write with at most this epoch
+        size_t expected = epoch;
+        bool taken = this->snapshotEpoch_unsafe().compare_exchange_strong(expected, epoch + 1, std::memory_order_seq_cst);
+        entrance = this->entranceOffset_unsafe();
+        if (taken && !this->readRetry(seq))
+        {
+            this->logger->debug("pinSnapshot() pinned epoch {} in slot {}", epoch, slot);
+            return epoch;
+        }
+        // Another snapshot took the epoch or a commit went in meanwhile, pin again
+        this->snapshotPin_unsafe(slot).store(0, std::memory_order_release);
+    }
+}
+
+void ShmemHeap::unpinSnapshot(size_t epoch)
+{
+    checkConnection();
+    for (size_t slot = 0; slot < maxSnapshots; slot++)
+    {
+        size_t pinned = epoch;
+        if (this->snapshotPin_unsafe(slot).compare_exchange_strong(pinned, 0, std::memory_order_seq_cst))
+        {
+            this->logger->debug("unpinSnapshot() released epoch {}", epoch);
+            return;
+        }
+    }
+    this->logger->error("unpinSnapshot() found no snapshot of epoch {}", epoch);
+    throw std::runtime_error("Snapshot is not pinned");
+}
+
+size_t ShmemHeap::snapshotEpoch()
+{
+    checkConnection();
+    return this->snapshotEpoch_unsafe().load(std::memory_order_seq_cst);
+}
+
+size_t ShmemHeap::newestSnapshot()
+{
+    checkConnection();
+    size_t newest = 0;
+    for (size_t slot = 0; slot < maxSnapshots; slot++)
+        newest = std::max(newest, this->snapshotPin_unsafe(slot).load(std::memory_order_seq_cst));
+    return newest;
+}
+
+size_t ShmemHeap::oldestSnapshot()
+{
+    checkConnection();
+    size_t oldest = SIZE_MAX;
+    for (size_t slot = 0; slot < maxSnapshots; slot++)
+    {
+        size_t pinned = this->snapshotPin_unsafe(slot).load(std::memory_order_seq_cst);
+        if (pinned != 0)
+            oldest = std::min(oldest, pinned);
+    }
+    return oldest;
+}
+
+std::vector<size_t> ShmemHeap::pinnedSnapshots()
+{
+    checkConnection();
+    std::vector<size_t> pins;
+    for (size_t slot = 0; slot < maxSnapshots; slot++)
+    {
+        size_t pinned = this->snapshotPin_unsafe(slot).load(std::memory_order_seq_cst);
+        if (pinned != 0)
+            pins.push_back(pinned);
+    }
+    return pins;
+}
+
+std::atomic<size_t> &ShmemHeap::retiredObjects()
+{
+    checkConnection();
+    return this->retiredObjects_unsafe();
+}
+
+int ShmemHeap::shfreeRegion(size_t offset, size_t size)
+{
+    TraceScope trace(this, TraceFreeRegion, size, offset);
+    this->checkConnection();
+    if (size == 0)
+        return trace.done(0);
+
+    Byte *headPtr = this->heapHead_unsafe();
+    Byte *endPtr = headPtr + offset + size;
+    if (offset % unitSize != 0 || size % unitSize != 0 || endPtr > this->heapTail_unsafe())
+    {
+        this->logger->warn("shfreeRegion(offset={}, size={}) is out of the heap or misaligned", offset, size);
+        return trace.done(-1);
+    }
+    if (this->arenaTail != NPtr && this->arenaTail >= offset && this->arenaTail < offset + size)
+        throw std::runtime_error("shfreeRegion() cannot free the region of an active arena");
+
+    BinsLockGuard guard(this);
+
+    // Validate before touching anything, the blocks must tile the range.
+    // Only a free last block may reach past the end, endArena() merges the unused tail into it
+    BlockHeader *first = reinterpret_cast<BlockHeader *>(headPtr + offset);
+    BlockHeader *block = first;
+    BlockHeader *last = nullptr;
+    while (reinterpret_cast<Byte *>(block) < endPtr)
+    {
+        if (block->size() < 4 * unitSize || block->size() % unitSize != 0 || reinterpret_cast<Byte *>(block->getNextPtr()) > this->heapTail_unsafe())
+            break;
+        last = block;
+        block = block->getNextPtr();
+    }
+    if (last == nullptr || (reinterpret_cast<Byte *>(block) != endPtr && (reinterpret_cast<Byte *>(block) < endPtr || last->A())))
+    {
+        this->logger->warn("shfreeRegion(offset={}, size={}) does not cover whole blocks", offset, size);
+        return trace.done(-1);
+    }
+    endPtr = reinterpret_cast<Byte *>(block);
+
+    // Free blocks inside the region leave their bins, allocated ones are simply absorbed
+    size_t freedBlocks = 0;
+    for (block = first; reinterpret_cast<Byte *>(block) < endPtr; block = block->getNextPtr())
+    {
+        if (!block->A())
+            this->removeFreeBlock(block);
+        else
+            freedBlocks++;
+    }
+    this->statCounter_unsafe(StatFreeCount).fetch_add(freedBlocks, std::memory_order_relaxed);
+
+    BlockHeader *coalesceTarget = first;
+    size_t newSize = static_cast<size_t>(endPtr - reinterpret_cast<Byte *>(first));
+
+    // Free blocks are never adjacent, so there is at most one neighbour to merge on each side
+    if (!first->P())
+    {
+        coalesceTarget = first->getPrevPtr();
+        this->removeFreeBlock(coalesceTarget);
+        newSize += coalesceTarget->size();
+    }
+    BlockHeader *next = reinterpret_cast<BlockHeader *>(endPtr);
+    if (endPtr < this->heapTail_unsafe() && !next->A())
+    {
+        this->removeFreeBlock(next);
+        newSize += next->size();
+    }
+
+    // Size: newSize; Busy: 0; Previous Allocated: not changed; Allocated: 0
+    coalesceTarget->reset(newSize | (coalesceTarget->size_BPA & 0b010));
+    coalesceTarget->getFooterPtr()->val() = newSize;
+    if (reinterpret_cast<Byte *>(coalesceTarget->getNextPtr()) < this->heapTail_unsafe())
+        coalesceTarget->getNextPtr()->setP(false);
+    this->insertFreeBlock(coalesceTarget);
+    this->releaseFreePages(coalesceTarget, reinterpret_cast<Byte *>(first), endPtr);
+
+    this->logger->info("shfreeRegion(offset={}, size={}) succeeded, free block at offset {} of size {}", offset, size, reinterpret_cast<Byte *>(coalesceTarget) - headPtr, newSize);
+    return trace.done(0);
+}
+
+// Debug
+void ShmemHeap::printShmHeap()
+{
+    checkConnection();
+    size_t staticCapacity = this->staticCapacity_unsafe();
+    size_t heapCapacity = this->heapCapacity_unsafe();
+    size_t freeBinBitmap = this->freeBinBitmap_unsafe();
+    size_t entranceOffset = this->entranceOffset_unsafe();
+    size_t binsLockOwner = this->binsLock_unsafe().load(std::memory_order_relaxed);
+    size_t resizeEpoch = this->resizeEpoch_unsafe().load(std::memory_order_relaxed);
+    Byte *heapHead = this->heapHead_unsafe();
     Byte *heapTail = this->heapTail_unsafe();
+    this->logger->info("********************************* Static Space ****************************");
+    this->logger->info("Static Space Capacity: {}", staticCapacity);
+    this->logger->info("Heap Capacity: {}", heapCapacity);
+    this->logger->info("Free bin bitmap: {:#018x}", freeBinBitmap);
+    this->logger->info("Entrance offset: {}", entranceOffset == NPtr ? "null" : std::to_string(entranceOffset));
+    this->logger->info("Bins lock owner: {}", binsLockOwner == 0 ? "none" : std::to_string(binsLockOwner));
+    this->logger->info("Resize epoch: {}", resizeEpoch);
+    Stats stats = this->stats();
+    this->logger->info("Free bytes: {} in {} blocks, largest: {}", stats.freeBytes, stats.freeBlocks, stats.largestFreeBlock);
+    this->logger->info("Allocs: {} frees: {} reallocs: {} resizes: {}", stats.allocCount, stats.freeCount, stats.reallocCount, stats.resizeCount);
+    this->logger->info("Contention: busy bit {} bins lock {}", stats.busyContention, stats.binsContention);
+    this->logger->info("********************************** Block List *****************************");
+    // this->logger->info("Offset\tStatus\tPrev\tBusy\tt_Begin\tt_End\tt_Size");
+    this->logger->info("{:<8} {:<6} {:<6} {:<6} {:<14} {:<14} {:<6}", "Offset", "Status", "Prev", "Busy", "Begin", "End", "Size");
 
+    uintptr_t begin, end, size;
     BlockHeader *current = reinterpret_cast<BlockHeader *>(heapHead);
     while (reinterpret_cast<Byte *>(current) < heapTail)
     {
-        layout.push_back(current->size_BPA);
+        size = current->size();
+        begin = reinterpret_cast<uintptr_t>(current);
+        end = begin + size;
+        this->logger->info("{:#08x} {:<6d} {:<6d} {:<6d} {:#014x} {:#014x} {:<6d}",
+                           reinterpret_cast<Byte *>(current) - heapHead,
+                           current->A() ? 1 : 0,
+                           current->P() ? 1 : 0,
+                           current->B() ? 1 : 0,
+                           begin,
+                           end,
+                           size);
+        current = current->getNextPtr();
+    }
+    this->logger->info("********************************** Free Bins ******************************");
+    for (size_t bin = 0; bin < numBins; bin++)
+    {
+        BlockHeader *binHead = this->freeBin_unsafe(bin);
+        if (binHead == nullptr)
+            continue;
+        this->logger->info("Bin {}:", bin);
+        BlockHeader *block = binHead;
+        do
+        {
+            this->logger->info("Block: {:#08x} Size: {}", reinterpret_cast<Byte *>(block) - heapHead, block->size());
+            block = block->getBckPtr();
+        } while (block != binHead);
+    }
+    this->logger->info("---------------------------------------------------------------------------");
+}
+
+std::vector<size_t> ShmemHeap::briefLayout()
+{
+    checkConnection();
+    std::vector<size_t> layout = {};
+
+    Byte *heapHead = this->heapHead_unsafe();
+    Byte *heapTail = this->heapTail_unsafe();
+
+    BlockHeader *current = reinterpret_cast<BlockHeader *>(heapHead);
+    while (reinterpret_cast<Byte *>(current) < heapTail)
+    {
+        layout.push_back(current->size() - sizeof(BlockHeader));
+        current = current->getNextPtr();
+    }
+
+    return layout;
+}
+
+std::string ShmemHeap::briefLayoutStr()
+{
+    checkConnection();
+    // Get the raw layout
+    std::vector<size_t> layout = {};
+
+    Byte *heapHead = this->heapHead_unsafe();
+    Byte *heapTail = this->heapTail_unsafe();
+
+    BlockHeader *current = reinterpret_cast<BlockHeader *>(heapHead);
+    while (reinterpret_cast<Byte *>(current) < heapTail)
+    {
+        layout.push_back(current->size_BPA & ~(BlockHeader::parkedBit | BlockHeader::seqMask));
         current = current->getNextPtr();
     }
 
@@ -512,31 +1550,401 @@ std::string ShmemHeap::briefLayoutStr()
         if (i < layout.size() - 1)
             layoutStr += ", ";
     }
-    return layoutStr;
+    return layoutStr;
+}
+
+bool ShmemHeap::verifyHeap()
+{
+    checkConnection();
+    BinsLockGuard guard(this);
+
+    Byte *heapHead = this->heapHead_unsafe();
+    Byte *heapTail = this->heapTail_unsafe();
+
+    // Walk the blocks in address order
+    size_t freeBlocks = 0;
+    size_t freeBytes = 0;
+    size_t largestFree = 0;
+    bool prevAllocated = true;
+    BlockHeader *current = reinterpret_cast<BlockHeader *>(heapHead);
+    while (reinterpret_cast<Byte *>(current) < heapTail)
+    {
+        size_t offset = reinterpret_cast<Byte *>(current) - heapHead;
+        size_t size = current->size();
+        if (size < 4 * unitSize || size % unitSize != 0 || reinterpret_cast<Byte *>(current) + size > heapTail)
+        {
+            this->logger->error("verifyHeap: block at offset {} has invalid size {}", offset, size);
+            return false;
+        }
+        if (current->P() != prevAllocated)
+        {
+            this->logger->error("verifyHeap: block at offset {} has P bit {} but the previous block is {}", offset, current->P(), prevAllocated ? "allocated" : "free");
+            return false;
+        }
+        if (!current->A())
+        {
+            if (!prevAllocated)
+            {
+                this->logger->error("verifyHeap: free block at offset {} follows another free block", offset);
+                return false;
+            }
+            if (current->getFooterPtr()->size_BPA != size)
+            {
+                this->logger->error("verifyHeap: free block at offset {} has footer {} but size {}", offset, current->getFooterPtr()->size_BPA, size);
+                return false;
+            }
+            if (current->B())
+            {
+                this->logger->error("verifyHeap: free block at offset {} is busy", offset);
+                return false;
+            }
+            freeBlocks++;
+            freeBytes += size;
+            largestFree = std::max(largestFree, size);
+        }
+        prevAllocated = current->A();
+        current = current->getNextPtr();
+    }
+
+    // Every free block must be reachable from exactly the bin of its size
+    size_t binnedBlocks = 0;
+    size_t bitmap = this->freeBinBitmap_unsafe();
+    for (size_t bin = 0; bin < numBins; bin++)
+    {
+        BlockHeader *binHead = this->freeBin_unsafe(bin);
+        if ((binHead != nullptr) != static_cast<bool>(bitmap & (1UL << bin)))
+        {
+            this->logger->error("verifyHeap: bitmap bit of bin {} does not match its head", bin);
+            return false;
+        }
+        if (binHead == nullptr)
+            continue;
+
+        BlockHeader *block = binHead;
+        do
+        {
+            Byte *blockPtr = reinterpret_cast<Byte *>(block);
+            if (blockPtr < heapHead || blockPtr + 4 * unitSize > heapTail || (blockPtr - heapHead) % unitSize != 0)
+            {
+                this->logger->error("verifyHeap: bin {} points outside the heap", bin);
+                return false;
+            }
+            if (block->A() || binIndex(block->size()) != bin)
+            {
+                this->logger->error("verifyHeap: block at offset {} does not belong to bin {}", blockPtr - heapHead, bin);
+                return false;
+            }
+            if (block->getBckPtr()->getFwdPtr() != block)
+            {
+                this->logger->error("verifyHeap: bin {} is broken at offset {}", bin, blockPtr - heapHead);
+                return false;
+            }
+            if (++binnedBlocks > freeBlocks)
+            {
+                this->logger->error("verifyHeap: bins hold more blocks than the {} free blocks in the heap", freeBlocks);
+                return false;
+            }
+            block = block->getBckPtr();
+        } while (block != binHead);
+    }
+    if (binnedBlocks != freeBlocks)
+    {
+        this->logger->error("verifyHeap: bins hold {} blocks but the heap has {} free blocks", binnedBlocks, freeBlocks);
+        return false;
+    }
+
+    // Pages on a slab list are allocated blocks of their class with a slot free and a slot taken
+    for (size_t slabClass = 0; slabClass < numSlabClasses; slabClass++)
+    {
+        size_t prevOffset = NPtr;
+        for (size_t pageOffset = this->slabListHead(slabClass); pageOffset != NPtr;)
+        {
+            Byte *pagePtr = heapHead + pageOffset;
+            if (pagePtr < heapHead + unitSize || pagePtr + sizeof(SlabPage) > heapTail || pageOffset % unitSize != 0)
+            {
+                this->logger->error("verifyHeap: slab list {} points outside the heap", slabClass);
+                return false;
+            }
+            SlabPage *page = reinterpret_cast<SlabPage *>(pagePtr);
+            BlockHeader *pageBlock = reinterpret_cast<BlockHeader *>(pagePtr) - 1;
+            if (!pageBlock->A() || page->slotSize != unitSize + slabClassSize(slabClass) || page->prevOffset != prevOffset ||
+                page->slotCount == 0 || page->slotCount > slabSlotsPerPage || sizeof(SlabPage) + page->slotCount * page->slotSize > payloadCapacity(pageBlock) ||
+                page->freeMap == 0 || page->freeMap == (1UL << page->slotCount) - 1)
+            {
+                this->logger->error("verifyHeap: slab page at offset {} is inconsistent with list {}", pageOffset, slabClass);
+                return false;
+            }
+            prevOffset = pageOffset;
+            pageOffset = page->nextOffset;
+        }
+    }
+
+    // The running counters must agree with the walk
+    if (this->statCounter_unsafe(StatFreeBytes).load(std::memory_order_relaxed) != freeBytes ||
+        this->statCounter_unsafe(StatFreeBlocks).load(std::memory_order_relaxed) != freeBlocks ||
+        this->statCounter_unsafe(StatLargestFree).load(std::memory_order_relaxed) != largestFree)
+    {
+        this->logger->error("verifyHeap: counters record {} free bytes in {} blocks (largest {}), the heap has {} in {} (largest {})",
+                            this->statCounter_unsafe(StatFreeBytes).load(std::memory_order_relaxed),
+                            this->statCounter_unsafe(StatFreeBlocks).load(std::memory_order_relaxed),
+                            this->statCounter_unsafe(StatLargestFree).load(std::memory_order_relaxed),
+                            freeBytes, freeBlocks, largestFree);
+        return false;
+    }
+    return true;
+}
+
+// Object transfer
+void ShmemHeap::borrow(const ShmemHeap &other)
+{
+    this->ShmemBase::borrow(other);
+
+    this->HCap = other.HCap;
+    this->SCap = other.SCap;
+    this->growthFactor = other.growthFactor;
+    this->minGrowSize = other.minGrowSize;
+    this->maxHCap = other.maxHCap;
+    this->arrayAlignment = other.arrayAlignment;
+    this->traceFile = other.traceFile;
+    this->segmented = other.segmented;
+    // A fresh connection maps the first segment only, the others are mapped on the next check
+    this->epoch = other.mappedSegments.empty() ? other.epoch : SIZE_MAX;
+    this->mappedSegments.clear();
+    // init logger
+    this->logger = other.getLogger()->clone("ShmHeap:" + this->getName());
+}
+
+void ShmemHeap::steal(ShmemHeap &&other)
+{
+    this->ShmemBase::steal(std::move(other));
+
+    this->HCap = other.HCap;
+    this->SCap = other.SCap;
+    this->growthFactor = other.growthFactor;
+    this->minGrowSize = other.minGrowSize;
+    this->maxHCap = other.maxHCap;
+    this->arrayAlignment = other.arrayAlignment;
+    this->traceFile = other.traceFile;
+    this->segmented = other.segmented;
+    this->epoch = other.mappedSegments.empty() ? other.epoch : SIZE_MAX;
+    this->mappedSegments.clear();
+    // init logger
+    this->logger = other.getLogger();
+}
+
+// Helper Methods
+thread_local int ShmemHeap::traceDepth = 0;
+
+ShmemHeap::TraceScope::TraceScope(ShmemHeap *heap, TraceOp op, size_t size, size_t offset, size_t aux)
+    : heap(heap), record(), active(heap->traceFile != nullptr), outermost(false)
+{
+    if (!this->active)
+        return;
+    this->outermost = traceDepth++ == 0;
+    if (this->outermost)
+    {
+        this->record.timestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+        this->record.size = size;
+        this->record.offset = offset;
+        this->record.op = op;
+        this->record.aux = static_cast<uint32_t>(aux);
+    }
+}
+
+void ShmemHeap::TraceScope::doneBatch(const size_t *sizes, const size_t *offsets, size_t n)
+{
+    if (!this->outermost)
+        return;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (sizes[i] == 0)
+            continue;
+        this->record.size = sizes[i];
+        this->record.result = offsets[i];
+        this->heap->writeTrace(this->record);
+    }
+}
+
+void ShmemHeap::writeTrace(const TraceRecord &record)
+{
+    // stdio locks the stream, records of concurrent threads are not interleaved
+    FILE *file = this->traceFile.get();
+    if (file != nullptr && std::fwrite(&record, sizeof(TraceRecord), 1, file) != 1)
+        this->logger->warn("Failed to append an allocation trace record: {}", std::strerror(errno));
+}
+
+void ShmemHeap::checkConnection()
+{
+    if (!this->isConnected())
+        ShmemBase::checkConnection(); // throws
+
+    // Acquire pairs with the epoch bump, a segment table read afterwards is at least as new as the epoch
+    size_t current = this->resizeEpoch_unsafe().load(std::memory_order_acquire);
+    if (current != this->epoch)
+    {
+        // The first page holding the epoch is mapped by every process, the grown tail may not be
+        this->logger->debug("Resize epoch changed {} -> {}, remapping", this->epoch, current);
+        // A recreated heap is mapped from scratch, along with the segments mapped so far
+        if (ShmemUtils::shmUnlinked(this->shmFd))
+            this->mappedSegments.clear();
+        this->reconnect();
+        this->epoch = current;
+        if (this->segmentCount_unsafe() != 0 || !this->mappedSegments.empty())
+            this->mapSegments();
+    }
+}
+
+void ShmemHeap::grow(size_t blockSize, size_t seenCapacity)
+{
+    size_t currentCapacity = this->heapCapacity_unsafe();
+    if (currentCapacity != seenCapacity)
+    { // Another process grew the heap since the miss, retry before growing again
+        this->logger->debug("grow(blockSize={}) skipped, heap capacity changed {} -> {}", blockSize, seenCapacity, currentCapacity);
+        return;
+    }
+
+    // Geometric growth keeps a sequence of allocations at amortized O(1) resizes,
+    // the additive part guarantees the missed block fits even when the heap is small or the factor is 1
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t additive = currentCapacity + pad(std::max(this->minGrowSize, blockSize), pageSize);
+    double scaled = static_cast<double>(currentCapacity) * this->growthFactor;
+    size_t geometric = scaled >= static_cast<double>(this->maxHCap) ? this->maxHCap : pad(static_cast<size_t>(scaled), pageSize);
+    size_t target = std::min(std::max(geometric, additive), this->maxHCap);
+
+    // The missed block fits only if the heap grows by blockSize (the last free block may help, but is not relied on)
+    if (target < currentCapacity + blockSize)
+    {
+        this->logger->error("grow(blockSize={}) failed, heap capacity {} would exceed the maximum {}", blockSize, currentCapacity + blockSize, this->maxHCap);
+        throw std::runtime_error("Heap capacity cannot grow beyond the maximum heap capacity");
+    }
+
+    this->logger->info("grow(blockSize={}) heap capacity {} -> {}", blockSize, currentCapacity, target);
+    this->resize(-1, static_cast<long>(target));
+}
+
+std::string ShmemHeap::segmentName(size_t serial) const
+{
+    return this->getName() + "_seg" + std::to_string(serial);
+}
+
+void ShmemHeap::appendSegment(size_t size)
+{
+    size_t count = this->segmentCount_unsafe();
+    if (count >= maxSegments)
+    {
+        this->logger->error("appendSegment(size={}) failed, heap {} already holds {} segments", size, this->getName(), count);
+        throw std::runtime_error("Segmented heap cannot hold more segments");
+    }
+    // Every process maps the segments back to back in the address range reserved behind the first one
+    size_t staticCapacity = this->staticCapacity_unsafe();
+    size_t begin = this->heapCapacity_unsafe();
+    size_t reserved = ShmemUtils::reservationSize(staticCapacity + segmentEnd(this->segmentEntry_unsafe(0)));
+    if (staticCapacity + begin + size > reserved)
+    {
+        this->logger->error("appendSegment(size={}) failed, heap {} would exceed its reserved address space of {} bytes", size, this->getName(), reserved);
+        throw std::runtime_error("Segmented heap cannot grow beyond its reserved address space");
+    }
+
+    // Serial 0 names no segment, a wrapped serial belongs to a segment dropped long ago
+    size_t serial = this->segmentNextSerial_unsafe();
+    this->segmentNextSerial_unsafe() = serial % ((1UL << (64 - segmentSerialShift)) - 1) + 1;
+    ShmemUtils::createShmAt(this->heapHead_unsafe() + begin, this->segmentName(serial), size, this->getMapOptions());
+
+    size_t entry = (serial << segmentSerialShift) | (begin + size);
+    this->segmentEntry_unsafe(count) = entry;
+    this->segmentCount_unsafe() = count + 1;
+    this->mappedSegments.push_back(entry);
+    this->logger->info("Appended segment {} ({} bytes) to heap {} at heap offset {}", this->segmentName(serial), size, this->getName(), begin);
+}
+
+size_t ShmemHeap::trimSegments(BlockHeader *lastBlock)
+{
+    size_t count = this->segmentCount_unsafe();
+    size_t oldHeapCapacity = this->heapCapacity_unsafe();
+    size_t blockOffset = reinterpret_cast<Byte *>(lastBlock) - this->heapHead_unsafe();
+
+    // A segment goes if the last free block covers it and what is left of the block is still a valid block
+    size_t newCount = count;
+    while (newCount > 1)
+    {
+        size_t begin = segmentEnd(this->segmentEntry_unsafe(newCount - 2));
+        if (begin < blockOffset || (begin != blockOffset && begin - blockOffset < 4 * unitSize))
+            break;
+        newCount--;
+    }
+    if (newCount == count)
+        return 0;
+
+    size_t newHeapCapacity = segmentEnd(this->segmentEntry_unsafe(newCount - 1));
+    size_t lastBlockSize = lastBlock->size();
+    this->removeFreeBlock(lastBlock);
+    if (newHeapCapacity > blockOffset)
+    {
+        lastBlock->setSize(newHeapCapacity - blockOffset);
+        lastBlock->getFooterPtr()->val() = newHeapCapacity - blockOffset;
+        this->insertFreeBlock(lastBlock);
+    }
+
+    // Nobody walks past the new capacity once it is written, then the segments go
+    this->heapCapacity_unsafe() = newHeapCapacity;
+    this->HCap = newHeapCapacity;
+    this->segmentCount_unsafe() = newCount;
+    this->epoch = this->resizeEpoch_unsafe().fetch_add(1, std::memory_order_release) + 1;
+    this->statCounter_unsafe(StatResizeCount).fetch_add(1, std::memory_order_relaxed);
+    ShmemUtils::unmapShmAt(this->heapHead_unsafe() + newHeapCapacity, oldHeapCapacity - newHeapCapacity);
+    for (size_t segment = newCount; segment < count; segment++)
+        ShmemUtils::unlinkShm(this->segmentName(segmentSerial(this->segmentEntry_unsafe(segment))));
+    this->mappedSegments.resize(newCount);
+
+    this->logger->info("trim() dropped {} segments, heap capacity {} -> {} (last block {} bytes)", count - newCount, oldHeapCapacity, newHeapCapacity, lastBlockSize);
+    return oldHeapCapacity - newHeapCapacity;
 }
 
-// Object transfer
-void ShmemHeap::borrow(const ShmemHeap &other)
+void ShmemHeap::mapSegments()
 {
-    this->ShmemBase::borrow(other);
+    size_t count = this->segmentCount_unsafe();
+    Byte *head = this->heapHead_unsafe();
+
+    // Keep what is mapped already. A trim followed by growth reuses a range under a new serial, which tells them apart
+    size_t keep = 0;
+    while (keep < this->mappedSegments.size() && keep < count && this->mappedSegments[keep] == this->segmentEntry_unsafe(keep))
+        keep++;
+    if (keep < this->mappedSegments.size())
+    {
+        // ShmemBase follows the first segment, the extra ones start where it ended when they were mapped
+        size_t keptEnd = segmentEnd(this->mappedSegments[keep == 0 ? 0 : keep - 1]);
+        size_t mappedEnd = segmentEnd(this->mappedSegments.back());
+        if (mappedEnd > keptEnd)
+            ShmemUtils::unmapShmAt(head + keptEnd, mappedEnd - keptEnd);
+        this->mappedSegments.resize(keep);
+    }
+    if (this->mappedSegments.empty() && count != 0)
+        this->mappedSegments.push_back(this->segmentEntry_unsafe(0));
 
-    this->HCap = other.HCap;
-    this->SCap = other.SCap;
-    // init logger
-    this->logger = other.getLogger()->clone("ShmHeap:" + this->getName());
+    for (size_t segment = this->mappedSegments.size(); segment < count; segment++)
+    {
+        size_t entry = this->segmentEntry_unsafe(segment);
+        size_t begin = segmentEnd(this->segmentEntry_unsafe(segment - 1));
+        ShmemUtils::connectShmAt(head + begin, this->segmentName(segmentSerial(entry)), segmentEnd(entry) - begin, this->getMapOptions());
+        this->mappedSegments.push_back(entry);
+    }
 }
 
-void ShmemHeap::steal(ShmemHeap &&other)
+void ShmemHeap::unlinkSegments()
 {
-    this->ShmemBase::steal(std::move(other));
-
-    this->HCap = other.HCap;
-    this->SCap = other.SCap;
-    // init logger
-    this->logger = other.getLogger();
+    // The table is authoritative while connected, afterwards only the segments this process mapped are known
+    if (this->isConnected())
+    {
+        for (size_t segment = 1; segment < this->segmentCount_unsafe(); segment++)
+            ShmemUtils::unlinkShm(this->segmentName(segmentSerial(this->segmentEntry_unsafe(segment))));
+    }
+    else
+    {
+        for (size_t segment = 1; segment < this->mappedSegments.size(); segment++)
+            ShmemUtils::unlinkShm(this->segmentName(segmentSerial(this->mappedSegments[segment])));
+    }
 }
 
-// Helper Methods
 int ShmemHeap::shfreeHelper(Byte *ptr)
 {
     // Safely handle special cases
@@ -545,26 +1953,48 @@ int ShmemHeap::shfreeHelper(Byte *ptr)
 
     this->checkConnection();
     Byte *headPtr = this->heapHead_unsafe();
+    TraceScope trace(this, TraceFree, 0, static_cast<size_t>(ptr - headPtr));
+
+    // A slab slot can sit too close to the heap tail for a block payload, test for it first
+    if (ptr - unitSize >= headPtr && ptr < this->heapTail_unsafe() && (ptr - headPtr) % unitSize == 0 && (reinterpret_cast<BlockHeader *>(ptr) - 1)->S())
+    {
+        // The S bit alone may be payload bytes of some block, the page behind it must check out before it is written
+        if (!this->verifySlabSlot(reinterpret_cast<BlockHeader *>(ptr) - 1))
+        {
+            this->logger->error("shfree(payloadOffset={}) finds a slab bit without a slab page behind it", ptr - headPtr);
+            throw std::runtime_error("Invalid slab slot passed to shfree");
+        }
+        return trace.done(this->slabFree(reinterpret_cast<BlockHeader *>(ptr) - 1));
+    }
 
     if (!verifyPayloadPtr(ptr))
     {
         this->logger->warn("shfree(payloadOffset={}) find the offset invalid, which should never be passed to shfree", ptr - headPtr);
-        return -1;
+        return trace.done(-1);
     }
 
     BlockHeader *header = reinterpret_cast<BlockHeader *>(ptr) - 1;
 
-    // Set Busy bit
-    header->wait();
-    header->setB(true);
+    // Set Busy bit, waits for any holder of the object
+    if (!header->tryLock())
+    {
+        this->statCounter_unsafe(StatBusyContention).fetch_add(1, std::memory_order_relaxed);
+        header->lock();
+    }
+
+    // Flipping the A bit exposes the block to coalescing, so everything below runs under the bins lock
+    BinsLockGuard guard(this);
 
     if (!header->A())
-        return -1;
+    {
+        header->unlock();
+        return trace.done(-1);
+    }
 
     // Set Allocated bit to 0
     header->setA(false);
-
-    this->insertFreeBlock(header);
+    size_t freedSize = header->size();
+    this->statCounter_unsafe(StatFreeCount).fetch_add(1, std::memory_order_relaxed);
 
     // Create Footer
     BlockHeader *newFooter = header->getFooterPtr();
@@ -587,20 +2017,16 @@ int ShmemHeap::shfreeHelper(Byte *ptr)
         if (prevBlockHeader->A())
             throw std::runtime_error("previous block is allocated, but following block's P bit is set");
 
-        // Wait Busy bit
-        prevBlockHeader->wait();
-        prevBlockHeader->setB(true);
+        // The previous block leaves its bin, it will be re-binned with its new size
+        this->removeFreeBlock(prevBlockHeader);
 
         size_t prevBlockSize = prevBlockHeader->size();
         size_t newSize = prevBlockSize + coalesceTarget->size();
 
         // Size: newSize; Busy: 1; Previous Allocated: not changed; Allocated: 0
-        prevBlockHeader->size_BPA = newSize | 0b100 | ((prevBlockHeader->size_BPA & 0b010) & ~0b001);
+        prevBlockHeader->reset(newSize | 0b100 | ((prevBlockHeader->size_BPA & 0b010) & ~0b001));
         newFooter->val() = newSize;
 
-        // update free list ptr
-        this->removeFreeBlock(coalesceTarget);
-
         // Write log
         this->logger->debug("shfree(payloadOffset={}) coalesced with prev: [{}, {}] <- [{}, {}]", ptr - headPtr, reinterpret_cast<Byte *>(prevBlockHeader) - headPtr, reinterpret_cast<Byte *>(coalesceTarget) - headPtr, reinterpret_cast<Byte *>(coalesceTarget) - headPtr, reinterpret_cast<Byte *>(newFooter) - headPtr);
 
@@ -611,31 +2037,137 @@ int ShmemHeap::shfreeHelper(Byte *ptr)
     {
         BlockHeader *nextBlockHeader = coalesceTarget->getNextPtr();
 
-        // Wait Busy bit
-        nextBlockHeader->wait();
+        // update free bin ptr
+        this->removeFreeBlock(nextBlockHeader);
 
         newFooter = nextBlockHeader->getFooterPtr();
 
         size_t newSize = coalesceTarget->size() + nextBlockHeader->size();
 
         // Size: newSize; Busy: 1; Previous Allocated: not changed; Allocated: 0
-        coalesceTarget->size_BPA = newSize | (coalesceTarget->size_BPA & 0b111);
+        coalesceTarget->setSize(newSize);
         newFooter->val() = newSize;
 
-        // update free list ptr
-        this->removeFreeBlock(nextBlockHeader);
-
         // Write log
         this->logger->debug("shfree(payloadOffset={}) coalesced with next: [{}, {}] <- [{}, {}]", ptr - headPtr, reinterpret_cast<Byte *>(coalesceTarget) - headPtr, reinterpret_cast<Byte *>(nextBlockHeader) - headPtr, reinterpret_cast<Byte *>(nextBlockHeader) - headPtr, reinterpret_cast<Byte *>(newFooter) - headPtr);
         // coalesceTarget unchanged;
     }
 
+    // The coalesced block is binned once its final size is known
+    this->insertFreeBlock(coalesceTarget);
+    // Neighbours below the threshold kept their pages when they were freed, they are released along with this block
+    Byte *releaseBegin = reinterpret_cast<Byte *>(header);
+    Byte *releaseEnd = releaseBegin + freedSize;
+    if (coalesceTarget != header && reinterpret_cast<Byte *>(header) - reinterpret_cast<Byte *>(coalesceTarget) < static_cast<ptrdiff_t>(this->releaseThreshold))
+        releaseBegin = reinterpret_cast<Byte *>(coalesceTarget);
+    if (reinterpret_cast<Byte *>(coalesceTarget->getNextPtr()) - releaseEnd < static_cast<ptrdiff_t>(this->releaseThreshold))
+        releaseEnd = reinterpret_cast<Byte *>(coalesceTarget->getNextPtr());
+    this->releaseFreePages(coalesceTarget, releaseBegin, releaseEnd);
+
     // Reset Busy bit
-    coalesceTarget->setB(false);
+    coalesceTarget->unlock();
 
     this->logger->info("shfree(payloadOffset={}) succeeded", ptr - headPtr);
+    return trace.done(0);
+}
+int ShmemHeap::slabFree(BlockHeader *header)
+{
+    // Set Busy bit, waits for any holder of the object
+    if (!header->tryLock())
+    {
+        this->statCounter_unsafe(StatBusyContention).fetch_add(1, std::memory_order_relaxed);
+        header->lock();
+    }
+
+    size_t emptyPageOffset = NPtr;
+    {
+        BinsLockGuard guard(this);
+
+        if (!header->A())
+        {
+            header->unlock();
+            return -1;
+        }
+
+        SlabPage *page = reinterpret_cast<SlabPage *>(reinterpret_cast<Byte *>(header) - header->size());
+        size_t slabClass = ShmemHeap::slabClass(page->slotSize - unitSize);
+        size_t slot = static_cast<size_t>(reinterpret_cast<Byte *>(header) - reinterpret_cast<Byte *>(page + 1)) / page->slotSize;
+
+        // A full page is off the list, it becomes allocatable again
+        if (page->freeMap == 0)
+            this->linkSlabPage(slabClass, page);
+        page->freeMap |= 1UL << slot;
+        header->setA(false);
+        this->statCounter_unsafe(StatFreeCount).fetch_add(1, std::memory_order_relaxed);
+
+        // An empty page goes back to the heap, nobody can take a slot from it once it is off the list
+        if (page->freeMap == (1UL << page->slotCount) - 1)
+        {
+            this->unlinkSlabPage(slabClass, page);
+            this->countSlabPage(slabClass, false);
+            emptyPageOffset = reinterpret_cast<Byte *>(page) - this->heapHead_unsafe();
+        }
+
+        // Reset Busy bit
+        header->unlock();
+    }
+
+    if (emptyPageOffset != NPtr)
+        return this->shfree(emptyPageOffset);
     return 0;
 }
+
+void ShmemHeap::releaseFreePages(BlockHeader *block, Byte *freedBegin, Byte *freedEnd)
+{
+    if (block->size() < this->releaseThreshold)
+        return;
+
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    // Offsets in the segment, which is what fallocate() works on
+    size_t blockOffset = static_cast<size_t>(reinterpret_cast<Byte *>(block) - this->shmPtr);
+    size_t footerOffset = static_cast<size_t>(reinterpret_cast<Byte *>(block->getFooterPtr()) - this->shmPtr);
+    size_t freedBeginOffset = static_cast<size_t>(freedBegin - this->shmPtr);
+    size_t freedEndOffset = static_cast<size_t>(freedEnd - this->shmPtr);
+
+    // The header with the free list links and the footer stay. The neighbours' old header/footer pages around the
+    // freed range are released with it, the rest of a merged neighbour was released when it was freed
+    size_t begin = std::max(pad(blockOffset + 3 * unitSize, pageSize), (freedBeginOffset - unitSize) / pageSize * pageSize);
+    size_t end = std::min(footerOffset / pageSize * pageSize, pad(freedEndOffset + 3 * unitSize, pageSize));
+    if (end <= begin)
+        return;
+
+    // The extra segments of a segmented heap are other objects, only madvise() on the mapping reaches all of them
+    FileDescriptor fd = this->segmentCount_unsafe() != 0 ? -1 : this->shmFd;
+    if (ShmemUtils::releaseShm(fd, this->shmPtr, begin, end - begin))
+        this->logger->debug("Released {} bytes of free block at offset {}", end - begin, blockOffset - this->staticCapacity_unsafe());
+}
+
+size_t ShmemHeap::arenaAllocate(size_t blockSize)
+{
+    BlockHeader *tail = reinterpret_cast<BlockHeader *>(this->heapHead_unsafe() + this->arenaTail);
+    size_t tailSize = tail->size();
+
+    // The tail must stay a valid block of its own
+    if (tailSize < blockSize + 4 * unitSize)
+    {
+        this->logger->warn("Arena at offset {} is exhausted, shmalloc falls back to the free bins", this->arenaBegin);
+        return NPtr;
+    }
+
+    // The tail is an allocated block owned by this instance, so carving it needs no bins lock.
+    // The new tail header is written before the carved block shrinks, a concurrent heap walk sees either layout
+    BlockHeader *newTail = reinterpret_cast<BlockHeader *>(reinterpret_cast<Byte *>(tail) + blockSize);
+    // Size: tailSize - blockSize; Busy: 0; Previous Allocated: 1; Allocated: 1
+    newTail->reset((tailSize - blockSize) | 0b011);
+    std::atomic_thread_fence(std::memory_order_release);
+    // The carved block moves on from the sequence of the last block here, like any allocation
+    tail->resetAllocated(blockSize | (tail->size_BPA & 0b111));
+
+    size_t resultOffset = this->arenaTail + unitSize;
+    this->arenaTail += blockSize;
+    return resultOffset;
+}
+
 // Utility functions
 bool ShmemHeap::verifyPayloadPtr(Byte *ptr)
 {
@@ -652,39 +2184,187 @@ bool ShmemHeap::verifyPayloadPtr(Byte *ptr)
     return true;
 }
 
-// Free list pointer manipulators
+ShmemHeap::BlockHeader *ShmemHeap::findFreeBlock(size_t blockSize)
+{
+    size_t bin = binIndex(blockSize);
+    size_t bitmap = this->freeBinBitmap_unsafe();
+
+    if (bitmap & (1UL << bin))
+    {
+        BlockHeader *binHead = this->freeBin_unsafe(bin);
+        // All blocks in an exact bin have the same size
+        if (bin < numExactBins)
+            return binHead;
+
+        // Best fit logic inside a log-spaced bin
+        BlockHeader *best = nullptr;
+        size_t bestSize = std::numeric_limits<size_t>::max();
+        BlockHeader *current = binHead;
+        do
+        {
+            size_t currentSize = current->size();
+            if (currentSize >= blockSize && currentSize < bestSize)
+            {
+                best = current;
+                bestSize = currentSize;
+
+                // Break if exact match
+                if (currentSize == blockSize)
+                    break;
+            }
+            current = current->getBckPtr();
+        } while (current != binHead);
+
+        if (best != nullptr)
+            return best;
+    }
+
+    // Every block in a larger bin is large enough, take the smallest non-empty one
+    size_t largerBins = bin + 1 < numBins ? bitmap & (~0UL << (bin + 1)) : 0;
+    if (largerBins == 0)
+        return nullptr;
+    return this->freeBin_unsafe(static_cast<size_t>(__builtin_ctzl(largerBins)));
+}
+
+// Free bin pointer manipulators
 void ShmemHeap::removeFreeBlock(BlockHeader *block)
 {
-    if (this->freeBlockListOffset_unsafe() == static_cast<size_t>(reinterpret_cast<Byte *>(block) - this->heapHead_unsafe()))
+    size_t bin = binIndex(block->size());
+    if (this->freeBinOffset_unsafe(bin) == static_cast<size_t>(reinterpret_cast<Byte *>(block) - this->heapHead_unsafe()))
     {
         if (block->getBckPtr() == block)
         {
-            // Block is the only element in the list
-            this->freeBlockListOffset_unsafe() = NPtr; // NPtr is an impossible byte offset of a block
+            // Block is the only element in the bin
+            this->freeBinOffset_unsafe(bin) = NPtr; // NPtr is an impossible byte offset of a block
+            this->freeBinBitmap_unsafe() &= ~(1UL << bin);
         }
         else
         {
-            this->freeBlockListOffset_unsafe() = reinterpret_cast<Byte *>(block->getBckPtr()) - this->heapHead_unsafe();
+            this->freeBinOffset_unsafe(bin) = reinterpret_cast<Byte *>(block->getBckPtr()) - this->heapHead_unsafe();
         }
     }
     block->remove();
+
+    // The counters are only written under the bins lock, stats() readers just need whole words
+    size_t size = block->size();
+    std::atomic<size_t> &freeBytes = this->statCounter_unsafe(StatFreeBytes);
+    std::atomic<size_t> &freeBlocks = this->statCounter_unsafe(StatFreeBlocks);
+    freeBytes.store(freeBytes.load(std::memory_order_relaxed) - size, std::memory_order_relaxed);
+    freeBlocks.store(freeBlocks.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+
+    std::atomic<size_t> &largestFree = this->statCounter_unsafe(StatLargestFree);
+    if (size == largestFree.load(std::memory_order_relaxed))
+    {
+        // The largest block left, its successor is in the highest non-empty bin
+        size_t largest = 0;
+        size_t bitmap = this->freeBinBitmap_unsafe();
+        if (bitmap != 0)
+        {
+            BlockHeader *binHead = this->freeBin_unsafe(63 - __builtin_clzl(bitmap));
+            BlockHeader *current = binHead;
+            do
+            {
+                largest = std::max(largest, current->size());
+                current = current->getBckPtr();
+            } while (current != binHead);
+        }
+        largestFree.store(largest, std::memory_order_relaxed);
+    }
 }
 
-void ShmemHeap::insertFreeBlock(BlockHeader *block, BlockHeader *prevBlock)
+void ShmemHeap::insertFreeBlock(BlockHeader *block)
 {
-    if (this->freeBlockListOffset_unsafe() == NPtr)
+    size_t bin = binIndex(block->size());
+    if (this->freeBinOffset_unsafe(bin) == NPtr)
     {
-        // Don't care the previous block when the list is empty, it must be an outdated block
-        this->freeBlockListOffset_unsafe() = reinterpret_cast<Byte *>(block) - this->heapHead_unsafe();
         block->insert(nullptr);
+        this->freeBinBitmap_unsafe() |= 1UL << bin;
     }
     else
     {
-        if (prevBlock == nullptr)
-            block->insert(this->freeBlockList_unsafe());
-        else
-            block->insert(prevBlock);
+        block->insert(this->freeBin_unsafe(bin));
     }
+    // Most recently freed block becomes the bin head
+    this->freeBinOffset_unsafe(bin) = reinterpret_cast<Byte *>(block) - this->heapHead_unsafe();
+
+    size_t size = block->size();
+    std::atomic<size_t> &freeBytes = this->statCounter_unsafe(StatFreeBytes);
+    std::atomic<size_t> &freeBlocks = this->statCounter_unsafe(StatFreeBlocks);
+    std::atomic<size_t> &largestFree = this->statCounter_unsafe(StatLargestFree);
+    freeBytes.store(freeBytes.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+    freeBlocks.store(freeBlocks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (size > largestFree.load(std::memory_order_relaxed))
+        largestFree.store(size, std::memory_order_relaxed);
+}
+
+// Slab page list manipulators
+void ShmemHeap::linkSlabPage(size_t slabClass, SlabPage *page)
+{
+    size_t pageOffset = reinterpret_cast<Byte *>(page) - this->heapHead_unsafe();
+    size_t headOffset = this->slabListHead(slabClass);
+    page->prevOffset = NPtr;
+    page->nextOffset = headOffset;
+    if (headOffset != NPtr)
+        reinterpret_cast<SlabPage *>(this->heapHead_unsafe() + headOffset)->prevOffset = pageOffset;
+    this->setSlabListHead(slabClass, pageOffset);
+}
+
+void ShmemHeap::unlinkSlabPage(size_t slabClass, SlabPage *page)
+{
+    if (page->prevOffset == NPtr)
+        this->setSlabListHead(slabClass, page->nextOffset);
+    else
+        reinterpret_cast<SlabPage *>(this->heapHead_unsafe() + page->prevOffset)->nextOffset = page->nextOffset;
+    if (page->nextOffset != NPtr)
+        reinterpret_cast<SlabPage *>(this->heapHead_unsafe() + page->nextOffset)->prevOffset = page->prevOffset;
+}
+
+size_t ShmemHeap::slabListHead(size_t slabClass)
+{
+    return this->slabPages_unsafe(slabClass) & ((1UL << slabGrowthShift) - 1);
+}
+
+void ShmemHeap::setSlabListHead(size_t slabClass, size_t pageOffset)
+{
+    size_t &word = this->slabPages_unsafe(slabClass);
+    word = (word & ~((1UL << slabGrowthShift) - 1)) | pageOffset;
+}
+
+size_t ShmemHeap::nextSlabPageSlots(size_t slabClass)
+{
+    size_t pages = this->slabPages_unsafe(slabClass) >> slabGrowthShift;
+    return pages >= 8 ? slabSlotsPerPage : std::min(slabFirstPageSlots << pages, slabSlotsPerPage);
+}
+
+void ShmemHeap::countSlabPage(size_t slabClass, bool opened)
+{
+    if (opened)
+        this->slabPages_unsafe(slabClass) += 1UL << slabGrowthShift;
+    else
+        this->slabPages_unsafe(slabClass) -= 1UL << slabGrowthShift;
+}
+
+bool ShmemHeap::verifySlabSlot(BlockHeader *header)
+{
+    uintptr_t headerPtr = reinterpret_cast<uintptr_t>(header);
+    uintptr_t pagePtr = headerPtr - header->size();
+    uintptr_t heapHead = reinterpret_cast<uintptr_t>(this->heapHead_unsafe());
+    if (header->size() < sizeof(SlabPage) || pagePtr < heapHead + unitSize || pagePtr > headerPtr || (pagePtr - heapHead) % unitSize != 0)
+        return false;
+
+    // The page lives in the payload of an allocated block of its own
+    SlabPage *page = reinterpret_cast<SlabPage *>(pagePtr);
+    BlockHeader *pageBlock = reinterpret_cast<BlockHeader *>(page) - 1;
+    if (!pageBlock->A() || pageBlock->S() || page->slotSize < unitSize)
+        return false;
+    size_t slabClass = ShmemHeap::slabClass(page->slotSize - unitSize);
+    if (slabClass == numSlabClasses || page->slotSize != unitSize + slabClassSize(slabClass) || page->slotCount == 0 || page->slotCount > slabSlotsPerPage ||
+        sizeof(SlabPage) + page->slotCount * page->slotSize > payloadCapacity(pageBlock))
+        return false;
+
+    // The header must start one of its slots
+    size_t slotOffset = header->size() - sizeof(SlabPage);
+    return slotOffset % page->slotSize == 0 && slotOffset / page->slotSize < page->slotCount;
 }
 
 // Protected/Private Methods
@@ -699,11 +2379,129 @@ inline size_t &ShmemHeap::heapCapacity_unsafe()
     return reinterpret_cast<size_t *>(this->shmPtr)[1];
 }
 
-inline size_t &ShmemHeap::freeBlockListOffset_unsafe()
+inline size_t &ShmemHeap::freeBinBitmap_unsafe()
 {
     return reinterpret_cast<size_t *>(this->shmPtr)[2];
 }
 
+inline size_t &ShmemHeap::freeBinOffset_unsafe(size_t bin)
+{
+    return reinterpret_cast<size_t *>(this->shmPtr)[6 + bin];
+}
+
+inline std::atomic<size_t> &ShmemHeap::binsLock_unsafe()
+{
+    return *reinterpret_cast<std::atomic<size_t> *>(reinterpret_cast<size_t *>(this->shmPtr) + 4);
+}
+
+inline std::atomic<size_t> &ShmemHeap::resizeEpoch_unsafe()
+{
+    return *reinterpret_cast<std::atomic<size_t> *>(reinterpret_cast<size_t *>(this->shmPtr) + 5);
+}
+
+inline std::atomic<size_t> &ShmemHeap::statCounter_unsafe(StatCounter counter)
+{
+    return *reinterpret_cast<std::atomic<size_t> *>(reinterpret_cast<size_t *>(this->shmPtr) + 6 + numBins + counter);
+}
+
+inline size_t &ShmemHeap::slabPages_unsafe(size_t slabClass)
+{
+    return reinterpret_cast<size_t *>(this->shmPtr)[6 + numBins + numStatCounters + slabClass];
+}
+
+inline size_t &ShmemHeap::segmentCount_unsafe()
+{
+    return reinterpret_cast<size_t *>(this->shmPtr)[6 + numBins + numStatCounters + numSlabClasses];
+}
+
+inline size_t &ShmemHeap::segmentNextSerial_unsafe()
+{
+    return reinterpret_cast<size_t *>(this->shmPtr)[6 + numBins + numStatCounters + numSlabClasses + 1];
+}
+
+inline size_t &ShmemHeap::segmentEntry_unsafe(size_t segment)
+{
+    return reinterpret_cast<size_t *>(this->shmPtr)[6 + numBins + numStatCounters + numSlabClasses + 2 + segment];
+}
+
+inline std::atomic<size_t> &ShmemHeap::changeCounter_unsafe()
+{
+    return *reinterpret_cast<std::atomic<size_t> *>(reinterpret_cast<size_t *>(this->shmPtr) + 6 + numBins + numStatCounters + numSlabClasses + 2 + maxSegments);
+}
+
+inline std::atomic<size_t> &ShmemHeap::changeWaiters_unsafe()
+{
+    return *reinterpret_cast<std::atomic<size_t> *>(reinterpret_cast<size_t *>(this->shmPtr) + 6 + numBins + numStatCounters + numSlabClasses + 2 + maxSegments + 1);
+}
+
+inline std::atomic<size_t> &ShmemHeap::commitSeq_unsafe()
+{
+    return *reinterpret_cast<std::atomic<size_t> *>(reinterpret_cast<size_t *>(this->shmPtr) + 6 + numBins + numStatCounters + numSlabClasses + 2 + maxSegments + 2);
+}
+
+inline std::atomic<size_t> &ShmemHeap::snapshotEpoch_unsafe()
+{
+    return *reinterpret_cast<std::atomic<size_t> *>(reinterpret_cast<size_t *>(this->shmPtr) + 6 + numBins + numStatCounters + numSlabClasses + 2 + maxSegments + 3);
+}
+
+inline std::atomic<size_t> &ShmemHeap::retiredObjects_unsafe()
+{
+    return *reinterpret_cast<std::atomic<size_t> *>(reinterpret_cast<size_t *>(this->shmPtr) + 6 + numBins + numStatCounters + numSlabClasses + 2 + maxSegments + 4);
+}
+
+inline std::atomic<size_t> &ShmemHeap::snapshotPin_unsafe(size_t slot)
+{
+    return *reinterpret_cast<std::atomic<size_t> *>(reinterpret_cast<size_t *>(this->shmPtr) + 6 + numBins + numStatCounters + numSlabClasses + 2 + maxSegments + 5 + slot);
+}
+
+ShmemHeap::BlockHeader *ShmemHeap::lastBlock_unsafe()
+{
+    // Start from the largest free block (hopefully close to the end)
+    size_t bitmap = this->freeBinBitmap_unsafe();
+    BlockHeader *lastBlock = bitmap != 0 ? this->freeBin_unsafe(63 - __builtin_clzl(bitmap)) : reinterpret_cast<BlockHeader *>(this->heapHead_unsafe());
+    while (reinterpret_cast<Byte *>(lastBlock->getNextPtr()) != this->heapTail_unsafe())
+    {
+        lastBlock = lastBlock->getNextPtr();
+    }
+    return lastBlock;
+}
+
+void ShmemHeap::lockBins()
+{
+    size_t expected = 0;
+    size_t owner = static_cast<size_t>(getpid());
+    bool contended = false;
+    for (int spin = 0; !this->binsLock_unsafe().compare_exchange_weak(expected, owner, std::memory_order_acquire, std::memory_order_relaxed); spin++)
+    {
+        // Counted once per acquisition. A spurious failure of the weak CAS on a free lock is not contention
+        if (!contended && expected != 0)
+        {
+            contended = true;
+            this->statCounter_unsafe(StatBinsContention).fetch_add(1, std::memory_order_relaxed);
+        }
+        // Critical sections are short, spin a little before giving up the time slice
+        if (spin >= 64)
+            std::this_thread::yield();
+        // The lock is a pid spinlock, not lock-free: an owner that died inside a critical section would hold it
+        // forever. Now and then check the owner and take the lock over from a dead one
+        if (spin >= 64 && spin % 1024 == 0 && expected != 0 && ShmemUtils::processDead(expected))
+        {
+            size_t deadOwner = expected;
+            if (this->binsLock_unsafe().compare_exchange_strong(expected, owner, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                this->logger->error("Bins lock owner {} died while holding it, lock taken over. The free bins may be inconsistent", deadOwner);
+                return;
+            }
+        }
+        expected = 0;
+    }
+}
+
+void ShmemHeap::unlockBins()
+{
+    this->binsLock_unsafe().store(0, std::memory_order_release);
+}
+
 inline size_t &ShmemHeap::entranceOffset_unsafe()
 {
     return reinterpret_cast<size_t *>(this->staticSpaceHead_unsafe())[3];
@@ -733,9 +2531,9 @@ inline Byte *ShmemHeap::heapTail_unsafe()
     return this->shmPtr + this->staticCapacity_unsafe() + this->heapCapacity_unsafe();
 }
 
-inline ShmemHeap::BlockHeader *ShmemHeap::freeBlockList_unsafe()
+inline ShmemHeap::BlockHeader *ShmemHeap::freeBin_unsafe(size_t bin)
 {
-    size_t offset = this->freeBlockListOffset_unsafe();
+    size_t offset = this->freeBinOffset_unsafe(bin);
     if (offset == NPtr)
         return nullptr;
     else
@@ -749,6 +2547,13 @@ void ShmemHeap::setHCap(size_t size)
     // pad heap capacity to a multiple of page size
     size_t newHeapCapacity = pad(size, pageSize);
 
+    // The bits above hold the write sequence of a block, see BlockHeader::seqShift
+    if (newHeapCapacity >= (1UL << BlockHeader::seqShift))
+    {
+        this->logger->error("Heap capacity {} exceeds the maximum of {} bytes", newHeapCapacity, 1UL << BlockHeader::seqShift);
+        throw std::runtime_error("Heap capacity cannot reach 2^40 bytes");
+    }
+
     if (this->isConnected())
     {
         size_t currentHeapCapacity = this->heapCapacity_unsafe();
@@ -762,6 +2567,93 @@ void ShmemHeap::setHCap(size_t size)
     this->logger->info("Request heap size: {}, new heap capacity: {}", size, newHeapCapacity);
 }
 
+void ShmemHeap::setGrowthFactor(double factor)
+{
+    if (!(factor >= 1.0))
+        throw std::runtime_error("Growth factor must be >= 1.0");
+    this->growthFactor = factor;
+}
+
+void ShmemHeap::setMinGrowSize(size_t size)
+{
+    this->minGrowSize = pad(size, sysconf(_SC_PAGESIZE));
+}
+
+void ShmemHeap::setMaxHCap(size_t size)
+{
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    // Round down, the cap must never be exceeded
+    this->maxHCap = size / pageSize * pageSize;
+}
+
+void ShmemHeap::setReleaseThreshold(size_t size)
+{
+    this->releaseThreshold = size;
+}
+
+size_t ShmemHeap::getReleaseThreshold() const
+{
+    return this->releaseThreshold;
+}
+
+void ShmemHeap::setArrayAlignment(size_t alignment)
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment > static_cast<size_t>(sysconf(_SC_PAGESIZE)))
+        throw std::runtime_error("Array alignment must be a power of two up to the page size");
+    this->arrayAlignment = std::max(alignment, unitSize);
+}
+
+size_t ShmemHeap::getArrayAlignment() const
+{
+    return this->arrayAlignment;
+}
+
+void ShmemHeap::startTrace(const std::string &path)
+{
+    FILE *file = std::fopen(path.c_str(), "ab");
+    if (file == nullptr)
+    {
+        this->logger->error("startTrace(path={}) failed to open the file: {}", path, std::strerror(errno));
+        throw std::runtime_error("Failed to open the trace file");
+    }
+    // Copies of this object keep writing until the last of them stops tracing
+    this->traceFile = std::shared_ptr<FILE>(file, std::fclose);
+    this->logger->info("startTrace(path={}) recording allocator calls", path);
+}
+
+void ShmemHeap::stopTrace()
+{
+    if (this->traceFile)
+        std::fflush(this->traceFile.get());
+    this->traceFile.reset();
+}
+
+bool ShmemHeap::isTracing() const
+{
+    return this->traceFile != nullptr;
+}
+
+void ShmemHeap::setSegmented(bool segmented)
+{
+    this->segmented = segmented;
+    this->logger->info("Set segmented growth to {}", segmented);
+}
+
+double ShmemHeap::getGrowthFactor() const
+{
+    return this->growthFactor;
+}
+
+size_t ShmemHeap::getMinGrowSize() const
+{
+    return this->minGrowSize;
+}
+
+size_t ShmemHeap::getMaxHCap() const
+{
+    return this->maxHCap;
+}
+
 void ShmemHeap::setSCap(size_t size)
 {
     // pad static space capacity to a multiple of 8
@@ -783,6 +2675,36 @@ void ShmemHeap::setSCap(size_t size)
     this->logger->info("Request static space size: {}, new static space capacity: {}", size, newStaticSpaceCapacity);
 }
 
+size_t ShmemHeap::binIndex(size_t blockSize)
+{
+    // Exact bins: 32, 40, ..., 280
+    if (blockSize < (4 + numExactBins) * unitSize)
+        return blockSize / unitSize - 4;
+
+    // Log-spaced bins: [288, 512) -> numExactBins, [512, 1024) -> numExactBins + 1, ...
+    size_t bin = numExactBins + static_cast<size_t>(63 - __builtin_clzl(blockSize)) - 8;
+    return bin < numBins ? bin : numBins - 1;
+}
+
+size_t ShmemHeap::slabClass(size_t size)
+{
+    // Classes hold 16, 32 and 64 byte payloads
+    size_t slabClass = 0;
+    while (slabClass < numSlabClasses && size > slabClassSize(slabClass))
+        slabClass++;
+    return slabClass;
+}
+
+size_t ShmemHeap::payloadCapacity(const BlockHeader *header)
+{
+    if (header->S())
+    {
+        const SlabPage *page = reinterpret_cast<const SlabPage *>(reinterpret_cast<const Byte *>(header) - header->size());
+        return page->slotSize - sizeof(BlockHeader);
+    }
+    return header->size() - sizeof(BlockHeader);
+}
+
 std::shared_ptr<spdlog::logger> &ShmemHeap::getLogger()
 {
     return this->logger;
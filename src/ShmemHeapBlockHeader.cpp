@@ -3,6 +3,22 @@
 #include <cstring>
 #include <thread>
 #include <chrono>
+#include <ctime>
+
+// The futex word is the low half of size_BPA, which holds the B bit
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "BlockHeader futex word assumes a little endian layout");
+
+// Busy-bit holders are short critical sections, spin this many times before parking
+static const int waitSpinLimit = 128;
+
+static inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
 
 size_t &ShmemHeap::BlockHeader::val()
 {
@@ -26,7 +42,7 @@ intptr_t &ShmemHeap::BlockHeader::bckOffset() const
 
 size_t ShmemHeap::BlockHeader::size() const
 {
-    return this->atomicVal().load(std::memory_order_relaxed) & ~0b111;
+    return this->atomicVal().load(std::memory_order_relaxed) & ~(0b111 | parkedBit | slabBit | seqMask);
 }
 
 void ShmemHeap::BlockHeader::setSize(size_t size)
@@ -36,7 +52,7 @@ void ShmemHeap::BlockHeader::setSize(size_t size)
     // Ensure correct update is done
     do
     {
-        newSize = size | (current & 0b111);
+        newSize = size | (current & (0b111 | parkedBit | slabBit | seqMask));
     } while (!this->atomicVal().compare_exchange_weak(current, newSize, std::memory_order_acquire, std::memory_order_relaxed));
 }
 
@@ -55,12 +71,17 @@ bool ShmemHeap::BlockHeader::A() const
     return this->atomicVal().load(std::memory_order_relaxed) & 0b001;
 }
 
+bool ShmemHeap::BlockHeader::S() const
+{
+    return this->atomicVal().load(std::memory_order_relaxed) & slabBit;
+}
+
 void ShmemHeap::BlockHeader::setB(bool b)
 {
     if (b)
         this->atomicVal().fetch_or(0b100, std::memory_order_relaxed);
     else
-        this->atomicVal().fetch_and(~0b100, std::memory_order_relaxed);
+        this->unlock();
 }
 
 void ShmemHeap::BlockHeader::setP(bool p)
@@ -160,17 +181,145 @@ intptr_t ShmemHeap::BlockHeader::offset(BlockHeader *desPtr) const
 
 int ShmemHeap::BlockHeader::wait(int timeout) const
 {
-    while (this->B())
+    if (timeout == 0)
     {
-        if (timeout == 0)
+        return this->B() ? ETIMEDOUT : 0;
+    }
+
+    for (int spin = 0; spin < waitSpinLimit; spin++)
+    {
+        if (!this->B())
         {
-            return ETIMEDOUT;
+            return 0;
+        }
+        cpuRelax();
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    while (true)
+    {
+        size_t current = this->atomicVal().load(std::memory_order_acquire);
+        if (!(current & 0b100))
+        {
+            return 0;
+        }
+        // Announce ourselves before parking, unlock() only issues a wake when the parked bit is set
+        if (!(current & parkedBit) && !this->atomicVal().compare_exchange_weak(current, current | parkedBit, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            continue;
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        timespec remaining;
+        timespec *remainingPtr = nullptr;
         if (timeout > 0)
         {
-            timeout--;
+            auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (left <= 0)
+            {
+                return ETIMEDOUT;
+            }
+            remaining.tv_sec = left / 1000000000;
+            remaining.tv_nsec = left % 1000000000;
+            remainingPtr = &remaining;
+        }
+
+        // Returns immediately if the low word (and with it the B bit) changed since the load above
+        ShmemUtils::futexWait(&this->size_BPA, static_cast<uint32_t>(current), remainingPtr);
+    }
+}
+
+bool ShmemHeap::BlockHeader::tryLock()
+{
+    return !(this->atomicVal().fetch_or(0b100, std::memory_order_acquire) & 0b100);
+}
+
+int ShmemHeap::BlockHeader::lock(int timeout)
+{
+    while (!this->tryLock())
+    {
+        if (this->wait(timeout) == ETIMEDOUT)
+        {
+            return ETIMEDOUT;
         }
     }
     return 0;
 }
+
+void ShmemHeap::BlockHeader::unlock()
+{
+    // Every parked waiter is woken, the ones losing the race set the parked bit again
+    size_t previous = this->atomicVal().fetch_and(~(0b100 | parkedBit), std::memory_order_release);
+    if (previous & parkedBit)
+    {
+        ShmemUtils::futexWakeAll(&this->size_BPA);
+    }
+}
+
+void ShmemHeap::BlockHeader::unlockWrite()
+{
+    // The sequence wraps inside its field, the size and the other bits are left alone
+    size_t current = this->atomicVal().load(std::memory_order_relaxed);
+    size_t next;
+    do
+    {
+        next = (current & ~(0b100 | parkedBit | seqMask)) | ((current + (1UL << seqShift)) & seqMask);
+    } while (!this->atomicVal().compare_exchange_weak(current, next, std::memory_order_release, std::memory_order_relaxed));
+    if (current & parkedBit)
+    {
+        ShmemUtils::futexWakeAll(&this->size_BPA);
+    }
+}
+
+size_t ShmemHeap::BlockHeader::readBegin() const
+{
+    // Only loads: parking through wait() would set the parked bit, dirtying the writer's line and making
+    // unlockWrite() pay for a futex wake. A write holds the busy bit for one payload copy, yielding is enough
+    for (int spin = 0;; spin++)
+    {
+        size_t current = this->atomicVal().load(std::memory_order_acquire);
+        if (!(current & 0b100))
+        {
+            return current & seqMask;
+        }
+        if (spin < waitSpinLimit)
+        {
+            cpuRelax();
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool ShmemHeap::BlockHeader::readRetry(size_t seq) const
+{
+    // Keeps the payload reads before the second look at the sequence
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return (this->atomicVal().load(std::memory_order_relaxed) & (seqMask | 0b100)) != seq;
+}
+
+size_t ShmemHeap::BlockHeader::seq() const
+{
+    return (this->atomicVal().load(std::memory_order_acquire) & seqMask) >> seqShift;
+}
+
+void ShmemHeap::BlockHeader::bumpSeq()
+{
+    size_t current = this->atomicVal().load(std::memory_order_relaxed);
+    size_t next;
+    do
+    {
+        next = (current & ~seqMask) | ((current + (1UL << seqShift)) & seqMask);
+    } while (!this->atomicVal().compare_exchange_weak(current, next, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void ShmemHeap::BlockHeader::reset(size_t bits)
+{
+    this->size_BPA = bits | (this->size_BPA & seqMask);
+}
+
+void ShmemHeap::BlockHeader::resetAllocated(size_t bits)
+{
+    this->size_BPA = bits | ((this->size_BPA + (1UL << seqShift)) & seqMask);
+}
@@ -25,8 +25,16 @@ void ShmemList::setObj(int index, ShmemObj *obj)
 
 size_t ShmemList::makeSpace(size_t listCapacity, ShmemHeap *heapPtr)
 {
-    size_t offset = heapPtr->shmalloc(sizeof(ShmemList));
-    size_t listSpaceOffset = makeListSpace(listCapacity, heapPtr);
+    // The list object and its list space are taken in one pass over the free bins
+    size_t sizes[2] = {sizeof(ShmemList), std::max(listCapacity, static_cast<size_t>(1)) * sizeof(ptrdiff_t)};
+    size_t offsets[2];
+    heapPtr->shmallocBatch(sizes, 2, offsets);
+    return initSpace(offsets[0], offsets[1], listCapacity, heapPtr);
+}
+
+size_t ShmemList::initSpace(size_t offset, size_t listSpaceOffset, size_t listCapacity, ShmemHeap *heapPtr)
+{
+    initListSpace(listSpaceOffset, heapPtr);
     ShmemList *ptr = static_cast<ShmemList *>(resolveOffset(offset, heapPtr));
 
     ptr->type = List;
@@ -44,13 +52,17 @@ size_t ShmemList::makeListSpace(size_t listCapacity, ShmemHeap *heapPtr)
     listCapacity = std::max(listCapacity, static_cast<size_t>(1));
 
     size_t listSpaceOffset = heapPtr->shmalloc(listCapacity * sizeof(ptrdiff_t));
+    initListSpace(listSpaceOffset, heapPtr);
+    return listSpaceOffset;
+}
+
+void ShmemList::initListSpace(size_t listSpaceOffset, ShmemHeap *heapPtr)
+{
     Byte *payloadPtr = heapPtr->heapHead() + listSpaceOffset;
     size_t payLoadSize = reinterpret_cast<ShmemHeap::BlockHeader *>(payloadPtr - sizeof(ShmemHeap::BlockHeader))->size() - sizeof(ShmemHeap::BlockHeader);
     // init the list space with NPtr (would be interpret as nullptr)
     size_t maxListCapacity = payLoadSize / sizeof(ptrdiff_t);
     std::fill(reinterpret_cast<ptrdiff_t *>(payloadPtr), reinterpret_cast<ptrdiff_t *>(payloadPtr) + maxListCapacity, NPtr);
-
-    return listSpaceOffset;
 }
 
 // listCapacity() inlined in tcc
@@ -110,7 +122,7 @@ void ShmemList::del(int index, ShmemHeap *heapPtr)
     if (offset != NPtr)
     {
         ShmemObj *victim = const_cast<ShmemObj *>(reinterpret_cast<const ShmemObj *>(reinterpret_cast<const Byte *>(this) + offset));
-        ShmemObj::deconstruct(reinterpret_cast<Byte *>(victim) - heapPtr->heapHead(), heapPtr);
+        ShmemObj::retire(reinterpret_cast<Byte *>(victim) - heapPtr->heapHead(), heapPtr);
     }
 
     for (int i = resolvedIndex; static_cast<size_t>(i) < this->listSize - 1; i++)
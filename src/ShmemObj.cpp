@@ -39,12 +39,105 @@ void ShmemObj::deconstruct(size_t offset, ShmemHeap *heapPtr)
     {
         ShmemDict::deconstruct(offset, heapPtr);
     }
+    else if (type == HashMap)
+    {
+        ShmemHashMap::deconstruct(offset, heapPtr);
+    }
+    else if (type == Queue)
+    {
+        ShmemQueue::deconstruct(offset, heapPtr);
+    }
+    else if (type == DictNode)
+    {
+        ShmemDictNode::deconstruct(offset, heapPtr);
+    }
     else
     {
         throw std::runtime_error("Encounter unknown type in deconstruction");
     }
 }
 
+// An object waiting in ShmemHeap::retiredObjects() for the snapshots that may read it
+struct RetiredObj
+{
+    size_t nextOffset; // older record, NPtr at the end
+    size_t epoch;      // snapshot epoch when it was retired, only snapshots older than it can reach the object
+    size_t offset;
+    size_t deep;
+};
+
+void ShmemObj::retire(size_t offset, ShmemHeap *heapPtr, bool deep)
+{
+    if (heapPtr->deferRetire(offset, [offset, heapPtr, deep]()
+                             { ShmemObj::retire(offset, heapPtr, deep); }))
+        return;
+
+    size_t newest = heapPtr->newestSnapshot();
+    if (newest == 0)
+    {
+        if (deep)
+            ShmemObj::deconstruct(offset, heapPtr);
+        else
+            heapPtr->shfree(offset);
+        return;
+    }
+
+    size_t recordOffset = heapPtr->shmallocSlab(sizeof(RetiredObj));
+    RetiredObj *record = reinterpret_cast<RetiredObj *>(heapPtr->heapHead() + recordOffset);
+    // Later than every pinned snapshot, a pin may not have moved the epoch on yet
+    record->epoch = std::max(heapPtr->snapshotEpoch(), newest + 1);
+    record->offset = offset;
+    record->deep = deep;
+
+    std::atomic<size_t> &head = heapPtr->retiredObjects();
+    record->nextOffset = head.load(std::memory_order_relaxed);
+    while (!head.compare_exchange_weak(record->nextOffset, recordOffset, std::memory_order_release, std::memory_order_relaxed))
+        ;
+}
+
+void ShmemObj::reclaim(ShmemHeap *heapPtr)
+{
+    std::atomic<size_t> &head = heapPtr->retiredObjects();
+    if (head.load(std::memory_order_acquire) == NPtr)
+        return;
+
+    // Take the whole list, the records still needed are put back below
+    size_t oldest = heapPtr->oldestSnapshot();
+    size_t recordOffset = head.exchange(NPtr, std::memory_order_acquire);
+    size_t keptHead = NPtr, keptTail = NPtr;
+    while (recordOffset != NPtr)
+    {
+        RetiredObj *record = reinterpret_cast<RetiredObj *>(heapPtr->heapHead() + recordOffset);
+        size_t nextOffset = record->nextOffset;
+        if (record->epoch <= oldest)
+        {
+            if (record->deep)
+                ShmemObj::deconstruct(record->offset, heapPtr);
+            else
+                heapPtr->shfree(record->offset);
+            heapPtr->shfree(recordOffset);
+        }
+        else
+        {
+            record->nextOffset = NPtr;
+            if (keptTail == NPtr)
+                keptHead = recordOffset;
+            else
+                reinterpret_cast<RetiredObj *>(heapPtr->heapHead() + keptTail)->nextOffset = recordOffset;
+            keptTail = recordOffset;
+        }
+        recordOffset = nextOffset;
+    }
+
+    if (keptHead != NPtr)
+    {
+        RetiredObj *tail = reinterpret_cast<RetiredObj *>(heapPtr->heapHead() + keptTail);
+        tail->nextOffset = head.load(std::memory_order_relaxed);
+        while (!head.compare_exchange_weak(tail->nextOffset, keptHead, std::memory_order_release, std::memory_order_relaxed))
+            ;
+    }
+}
+
 // __str__
 std::string ShmemObj::toString(int indent, int maxElements) const
 {
@@ -67,6 +160,14 @@ std::string ShmemObj::toString(int indent, int maxElements) const
     {
         return static_cast<const ShmemDict *>(this)->toString(indent, maxElements);
     }
+    else if (type == HashMap)
+    {
+        return static_cast<const ShmemHashMap *>(this)->toString(indent, maxElements);
+    }
+    else if (type == Queue)
+    {
+        return static_cast<const ShmemQueue *>(this)->toString(indent, maxElements);
+    }
     else
     {
         throw std::runtime_error("Encounter unknown type in deconstruction");
@@ -82,6 +183,8 @@ KeyType ShmemObj::beginIdx() const
         return 0;
     else if (this->type == Dict)
         return static_cast<const ShmemDict *>(this)->beginIdx();
+    else if (this->type == HashMap)
+        return static_cast<const ShmemHashMap *>(this)->beginIdx();
     else
         throw std::runtime_error("ShmemObj::beginIdx(): Unknown type:" + std::to_string(this->type));
 }
@@ -94,6 +197,8 @@ KeyType ShmemObj::endIdx() const
         return static_cast<int>(static_cast<const ShmemList *>(this)->len());
     else if (this->type == Dict)
         return static_cast<const ShmemDict *>(this)->endIdx();
+    else if (this->type == HashMap)
+        return static_cast<const ShmemHashMap *>(this)->endIdx();
     else
         throw std::runtime_error("ShmemObj::endIdx(): Unknown type:" + std::to_string(this->type));
 }
@@ -116,6 +221,10 @@ KeyType ShmemObj::nextIdx(KeyType index) const
     {
         return static_cast<const ShmemDict *>(this)->nextIdx(index);
     }
+    else if (this->type == HashMap)
+    {
+        return static_cast<const ShmemHashMap *>(this)->nextIdx(index);
+    }
     else
     {
         throw std::runtime_error("ShmemObj::nextIdx(): Unknown type:" + std::to_string(this->type));
@@ -138,6 +247,14 @@ ShmemObj::operator pybind11::object() const
     {
         return static_cast<const ShmemDict *>(this)->operator pybind11::dict();
     }
+    else if (this->type == HashMap)
+    {
+        return static_cast<const ShmemHashMap *>(this)->operator pybind11::dict();
+    }
+    else if (this->type == Queue)
+    {
+        throw ConversionError("Cannot convert queue to python object, pop() its messages instead");
+    }
     else
     {
         throw std::runtime_error("ShmemObj::operator pybind11::object(): Unknown type:" + std::to_string(this->type));
@@ -73,8 +73,7 @@ size_t ShmemPrimitive_::construct(const std::string str, ShmemHeap *heapPtr)
 {
     size_t size = str.size() + 1; // +1 for the \0
     size_t offset = makeSpace<char>(size, heapPtr);
-    ShmemPrimitive_ *ptr = reinterpret_cast<ShmemPrimitive_ *>(heapPtr->heapHead() + offset);
-    memcpy(reinterpret_cast<char *>(ptr->getBytePtr()), str.data(), size * sizeof(char));
+    reinterpret_cast<ShmemPrimitive_ *>(heapPtr->heapHead() + offset)->fill(str);
     return offset;
 }
 
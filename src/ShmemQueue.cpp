@@ -0,0 +1,318 @@
+#include "ShmemQueue.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+static_assert(sizeof(ShmemQueue) == 3 * 64, "ShmemQueue header, producer and consumer must take one cache line each");
+
+// Utilities
+namespace
+{
+    // The other side usually publishes within a few hundred nanoseconds, spin this many times before sleeping
+    const int waitSpinLimit = 128;
+
+    inline void cpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    /**
+     * @brief Sleep on a futex word until it moves away from seen, or the deadline passes
+     *
+     * @return false if the deadline had already passed
+     */
+    bool sleepOn(const std::atomic<size_t> &signal, size_t seen, int timeout, const std::chrono::steady_clock::time_point &deadline)
+    {
+        timespec remaining;
+        timespec *remainingPtr = nullptr;
+        if (timeout >= 0)
+        {
+            auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (left <= 0)
+                return false;
+            remaining.tv_sec = left / 1000000000;
+            remaining.tv_nsec = left % 1000000000;
+            remainingPtr = &remaining;
+        }
+        // Returns at once if the low half of the word moved since it was seen
+        ShmemUtils::futexWait(reinterpret_cast<const size_t *>(&signal), static_cast<uint32_t>(seen), remainingPtr);
+        return true;
+    }
+}
+
+// Protected methods
+
+ShmemQueue::Slot *ShmemQueue::slot(size_t pos)
+{
+    return reinterpret_cast<Slot *>(reinterpret_cast<Byte *>(this + 1) + (pos & (capacity - 1)) * stride);
+}
+
+size_t ShmemQueue::tryPushRaw(const void *const *messages, const size_t *lengths, size_t count)
+{
+    size_t pushed = 0;
+    if (!multi)
+    {
+        size_t tail = producer.tail.load(std::memory_order_relaxed);
+        if (capacity - (tail - producer.cachedHead) < count)
+            producer.cachedHead = consumer.head.load(std::memory_order_acquire);
+        pushed = std::min(count, capacity - (tail - producer.cachedHead));
+        for (size_t i = 0; i < pushed; i++)
+        {
+            Slot *target = slot(tail + i);
+            target->length = static_cast<uint32_t>(lengths[i]);
+            std::memcpy(target->data(), messages[i], lengths[i]);
+        }
+        if (pushed != 0)
+            producer.tail.store(tail + pushed, std::memory_order_release);
+    }
+    else
+    {
+        for (; pushed < count; pushed++)
+        {
+            size_t pos = producer.tail.load(std::memory_order_relaxed);
+            Slot *target;
+            while (true)
+            {
+                target = slot(pos);
+                ptrdiff_t diff = static_cast<ptrdiff_t>(target->seq.load(std::memory_order_acquire) - pos);
+                if (diff == 0)
+                {
+                    if (producer.tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                { // The slot still holds the message of the previous lap, the ring is full
+                    target = nullptr;
+                    break;
+                }
+                else
+                {
+                    pos = producer.tail.load(std::memory_order_relaxed);
+                }
+            }
+            if (target == nullptr)
+                break;
+            target->length = static_cast<uint32_t>(lengths[pushed]);
+            std::memcpy(target->data(), messages[pushed], lengths[pushed]);
+            target->seq.store(pos + 1, std::memory_order_release);
+        }
+    }
+    if (pushed != 0)
+        wake(producer.dataWaiters, producer.dataSignal);
+    return pushed;
+}
+
+size_t ShmemQueue::tryPopRaw(void *buffer, size_t bufferStride, size_t *lengths, size_t maxCount)
+{
+    Byte *out = static_cast<Byte *>(buffer);
+    size_t popped = 0;
+    if (!multi)
+    {
+        size_t head = consumer.head.load(std::memory_order_relaxed);
+        if (consumer.cachedTail - head < maxCount)
+            consumer.cachedTail = producer.tail.load(std::memory_order_acquire);
+        popped = std::min(maxCount, consumer.cachedTail - head);
+        for (size_t i = 0; i < popped; i++)
+        {
+            const Slot *source = slot(head + i);
+            lengths[i] = source->length;
+            std::memcpy(out + i * bufferStride, source->data(), std::min<size_t>(source->length, bufferStride));
+        }
+        if (popped != 0)
+            consumer.head.store(head + popped, std::memory_order_release);
+    }
+    else
+    {
+        for (; popped < maxCount; popped++)
+        {
+            size_t pos = consumer.head.load(std::memory_order_relaxed);
+            Slot *source;
+            while (true)
+            {
+                source = slot(pos);
+                ptrdiff_t diff = static_cast<ptrdiff_t>(source->seq.load(std::memory_order_acquire) - (pos + 1));
+                if (diff == 0)
+                {
+                    if (consumer.head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                { // No message pushed to the slot in this lap yet, the ring is empty
+                    source = nullptr;
+                    break;
+                }
+                else
+                {
+                    pos = consumer.head.load(std::memory_order_relaxed);
+                }
+            }
+            if (source == nullptr)
+                break;
+            lengths[popped] = source->length;
+            std::memcpy(out + popped * bufferStride, source->data(), std::min<size_t>(source->length, bufferStride));
+            // Free for the push of the next lap
+            source->seq.store(pos + capacity, std::memory_order_release);
+        }
+    }
+    if (popped != 0)
+        wake(consumer.spaceWaiters, consumer.spaceSignal);
+    return popped;
+}
+
+void ShmemQueue::wake(std::atomic<size_t> &waiters, std::atomic<size_t> &signal)
+{
+    // Pairs with the fence in pushRaw() / popRaw(): either the sleeper sees the publish or we see the sleeper
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_relaxed) == 0 || waiters.exchange(0, std::memory_order_seq_cst) == 0)
+        return;
+    signal.fetch_add(1, std::memory_order_seq_cst);
+    ShmemUtils::futexWakeAll(reinterpret_cast<const size_t *>(&signal));
+}
+
+// Public methods
+
+size_t ShmemQueue::construct(ShmemHeap *heapPtr, size_t capacity, size_t slotSize, bool multi)
+{
+    if (slotSize == 0 || slotSize > UINT32_MAX)
+        throw std::runtime_error("Queue slot size must be between 1 and " + std::to_string(UINT32_MAX) + " bytes, got " + std::to_string(slotSize));
+
+    // A ring of one slot cannot tell a full slot from a free one in MPMC mode
+    size_t slotCount = 2;
+    while (slotCount < capacity)
+        slotCount <<= 1;
+    // Keep the sequence numbers of the slots aligned
+    size_t stride = (sizeof(Slot) + slotSize + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t);
+
+    size_t queueOffset = heapPtr->shmemalign(sizeof(ShmemQueue) + slotCount * stride, CacheLine);
+    ShmemQueue *queuePtr = reinterpret_cast<ShmemQueue *>(resolveOffset(queueOffset, heapPtr));
+    queuePtr->type = Queue;
+    queuePtr->size = 0;
+    queuePtr->capacity = slotCount;
+    queuePtr->slotSize = slotSize;
+    queuePtr->stride = stride;
+    queuePtr->multi = multi ? 1 : 0;
+
+    queuePtr->producer.tail.store(0, std::memory_order_relaxed);
+    queuePtr->producer.cachedHead = 0;
+    queuePtr->producer.dataWaiters.store(0, std::memory_order_relaxed);
+    queuePtr->producer.dataSignal.store(0, std::memory_order_relaxed);
+    queuePtr->consumer.head.store(0, std::memory_order_relaxed);
+    queuePtr->consumer.cachedTail = 0;
+    queuePtr->consumer.spaceWaiters.store(0, std::memory_order_relaxed);
+    queuePtr->consumer.spaceSignal.store(0, std::memory_order_relaxed);
+    for (size_t pos = 0; pos < slotCount; pos++)
+        queuePtr->slot(pos)->seq.store(pos, std::memory_order_relaxed);
+
+    return queueOffset;
+}
+
+size_t ShmemQueue::construct(pybind11::dict spec, ShmemHeap *heapPtr)
+{
+    size_t capacity = spec.contains("capacity") ? spec["capacity"].cast<size_t>() : DefaultCapacity;
+    size_t slotSize = spec.contains("slotSize") ? spec["slotSize"].cast<size_t>() : DefaultSlotSize;
+    bool multi = spec.contains("multi") ? spec["multi"].cast<bool>() : false;
+    return ShmemQueue::construct(heapPtr, capacity, slotSize, multi);
+}
+
+void ShmemQueue::deconstruct(size_t offset, ShmemHeap *heapPtr)
+{
+    heapPtr->shfree(reinterpret_cast<Byte *>(resolveOffset(offset, heapPtr)));
+}
+
+size_t ShmemQueue::len() const
+{
+    // Head first, it never passes the tail loaded after it
+    size_t head = consumer.head.load(std::memory_order_acquire);
+    size_t tail = producer.tail.load(std::memory_order_acquire);
+    return tail > head ? std::min(tail - head, capacity) : 0;
+}
+
+std::string ShmemQueue::toString(int indent, int maxElements) const
+{
+    (void)indent;
+    (void)maxElements;
+    std::ostringstream resultStream;
+    resultStream << "(Q:" << len() << "/" << capacity << ")" << (multi ? "MPMC" : "SPSC") << "[" << slotSize << " bytes]";
+    return resultStream.str();
+}
+
+size_t ShmemQueue::getCapacity() const
+{
+    return capacity;
+}
+
+size_t ShmemQueue::getSlotSize() const
+{
+    return slotSize;
+}
+
+bool ShmemQueue::isMulti() const
+{
+    return multi != 0;
+}
+
+size_t ShmemQueue::pushRaw(const void *const *messages, const size_t *lengths, size_t count, int timeout)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (lengths[i] > slotSize)
+            throw std::runtime_error("Message of " + std::to_string(lengths[i]) + " bytes does not fit a slot of " + std::to_string(slotSize) + " bytes");
+    }
+
+    size_t pushed = tryPushRaw(messages, lengths, count);
+    if (pushed == count || timeout == 0)
+        return pushed;
+    for (int spin = 0; spin < waitSpinLimit && pushed < count; spin++)
+    {
+        cpuRelax();
+        pushed += tryPushRaw(messages + pushed, lengths + pushed, count - pushed);
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    while (pushed < count)
+    {
+        // The signal is read before the flag is set: a wake() that clears our flag has to bump the signal after
+        // this read, so the futex wait below returns at once instead of sleeping without a flag
+        // The flag is left set when the retry succeeds, the next pop then makes one needless wake-up. Clearing it
+        // here could drop the wake-up of another producer that went to sleep meanwhile
+        size_t seen = consumer.spaceSignal.load(std::memory_order_seq_cst);
+        consumer.spaceWaiters.store(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        size_t more = tryPushRaw(messages + pushed, lengths + pushed, count - pushed);
+        bool waited = more != 0 || sleepOn(consumer.spaceSignal, seen, timeout, deadline);
+        pushed += more;
+        if (!waited)
+            break;
+    }
+    return pushed;
+}
+
+size_t ShmemQueue::popRaw(void *buffer, size_t bufferStride, size_t *lengths, size_t maxCount, int timeout)
+{
+    size_t popped = tryPopRaw(buffer, bufferStride, lengths, maxCount);
+    if (popped != 0 || maxCount == 0 || timeout == 0)
+        return popped;
+    for (int spin = 0; spin < waitSpinLimit && popped == 0; spin++)
+    {
+        cpuRelax();
+        popped = tryPopRaw(buffer, bufferStride, lengths, maxCount);
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    while (popped == 0)
+    {
+        // Signal before flag and the flag left set, see pushRaw()
+        size_t seen = producer.dataSignal.load(std::memory_order_seq_cst);
+        producer.dataWaiters.store(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        popped = tryPopRaw(buffer, bufferStride, lengths, maxCount);
+        bool waited = popped != 0 || sleepOn(producer.dataSignal, seen, timeout, deadline);
+        if (!waited)
+            break;
+    }
+    return popped;
+}
@@ -1,4 +1,97 @@
 #include "ShmemUtils.h"
+#include <algorithm>
+#include <ctime>
+#include <climits>
+#include <poll.h>
+#include <signal.h>
+#include <cerrno>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+// glibc keeps POSIX shared memory objects and named semaphores as files under this directory
+static const char *shmDir = "/dev/shm";
+
+/**
+ * @brief Watches the shared memory directory so connect calls can sleep until an object shows up
+ *
+ * Falls back to plain sleeping when inotify is unavailable
+ */
+class ShmDirWatch
+{
+public:
+    explicit ShmDirWatch(const std::string &entryName) : entryName(entryName)
+    {
+#ifdef __linux__
+        this->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        // IN_MODIFY catches the ftruncate that follows shm_open in createShm()
+        if (this->fd != -1 && inotify_add_watch(this->fd, shmDir, IN_CREATE | IN_MOVED_TO | IN_MODIFY) == -1)
+        {
+            ::close(this->fd);
+            this->fd = -1;
+        }
+#endif
+    }
+    ~ShmDirWatch()
+    {
+        if (this->fd != -1)
+            ::close(this->fd);
+    }
+    ShmDirWatch(const ShmDirWatch &) = delete;
+    ShmDirWatch &operator=(const ShmDirWatch &) = delete;
+
+    /**
+     * @brief Sleep until the watched entry is created or the interval passes, whichever comes first
+     */
+    void waitFor(const milliseconds &interval)
+    {
+#ifdef __linux__
+        if (this->fd != -1)
+        {
+            auto deadline = std::chrono::steady_clock::now() + interval;
+            while (true)
+            {
+                auto left = std::chrono::duration_cast<milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                if (left <= 0)
+                    return;
+                pollfd pfd = {this->fd, POLLIN, 0};
+                if (poll(&pfd, 1, static_cast<int>(left)) <= 0)
+                    return;
+                if (this->drainMatches())
+                    return;
+            }
+        }
+#endif
+        std::this_thread::sleep_for(interval);
+    }
+
+private:
+#ifdef __linux__
+    // Consume all pending events, true if one of them names the watched entry
+    bool drainMatches()
+    {
+        alignas(inotify_event) char buffer[4096];
+        bool matched = false;
+        ssize_t length;
+        while ((length = read(this->fd, buffer, sizeof(buffer))) > 0)
+        {
+            for (char *ptr = buffer; ptr < buffer + length;)
+            {
+                const inotify_event *event = reinterpret_cast<const inotify_event *>(ptr);
+                if (event->len > 0 && this->entryName == event->name)
+                    matched = true;
+                ptr += sizeof(inotify_event) + event->len;
+            }
+        }
+        return matched;
+    }
+#endif
+
+    std::string entryName;
+    int fd = -1;
+};
 
 std::shared_ptr<spdlog::logger> ShmemUtils::getLogger()
 {
@@ -34,22 +127,26 @@ sem_t *ShmemUtils::connectSem(const std::string &semName, const milliseconds &wa
     auto startTime = std::chrono::steady_clock::now();
     float timeCnt = 0.f;
     sem_t *sem = nullptr;
+    // Set up before the first attempt so a creation in between is not missed
+    ShmDirWatch watch("sem." + semName);
 
     while (true)
     {
-        if (semExists(semName))
+        // Open directly instead of semExists(), which creates a probe semaphore and would wake the watch itself
+        sem = sem_open(semName.c_str(), O_RDWR, 0666);
+        if (sem != SEM_FAILED)
         {
-            sem = sem_open(semName.c_str(), O_RDWR, 0666);
-            if (sem == SEM_FAILED)
-            {
-                getLogger()->error("Failed to open semaphore {}: {}", semName, strerror(errno));
-                throw std::runtime_error("Failed to open semaphore even when it should exist");
-            }
             getLogger()->info("Connected to semaphore {} in {:.2f} seconds", semName, timeCnt);
             break;
         }
+        else if (errno != ENOENT)
+        {
+            getLogger()->error("Failed to open semaphore {}: {}", semName, strerror(errno));
+            throw std::runtime_error("Failed to open semaphore even when it should exist");
+        }
         else
         {
+            sem = nullptr;
             auto currentTime = std::chrono::steady_clock::now();
             timeCnt = std::chrono::duration<float>(currentTime - startTime).count();
 
@@ -60,7 +157,7 @@ sem_t *ShmemUtils::connectSem(const std::string &semName, const milliseconds &wa
             }
 
             getLogger()->debug("Waiting for semaphore {} ... [ {:.1f} seconds ]", semName, timeCnt);
-            std::this_thread::sleep_for(waitTime);
+            watch.waitFor(waitTime);
         }
     }
 
@@ -69,10 +166,8 @@ sem_t *ShmemUtils::connectSem(const std::string &semName, const milliseconds &wa
 
 sem_t *ShmemUtils::createSem(const std::string &semName)
 {
-    if (semExists(semName))
-    {
-        sem_unlink(semName.c_str());
-    }
+    // Remove a stale semaphore. Probing with semExists() would briefly create one a connector could grab
+    sem_unlink(semName.c_str());
     sem_t *semTmp = sem_open(semName.c_str(), O_CREAT | O_EXCL, 0666, 0);
 
     if (semTmp == SEM_FAILED)
@@ -96,19 +191,28 @@ bool ShmemUtils::shmExists(const std::string &shmName)
     }
 }
 
-FileDescriptor ShmemUtils::connectShm(Byte *&shmPtr, const std::string &shmName, const milliseconds &waitTime, const milliseconds &timeout)
+FileDescriptor ShmemUtils::connectShm(Byte *&shmPtr, const std::string &shmName, const milliseconds &waitTime, const milliseconds &timeout, int options)
 {
     auto startTime = std::chrono::steady_clock::now();
     float timeCnt = 0.f;
     FileDescriptor shmFd = -1;
+    // Set up before the first attempt so a creation in between is not missed
+    ShmDirWatch watch(shmName);
 
     while (true)
     {
         shmFd = shm_open(shmName.c_str(), O_RDWR, 0666);
+        if (shmFd != -1 && getShmSize(shmFd) == 0)
+        {
+            // Caught between shm_open and ftruncate in createShm(), wait for the size to be set
+            ::close(shmFd);
+            shmFd = -1;
+            errno = ENOENT;
+        }
         if (shmFd != -1)
         {
             size_t size = getShmSize(shmFd);
-            shmPtr = static_cast<Byte *>(mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0));
+            shmPtr = mapShm(shmFd, size, options);
             getLogger()->info("Connected to shared memory {} in {} seconds", shmName, timeCnt);
             break;
         }
@@ -126,7 +230,7 @@ FileDescriptor ShmemUtils::connectShm(Byte *&shmPtr, const std::string &shmName,
                 }
 
                 getLogger()->debug("Waiting for shared memory {} ... [ {:.1f} seconds ]", shmName, timeCnt);
-                std::this_thread::sleep_for(waitTime);
+                watch.waitFor(waitTime);
             }
             else
             {
@@ -139,10 +243,10 @@ FileDescriptor ShmemUtils::connectShm(Byte *&shmPtr, const std::string &shmName,
     return shmFd;
 }
 
-FileDescriptor ShmemUtils::createShm(Byte *&shmPtr, const std::string &shmName, const size_t &size)
+FileDescriptor ShmemUtils::createShm(Byte *&shmPtr, const std::string &shmName, const size_t &size, int options)
 {
-    if (shmExists(shmName))
-        shm_unlink(shmName.c_str());
+    // Remove a stale object. Probing with shmExists() would briefly create one a connector could grab
+    shm_unlink(shmName.c_str());
     FileDescriptor shmFd = shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
     if (shmFd == -1)
     {
@@ -154,17 +258,225 @@ FileDescriptor ShmemUtils::createShm(Byte *&shmPtr, const std::string &shmName,
         getLogger()->error("Failed to set size of shared memory");
         throw std::runtime_error("Failed to set size of shared memory");
     }
-    shmPtr = static_cast<Byte *>(mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0));
+    // A new object reads as zeros already, pages are only touched here if MapPopulate asks for it
+    shmPtr = mapShm(shmFd, size, options);
+
+    getLogger()->info("Create shared memory. shmName: {}, shmPtr: {}, shmFd: {}, size: {}", shmName, static_cast<const void *>(shmPtr), shmFd, size);
+    return shmFd;
+}
+
+static size_t pageUp(size_t size)
+{
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    return (size + pageSize - 1) / pageSize * pageSize;
+}
+
+size_t ShmemUtils::reservationSize(size_t size)
+{
+    return std::max(pageUp(size), shmReserveSize);
+}
+
+Byte *ShmemUtils::mapShm(FileDescriptor shmFd, size_t size, int options)
+{
+    // Reserve address space first, so growing the mapping later never has to move it
+    // Huge pages need a 2 MiB aligned start, reserve one more huge page and trim the slack on both sides
+    size_t slack = (options & MapHugePages) ? hugePageSize : 0;
+    void *reserved = mmap(0, reservationSize(size) + slack, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED)
+    {
+        getLogger()->error("Failed to reserve address space for shared memory: {}", strerror(errno));
+        throw std::runtime_error("Failed to map shared memory");
+    }
+    if (slack != 0)
+    {
+        Byte *begin = static_cast<Byte *>(reserved);
+        Byte *aligned = reinterpret_cast<Byte *>((reinterpret_cast<uintptr_t>(begin) + hugePageSize - 1) & ~(hugePageSize - 1));
+        if (aligned != begin)
+            munmap(begin, aligned - begin);
+        munmap(aligned + reservationSize(size), slack - (aligned - begin));
+        reserved = aligned;
+    }
+    void *shmPtr = mmap(reserved, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, shmFd, 0);
     if (shmPtr == MAP_FAILED)
     {
-        getLogger()->error("Failed to map shared memory");
+        munmap(reserved, reservationSize(size));
+        getLogger()->error("Failed to map shared memory: {}", strerror(errno));
         throw std::runtime_error("Failed to map shared memory");
     }
-    // init with zeros
-    clearShm(shmPtr, size);
+    adviseShm(static_cast<Byte *>(shmPtr), size, options);
+    return static_cast<Byte *>(shmPtr);
+}
 
-    getLogger()->info("Create shared memory. shmName: {}, shmPtr: {}, shmFd: {}, size: {}", shmName, static_cast<const void *>(shmPtr), shmFd, size);
-    return shmFd;
+void ShmemUtils::adviseShm(Byte *shmPtr, size_t size, int options)
+{
+    if (size == 0 || options == MapDefault)
+        return;
+    size = pageUp(size);
+
+    // Advise before faulting anything in, otherwise the range is populated with small pages
+    if ((options & MapHugePages) && madvise(shmPtr, size, MADV_HUGEPAGE) != 0)
+        getLogger()->warn("madvise(MADV_HUGEPAGE) failed: {}", strerror(errno));
+
+    if (options & MapPopulate)
+    {
+        bool populated = false;
+#ifdef MADV_POPULATE_WRITE
+        populated = madvise(shmPtr, size, MADV_POPULATE_WRITE) == 0;
+#endif
+        if (!populated)
+        {
+            // Older kernels: fault every page by hand, a read fault on shmem maps the page writable
+            size_t pageSize = sysconf(_SC_PAGESIZE);
+            for (size_t i = 0; i < size; i += pageSize)
+                static_cast<void>(*reinterpret_cast<volatile Byte *>(shmPtr + i));
+        }
+    }
+
+    if ((options & MapLock) && mlock(shmPtr, size) != 0)
+        getLogger()->warn("mlock of {} bytes failed: {}", size, strerror(errno));
+}
+
+Byte *ShmemUtils::remapShm(FileDescriptor shmFd, Byte *shmPtr, size_t oldSize, size_t newSize, int options)
+{
+    // A mapping of n bytes always spans reservationSize(n): pageUp(n) of shm followed by PROT_NONE address space
+    size_t oldReserved = reservationSize(oldSize);
+    void *newPtr = MAP_FAILED;
+    if (newSize <= oldReserved)
+    {
+        // Only the pages past the old mapping are mapped over the reservation, the address does not change
+        // and the resident pages of the old range are left alone
+        newPtr = shmPtr;
+        if (pageUp(newSize) > pageUp(oldSize) &&
+            mmap(shmPtr + pageUp(oldSize), pageUp(newSize) - pageUp(oldSize), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, shmFd, pageUp(oldSize)) == MAP_FAILED)
+            newPtr = MAP_FAILED;
+        if (pageUp(newSize) < pageUp(oldSize))
+        {
+            // Return the released tail to the reservation, then trim a reservation larger than the default
+            mmap(shmPtr + pageUp(newSize), pageUp(oldSize) - pageUp(newSize), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+            if (reservationSize(newSize) < oldReserved)
+                munmap(shmPtr + reservationSize(newSize), oldReserved - reservationSize(newSize));
+        }
+    }
+    else
+    {
+        // Outgrew the reservation, drop the rest of it and let the kernel move the pages (no copy)
+        if (oldReserved > pageUp(oldSize))
+            munmap(shmPtr + pageUp(oldSize), oldReserved - pageUp(oldSize));
+#ifdef __linux__
+        newPtr = mremap(shmPtr, pageUp(oldSize), newSize, MREMAP_MAYMOVE);
+#else
+        munmap(shmPtr, pageUp(oldSize));
+        newPtr = mmap(0, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0);
+#endif
+    }
+    if (newPtr == MAP_FAILED)
+    {
+        getLogger()->error("Failed to remap shared memory: {}", strerror(errno));
+        throw std::runtime_error("Failed to remap shared memory");
+    }
+    // Only the grown range is new to this process, the rest already carries the options
+    if (pageUp(newSize) > pageUp(oldSize))
+        adviseShm(static_cast<Byte *>(newPtr) + pageUp(oldSize), pageUp(newSize) - pageUp(oldSize), options);
+    getLogger()->debug("Remapped shared memory. shmPtr: {}->{}, shmFd: {}, size: {}->{}", static_cast<const void *>(shmPtr), newPtr, shmFd, oldSize, newSize);
+    return static_cast<Byte *>(newPtr);
+}
+
+Byte *ShmemUtils::resizeShm(FileDescriptor shmFd, Byte *shmPtr, size_t oldSize, size_t newSize, int options)
+{
+    if (ftruncate(shmFd, newSize) == -1)
+    {
+        getLogger()->error("Failed to resize shared memory: {}", strerror(errno));
+        throw std::runtime_error("Failed to resize shared memory");
+    }
+    return remapShm(shmFd, shmPtr, oldSize, newSize, options);
+}
+
+// Maps the whole object over the reservation at shmPtr and closes the descriptor
+static void mapShmFixed(FileDescriptor shmFd, Byte *shmPtr, size_t size, int options)
+{
+    void *mapped = mmap(shmPtr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, shmFd, 0);
+    ::close(shmFd);
+    if (mapped == MAP_FAILED)
+    {
+        ShmemUtils::getLogger()->error("Failed to map shared memory at {}: {}", static_cast<const void *>(shmPtr), strerror(errno));
+        throw std::runtime_error("Failed to map shared memory");
+    }
+    ShmemUtils::adviseShm(shmPtr, size, options);
+}
+
+void ShmemUtils::createShmAt(Byte *shmPtr, const std::string &shmName, size_t size, int options)
+{
+    shm_unlink(shmName.c_str());
+    FileDescriptor shmFd = shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (shmFd == -1)
+    {
+        getLogger()->error("Failed to create shared memory {}: {}", shmName, strerror(errno));
+        throw std::runtime_error("Failed to create shared memory");
+    }
+    if (ftruncate(shmFd, size) == -1)
+    {
+        getLogger()->error("Failed to set size of shared memory {}: {}", shmName, strerror(errno));
+        ::close(shmFd);
+        shm_unlink(shmName.c_str());
+        throw std::runtime_error("Failed to set size of shared memory");
+    }
+    mapShmFixed(shmFd, shmPtr, size, options);
+
+    getLogger()->info("Create shared memory at a fixed address. shmName: {}, shmPtr: {}, size: {}", shmName, static_cast<const void *>(shmPtr), size);
+}
+
+void ShmemUtils::connectShmAt(Byte *shmPtr, const std::string &shmName, size_t size, int options)
+{
+    FileDescriptor shmFd = shm_open(shmName.c_str(), O_RDWR, 0666);
+    if (shmFd == -1)
+    {
+        getLogger()->error("Failed to connect to shared memory {}: {}", shmName, strerror(errno));
+        throw std::runtime_error("Failed to connect to shared memory");
+    }
+    if (getShmSize(shmFd) < size)
+    {
+        getLogger()->error("Shared memory {} holds {} bytes, expected {}", shmName, getShmSize(shmFd), size);
+        ::close(shmFd);
+        throw std::runtime_error("Shared memory is smaller than expected");
+    }
+    mapShmFixed(shmFd, shmPtr, size, options);
+
+    getLogger()->info("Connect to shared memory at a fixed address. shmName: {}, shmPtr: {}, size: {}", shmName, static_cast<const void *>(shmPtr), size);
+}
+
+void ShmemUtils::unmapShmAt(Byte *shmPtr, size_t size)
+{
+    if (size == 0)
+        return;
+    if (mmap(shmPtr, pageUp(size), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)
+    {
+        getLogger()->error("Failed to unmap shared memory at {}: {}", static_cast<const void *>(shmPtr), strerror(errno));
+        throw std::runtime_error("Failed to unmap shared memory");
+    }
+    getLogger()->debug("Unmapped shared memory at a fixed address. shmPtr: {}, size: {}", static_cast<const void *>(shmPtr), size);
+}
+
+bool ShmemUtils::releaseShm(FileDescriptor shmFd, Byte *shmPtr, size_t offset, size_t size)
+{
+    if (size == 0)
+        return true;
+#ifdef __linux__
+    if (fallocate(shmFd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset), static_cast<off_t>(size)) == 0)
+        return true;
+    if (madvise(shmPtr + offset, size, MADV_REMOVE) == 0)
+        return true;
+#else
+    static_cast<void>(shmFd);
+    static_cast<void>(shmPtr);
+#endif
+    getLogger()->debug("Failed to release {} bytes at offset {} of shared memory: {}", size, offset, strerror(errno));
+    return false;
+}
+
+bool ShmemUtils::shmUnlinked(FileDescriptor shmFd)
+{
+    struct stat shm_stat;
+    return fstat(shmFd, &shm_stat) == -1 || shm_stat.st_nlink == 0;
 }
 
 void ShmemUtils::clearSem(sem_t *sem)
@@ -186,7 +498,7 @@ void ShmemUtils::closeShm(FileDescriptor shmFd, Byte *shmPtr, const size_t &size
 
     if (shmPtr != nullptr)
     {
-        munmap(shmPtr, size);
+        munmap(shmPtr, reservationSize(size));
         shmPtr = nullptr;
     }
     if (shmFd != -1)
@@ -265,10 +577,15 @@ void ShmemUtils::setSemValue(sem_t *sem, const size_t &val)
 int ShmemUtils::waitSem(sem_t *sem, const milliseconds &waitTime, const milliseconds &timeout, std::function<bool()> callback)
 {
     auto start = std::chrono::steady_clock::now();
+    auto deadline = start + timeout;
     while (true)
     {
-        // Try to wait on the semaphore without blocking
-        if (sem_trywait(sem) == 0)
+        // Block in the kernel until posted. With a callback, wake up every waitTime to poll it
+        auto sliceEnd = deadline;
+        if (callback != nullptr)
+            sliceEnd = std::min(deadline, std::chrono::steady_clock::now() + waitTime);
+
+        if (timedWaitSem(sem, sliceEnd) == 0)
         {
             // Successfully acquired the semaphore
             auto elapsed = std::chrono::steady_clock::now() - start;
@@ -294,14 +611,36 @@ int ShmemUtils::waitSem(sem_t *sem, const milliseconds &waitTime, const millisec
             return ETIMEDOUT;
         }
 
-        // Add a small sleep to avoid busy-waiting
-        std::this_thread::sleep_for(waitTime);
-
         // Update time count for logging purposes
         auto elapsedMillis = std::chrono::duration_cast<milliseconds>(elapsed).count();
         getLogger()->debug("\rWaiting sem {} ... [ {:.1f} seconds ]", static_cast<const void *>(sem), static_cast<float>(elapsedMillis) / 1000.0f);
     }
 }
+
+int ShmemUtils::timedWaitSem(sem_t *sem, const std::chrono::steady_clock::time_point &deadline)
+{
+    while (true)
+    {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 30))
+        // sem_clockwait takes a CLOCK_MONOTONIC deadline, which steady_clock is built on
+        auto sinceEpoch = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+        timespec ts = {static_cast<time_t>(sinceEpoch / 1000000000), static_cast<long>(sinceEpoch % 1000000000)};
+        int result = sem_clockwait(sem, CLOCK_MONOTONIC, &ts);
+#else
+        // sem_timedwait only understands CLOCK_REALTIME, translate the remaining time
+        auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now());
+        auto realDeadline = std::chrono::duration_cast<std::chrono::nanoseconds>((std::chrono::system_clock::now() + left).time_since_epoch()).count();
+        timespec ts = {static_cast<time_t>(realDeadline / 1000000000), static_cast<long>(realDeadline % 1000000000)};
+        int result = sem_timedwait(sem, &ts);
+#endif
+        if (result == 0)
+            return 0;
+        if (errno != EINTR)
+            return errno;
+        // Interrupted by a signal, resume waiting for the same deadline
+    }
+}
+
 int ShmemUtils::postSem(sem_t *sem)
 {
     sem_post(sem);
@@ -309,4 +648,32 @@ int ShmemUtils::postSem(sem_t *sem)
     sem_getvalue(sem, &val);
     getLogger()->debug("Posted on {} semaphore. sem: {}->{}", static_cast<const void *>(sem), val - 1, val);
     return 0;
-}
\ No newline at end of file
+}
+
+// Shared (not FUTEX_PRIVATE) futexes, the words live in segments mapped by several processes
+void ShmemUtils::futexWait(const size_t *word, uint32_t expected, const timespec *timeout)
+{
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<const uint32_t *>(word), FUTEX_WAIT, expected, timeout, nullptr, 0);
+#else
+    (void)word;
+    (void)expected;
+    (void)timeout;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+}
+
+void ShmemUtils::futexWakeAll(const size_t *word)
+{
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<const uint32_t *>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#else
+    (void)word;
+#endif
+}
+
+bool ShmemUtils::processDead(size_t pid)
+{
+    // Signal 0 only checks that the process exists. EPERM means it exists under another user
+    return pid != 0 && kill(static_cast<pid_t>(pid), 0) != 0 && errno == ESRCH;
+}
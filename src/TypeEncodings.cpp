@@ -19,6 +19,8 @@ const std::unordered_map<int, std::string> typeNames = {
     {List, "list"},
     {DictNode, "dict node"},
     {Dict, "dict"},
+    {HashMap, "hash map"},
+    {Queue, "queue"},
 };
 
 bool isPrimitive(int type)
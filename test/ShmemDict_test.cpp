@@ -2,6 +2,8 @@
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <cstring>
+#include <thread>
+#include <sys/wait.h>
 
 #include "ShmemList.h"
 #include "ShmemAccessor.h"
@@ -55,28 +57,28 @@ TEST_F(ShmemDictTest, BasicAssignmentAndMemoryUsage)
 
     acc = m1;
 
-    // 24     , 56 , 24     , 24,    , 56      , 24      , 3832
-    // DictObj, NIL, NIL_key, data(2), DictNode, key("9"), free_block
-    EXPECT_EQ(shmHeap.briefLayout(), vector<size_t>({24, 56, 24, 24, 56, 24, 3832}));
+    // 40     , 328                     , 24     , 136                , 24      , 3496
+    // DictObj, node page(NIL, DictNode), NIL_key, scalar page(data(2)), key("9"), free_block
+    EXPECT_EQ(shmHeap.briefLayout(), vector<size_t>({40, 328, 24, 136, 24, 3496}));
 
     std::map<std::string, int> m2({{std::string(100, 'A'), 2}});
     acc = m2;
 
-    // 24     , 56 , 24     , 24,    , 56      , 112, 3744
-    // DictObj, NIL, NIL_key, data(2), DictNode, key, free_block
-    EXPECT_EQ(shmHeap.briefLayout(), vector<size_t>({24, 56, 24, 24, 56, 112, 3744}));
+    // 40     , 328                     , 24     , 136                , 112, 3408
+    // DictObj, node page(NIL, DictNode), NIL_key, scalar page(data(2)), key, free_block
+    EXPECT_EQ(shmHeap.briefLayout(), vector<size_t>({40, 328, 24, 136, 112, 3408}));
 
     acc = m1;
     acc["new"] = 5;
 
-    // 24     , 56 , 24     , 24,    , 56      , 24,     , 24     , 56      , 24        , 3704
-    // DictObj, NIL, NIL_key, data(2), DictNode, key("9"), data(5), DictNode, key("new"), free_block
-    EXPECT_EQ(shmHeap.briefLayout(), vector<size_t>({24, 56, 24, 24, 56, 24, 24, 56, 24, 3704}));
+    // 40     , 328                        , 24     , 136                         , 24      , 24        , 3464
+    // DictObj, node page(NIL, 2 DictNodes), NIL_key, scalar page(data(2), data(5)), key("9"), key("new"), free_block
+    EXPECT_EQ(shmHeap.briefLayout(), vector<size_t>({40, 328, 24, 136, 24, 24, 3464}));
 
     acc["new"] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
-    // 24     , 56 , 24     , 24,    , 56      , 24,     , 24(freed), 56      , 24        , 72            , 3704
-    // DictObj, NIL, NIL_key, data(2), DictNode, key("9"), data(5)  , DictNode, key("new"), new data array, free_block
-    EXPECT_EQ(shmHeap.briefLayout(), vector<size_t>({24, 56, 24, 24, 56, 24, 24, 56, 24, 72, 3624}));
+    // 40     , 328                        , 24     , 136                             , 24      , 24        , 72            , 3384
+    // DictObj, node page(NIL, 2 DictNodes), NIL_key, scalar page(data(2), freed slot), key("9"), key("new"), new data array, free_block
+    EXPECT_EQ(shmHeap.briefLayout(), vector<size_t>({40, 328, 24, 136, 24, 24, 72, 3384}));
 
     EXPECT_ANY_THROW(acc.del(9));
     acc.del("9");
@@ -91,6 +93,365 @@ TEST_F(ShmemDictTest, BasicAssignmentAndMemoryUsage)
     std::cout << acc << std::endl;
 }
 
+TEST_F(ShmemDictTest, BatchedValues)
+{
+    std::string value(20, 'v');
+    std::map<std::string, std::string> m1({{"a", value}, {"b", value}, {"c", value}});
+    acc = m1;
+
+    // 40     , 328                     , 24     , 32 * 3                      , 24 * 3       , 3456
+    // DictObj, node page(NIL, DictNode), NIL_key, values allocated in one batch, keys a, b, c , free_block
+    EXPECT_EQ(shmHeap.briefLayout(), vector<size_t>({40, 328, 24, 32, 32, 32, 24, 24, 24, 3456}));
+    EXPECT_EQ(acc, m1);
+    EXPECT_TRUE(shmHeap.verifyHeap());
+
+    acc.del("b");
+    acc["d"] = value;
+    EXPECT_EQ(acc["d"], value);
+    acc = nullptr;
+    EXPECT_EQ(shmHeap.briefLayout(), vector<size_t>({4096 - unitSize}));
+}
+
+TEST_F(ShmemDictTest, CollidingHashesCompareByKey)
+{
+    size_t offset = ShmemDictNode::construct("abc", &shmHeap);
+    const ShmemDictNode *node = reinterpret_cast<const ShmemDictNode *>(shmHeap.heapHead() + offset);
+    EXPECT_EQ(node->hashedKey(), hashIntOrString("abc"));
+
+    // Pretend every key below collides with the node's hash: the full key decides
+    size_t hash = node->hashedKey();
+    EXPECT_EQ(node->compare(hash, "abc"), 0);
+    EXPECT_LT(node->compare(hash, "abb"), 0);
+    EXPECT_GT(node->compare(hash, "abd"), 0);
+    EXPECT_LT(node->compare(hash, "ab"), 0);
+    EXPECT_GT(node->compare(hash, "abcd"), 0);
+    EXPECT_LT(node->compare(hash, 7), 0); // Int keys order before string keys
+
+    ShmemDictNode::deconstruct(offset, &shmHeap);
+
+    offset = ShmemDictNode::construct(7, &shmHeap);
+    node = reinterpret_cast<const ShmemDictNode *>(shmHeap.heapHead() + offset);
+    hash = node->hashedKey();
+    EXPECT_EQ(node->compare(hash, 7), 0);
+    EXPECT_LT(node->compare(hash, -7), 0);
+    EXPECT_GT(node->compare(hash, 8), 0);
+    EXPECT_GT(node->compare(hash, "7"), 0);
+    ShmemDictNode::deconstruct(offset, &shmHeap);
+}
+
+TEST_F(ShmemDictTest, WatchWakesOnWritesBelow)
+{
+    acc = std::map<std::string, float>({{"b", 2}});
+    acc["a"] = std::map<std::string, float>({{"x", 1}});
+    size_t root = acc.version(), a = acc["a"].version(), b = acc["b"].version();
+    EXPECT_NE(a, 0u);
+    EXPECT_EQ(acc["missing"].version(), 0u);
+
+    // A write moves the version of the object written and of every object above it, siblings keep theirs
+    acc["a"]["x"] = 3.0f;
+    EXPECT_NE(acc.version(), root);
+    EXPECT_NE(acc["a"].version(), a);
+    EXPECT_EQ(acc["b"].version(), b);
+    EXPECT_EQ(acc["b"].watch(b, 0), b);
+    EXPECT_FALSE(acc["b"].waitForChange(20));
+
+    // Another process inserts below "a" while we sleep on it
+    size_t since = acc["a"].version();
+    size_t changes = shmHeap.changeCount();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        ShmemHeap other("test_shm_dict", 1, 1);
+        other.connect();
+        ShmemAccessor otherAcc(&other);
+        otherAcc["a"]["y"] = 5.0f;
+        _exit(0);
+    }
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_NE(acc["a"].watch(since, 5000), since);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(4000));
+    int status = -1;
+    waitpid(pid, &status, 0);
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+    EXPECT_EQ(acc["a"]["y"], 5.0f);
+    EXPECT_GT(shmHeap.changeCount(), changes);
+
+    // Deleting the object leaves its path without a version
+    acc["a"].del("y");
+    EXPECT_EQ(acc["a"]["y"].version(), 0u);
+    EXPECT_TRUE(shmHeap.verifyHeap());
+}
+
+TEST_F(ShmemDictTest, VersionSurvivesReplacement)
+{
+    // Every replacement reuses the block of the previous value, the version must still move
+    acc = std::map<std::string, int>({{"x", 1}});
+    acc["x"] = 2;
+    ShmemAccessor x = acc["x"];
+    size_t since = x.version();
+    acc["x"] = 3;
+    acc["x"] = 4;
+    // The bits above the write sequence hold the offset of the object
+    const int offsetShift = 62 - ShmemHeap::BlockHeader::seqShift;
+    EXPECT_EQ(x.version() >> offsetShift, since >> offsetShift);
+    EXPECT_NE(x.watch(since, 0), since);
+
+    // Also when the key is deleted and inserted again in between
+    since = x.version();
+    acc.del("x");
+    acc["x"] = 5;
+    EXPECT_NE(x.watch(since, 0), since);
+    EXPECT_EQ(acc["x"], 5);
+}
+
+TEST_F(ShmemDictTest, TransactionsPublishAtOnce)
+{
+    acc = std::map<std::string, int>({{"v", 0}, {"w", 0}});
+
+    // Staged writes stay invisible until commit(), abort() drops them
+    shmHeap.beginTransaction();
+    EXPECT_TRUE(shmHeap.inTransaction());
+    acc["v"] = 1;
+    acc["w"] = 1;
+    EXPECT_EQ(acc["v"], 0);
+    shmHeap.abort();
+    EXPECT_FALSE(shmHeap.inTransaction());
+    EXPECT_EQ(acc["v"], 0);
+    EXPECT_THROW(shmHeap.commit(), std::runtime_error);
+
+    // The whole batch wakes the watchers once
+    size_t changes = shmHeap.changeCount();
+    shmHeap.beginTransaction();
+    acc["v"] = 2;
+    acc["w"] = 2;
+    acc.add(3, "u");
+    shmHeap.commit();
+    EXPECT_EQ(shmHeap.changeCount(), changes + 1);
+    EXPECT_EQ(acc["v"], 2);
+    EXPECT_EQ(acc["w"], 2);
+    EXPECT_EQ(acc["u"], 3);
+
+    // Another process never reads v and w from different commits
+    const int numCommits = 2000;
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        ShmemHeap other("test_shm_dict", 1, 1);
+        other.connect();
+        ShmemAccessor otherAcc(&other);
+        int v = 0;
+        while (v != numCommits)
+        {
+            size_t seq = other.readBegin();
+            v = otherAcc["v"];
+            int w = otherAcc["w"];
+            if (other.readRetry(seq))
+                continue;
+            if (v != w)
+                _exit(1);
+        }
+        _exit(0);
+    }
+    for (int i = 1; i <= numCommits; i++)
+    {
+        shmHeap.beginTransaction();
+        acc["v"] = i;
+        acc["w"] = i;
+        shmHeap.commit();
+    }
+    int status = -1;
+    waitpid(pid, &status, 0);
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+
+    // A failing write rolls the whole commit back, the writes before it included
+    shmHeap.beginTransaction();
+    acc["v"] = -1;
+    acc["x"] = std::vector<int>({1, 2, 3});
+    acc["x"][1] = 0;
+    acc.del("w");
+    acc["v"][3] = 1;
+    acc["w"] = -1;
+    EXPECT_THROW(shmHeap.commit(), std::runtime_error);
+    EXPECT_FALSE(shmHeap.inTransaction());
+    EXPECT_EQ(acc["v"], numCommits);
+    EXPECT_EQ(acc["w"], numCommits);
+    EXPECT_FALSE(acc.contains("x"));
+    EXPECT_EQ(acc.len(), 3u);
+    EXPECT_TRUE(shmHeap.verifyHeap());
+
+    // What the rolled back writes linked is freed, nothing is left behind once the data goes
+    acc = nullptr;
+    EXPECT_EQ(shmHeap.briefLayout().size(), 1u);
+}
+
+TEST_F(ShmemDictTest, RolledBackCommitRestoresListsAndKeys)
+{
+    acc = std::map<std::string, std::vector<std::string>>({{"l", {"a", "b", "c"}}, {"k", {"x"}}});
+    // Writes copy the dict nodes a snapshot reads, the rollback must leave both views intact
+    ShmemAccessor snap = acc.snapshot();
+
+    shmHeap.beginTransaction();
+    acc["l"][0] = std::string("z");
+    acc["l"].del(1);
+    acc["l"].add(std::string("d"));
+    acc["l"].del(-1);
+    acc.del("k");
+    acc["n"] = 1;
+    acc["missing"][0] = 1;
+    EXPECT_THROW(shmHeap.commit(), std::runtime_error);
+
+    for (ShmemAccessor view : {acc, snap})
+    {
+        EXPECT_EQ(view.len(), 2u);
+        EXPECT_EQ(view["l"].len(), 3u);
+        EXPECT_EQ(view["l"][0].get<std::string>(), "a");
+        EXPECT_EQ(view["l"][1].get<std::string>(), "b");
+        EXPECT_EQ(view["l"][2].get<std::string>(), "c");
+        EXPECT_EQ(view["k"][0].get<std::string>(), "x");
+        EXPECT_FALSE(view.contains("n"));
+    }
+    EXPECT_TRUE(shmHeap.verifyHeap());
+
+    snap.release();
+    acc = nullptr;
+    EXPECT_EQ(shmHeap.briefLayout().size(), 1u);
+}
+
+TEST_F(ShmemDictTest, CommitterDiesHoldingTheSequence)
+{
+    acc = std::map<std::string, int>({{"v", 0}});
+
+    // The child dies in the middle of its commit, the sequence stays odd with its pid
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        ShmemHeap other("test_shm_dict", 1, 1);
+        other.connect();
+        ShmemAccessor otherAcc(&other);
+        other.beginTransaction();
+        otherAcc["v"] = 1;
+        other.stageWrite([]()
+                         { _exit(0); });
+        other.commit();
+        _exit(1);
+    }
+    int status = -1;
+    waitpid(pid, &status, 0);
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+
+    // Readers and the next committer take the sequence over instead of waiting forever
+    EXPECT_EQ(acc["v"], 1);
+    shmHeap.beginTransaction();
+    acc["v"] = 2;
+    shmHeap.commit();
+    EXPECT_EQ(acc["v"], 2);
+    EXPECT_TRUE(shmHeap.verifyHeap());
+}
+
+TEST_F(ShmemDictTest, SnapshotsKeepTheirVersion)
+{
+    std::map<int, int> m1;
+    for (int i = 0; i < 64; i++)
+        m1[i] = i;
+    acc = m1;
+    acc[100] = std::map<std::string, int>({{"x", 1}});
+
+    ShmemAccessor snap = acc.snapshot();
+    EXPECT_TRUE(snap.isSnapshot());
+    EXPECT_FALSE(acc.isSnapshot());
+    EXPECT_TRUE(snap[100].isSnapshot());
+    EXPECT_EQ(shmHeap.newestSnapshot(), snap.snapshotEpoch());
+
+    // Writes after the snapshot only show through the live accessor
+    for (int i = 0; i < 64; i += 2)
+        acc.del(i);
+    for (int i = 64; i < 96; i++)
+        acc[i] = i;
+    acc[1] = -1;
+    acc[100]["x"] = 2;
+    acc[100]["y"] = 3;
+    EXPECT_EQ(acc.len(), 65);
+    EXPECT_EQ(acc[1], -1);
+    EXPECT_FALSE(acc.contains(0));
+    EXPECT_EQ(acc[100]["x"], 2);
+
+    EXPECT_EQ(snap.len(), 65);
+    EXPECT_EQ(snap[0], 0);
+    EXPECT_EQ(snap[1], 1);
+    EXPECT_FALSE(snap.contains(64));
+    EXPECT_EQ(snap[100]["x"], 1);
+    EXPECT_FALSE(snap[100].contains("y"));
+    int count = 0;
+    for (auto it = snap.begin(); it != snap.end(); ++it)
+        count++;
+    EXPECT_EQ(count, 65);
+    EXPECT_THROW(snap[1] = 5, std::runtime_error);
+    EXPECT_THROW(snap.del(1), std::runtime_error);
+
+    // Replacing the root object keeps the old one for the snapshot
+    acc = std::map<std::string, int>({{"a", 1}});
+    ShmemAccessor second = acc.snapshot();
+    acc["a"] = 2;
+    EXPECT_EQ(snap[3], 3);
+    EXPECT_EQ(second["a"], 1);
+    EXPECT_EQ(acc["a"], 2);
+
+    // Old versions are freed once no snapshot holds them
+    snap.release();
+    second.release();
+    EXPECT_FALSE(snap.isSnapshot());
+    EXPECT_EQ(snap.len(), 1);
+    EXPECT_EQ(shmHeap.newestSnapshot(), 0);
+    EXPECT_EQ(shmHeap.retiredObjects().load(), NPtr);
+    EXPECT_TRUE(shmHeap.verifyHeap());
+
+    std::vector<ShmemAccessor> snapshots;
+    for (size_t i = 0; i < ShmemHeap::maxSnapshots; i++)
+        snapshots.push_back(acc.snapshot());
+    EXPECT_THROW(acc.snapshot(), std::runtime_error);
+    snapshots.clear();
+
+    // A writer in another process goes on while the snapshot is read
+    acc = m1;
+    ShmemAccessor frozen = acc.snapshot();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        ShmemHeap other("test_shm_dict", 1, 1);
+        other.connect();
+        ShmemAccessor otherAcc(&other);
+        for (int round = 1; round <= 20; round++)
+        {
+            for (int i = 0; i < 64; i++)
+                otherAcc[i] = -round;
+            otherAcc.del(round);
+            otherAcc[round + 64] = round;
+        }
+        _exit(0);
+    }
+    bool consistent = true;
+    int status = -1;
+    while (waitpid(pid, &status, WNOHANG) == 0)
+    {
+        int sum = 0;
+        count = 0;
+        for (auto it = frozen.begin(); it != frozen.end(); ++it)
+        {
+            sum += static_cast<int>(*it);
+            count++;
+        }
+        consistent = consistent && sum == 63 * 64 / 2 && count == 64;
+    }
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+    EXPECT_TRUE(consistent);
+    EXPECT_EQ(acc[0], -20);
+    EXPECT_EQ(frozen[0], 0);
+    frozen.release();
+    EXPECT_EQ(shmHeap.retiredObjects().load(), NPtr);
+    EXPECT_TRUE(shmHeap.verifyHeap());
+}
+
 TEST_F(ShmemDictTest, QuickAssign)
 {
     map<int, int> m1 = {{1, 11}, {2, 22}, {3, 33}, {4, 44}};
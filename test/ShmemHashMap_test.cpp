@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <cstring>
+
+#include "ShmemHashMap.h"
+#include "ShmemAccessor.h"
+
+using namespace std;
+class ShmemHashMapTest : public ::testing::Test
+{
+protected:
+    // Setup code (called before each test)
+    ShmemHashMapTest() : shmHeap("test_shm_hash_map", 80, 1 << 20), acc(&shmHeap){};
+
+    void SetUp() override
+    {
+        shmHeap.getLogger()->set_level(spdlog::level::info);
+        auto console_sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+        shmHeap.getLogger()->sinks().clear();
+        shmHeap.getLogger()->sinks().push_back(console_sink);
+        // Initialize necessary objects/resources
+        shmHeap.create();
+        Py_Initialize();
+    }
+
+    // Teardown code (called after each test)
+    void TearDown() override
+    {
+        // Cleanup objects/resources
+    }
+
+    ShmemHeap shmHeap;
+    ShmemAccessor acc;
+};
+
+TEST_F(ShmemHashMapTest, CreateEmptyHashMap)
+{
+    acc = SHashMap();
+    EXPECT_EQ(acc.len(), 0);
+    EXPECT_EQ(acc.typeId(), HashMap);
+    EXPECT_EQ(acc.typeStr(), "hash map");
+    EXPECT_EQ(acc.toString(), "(H:0){\n}");
+}
+
+TEST_F(ShmemHashMapTest, InsertLookupDelete)
+{
+    acc = SHashMap();
+    const int n = 1000; // Forces several rehashes from the initial 16 slots
+
+    for (int i = 0; i < n; i++)
+    {
+        acc[i] = i * 2;
+        acc["key" + to_string(i)] = i * 3;
+    }
+    EXPECT_EQ(acc.len(), 2 * n);
+    for (int i = 0; i < n; i++)
+    {
+        EXPECT_EQ(acc[i].get<int>(), i * 2);
+        EXPECT_EQ(acc["key" + to_string(i)].get<int>(), i * 3);
+    }
+    EXPECT_FALSE(acc.contains(n));
+    EXPECT_FALSE(acc.contains("key" + to_string(n)));
+    EXPECT_FALSE(acc.contains("0")); // Int and string keys never match each other
+
+    // Overwrite keeps the size
+    acc[7] = "seven";
+    EXPECT_EQ(acc[7], "seven");
+    EXPECT_EQ(acc.len(), 2 * n);
+
+    // Delete the even keys, the odd ones must stay reachable past the tombstones
+    for (int i = 0; i < n; i += 2)
+    {
+        acc.del(i);
+        acc.del("key" + to_string(i));
+    }
+    EXPECT_EQ(acc.len(), n);
+    EXPECT_ANY_THROW(acc.del(0));
+    for (int i = 1; i < n; i += 2)
+    {
+        EXPECT_TRUE(acc.contains(i));
+        EXPECT_EQ(acc["key" + to_string(i)].get<int>(), i * 3);
+    }
+    for (int i = 0; i < n; i += 2)
+        EXPECT_FALSE(acc.contains(i));
+
+    // Reinsert into the freed slots
+    for (int i = 0; i < n; i += 2)
+        acc[i] = -i;
+    EXPECT_EQ(acc.len(), n + n / 2);
+    EXPECT_EQ(acc[998].get<int>(), -998);
+}
+
+TEST_F(ShmemHashMapTest, AccessorPathsAndConversion)
+{
+    acc = SHashMap();
+    acc["A"] = 1;
+    acc["B"] = vector<int>({1, 2, 3});
+    acc["C"] = map<string, int>({{"x", 10}, {"y", 20}});
+    acc[5] = SHashMap();
+    acc[5]["inner"] = 3.5f;
+
+    EXPECT_EQ(acc["B"][1].get<int>(), 2);
+    EXPECT_EQ(acc["C"]["y"].get<int>(), 20);
+    EXPECT_EQ(acc[5].typeId(), HashMap);
+    EXPECT_FLOAT_EQ(acc[5]["inner"].get<float>(), 3.5f);
+
+    // Iteration visits every key once
+    set<KeyType> visited;
+    for (auto it = acc.begin(); it != acc.end(); ++it)
+        visited.insert(it.path.back());
+    EXPECT_EQ(visited, set<KeyType>({"A", "B", "C", 5}));
+
+    acc = SHashMap();
+    acc["A"] = 1;
+    acc["BB"] = 11;
+    acc["CCC"] = 111;
+    map<string, int> m1 = {{"A", 1}, {"BB", 11}, {"CCC", 111}};
+    EXPECT_EQ(acc, m1);
+    EXPECT_EQ(acc.get<decltype(m1)>(), m1);
+
+    pybind11::object obj = acc.operator pybind11::object();
+    EXPECT_TRUE(pybind11::isinstance<pybind11::dict>(obj));
+    EXPECT_EQ(pybind11::cast<pybind11::dict>(obj).size(), 3u);
+}
+
+TEST_F(ShmemHashMapTest, FreesEverything)
+{
+    std::string emptyLayout = shmHeap.briefLayoutStr();
+
+    acc = SHashMap();
+    for (int i = 0; i < 200; i++)
+        acc["key" + to_string(i)] = vector<int>({i, i + 1});
+    acc = nullptr;
+
+    EXPECT_EQ(shmHeap.briefLayoutStr(), emptyLayout);
+}
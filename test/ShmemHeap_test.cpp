@@ -1,5 +1,10 @@
 #include <gtest/gtest.h>
 #include <cstring>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
 
 #include "ShmemHeap.h"
 
@@ -11,7 +16,7 @@ protected:
     void SetUp() override
     {
         // Initialize necessary objects/resources
-        shmHeap = new ShmemHeap("test_shm_heap", 80, 1024);
+        shmHeap = new ShmemHeap("test_shm_heap", 1024, 1024);
         // Set spdlog sink to a file
     }
 
@@ -29,16 +34,17 @@ protected:
 TEST_F(ShmemHeapTest, Constructor)
 {
     EXPECT_EQ(shmHeap->getName(), "test_shm_heap");
-    // EXPECT_EQ(shmHeap->staticCapacity(), 80);
+    // EXPECT_EQ(shmHeap->staticCapacity(), 1024);
     // EXPECT_EQ(shmHeap->heapCapacity(), 4096);
-    EXPECT_EQ(shmHeap->getCapacity(), 4096 + 80);
+    EXPECT_EQ(shmHeap->getCapacity(), 4096 + 1024);
     EXPECT_FALSE(shmHeap->isConnected());
     EXPECT_FALSE(shmHeap->ownsSharedMemory());
     EXPECT_EQ(shmHeap->getVersion(), -1);
 
     ShmemHeap another = ShmemHeap("another_shm_heap", 1, 4097);
     EXPECT_EQ(another.getName(), "another_shm_heap");
-    EXPECT_EQ(another.getCapacity(), 2 * 4096 + 4 * 8);
+    // Static space is padded up to the header (6 slots + free bin heads + stat counters + slab lists + segment table)
+    EXPECT_EQ(another.getCapacity(), 2 * 4096 + another.minStaticSize * unitSize);
 }
 
 TEST_F(ShmemHeapTest, Create)
@@ -46,20 +52,20 @@ TEST_F(ShmemHeapTest, Create)
     shmHeap->create();
     EXPECT_TRUE(shmHeap->isConnected());
     EXPECT_TRUE(shmHeap->ownsSharedMemory());
-    EXPECT_EQ(shmHeap->staticCapacity(), 80);
+    EXPECT_EQ(shmHeap->staticCapacity(), 1024);
     EXPECT_EQ(shmHeap->heapCapacity(), 4096);
 }
 
 TEST_F(ShmemHeapTest, Connect)
 {
     shmHeap->setHCap(4097);
-    shmHeap->setSCap(90);
+    shmHeap->setSCap(1030);
     shmHeap->create();
 
     ShmemHeap another = ShmemHeap("test_shm_heap", 1, 1000000);
     another.connect();
     // After the connect, the capacity should based on the shared memory
-    EXPECT_EQ(another.staticCapacity(), 96);
+    EXPECT_EQ(another.staticCapacity(), 1032);
     EXPECT_EQ(another.heapCapacity(), 4096 * 2);
 }
 
@@ -72,12 +78,12 @@ TEST_F(ShmemHeapTest, ResizeCapacityCorrectness)
     ShmemHeap another = ShmemHeap("test_shm_heap", 1, 1000000);
     another.connect();
 
-    EXPECT_EQ(another.staticCapacity(), 80);
+    EXPECT_EQ(another.staticCapacity(), 1024);
     EXPECT_EQ(another.heapCapacity(), 4096 * 2);
 
-    shmHeap->resize(90, 4096 * 2 + 1);
+    shmHeap->resize(1030, 4096 * 2 + 1);
 
-    EXPECT_EQ(another.staticCapacity(), 96);
+    EXPECT_EQ(another.staticCapacity(), 1032);
     EXPECT_EQ(another.heapCapacity(), 4096 * 3);
 }
 
@@ -97,7 +103,7 @@ TEST_F(ShmemHeapTest, ResizeContentCorrectness)
     shmHeap->shfree(ptr2);
     EXPECT_EQ(another.briefLayoutStr(), "256A, 7712E, 200A");
     // Create an allocated block at the end of the heap
-    shmHeap->resize(90, 4096 * 2 + 1);
+    shmHeap->resize(1030, 4096 * 2 + 1);
     EXPECT_EQ(another.briefLayoutStr(), "256A, 7712E, 200A, 4088E");
 
     shmHeap->shfree(ptr3);
@@ -111,10 +117,191 @@ TEST_F(ShmemHeapTest, ResizeContentCorrectness)
     // 4120 = 24 + 4096
     EXPECT_EQ(shmHeap->briefLayoutStr(), "256A, 11984A, 4120E");
 
-    EXPECT_EQ(another.staticCapacity(), 96);
+    EXPECT_EQ(another.staticCapacity(), 1032);
     EXPECT_EQ(another.heapCapacity(), 4096 * 4);
 }
 
+TEST_F(ShmemHeapTest, ResizeInPlace)
+{
+    shmHeap->create();
+    ShmemHeap another = ShmemHeap("test_shm_heap", 1, 1);
+    another.connect();
+
+    size_t ptr = shmHeap->shmalloc(100);
+    std::memset(shmHeap->heapHead() + ptr, 0x5A, 100);
+    Byte *head = shmHeap->heapHead();
+    Byte *anotherHead = another.heapHead();
+
+    // Neither the resizing process nor a connected one moves
+    shmHeap->resize(1 << 20);
+    EXPECT_EQ(shmHeap->heapHead(), head);
+    EXPECT_EQ(another.heapHead(), anotherHead);
+    EXPECT_EQ(another.heapCapacity(), 1 << 20);
+    EXPECT_EQ(anotherHead[ptr + 99], 0x5A);
+    EXPECT_EQ(another.briefLayoutStr(), "104A, " + std::to_string((1 << 20) - 2 * unitSize - 104) + "E");
+}
+
+TEST_F(ShmemHeapTest, SegmentedHeap)
+{
+    auto segmentExists = [](const std::string &name)
+    { return access(("/dev/shm/" + name).c_str(), F_OK) == 0; };
+
+    shmHeap->setSegmented(true);
+    EXPECT_TRUE(shmHeap->getSegmented());
+    shmHeap->create();
+    EXPECT_TRUE(shmHeap->isSegmented());
+    EXPECT_EQ(shmHeap->numSegments(), 1u);
+    // The heap ends on a page boundary, the next segment is mapped right behind it
+    size_t firstEnd = 2 * 4096 - 1024;
+    EXPECT_EQ(shmHeap->heapCapacity(), firstEnd);
+
+    ShmemHeap another = ShmemHeap("test_shm_heap", 1, 1);
+    another.connect();
+    EXPECT_TRUE(another.isSegmented());
+
+    size_t ptr = shmHeap->shmalloc(100);
+    std::memset(shmHeap->heapHead() + ptr, 0x5A, 100);
+    Byte *head = shmHeap->heapHead();
+    Byte *anotherHead = another.heapHead();
+
+    // Growth appends a segment, the block straddles both of them and nothing moves
+    size_t big = shmHeap->shmalloc(64 << 10);
+    std::memset(shmHeap->heapHead() + big, 0xC3, 64 << 10);
+    EXPECT_EQ(shmHeap->numSegments(), 2u);
+    EXPECT_EQ(shmHeap->heapHead(), head);
+    EXPECT_TRUE(segmentExists("test_shm_heap_seg1"));
+    EXPECT_EQ(shmHeap->segmentOf(ptr), (std::pair<size_t, size_t>(0, ptr)));
+    EXPECT_EQ(shmHeap->segmentOf(firstEnd + 8), (std::pair<size_t, size_t>(1, 8)));
+    EXPECT_ANY_THROW(shmHeap->segmentOf(shmHeap->heapCapacity()));
+
+    // A connected process maps the new segment on its next check, at the same relative place
+    EXPECT_EQ(another.numSegments(), 2u);
+    EXPECT_EQ(another.heapHead(), anotherHead);
+    EXPECT_EQ(anotherHead[ptr + 99], 0x5A);
+    EXPECT_EQ(anotherHead[big + (64 << 10) - 1], 0xC3);
+    EXPECT_TRUE(another.verifyHeap());
+
+    // An explicit resize appends as well, the static space is fixed
+    shmHeap->resize(shmHeap->heapCapacity() + 4096);
+    EXPECT_EQ(shmHeap->numSegments(), 3u);
+    EXPECT_ANY_THROW(shmHeap->resize(4096, -1));
+    EXPECT_EQ(shmHeap->staticCapacity(), 1024u);
+
+    // trim() drops the trailing segments covered by the last free block
+    shmHeap->shfree(big);
+    size_t capacity = shmHeap->heapCapacity();
+    EXPECT_EQ(shmHeap->trim(), capacity - firstEnd);
+    EXPECT_EQ(shmHeap->numSegments(), 1u);
+    EXPECT_FALSE(segmentExists("test_shm_heap_seg1"));
+    EXPECT_FALSE(segmentExists("test_shm_heap_seg2"));
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "104A, " + std::to_string(firstEnd - 112 - unitSize) + "E");
+
+    // Growing again reuses the range under a new name, the other process drops its stale mapping
+    big = shmHeap->shmalloc(64 << 10);
+    std::memset(shmHeap->heapHead() + big, 0x7E, 64 << 10);
+    EXPECT_TRUE(segmentExists("test_shm_heap_seg3"));
+    EXPECT_EQ(another.heapHead(), anotherHead);
+    EXPECT_EQ(another.numSegments(), 2u);
+    EXPECT_EQ(anotherHead[big + (64 << 10) - 1], 0x7E);
+    EXPECT_TRUE(another.verifyHeap());
+
+    shmHeap->unlink();
+    EXPECT_FALSE(segmentExists("test_shm_heap_seg3"));
+}
+
+TEST_F(ShmemHeapTest, MapOptions)
+{
+    auto residentPages = [](Byte *ptr, size_t size)
+    {
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        std::vector<unsigned char> pages((size + pageSize - 1) / pageSize);
+        EXPECT_EQ(mincore(ptr, size, pages.data()), 0);
+        size_t resident = 0;
+        for (unsigned char page : pages)
+            resident += page & 1;
+        return resident;
+    };
+
+    // A new heap only touches the pages it writes to
+    shmHeap->setHCap(1 << 20);
+    shmHeap->create();
+    EXPECT_LT(residentPages(shmHeap->staticSpaceHead(), shmHeap->getCapacity()), 4u);
+    shmHeap->unlink();
+
+    ShmemHeap heap("test_shm_heap_map_options", 1024, 1 << 20);
+    heap.setMapOptions(ShmemUtils::MapHugePages | ShmemUtils::MapPopulate | ShmemUtils::MapLock);
+    EXPECT_EQ(heap.getMapOptions(), ShmemUtils::MapHugePages | ShmemUtils::MapPopulate | ShmemUtils::MapLock);
+    heap.create();
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t pages = (heap.getCapacity() + pageSize - 1) / pageSize;
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(heap.staticSpaceHead()) % ShmemUtils::hugePageSize, 0u);
+    EXPECT_EQ(residentPages(heap.staticSpaceHead(), heap.getCapacity()), pages);
+
+    // The grown range is pre-faulted as well
+    heap.resize(2 << 20);
+    pages = (heap.getCapacity() + pageSize - 1) / pageSize;
+    EXPECT_EQ(residentPages(heap.staticSpaceHead(), heap.getCapacity()), pages);
+    EXPECT_EQ(heap.briefLayoutStr(), std::to_string((2 << 20) - unitSize) + "E");
+    heap.unlink();
+}
+
+TEST_F(ShmemHeapTest, ReleaseAndTrim)
+{
+    auto residentPages = [](Byte *ptr, size_t size)
+    {
+        // mincore wants a page aligned start
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        size_t skew = reinterpret_cast<uintptr_t>(ptr) % pageSize;
+        ptr -= skew;
+        size += skew;
+        std::vector<unsigned char> pages((size + pageSize - 1) / pageSize);
+        EXPECT_EQ(mincore(ptr, size, pages.data()), 0);
+        size_t resident = 0;
+        for (unsigned char page : pages)
+            resident += page & 1;
+        return resident;
+    };
+
+    shmHeap->setHCap(4 << 20);
+    shmHeap->setReleaseThreshold(1 << 20);
+    shmHeap->create();
+
+    // Small frees keep their pages
+    size_t small = shmHeap->shmalloc(64 << 10);
+    std::memset(shmHeap->heapHead() + small, 0xAB, 64 << 10);
+    size_t large = shmHeap->shmalloc(2 << 20);
+    std::memset(shmHeap->heapHead() + large, 0xCD, 2 << 20);
+    size_t guard = shmHeap->shmalloc(64);
+    shmHeap->shfree(small);
+    EXPECT_GE(residentPages(shmHeap->heapHead() + small, 64 << 10), 15u);
+
+    // A large free releases everything but the header and footer pages, the merged small block included
+    EXPECT_EQ(shmHeap->shfree(large), 0);
+    EXPECT_LE(residentPages(shmHeap->heapHead(), (2 << 20) + (64 << 10)), 3u);
+    EXPECT_TRUE(shmHeap->verifyHeap());
+    EXPECT_EQ(shmHeap->briefLayoutStr(), std::to_string((2 << 20) + (64 << 10) + 2 * unitSize - unitSize) + "E, 64A, " + std::to_string((4 << 20) - (2 << 20) - (64 << 10) - 3 * unitSize - 72) + "E");
+
+    // Released pages read as zeros once they are allocated again
+    size_t again = shmHeap->shmalloc(1 << 20);
+    EXPECT_EQ(shmHeap->heapHead()[again + (512 << 10)], static_cast<Byte>(0));
+    shmHeap->shfree(again);
+
+    // trim() cuts the trailing free pages, the last free block keeps the odd bytes
+    size_t capacity = shmHeap->heapCapacity();
+    size_t cut = shmHeap->trim();
+    EXPECT_GT(cut, 0u);
+    EXPECT_EQ(shmHeap->heapCapacity(), capacity - cut);
+    EXPECT_EQ(shmHeap->heapCapacity() % 4096, 0u);
+    EXPECT_LT(shmHeap->heapCapacity() - (guard + 64), 4096u + 4 * unitSize);
+    EXPECT_EQ(shmHeap->getCapacity(), shmHeap->staticCapacity() + shmHeap->heapCapacity());
+    EXPECT_TRUE(shmHeap->verifyHeap());
+    EXPECT_EQ(shmHeap->trim(), 0u);
+
+    // The heap grows again as usual
+    shmHeap->shmalloc(1 << 20);
+    EXPECT_TRUE(shmHeap->verifyHeap());
+}
+
 TEST_F(ShmemHeapTest, FullMallocAndFree)
 {
     shmHeap->setHCap(1);
@@ -192,4 +379,821 @@ TEST_F(ShmemHeapTest, BasicRealloc)
 
     size_t ptr2 = shmHeap->shrealloc(ptr1, 0x1FA);
     EXPECT_EQ(shmHeap->briefLayoutStr(), "512A, 3568E");
-}
\ No newline at end of file
+}
+TEST_F(ShmemHeapTest, InPlaceRealloc)
+{
+    shmHeap->create();
+
+    size_t ptr1 = shmHeap->shmalloc(64);
+    size_t ptr2 = shmHeap->shmalloc(64);
+    size_t ptr3 = shmHeap->shmalloc(64);
+    for (int i = 0; i < 64; i++)
+        shmHeap->heapHead()[ptr1 + i] = static_cast<Byte>(i);
+    shmHeap->shfree(ptr2);
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "64A, 64E, 64A, 3872E");
+
+    // Absorb the next free block and split off the remainder
+    EXPECT_EQ(shmHeap->shrealloc(ptr1, 100), ptr1);
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "104A, 24E, 64A, 3872E");
+    EXPECT_TRUE(shmHeap->verifyHeap());
+
+    // A remainder too small for a free block is absorbed as well
+    EXPECT_EQ(shmHeap->shrealloc(ptr1, 128), ptr1);
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "136A, 64A, 3872E");
+    EXPECT_TRUE(shmHeap->verifyHeap());
+
+    // Shrinking gives the spare bytes to a following free block, or splits one off
+    EXPECT_EQ(shmHeap->shrealloc(ptr3, 40), ptr3);
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "136A, 40A, 3896E");
+    EXPECT_EQ(shmHeap->shrealloc(ptr1, 64), ptr1);
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "64A, 64E, 40A, 3896E");
+    EXPECT_TRUE(shmHeap->verifyHeap());
+
+    // No room behind the block, the payload moves
+    size_t moved = shmHeap->shrealloc(ptr1, 200);
+    EXPECT_NE(moved, ptr1);
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "136E, 40A, 200A, 3688E");
+    for (int i = 0; i < 64; i++)
+        EXPECT_EQ(shmHeap->heapHead()[moved + i], static_cast<Byte>(i));
+    EXPECT_TRUE(shmHeap->verifyHeap());
+}
+
+TEST_F(ShmemHeapTest, HeapStats)
+{
+    shmHeap->create();
+    ShmemHeap::Stats stats = shmHeap->stats();
+    EXPECT_EQ(stats.heapCapacity, 4096u);
+    EXPECT_EQ(stats.allocatedBytes, 0u);
+    EXPECT_EQ(stats.freeBytes, 4096u);
+    EXPECT_EQ(stats.freeBlocks, 1u);
+    EXPECT_EQ(stats.largestFreeBlock, 4096u);
+    EXPECT_EQ(stats.allocCount, 0u);
+
+    size_t ptr1 = shmHeap->shmalloc(64);
+    size_t ptr2 = shmHeap->shmalloc(64);
+    size_t ptr3 = shmHeap->shmalloc(64);
+    shmHeap->shfree(ptr2);
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "64A, 64E, 64A, 3872E");
+    stats = shmHeap->stats();
+    EXPECT_EQ(stats.allocatedBytes, 2 * 72u);
+    EXPECT_EQ(stats.freeBytes, 72u + 3880u);
+    EXPECT_EQ(stats.freeBlocks, 2u);
+    EXPECT_EQ(stats.largestFreeBlock, 3880u);
+    EXPECT_EQ(stats.allocCount, 3u);
+    EXPECT_EQ(stats.freeCount, 1u);
+    EXPECT_TRUE(shmHeap->verifyHeap());
+
+    // Taking the largest block hands the title to the next one
+    size_t big = shmHeap->shmalloc(3872);
+    stats = shmHeap->stats();
+    EXPECT_EQ(stats.freeBlocks, 1u);
+    EXPECT_EQ(stats.largestFreeBlock, 72u);
+    shmHeap->shfree(big);
+
+    // Realloc in place and resize are counted, a double free is not
+    shmHeap->shrealloc(ptr1, 100);
+    shmHeap->resize(8192);
+    EXPECT_EQ(shmHeap->shfree(ptr2), -1);
+    stats = shmHeap->stats();
+    EXPECT_EQ(stats.heapCapacity, 8192u);
+    EXPECT_EQ(stats.reallocCount, 1u);
+    EXPECT_EQ(stats.resizeCount, 1u);
+    EXPECT_EQ(stats.freeCount, 2u);
+    EXPECT_EQ(stats.allocatedBytes, 112u + 72u);
+    EXPECT_EQ(stats.largestFreeBlock, 8192u - 112u - 32u - 72u);
+    EXPECT_TRUE(shmHeap->verifyHeap());
+
+    // Arena carves count as allocations, the region free counts every block in it
+    size_t region = shmHeap->beginArena(1024);
+    for (int i = 0; i < 10; i++)
+        shmHeap->shmalloc(24);
+    size_t used = shmHeap->endArena();
+    EXPECT_EQ(shmHeap->stats().allocCount, 3u + 1 + 1 + 10);
+    EXPECT_EQ(shmHeap->shfreeRegion(region, used), 0);
+    EXPECT_EQ(shmHeap->stats().freeCount, 2u + 1 + 10);
+    EXPECT_TRUE(shmHeap->verifyHeap());
+
+    // Another process reads the same counters
+    ShmemHeap reader("test_shm_heap");
+    reader.connect();
+    stats = shmHeap->stats();
+    ShmemHeap::Stats seen = reader.stats();
+    EXPECT_EQ(seen.allocatedBytes, stats.allocatedBytes);
+    EXPECT_EQ(seen.freeBlocks, stats.freeBlocks);
+    EXPECT_EQ(seen.allocCount, stats.allocCount);
+    EXPECT_EQ(seen.busyContention, 0u);
+    reader.close();
+
+    shmHeap->shfree(ptr1);
+    shmHeap->shfree(ptr3);
+    stats = shmHeap->stats();
+    EXPECT_EQ(stats.allocatedBytes, 0u);
+    EXPECT_EQ(stats.freeBlocks, 1u);
+    EXPECT_EQ(stats.largestFreeBlock, 8192u);
+}
+
+TEST_F(ShmemHeapTest, SlabAllocation)
+{
+    shmHeap->create();
+    // 5 words of page info, then the 24-byte slots
+    const size_t pageSize = 5 * unitSize + ShmemHeap::slabFirstPageSlots * 24;
+
+    // Slots of one class are packed back to back in one page, each behind its own 8-byte header
+    std::vector<size_t> slots;
+    for (size_t i = 0; i < ShmemHeap::slabFirstPageSlots; i++)
+    {
+        slots.push_back(shmHeap->shmallocSlab(12));
+        *reinterpret_cast<size_t *>(shmHeap->heapHead() + slots.back()) = i;
+    }
+    for (size_t i = 1; i < slots.size(); i++)
+        EXPECT_EQ(slots[i], slots[i - 1] + 24);
+    EXPECT_EQ(shmHeap->briefLayout(), std::vector<size_t>({pageSize, 4096 - pageSize - 2 * unitSize}));
+    EXPECT_TRUE(shmHeap->verifyHeap());
+
+    // A full class opens a page twice as large, other classes get pages of their own
+    size_t extra = shmHeap->shmallocSlab(16);
+    EXPECT_EQ(shmHeap->briefLayout()[1], 5 * unitSize + 2 * ShmemHeap::slabFirstPageSlots * 24);
+    size_t node = shmHeap->shmallocSlab(64);
+    EXPECT_EQ(shmHeap->briefLayout().size(), 4u);
+    EXPECT_EQ(shmHeap->briefLayout()[2], 5 * unitSize + ShmemHeap::slabFirstPageSlots * 72);
+    ShmemHeap::BlockHeader *nodeHeader = reinterpret_cast<ShmemHeap::BlockHeader *>(shmHeap->heapHead() + node) - 1;
+    EXPECT_TRUE(nodeHeader->S());
+    EXPECT_EQ(ShmemHeap::payloadCapacity(nodeHeader), 64u);
+    EXPECT_TRUE(shmHeap->verifyHeap());
+
+    // The slot header carries a busy bit like any block header
+    EXPECT_TRUE(nodeHeader->tryLock());
+    EXPECT_FALSE(nodeHeader->tryLock());
+    nodeHeader->unlock();
+    EXPECT_TRUE(nodeHeader->S());
+
+    // Too large for a slab: a regular block
+    size_t large = shmHeap->shmallocSlab(100);
+    EXPECT_FALSE((reinterpret_cast<ShmemHeap::BlockHeader *>(shmHeap->heapHead() + large) - 1)->S());
+    // A 40-byte payload would take a 72-byte slot, the 48-byte block is smaller
+    size_t between = shmHeap->shmallocSlab(40);
+    EXPECT_FALSE((reinterpret_cast<ShmemHeap::BlockHeader *>(shmHeap->heapHead() + between) - 1)->S());
+
+    // Freed slots are reused, a double free is refused
+    EXPECT_EQ(shmHeap->shfree(slots[3]), 0);
+    EXPECT_EQ(shmHeap->shfree(slots[3]), -1);
+    EXPECT_EQ(shmHeap->shmallocSlab(8), slots[3]);
+    for (size_t i = 0; i < slots.size(); i++)
+        if (i != 3)
+            EXPECT_EQ(*reinterpret_cast<size_t *>(shmHeap->heapHead() + slots[i]), i);
+
+    // A slot keeps its place while the payload fits and moves out once it does not
+    EXPECT_EQ(shmHeap->shrealloc(slots[0], 16), slots[0]);
+    size_t moved = shmHeap->shrealloc(slots[0], 40);
+    EXPECT_NE(moved, slots[0]);
+    EXPECT_EQ(*reinterpret_cast<size_t *>(shmHeap->heapHead() + moved), 0u);
+    EXPECT_TRUE(shmHeap->verifyHeap());
+
+    // Pages go back to the heap once their last slot is freed
+    for (size_t i = 1; i < slots.size(); i++)
+        EXPECT_EQ(shmHeap->shfree(slots[i]), 0);
+    EXPECT_EQ(shmHeap->shfree(extra), 0);
+    EXPECT_EQ(shmHeap->shfree(node), 0);
+    EXPECT_EQ(shmHeap->shfree(moved), 0);
+    EXPECT_EQ(shmHeap->shfree(large), 0);
+    EXPECT_EQ(shmHeap->shfree(between), 0);
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "4088E");
+    EXPECT_TRUE(shmHeap->verifyHeap());
+
+    // Arena mode bypasses the slabs, the region must not share pages with the rest of the heap
+    size_t region = shmHeap->beginArena(256);
+    size_t carved = shmHeap->shmallocSlab(12);
+    EXPECT_FALSE((reinterpret_cast<ShmemHeap::BlockHeader *>(shmHeap->heapHead() + carved) - 1)->S());
+    EXPECT_EQ(shmHeap->shfreeRegion(region, shmHeap->endArena()), 0);
+}
+
+TEST_F(ShmemHeapTest, SlabPagesGrow)
+{
+    shmHeap->create();
+
+    // Pages of a class double from slabFirstPageSlots slots up to slabSlotsPerPage
+    std::vector<size_t> slots;
+    for (size_t slotCount = ShmemHeap::slabFirstPageSlots, pages = 0; pages < 4; slotCount = std::min(2 * slotCount, ShmemHeap::slabSlotsPerPage), pages++)
+    {
+        for (size_t i = 0; i < slotCount; i++)
+            slots.push_back(shmHeap->shmallocSlab(32));
+        EXPECT_EQ(slots.back() - slots[slots.size() - slotCount], (slotCount - 1) * 40);
+        EXPECT_EQ(shmHeap->briefLayout()[pages], 5 * unitSize + slotCount * 40);
+    }
+    EXPECT_TRUE(shmHeap->verifyHeap());
+
+    for (size_t slot : slots)
+        EXPECT_EQ(shmHeap->shfree(slot), 0);
+    EXPECT_EQ(shmHeap->briefLayout().size(), 1u);
+    EXPECT_TRUE(shmHeap->verifyHeap());
+}
+
+TEST_F(ShmemHeapTest, InvalidSlabFree)
+{
+    shmHeap->create();
+
+    // A payload word that looks like a slab slot header is refused, the block behind it stays intact
+    size_t offset = shmHeap->shmalloc(64);
+    *reinterpret_cast<size_t *>(shmHeap->heapHead() + offset) = ShmemHeap::BlockHeader::slabBit | 48 | 0b001;
+    EXPECT_ANY_THROW(shmHeap->shfree(offset + unitSize));
+    *reinterpret_cast<size_t *>(shmHeap->heapHead() + offset) = ShmemHeap::BlockHeader::slabBit | 0b001;
+    EXPECT_ANY_THROW(shmHeap->shfree(offset + unitSize));
+
+    // Same for a real slot header moved off its slot boundary
+    size_t slot = shmHeap->shmallocSlab(8);
+    ShmemHeap::BlockHeader *header = reinterpret_cast<ShmemHeap::BlockHeader *>(shmHeap->heapHead() + slot) - 1;
+    *reinterpret_cast<size_t *>(shmHeap->heapHead() + slot) = ShmemHeap::BlockHeader::slabBit | (header->size() + unitSize) | 0b001;
+    EXPECT_ANY_THROW(shmHeap->shfree(slot + unitSize));
+
+    EXPECT_EQ(shmHeap->shfree(slot), 0);
+    EXPECT_EQ(shmHeap->shfree(offset), 0);
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "4088E");
+    EXPECT_TRUE(shmHeap->verifyHeap());
+}
+
+TEST_F(ShmemHeapTest, AlignedAllocation)
+{
+    shmHeap->create();
+    uintptr_t head = reinterpret_cast<uintptr_t>(shmHeap->heapHead());
+
+    // The gaps in front of the aligned blocks stay on the free lists
+    std::vector<size_t> offsets;
+    for (size_t alignment : {16, 32, 64, 256, 4096})
+    {
+        size_t offset = shmHeap->shmemalign(100, alignment);
+        EXPECT_EQ((head + offset) % alignment, 0u) << "alignment " << alignment;
+        EXPECT_GE(ShmemHeap::payloadCapacity(reinterpret_cast<ShmemHeap::BlockHeader *>(shmHeap->heapHead() + offset) - 1), 100u);
+        *reinterpret_cast<size_t *>(shmHeap->heapHead() + offset) = alignment;
+        offsets.push_back(offset);
+        EXPECT_TRUE(shmHeap->verifyHeap());
+    }
+    head = reinterpret_cast<uintptr_t>(shmHeap->heapHead()); // The page alignment may have grown the heap
+
+    // Align the data behind an 8-byte object header instead of the payload itself
+    size_t shifted = shmHeap->shmemalign(200, 64, unitSize);
+    EXPECT_EQ((head + shifted + unitSize) % 64, 0u);
+    offsets.push_back(shifted);
+
+    // Small alignments are plain shmalloc, invalid ones are refused
+    size_t plain = shmHeap->shmemalign(24, unitSize);
+    EXPECT_EQ((head + plain) % unitSize, 0u);
+    offsets.push_back(plain);
+    EXPECT_EQ(shmHeap->shmemalign(0, 64), 0u);
+    EXPECT_ANY_THROW(shmHeap->shmemalign(64, 48));
+    EXPECT_ANY_THROW(shmHeap->shmemalign(64, 1UL << 20));
+    EXPECT_ANY_THROW(shmHeap->shmemalign(64, 64, 4));
+    EXPECT_TRUE(shmHeap->verifyHeap());
+
+    // Aligned blocks are freed and reallocated like any other
+    const std::vector<size_t> written = {16, 32, 64, 256, 4096};
+    for (size_t i = 0; i < written.size(); i++)
+        EXPECT_EQ(*reinterpret_cast<size_t *>(shmHeap->heapHead() + offsets[i]), written[i]);
+    size_t moved = shmHeap->shrealloc(offsets[0], 4000);
+    EXPECT_EQ(*reinterpret_cast<size_t *>(shmHeap->heapHead() + moved), 16u);
+    offsets[0] = moved;
+
+    // Passing the alignment keeps it when the payload moves, also for the data behind an object header
+    size_t movedAligned = shmHeap->shrealloc(offsets[2], 6000, 64);
+    head = reinterpret_cast<uintptr_t>(shmHeap->heapHead());
+    EXPECT_NE(movedAligned, offsets[2]);
+    EXPECT_EQ((head + movedAligned) % 64, 0u);
+    EXPECT_EQ(*reinterpret_cast<size_t *>(shmHeap->heapHead() + movedAligned), 64u);
+    offsets[2] = movedAligned;
+    size_t movedShifted = shmHeap->shrealloc(shifted, 5000, 64);
+    head = reinterpret_cast<uintptr_t>(shmHeap->heapHead());
+    EXPECT_NE(movedShifted, shifted);
+    EXPECT_EQ((head + movedShifted + unitSize) % 64, 0u);
+    offsets[5] = movedShifted;
+    EXPECT_ANY_THROW(shmHeap->shrealloc(offsets[1], 5000, 48));
+    EXPECT_TRUE(shmHeap->verifyHeap());
+    for (size_t offset : offsets)
+        EXPECT_EQ(shmHeap->shfree(offset), 0);
+    EXPECT_EQ(shmHeap->briefLayout().size(), 1u);
+    EXPECT_TRUE(shmHeap->verifyHeap());
+}
+
+TEST_F(ShmemHeapTest, BatchAllocation)
+{
+    shmHeap->create();
+
+    // Blocks are carved back to back and padded like shmalloc(), a 0 size gets no block
+    const size_t sizes[] = {100, 0, 8, 200, 24};
+    size_t offsets[5];
+    shmHeap->shmallocBatch(sizes, 5, offsets);
+    EXPECT_EQ(offsets[1], 0u);
+    EXPECT_EQ(offsets[2], offsets[0] + 104 + unitSize);
+    EXPECT_EQ(offsets[3], offsets[2] + 24 + unitSize);
+    EXPECT_EQ(offsets[4], offsets[3] + 200 + unitSize);
+    EXPECT_EQ(shmHeap->briefLayout(), std::vector<size_t>({104, 24, 200, 24, 4096 - 384 - unitSize}));
+    EXPECT_EQ(shmHeap->stats().allocCount, 4u);
+    EXPECT_TRUE(shmHeap->verifyHeap());
+
+    // Each block is an ordinary block for shrealloc() and shfree()
+    std::memset(shmHeap->heapHead() + offsets[3], 7, 200);
+    EXPECT_EQ(shmHeap->shfree(offsets[2]), 0);
+    EXPECT_EQ(shmHeap->shrealloc(offsets[0], 120), offsets[0]);
+    EXPECT_EQ(shmHeap->heapHead()[offsets[3] + 199], 7);
+    EXPECT_TRUE(shmHeap->verifyHeap());
+
+    // A batch larger than the heap grows it once
+    std::vector<size_t> manySizes(200, 40), manyOffsets(200);
+    shmHeap->shmallocBatch(manySizes.data(), manySizes.size(), manyOffsets.data());
+    for (size_t i = 1; i < manyOffsets.size(); i++)
+        EXPECT_EQ(manyOffsets[i], manyOffsets[i - 1] + 48);
+    EXPECT_GT(shmHeap->heapCapacity(), 4096u);
+    EXPECT_TRUE(shmHeap->verifyHeap());
+
+    std::shuffle(manyOffsets.begin(), manyOffsets.end(), std::mt19937(1));
+    for (size_t offset : manyOffsets)
+        EXPECT_EQ(shmHeap->shfree(offset), 0);
+    for (size_t i : {0, 3, 4})
+        EXPECT_EQ(shmHeap->shfree(offsets[i]), 0);
+    EXPECT_EQ(shmHeap->briefLayout().size(), 1u);
+    EXPECT_TRUE(shmHeap->verifyHeap());
+
+    // Arena mode carves the requests from the arena
+    size_t region = shmHeap->beginArena(1024);
+    shmHeap->shmallocBatch(sizes, 5, offsets);
+    EXPECT_EQ(offsets[0], region + unitSize);
+    EXPECT_EQ(shmHeap->shfreeRegion(region, shmHeap->endArena()), 0);
+    EXPECT_TRUE(shmHeap->verifyHeap());
+}
+
+TEST_F(ShmemHeapTest, TraceRecording)
+{
+    const std::string tracePath = "/tmp/test_shm_heap.trace";
+    std::remove(tracePath.c_str());
+    shmHeap->create();
+    EXPECT_FALSE(shmHeap->isTracing());
+    EXPECT_ANY_THROW(shmHeap->startTrace("/nonexistent/dir/trace"));
+
+    shmHeap->startTrace(tracePath);
+    EXPECT_TRUE(shmHeap->isTracing());
+    size_t block = shmHeap->shmalloc(100);
+    // Moves and grows the heap, the inner shmalloc(), resize() and shfree() are not recorded
+    size_t moved = shmHeap->shrealloc(block, 5000);
+    size_t slot = shmHeap->shmallocSlab(12);
+    size_t aligned = shmHeap->shmemalign(64, 64);
+    EXPECT_EQ(shmHeap->shfree(slot), 0);
+    EXPECT_EQ(shmHeap->shfree(moved), 0);
+    EXPECT_EQ(shmHeap->shfree(aligned), 0);
+    shmHeap->resize(static_cast<long>(shmHeap->heapCapacity() + 4096));
+    size_t cut = shmHeap->trim();
+    // The region is reserved and given back by the arena calls, the shmalloc() and shfree() behind them are not recorded
+    size_t region = shmHeap->beginArena(256);
+    size_t carved = shmHeap->shmalloc(24);
+    size_t used = shmHeap->endArena();
+    EXPECT_EQ(shmHeap->shfreeRegion(region, used), 0);
+    shmHeap->stopTrace();
+    shmHeap->shmalloc(10);
+    EXPECT_FALSE(shmHeap->isTracing());
+
+    std::vector<ShmemHeap::TraceRecord> records(32);
+    FILE *file = std::fopen(tracePath.c_str(), "rb");
+    ASSERT_NE(file, nullptr);
+    records.resize(std::fread(records.data(), sizeof(ShmemHeap::TraceRecord), records.size(), file));
+    std::fclose(file);
+    std::remove(tracePath.c_str());
+
+    std::vector<uint32_t> ops;
+    for (const ShmemHeap::TraceRecord &record : records)
+        ops.push_back(record.op);
+    EXPECT_EQ(ops, std::vector<uint32_t>({ShmemHeap::TraceMalloc, ShmemHeap::TraceRealloc, ShmemHeap::TraceMallocSlab, ShmemHeap::TraceMemalign,
+                                          ShmemHeap::TraceFree, ShmemHeap::TraceFree, ShmemHeap::TraceFree, ShmemHeap::TraceResize, ShmemHeap::TraceTrim,
+                                          ShmemHeap::TraceBeginArena, ShmemHeap::TraceMalloc, ShmemHeap::TraceEndArena, ShmemHeap::TraceFreeRegion}));
+    ASSERT_EQ(records.size(), 13u);
+    EXPECT_EQ(records[0].size, 100u);
+    EXPECT_EQ(records[0].result, block);
+    EXPECT_EQ(records[1].offset, block);
+    EXPECT_EQ(records[1].size, 5000u);
+    EXPECT_EQ(records[1].result, moved);
+    EXPECT_EQ(records[2].result, slot);
+    EXPECT_EQ(records[3].offset, 64u);
+    EXPECT_EQ(records[3].result, aligned);
+    EXPECT_EQ(records[4].offset, slot);
+    EXPECT_EQ(records[5].offset, moved);
+    EXPECT_EQ(records[7].offset, static_cast<uint64_t>(-1));
+    EXPECT_EQ(records[8].result, cut);
+    EXPECT_EQ(records[9].size, 256u);
+    EXPECT_EQ(records[9].result, region);
+    EXPECT_EQ(records[10].result, carved);
+    EXPECT_EQ(records[11].result, used);
+    EXPECT_EQ(records[12].offset, region);
+    EXPECT_EQ(records[12].size, used);
+    EXPECT_EQ(records[12].result, 0u);
+    for (size_t i = 1; i < records.size(); i++)
+        EXPECT_LE(records[i - 1].timestamp, records[i].timestamp);
+}
+
+TEST_F(ShmemHeapTest, BinIndex)
+{
+    EXPECT_EQ(ShmemHeap::binIndex(32), 0);
+    EXPECT_EQ(ShmemHeap::binIndex(40), 1);
+    EXPECT_EQ(ShmemHeap::binIndex(280), ShmemHeap::numExactBins - 1);
+    EXPECT_EQ(ShmemHeap::binIndex(288), ShmemHeap::numExactBins);
+    EXPECT_EQ(ShmemHeap::binIndex(504), ShmemHeap::numExactBins);
+    EXPECT_EQ(ShmemHeap::binIndex(512), ShmemHeap::numExactBins + 1);
+    EXPECT_EQ(ShmemHeap::binIndex(4096), ShmemHeap::numExactBins + 4);
+    EXPECT_EQ(ShmemHeap::binIndex(SIZE_MAX & ~0b111), ShmemHeap::numBins - 1);
+}
+
+TEST_F(ShmemHeapTest, BinnedAllocation)
+{
+    shmHeap->create();
+    EXPECT_EQ(shmHeap->freeBinBitmap(), 1UL << ShmemHeap::binIndex(4096));
+
+    size_t ptr1 = shmHeap->shmalloc(24);
+    size_t ptr2 = shmHeap->shmalloc(64);
+    size_t ptr3 = shmHeap->shmalloc(24);
+    size_t ptr4 = shmHeap->shmalloc(600);
+    size_t ptr5 = shmHeap->shmalloc(24);
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "24A, 64A, 24A, 600A, 24A, 3312E");
+
+    shmHeap->shfree(ptr2);
+    shmHeap->shfree(ptr4);
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "24A, 64E, 24A, 600E, 24A, 3312E");
+    EXPECT_TRUE(shmHeap->freeBinBitmap() & (1UL << ShmemHeap::binIndex(72)));
+    EXPECT_EQ(shmHeap->freeBinOffset(ShmemHeap::binIndex(72)), ptr2 - unitSize);
+    EXPECT_EQ(shmHeap->freeBinOffset(ShmemHeap::binIndex(608)), ptr4 - unitSize);
+
+    // An exact bin hit reuses the hole instead of splitting the tail block
+    EXPECT_EQ(shmHeap->shmalloc(64), ptr2);
+    EXPECT_FALSE(shmHeap->freeBinBitmap() & (1UL << ShmemHeap::binIndex(72)));
+
+    // Best fit inside a log-spaced bin
+    EXPECT_EQ(shmHeap->shmalloc(500), ptr4);
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "24A, 64A, 24A, 504A, 88E, 24A, 3312E");
+    EXPECT_EQ(shmHeap->freeBinOffset(ShmemHeap::binIndex(96)), ptr4 + 504);
+
+    // Nothing fits in a small bin, the smallest non-empty larger bin is used
+    size_t ptr6 = shmHeap->shmalloc(200);
+    EXPECT_EQ(ptr6, ptr5 + 32);
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "24A, 64A, 24A, 504A, 88E, 24A, 200A, 3104E");
+
+    shmHeap->shfree(ptr1);
+    shmHeap->shfree(ptr3);
+    shmHeap->shfree(ptr5);
+    shmHeap->shfree(ptr2);
+    shmHeap->shfree(ptr4);
+    shmHeap->shfree(ptr6);
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "4088E");
+    EXPECT_EQ(shmHeap->freeBinBitmap(), 1UL << ShmemHeap::binIndex(4096));
+    EXPECT_TRUE(shmHeap->verifyHeap());
+}
+
+TEST_F(ShmemHeapTest, GrowthPolicy)
+{
+    shmHeap->create();
+    EXPECT_EQ(shmHeap->getGrowthFactor(), 2.0);
+    EXPECT_ANY_THROW(shmHeap->setGrowthFactor(0.5));
+
+    // A miss larger than the doubled heap grows by the request rounded up to pages
+    shmHeap->shmalloc(5000);
+    EXPECT_EQ(shmHeap->heapCapacity(), 4096 + 8192);
+
+    // Many small misses grow geometrically, one resize per doubling
+    size_t resizes = 0;
+    size_t lastCapacity = shmHeap->heapCapacity();
+    for (int i = 0; i < 1000; i++)
+    {
+        shmHeap->shmalloc(1000);
+        if (shmHeap->heapCapacity() != lastCapacity)
+        {
+            EXPECT_GE(shmHeap->heapCapacity(), 2 * lastCapacity);
+            lastCapacity = shmHeap->heapCapacity();
+            resizes++;
+        }
+    }
+    EXPECT_LE(resizes, 7u);
+
+    // Linear growth by a fixed step
+    shmHeap->setGrowthFactor(1.0);
+    shmHeap->setMinGrowSize(1 << 16);
+    while (shmHeap->heapCapacity() == lastCapacity)
+        shmHeap->shmalloc(1000);
+    EXPECT_EQ(shmHeap->heapCapacity(), lastCapacity + (1 << 16));
+
+    // The cap is never exceeded
+    shmHeap->setMaxHCap(shmHeap->heapCapacity() + 5000);
+    EXPECT_EQ(shmHeap->getMaxHCap(), shmHeap->heapCapacity() + 4096);
+    EXPECT_ANY_THROW(shmHeap->shmalloc(1 << 20));
+    EXPECT_EQ(shmHeap->heapCapacity(), shmHeap->getMaxHCap() - 4096);
+    EXPECT_TRUE(shmHeap->verifyHeap());
+}
+
+TEST_F(ShmemHeapTest, ArenaAllocation)
+{
+    shmHeap->create();
+
+    // An empty region is rejected and leaves arena mode off
+    EXPECT_ANY_THROW(shmHeap->beginArena(0));
+    EXPECT_FALSE(shmHeap->inArena());
+
+    size_t region = shmHeap->beginArena(2048);
+    EXPECT_TRUE(shmHeap->inArena());
+    EXPECT_ANY_THROW(shmHeap->beginArena(64));
+
+    // Blocks are carved back to back from the front of the region
+    size_t ptr1 = shmHeap->shmalloc(24);
+    size_t ptr2 = shmHeap->shmalloc(24);
+    size_t ptr3 = shmHeap->shmalloc(24);
+    EXPECT_EQ(ptr1, region + unitSize);
+    EXPECT_EQ(ptr2, ptr1 + 32);
+    EXPECT_EQ(ptr3, ptr2 + 32);
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "24A, 24A, 24A, 1952A, 2032E");
+
+    // Carved blocks are regular blocks
+    EXPECT_EQ(shmHeap->shfree(ptr2), 0);
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "24A, 24E, 24A, 1952A, 2032E");
+    EXPECT_TRUE(shmHeap->verifyHeap());
+
+    EXPECT_EQ(shmHeap->endArena(), 96u);
+    EXPECT_FALSE(shmHeap->inArena());
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "24A, 24E, 24A, 3992E");
+
+    // The whole region goes back at once
+    EXPECT_EQ(shmHeap->shfreeRegion(region, 96), 0);
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "4088E");
+    EXPECT_TRUE(shmHeap->verifyHeap());
+
+    // A freed last block merges with the unused tail, the region still frees cleanly
+    region = shmHeap->beginArena(1024);
+    ptr1 = shmHeap->shmalloc(100);
+    ptr2 = shmHeap->shmalloc(100);
+    size_t outside = shmHeap->shmalloc(1024); // Overflows the arena, served by the free bins
+    shmHeap->shfree(ptr2);
+    size_t used = shmHeap->endArena();
+    EXPECT_EQ(used, 2 * 112u);
+    EXPECT_EQ(shmHeap->shfreeRegion(region + unitSize, used), -1);
+    EXPECT_EQ(shmHeap->shfreeRegion(region, used), 0);
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "1024E, 1024A, 2024E");
+    EXPECT_EQ(shmHeap->shfree(outside), 0);
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "4088E");
+    EXPECT_TRUE(shmHeap->verifyHeap());
+}
+
+TEST_F(ShmemHeapTest, BusyBitIsExclusive)
+{
+    shmHeap->create();
+    size_t ptr = shmHeap->shmalloc(24);
+    ShmemHeap::BlockHeader *header = reinterpret_cast<ShmemHeap::BlockHeader *>(shmHeap->heapHead() + ptr) - 1;
+
+    EXPECT_TRUE(header->tryLock());
+    EXPECT_FALSE(header->tryLock());
+    EXPECT_EQ(header->lock(0), ETIMEDOUT);
+    EXPECT_TRUE(header->A()); // Other bits are untouched
+
+    header->unlock();
+    EXPECT_EQ(header->lock(0), 0);
+    header->unlock();
+    EXPECT_FALSE(header->B());
+}
+
+TEST_F(ShmemHeapTest, DeadBinsOwnerIsReplaced)
+{
+    shmHeap->create();
+
+    // A process that exited while holding the bins lock, its pid is left in the lock word (static slot 4)
+    pid_t pid = fork();
+    if (pid == 0)
+        _exit(0);
+    waitpid(pid, nullptr, 0);
+    std::atomic<size_t> *binsLock = reinterpret_cast<std::atomic<size_t> *>(shmHeap->heapHead() - shmHeap->staticCapacity()) + 4;
+    binsLock->store(static_cast<size_t>(pid));
+
+    size_t ptr = shmHeap->shmalloc(24);
+    EXPECT_NE(ptr, 0u);
+    EXPECT_EQ(binsLock->load(), 0u);
+    EXPECT_EQ(shmHeap->shfree(ptr), 0);
+    EXPECT_TRUE(shmHeap->verifyHeap());
+}
+
+TEST_F(ShmemHeapTest, ParkedWaiterIsWoken)
+{
+    shmHeap->create();
+    size_t ptr = shmHeap->shmalloc(24);
+    ShmemHeap::BlockHeader *header = reinterpret_cast<ShmemHeap::BlockHeader *>(shmHeap->heapHead() + ptr) - 1;
+    size_t size = header->size();
+
+    ASSERT_TRUE(header->tryLock());
+
+    // Timeouts still hold once the waiter is parked
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(header->wait(20), ETIMEDOUT);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+    EXPECT_TRUE(header->size_BPA & ShmemHeap::BlockHeader::parkedBit);
+    EXPECT_EQ(header->size(), size);
+
+    // Another process parks on the header until we unlock it
+    pid_t pid = fork();
+    if (pid == 0)
+        _exit(header->lock(5000) == 0 ? 0 : 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    header->unlock();
+
+    int status = -1;
+    waitpid(pid, &status, 0);
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+
+    // The child still holds the busy bit, the parked bit is gone
+    EXPECT_TRUE(header->B());
+    EXPECT_FALSE(header->size_BPA & ShmemHeap::BlockHeader::parkedBit);
+    header->unlock();
+    EXPECT_EQ(shmHeap->briefLayoutStr(), "24A, 4056E");
+}
+
+TEST_F(ShmemHeapTest, ConnectAndWaitBlockUntilReady)
+{
+    // The other process creates the heap late, then posts the counter semaphore
+    int donePipe[2];
+    ASSERT_EQ(pipe(donePipe), 0);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(donePipe[1]);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        ShmemHeap late("test_shm_heap_late", 1024, 1024);
+        late.create();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        late.postCounterSem();
+        // Keep the heap alive until the parent is done with it
+        char done;
+        (void)read(donePipe[0], &done, 1);
+        late.unlink();
+        _exit(0);
+    }
+    close(donePipe[0]);
+
+    ShmemHeap another("test_shm_heap_late", 1, 1);
+    another.connect();
+
+    auto start = std::chrono::steady_clock::now();
+    another.waitCounterSem();
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+    EXPECT_EQ(another.getCounterSemValue(), 0);
+    // Posted after create() finished, so the static header is initialized by now
+    EXPECT_EQ(another.heapCapacity(), 4096);
+
+    close(donePipe[1]);
+    int status = -1;
+    waitpid(pid, &status, 0);
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+}
+
+TEST_F(ShmemHeapTest, ConcurrentAllocation)
+{
+    // Large enough that no process ever needs to resize
+    shmHeap->setHCap(1 << 20);
+    shmHeap->create();
+
+    const int numProcesses = 4;
+    const int numOperations = 20000;
+    // Children block on the pipe until all of them are forked, so they really run concurrently
+    int startPipe[2];
+    ASSERT_EQ(pipe(startPipe), 0);
+    std::vector<pid_t> children;
+    for (int p = 0; p < numProcesses; p++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            char start;
+            close(startPipe[1]);
+            if (read(startPipe[0], &start, 1) != 0)
+                _exit(3);
+
+            // Each process stamps its payloads and checks nobody else wrote into them
+            std::mt19937 rng(p);
+            std::vector<std::pair<size_t, size_t>> live; // (offset, words)
+            auto check = [&](size_t offset, size_t words)
+            {
+                size_t *payload = reinterpret_cast<size_t *>(shmHeap->heapHead() + offset);
+                for (size_t i = 0; i < words; i++)
+                    if (payload[i] != ((static_cast<size_t>(getpid()) << 32) | i))
+                        return false;
+                return true;
+            };
+            for (int i = 0; i < numOperations; i++)
+            {
+                if (live.size() < 64 && (live.empty() || rng() % 2 == 0))
+                {
+                    size_t size = 8 + rng() % 512;
+                    // Small payloads go through the slab pages, which are shared between the processes too
+                    size_t offset = size <= 64 ? shmHeap->shmallocSlab(size) : shmHeap->shmalloc(size);
+                    size_t *payload = reinterpret_cast<size_t *>(shmHeap->heapHead() + offset);
+                    for (size_t w = 0; w < size / unitSize; w++)
+                        payload[w] = (static_cast<size_t>(getpid()) << 32) | w;
+                    live.emplace_back(offset, size / unitSize);
+                }
+                else
+                {
+                    size_t idx = rng() % live.size();
+                    if (!check(live[idx].first, live[idx].second))
+                        _exit(1);
+                    if (shmHeap->shfree(live[idx].first) != 0)
+                        _exit(2);
+                    live[idx] = live.back();
+                    live.pop_back();
+                }
+            }
+            for (auto &[offset, words] : live)
+            {
+                if (!check(offset, words))
+                    _exit(1);
+                shmHeap->shfree(offset);
+            }
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+    close(startPipe[0]);
+    close(startPipe[1]);
+
+    for (pid_t pid : children)
+    {
+        int status = -1;
+        waitpid(pid, &status, 0);
+        EXPECT_TRUE(WIFEXITED(status));
+        EXPECT_EQ(WEXITSTATUS(status), 0);
+    }
+
+    EXPECT_TRUE(shmHeap->verifyHeap());
+    EXPECT_EQ(shmHeap->briefLayoutStr(), std::to_string((1 << 20) - unitSize) + "E");
+    ShmemHeap::Stats stats = shmHeap->stats();
+    EXPECT_EQ(stats.allocCount, stats.freeCount);
+    EXPECT_EQ(stats.allocatedBytes, 0u);
+    EXPECT_GE(stats.allocCount, static_cast<size_t>(numProcesses * numOperations / 2));
+}
+
+TEST_F(ShmemHeapTest, ReadersFollowResize)
+{
+    shmHeap->create();
+
+    const int numReaders = 3;
+    const int numResizes = 64;
+    const size_t words = 256;
+    size_t dataOffset = shmHeap->shmalloc(words * sizeof(size_t));
+    size_t flagOffset = shmHeap->shmalloc(sizeof(size_t));
+    for (size_t i = 0; i < words; i++)
+        reinterpret_cast<size_t *>(shmHeap->heapHead() + dataOffset)[i] = i * i;
+    reinterpret_cast<std::atomic<size_t> *>(shmHeap->heapHead() + flagOffset)->store(0);
+
+    int startPipe[2];
+    ASSERT_EQ(pipe(startPipe), 0);
+    std::vector<pid_t> children;
+    for (int p = 0; p < numReaders; p++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            char start;
+            close(startPipe[1]);
+            if (read(startPipe[0], &start, 1) != 0)
+                _exit(3);
+
+            // Readers never call resize, they only see the heap growing under them
+            size_t epochs = 0, lastEpoch = shmHeap->resizeEpoch();
+            while (true)
+            {
+                bool done = reinterpret_cast<std::atomic<size_t> *>(shmHeap->heapHead() + flagOffset)->load() != 0;
+                size_t capacity = shmHeap->heapCapacity();
+                const size_t *data = reinterpret_cast<const size_t *>(shmHeap->heapHead() + dataOffset);
+                for (size_t i = 0; i < words; i++)
+                    if (data[i] != i * i)
+                        _exit(1);
+                // The grown tail must be mapped by the time heapHead() returns
+                if (shmHeap->heapHead()[capacity - 1] != static_cast<Byte>(0))
+                    _exit(2);
+                if (shmHeap->resizeEpoch() != lastEpoch)
+                {
+                    lastEpoch = shmHeap->resizeEpoch();
+                    epochs++;
+                }
+                if (done)
+                    break;
+            }
+            _exit(lastEpoch == numResizes && epochs > 0 ? 0 : 4);
+        }
+        children.push_back(pid);
+    }
+    close(startPipe[0]);
+    close(startPipe[1]);
+
+    for (int i = 0; i < numResizes; i++)
+    {
+        shmHeap->resize(shmHeap->heapCapacity() + 4096);
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    reinterpret_cast<std::atomic<size_t> *>(shmHeap->heapHead() + flagOffset)->store(1);
+
+    for (pid_t pid : children)
+    {
+        int status = -1;
+        waitpid(pid, &status, 0);
+        EXPECT_TRUE(WIFEXITED(status));
+        EXPECT_EQ(WEXITSTATUS(status), 0);
+    }
+    EXPECT_EQ(shmHeap->resizeEpoch(), static_cast<size_t>(numResizes));
+    EXPECT_EQ(shmHeap->heapCapacity(), 4096 + numResizes * 4096);
+}
@@ -50,7 +50,15 @@ TEST_F(ShmemListTest, BasicAssignmentAndMemoryUsage)
 
     v = {{1}, {1, 2}, {1, 2, 3}, {1, 2, 3, 4}, {1, 2, 3, 4, 5}, {1, 2, 3, 4, 5, 6}, {1, 2, 3, 4, 5, 6, 7}, {1, 2, 3, 4, 5, 6, 7, 8}, {1, 2, 3, 4, 5, 6, 7, 8, 9}, {1, 2, 3, 4, 5, 6, 7, 8, 9, 10}};
     acc = v;
+    // The elements are allocated in one batch behind the list space, {1} included
     EXPECT_EQ(shmHeap.briefLayout(), std::vector<size_t>({24, 8 * 10, 24, 24, 24, 24, 32, 32, 40, 40, 48, 48, 3552}));
+    EXPECT_TRUE(shmHeap.verifyHeap());
+
+    // Appending to the batched list keeps working, freeing it leaves a single free block
+    acc.add(std::vector<int>({1, 2, 3}));
+    EXPECT_EQ(acc[10][2].get<int>(), 3);
+    acc = nullptr;
+    EXPECT_EQ(shmHeap.briefLayout(), std::vector<size_t>({4096 - unitSize}));
 }
 
 TEST_F(ShmemListTest, TypeIdAndLen)
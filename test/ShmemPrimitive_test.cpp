@@ -3,6 +3,9 @@
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <cstring>
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include "ShmemPrimitive.h"
 #include "ShmemAccessor.h"
 using namespace std;
@@ -43,7 +46,7 @@ TEST_F(ShmemPrimitiveTest, BasicAssignmentAndMemoryUsage)
     size_t expectedMemSize = 0;
 
     acc = 1;
-    expectedMemSize = 24; // min payload is 24
+    expectedMemSize = 5 * 8 + ShmemHeap::slabFirstPageSlots * 24; // Scalars share a slab page: 5 words of page info + 24-byte slots
     EXPECT_EQ(shmHeap.briefLayout(), std::vector<size_t>({expectedMemSize, 4096 - expectedMemSize - unitSize * 2}));
     EXPECT_EQ(acc.toString(), "(P:int:1)[1]");
 
@@ -70,6 +73,27 @@ TEST_F(ShmemPrimitiveTest, BasicAssignmentAndMemoryUsage)
     // std::cout << acc.toString(10) << std::endl;
 }
 
+TEST_F(ShmemPrimitiveTest, AlignedArrays)
+{
+    shmHeap.setArrayAlignment(64);
+    EXPECT_EQ(shmHeap.getArrayAlignment(), 64u);
+    EXPECT_ANY_THROW(shmHeap.setArrayAlignment(48));
+
+    // The data behind the object header starts on a cache line
+    acc = std::vector<float>(100, 1.5f);
+    uintptr_t data = reinterpret_cast<uintptr_t>(shmHeap.entrance()) + sizeof(ShmemPrimitive_);
+    EXPECT_EQ(data % 64, 0u);
+    EXPECT_FLOAT_EQ(acc[99].get<float>(), 1.5f);
+    EXPECT_TRUE(shmHeap.verifyHeap());
+
+    // Scalars and arrays shorter than the alignment are not padded
+    acc = std::vector<int>(4, 1);
+    EXPECT_EQ(shmHeap.briefLayout(), std::vector<size_t>({24, 4096 - 24 - unitSize * 2}));
+
+    acc = nullptr;
+    EXPECT_EQ(shmHeap.briefLayout(), std::vector<size_t>({4096 - unitSize}));
+}
+
 TEST_F(ShmemPrimitiveTest, TypeIdAndLen)
 {
     // Single Primitive
@@ -127,6 +151,62 @@ TEST_F(ShmemPrimitiveTest, SetAndGetElement)
     EXPECT_EQ(acc.typeId(), Char);
 }
 
+TEST_F(ShmemPrimitiveTest, ReadsRetryAcrossWrites)
+{
+    acc = std::vector<float>(4096, 0);
+    ShmemHeap::BlockHeader *header = reinterpret_cast<ShmemHeap::BlockHeader *>(shmHeap.entrance()) - 1;
+    std::vector<size_t> layout = shmHeap.briefLayout();
+
+    // Every write bumps the sequence, the block keeps its size and flags
+    size_t seq = header->readBegin();
+    acc[3] = 1.5f;
+    EXPECT_EQ(header->readBegin(), seq + (1UL << ShmemHeap::BlockHeader::seqShift));
+    EXPECT_TRUE(header->readRetry(seq));
+    EXPECT_FALSE(header->readRetry(header->readBegin()));
+    EXPECT_FALSE(header->B());
+    EXPECT_EQ(shmHeap.briefLayout(), layout);
+    acc[3] = 0.0f;
+
+    // A reader waiting for a write leaves the header alone, the writer has nobody to wake
+    header->lock();
+    size_t locked = header->size_BPA;
+    std::thread reader([&]()
+                       { seq = header->readBegin(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(header->size_BPA, locked);
+    header->unlockWrite();
+    reader.join();
+    EXPECT_FALSE(header->readRetry(seq));
+
+    // A writer fills the whole array with one value per write, a reader never sees a mix
+    std::atomic<bool> done{false};
+    std::thread writer([&]()
+                       {
+        float *data = reinterpret_cast<float *>(shmHeap.entrance() + sizeof(ShmemPrimitive_));
+        for (int round = 1; round <= 5000; round++)
+        {
+            header->lock();
+            std::fill(data, data + 4096, static_cast<float>(round));
+            header->unlockWrite();
+        }
+        done = true; });
+
+    size_t torn = 0, reads = 0;
+    while (!done)
+    {
+        std::vector<float> snapshot = acc.get<std::vector<float>>();
+        torn += std::any_of(snapshot.begin(), snapshot.end(), [&](float value)
+                            { return value != snapshot[0]; });
+        reads++;
+    }
+    writer.join();
+
+    EXPECT_EQ(torn, 0u);
+    EXPECT_GT(reads, 0u);
+    EXPECT_EQ(acc[4095].get<float>(), 5000.0f);
+    EXPECT_EQ(shmHeap.briefLayout(), layout);
+}
+
 TEST_F(ShmemPrimitiveTest, Contains)
 {
     acc = std::vector<float>(10, 1);
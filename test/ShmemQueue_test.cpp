@@ -0,0 +1,311 @@
+#include <gtest/gtest.h>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <cstring>
+#include <thread>
+#include <sys/wait.h>
+
+#include "ShmemQueue.h"
+#include "ShmemAccessor.h"
+
+using namespace std;
+class ShmemQueueTest : public ::testing::Test
+{
+protected:
+    // Setup code (called before each test)
+    ShmemQueueTest() : shmHeap("test_shm_queue", 80, 1 << 20), acc(&shmHeap){};
+
+    void SetUp() override
+    {
+        shmHeap.getLogger()->set_level(spdlog::level::info);
+        auto console_sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+        shmHeap.getLogger()->sinks().clear();
+        shmHeap.getLogger()->sinks().push_back(console_sink);
+        // Initialize necessary objects/resources
+        shmHeap.create();
+        Py_Initialize();
+    }
+
+    // Teardown code (called after each test)
+    void TearDown() override
+    {
+        // Cleanup objects/resources
+    }
+
+    ShmemHeap shmHeap;
+    ShmemAccessor acc;
+};
+
+TEST_F(ShmemQueueTest, CreateEmptyQueue)
+{
+    acc = SQueue(100);
+    EXPECT_EQ(acc.len(), 0);
+    EXPECT_EQ(acc.typeId(), Queue);
+    EXPECT_EQ(acc.typeStr(), "queue");
+    EXPECT_EQ(acc.toString(), "(Q:0/128)SPSC[48 bytes]");
+
+    // Messages are not indexable and the queue does not convert
+    EXPECT_THROW(acc[0].len(), std::runtime_error);
+    EXPECT_THROW(acc.get<int>(), ConversionError);
+
+    acc = SQueue(3, 100, true);
+    EXPECT_EQ(acc.toString(), "(Q:0/4)MPMC[100 bytes]");
+    EXPECT_THROW(acc = SQueue(4, 0), std::runtime_error);
+}
+
+TEST_F(ShmemQueueTest, PushPopInOrder)
+{
+    for (bool multi : {false, true})
+    {
+        acc = SQueue(8, 16, multi);
+
+        int value = -1;
+        EXPECT_FALSE(acc.pop(value, 0));
+        EXPECT_EQ(value, -1);
+
+        for (int i = 0; i < 8; i++)
+            EXPECT_TRUE(acc.push(i, 0));
+        EXPECT_EQ(acc.len(), 8);
+        EXPECT_FALSE(acc.push(8, 0));
+
+        // Laps around the ring keep the order
+        for (int i = 0; i < 100; i++)
+        {
+            EXPECT_TRUE(acc.pop(value, 0));
+            EXPECT_EQ(value, i);
+            EXPECT_TRUE(acc.push(i + 8, 0));
+        }
+        EXPECT_EQ(acc.len(), 8);
+
+        std::vector<int> values;
+        EXPECT_EQ(acc.popBatch(values, 100, 0), 8u);
+        EXPECT_EQ(values.front(), 100);
+        EXPECT_EQ(values.back(), 107);
+        EXPECT_EQ(acc.len(), 0);
+
+        // Strings up to the slot size, the batch stops when the ring is full
+        EXPECT_EQ(acc.pushBatch(std::vector<std::string>({"a", "", "0123456789abcdef", "b", "c", "d", "e", "f", "g"}), 0), 8u);
+        EXPECT_THROW(acc.push(std::string("0123456789abcdefg")), std::runtime_error);
+        std::string message;
+        EXPECT_TRUE(acc.pop(message));
+        EXPECT_EQ(message, "a");
+        EXPECT_TRUE(acc.pop(message));
+        EXPECT_EQ(message, "");
+        EXPECT_TRUE(acc.pop(message));
+        EXPECT_EQ(message, "0123456789abcdef");
+        // A typed pop only takes messages of its size, the message is gone anyway
+        EXPECT_THROW(acc.pop(value), ConversionError);
+        std::vector<std::string> messages;
+        EXPECT_EQ(acc.popBatch(messages, 100), 4u);
+        EXPECT_EQ(messages, std::vector<std::string>({"c", "d", "e", "f"}));
+
+        // Waits end on the timeout
+        auto start = std::chrono::steady_clock::now();
+        EXPECT_FALSE(acc.pop(message, 20));
+        EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+        EXPECT_EQ(messages.size(), 4u);
+    }
+}
+
+TEST_F(ShmemQueueTest, QueueInDict)
+{
+    acc = std::map<std::string, int>({{"a", 1}});
+    acc["q"] = SQueue(16, 8, true);
+    EXPECT_EQ(acc.len(), 2);
+    EXPECT_EQ(acc["q"].typeStr(), "queue");
+
+    EXPECT_TRUE(acc["q"].push(1.5));
+    double value;
+    EXPECT_TRUE(acc["q"].pop(value));
+    EXPECT_EQ(value, 1.5);
+    EXPECT_THROW(acc["a"].push(1), std::runtime_error);
+    EXPECT_THROW(acc["missing"].push(1), std::runtime_error);
+
+    // Snapshots do not push or pop
+    ShmemAccessor snap = acc.snapshot();
+    EXPECT_THROW(snap["q"].push(1), std::runtime_error);
+    snap.release();
+
+    acc["q"].push(2);
+    acc.del("q");
+    EXPECT_EQ(acc.len(), 1);
+    EXPECT_TRUE(shmHeap.verifyHeap());
+}
+
+TEST_F(ShmemQueueTest, BlockedPopWakesOnPush)
+{
+    acc = SQueue(4);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        ShmemHeap other("test_shm_queue", 1, 1);
+        other.connect();
+        ShmemAccessor otherAcc(&other);
+        otherAcc.push(std::string("hello"));
+        _exit(0);
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::string message;
+    EXPECT_TRUE(acc.pop(message, 5000));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(4000));
+    EXPECT_EQ(message, "hello");
+    int status = -1;
+    waitpid(pid, &status, 0);
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+}
+
+TEST_F(ShmemQueueTest, CrossProcessSPSC)
+{
+    // A small ring, so both sides keep blocking on each other
+    acc = SQueue(64);
+    const uint64_t numMessages = 200000;
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        ShmemHeap other("test_shm_queue", 1, 1);
+        other.connect();
+        ShmemAccessor otherAcc(&other);
+        std::vector<uint64_t> batch;
+        uint64_t expected = 0;
+        while (expected != numMessages)
+        {
+            batch.clear();
+            otherAcc.popBatch(batch, 16);
+            for (uint64_t value : batch)
+            {
+                if (value != expected++)
+                    _exit(1);
+            }
+        }
+        _exit(0);
+    }
+    for (uint64_t i = 0; i < numMessages; i++)
+        acc.push(i);
+    int status = -1;
+    waitpid(pid, &status, 0);
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+    EXPECT_EQ(acc.len(), 0);
+}
+
+TEST_F(ShmemQueueTest, CrossProcessMPMC)
+{
+    acc = std::map<std::string, long long>({{"count0", 0}, {"count1", 0}, {"sum0", 0}, {"sum1", 0}});
+    acc["q"] = SQueue(64, 8, true);
+    const uint64_t numMessages = 50000;
+    const uint64_t done = UINT64_MAX;
+
+    // Two producers tag their messages, two consumers check the order of each tag
+    std::vector<pid_t> producers, consumers;
+    for (uint64_t producer = 0; producer < 2; producer++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            ShmemHeap other("test_shm_queue", 1, 1);
+            other.connect();
+            ShmemAccessor otherAcc(&other);
+            for (uint64_t i = 0; i < numMessages; i++)
+                otherAcc["q"].push((producer << 32) | i);
+            _exit(0);
+        }
+        producers.push_back(pid);
+    }
+    for (int consumer = 0; consumer < 2; consumer++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            ShmemHeap other("test_shm_queue", 1, 1);
+            other.connect();
+            ShmemAccessor otherAcc(&other);
+            long long count = 0, sum = 0;
+            int64_t last[2] = {-1, -1};
+            uint64_t value;
+            while (otherAcc["q"].pop(value) && value != done)
+            {
+                int64_t i = static_cast<int64_t>(value & 0xFFFFFFFF);
+                if (i <= last[value >> 32])
+                    _exit(1);
+                last[value >> 32] = i;
+                count++;
+                sum += i;
+            }
+            otherAcc["count" + to_string(consumer)] = count;
+            otherAcc["sum" + to_string(consumer)] = sum;
+            _exit(0);
+        }
+        consumers.push_back(pid);
+    }
+
+    int status = -1;
+    for (pid_t pid : producers)
+    {
+        waitpid(pid, &status, 0);
+        EXPECT_EQ(WEXITSTATUS(status), 0);
+    }
+    acc["q"].push(done);
+    acc["q"].push(done);
+    for (pid_t pid : consumers)
+    {
+        waitpid(pid, &status, 0);
+        EXPECT_EQ(WEXITSTATUS(status), 0);
+    }
+    EXPECT_EQ(acc["count0"].get<long long>() + acc["count1"].get<long long>(), static_cast<long long>(2 * numMessages));
+    EXPECT_EQ(acc["sum0"].get<long long>() + acc["sum1"].get<long long>(), static_cast<long long>(numMessages * (numMessages - 1)));
+    EXPECT_EQ(acc["q"].len(), 0);
+}
+
+TEST_F(ShmemQueueTest, BlockedConsumersDrainEveryMessage)
+{
+    const int numConsumers = 4;
+    const long long numMessages = 4000;
+    const long long done = -1;
+    acc = std::map<std::string, long long>({{"count0", 0}, {"count1", 0}, {"count2", 0}, {"count3", 0}});
+    acc["q"] = SQueue(16, 8, true);
+
+    // The consumers mostly sleep, every push races the wake-ups of the others. A lost wake-up ends in a timeout
+    std::vector<pid_t> consumers;
+    for (int consumer = 0; consumer < numConsumers; consumer++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            ShmemHeap other("test_shm_queue", 1, 1);
+            other.connect();
+            ShmemAccessor otherAcc(&other);
+            long long count = 0, value;
+            while (true)
+            {
+                if (!otherAcc["q"].pop(value, 5000))
+                    _exit(2);
+                if (value == done)
+                    break;
+                count++;
+            }
+            otherAcc["count" + to_string(consumer)] = count;
+            _exit(0);
+        }
+        consumers.push_back(pid);
+    }
+
+    for (long long i = 0; i < numMessages; i++)
+    {
+        acc["q"].push(i);
+        if (i % 8 == 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    for (int consumer = 0; consumer < numConsumers; consumer++)
+        acc["q"].push(done);
+
+    int status = -1;
+    long long total = 0;
+    for (int consumer = 0; consumer < numConsumers; consumer++)
+    {
+        waitpid(consumers[consumer], &status, 0);
+        EXPECT_EQ(WEXITSTATUS(status), 0);
+        total += acc["count" + to_string(consumer)].get<long long>();
+    }
+    EXPECT_EQ(total, numMessages);
+    EXPECT_EQ(acc["q"].len(), 0);
+}